@@ -0,0 +1,34 @@
+#ifndef _ASSETLOADER_HPP
+#define _ASSETLOADER_HPP
+
+#include <functional>
+
+// Carregamento paralelo de recursos (texturas e modelos). Cada recurso é
+// dividido em duas etapas:
+//
+//   - "work":   trabalho pesado e independente do OpenGL (leitura do disco,
+//               decodificação de imagens, leitura e processamento de ".obj"),
+//               executado em uma das threads auxiliares;
+//   - "commit": envio dos dados para a GPU (glTexImage2D(), glBufferData(),
+//               etc.), executado na thread que possui o contexto OpenGL.
+//
+// Os "commits" são executados estritamente na ordem em que os recursos foram
+// submetidos, de forma que a numeração das unidades de textura e o conteúdo de
+// g_VirtualScene são exatamente os mesmos do carregamento sequencial.
+
+// Cria as threads auxiliares. Se num_threads == 0, usa o número de núcleos da
+// máquina. Enquanto o carregador não estiver iniciado, AssetLoader_Submit()
+// executa as duas etapas imediatamente, de forma sequencial.
+void AssetLoader_Start(unsigned num_threads = 0);
+
+// Submete um recurso para carregamento. Deve ser chamada somente pela thread
+// do contexto OpenGL.
+void AssetLoader_Submit(std::function<void()> work, std::function<void()> commit);
+
+// Executa, na ordem de submissão, o "commit" de todos os recursos submetidos,
+// esperando que o "work" de cada um termine. Depois disso as threads
+// auxiliares são encerradas. Exceções lançadas pelo "work" de um recurso são
+// relançadas aqui, na vez do seu "commit".
+void AssetLoader_Finish();
+
+#endif // _ASSETLOADER_HPP
@@ -0,0 +1,59 @@
+#ifndef _CACHEFILE_HPP
+#define _CACHEFILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// Funções auxiliares comuns aos arquivos de cache gerados a partir dos
+// arquivos de dados: o cache de malhas ("meshcache.hpp") e o cache de
+// texturas ("texturecache.hpp"). Cada cache é gravado ao lado do seu arquivo
+// fonte, e guarda o tamanho, a data de modificação e o hash do arquivo fonte
+// para detectar quando o mesmo foi alterado.
+
+// Conteúdo de um arquivo de cache, mapeado em memória ou lido para o heap.
+struct CacheFile {
+    void*  data;
+    size_t size;
+    bool   mapped;
+};
+
+// Lê o conteúdo completo do arquivo para a memória, mapeando o mesmo quando o
+// sistema operacional permite.
+bool CacheFile_Map(const std::string& filename, CacheFile* file);
+void CacheFile_Unmap(CacheFile* file);
+
+// Verifica se o intervalo [offset, offset + count*element_size) está contido
+// dentro do arquivo.
+bool CacheFile_InBounds(const CacheFile* file, uint64_t offset, uint64_t count, size_t element_size);
+
+// Tamanho e data de modificação (em nanossegundos, quando disponível) do
+// arquivo fonte.
+bool CacheFile_StatSource(const char* filename, uint64_t* size, int64_t* mtime);
+
+// Hash FNV-1a de 64 bits do conteúdo do arquivo fonte. Usado somente quando a
+// data de modificação do arquivo fonte mudou, para detectar se o conteúdo
+// realmente foi alterado (por exemplo, após um "git checkout").
+bool CacheFile_HashSource(const char* filename, uint64_t* hash);
+
+// Grava "mtime" na posição "offset" do arquivo de cache "filename", sem
+// reescrever o restante do arquivo. Usado quando a data de modificação do
+// arquivo fonte mudou mas o seu hash continua o mesmo, para que as próximas
+// execuções não precisem calcular o hash novamente.
+bool CacheFile_UpdateSourceMtime(const std::string& filename, size_t offset, int64_t mtime);
+
+// Os blocos de dados dos arquivos de cache começam em posições alinhadas a
+// 16 bytes, de forma que podem ser usados diretamente a partir do arquivo
+// mapeado em memória. CacheFile_WriteBlock() preenche com zeros até a próxima
+// posição alinhada e grava o bloco, atualizando "offset".
+size_t CacheFile_Align(size_t offset);
+bool CacheFile_WriteBlock(FILE* f, const void* data, size_t size, size_t* offset);
+
+// Os caches são escritos em um arquivo temporário, que é então renomeado para
+// "filename", de forma que uma execução interrompida nunca deixa um cache pela
+// metade. Fecha "f" e, se "ok" for true, renomeia o arquivo temporário; caso
+// contrário, remove o mesmo e retorna false.
+bool CacheFile_Commit(FILE* f, const std::string& tmp_filename, const std::string& filename, bool ok);
+
+#endif // _CACHEFILE_HPP
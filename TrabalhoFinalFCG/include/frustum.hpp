@@ -0,0 +1,45 @@
+#ifndef _FRUSTUM_HPP
+#define _FRUSTUM_HPP
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+// Frustum de visualização da câmera, usado para descartar ("culling") os
+// objetos que estão completamente fora da tela antes de desenhá-los. Veja
+// DrawVirtualObject() em "main.cpp".
+
+// Os seis planos do frustum (esquerda, direita, baixo, cima, near e far),
+// em coordenadas globais. Cada plano é um vec4 (a,b,c,d) com (a,b,c)
+// normalizado e apontando para dentro: um ponto p está do lado de dentro do
+// plano se a*p.x + b*p.y + c*p.z + d >= 0.
+struct Frustum {
+    glm::vec4 planes[6];
+};
+
+// Extrai os planos do frustum da matriz "projection * view" (método de
+// Gribb e Hartmann, "Fast Extraction of Viewing Frustum Planes from the
+// World-View-Projection Matrix", 2001).
+void Frustum_FromMatrix(const glm::mat4& projection_view, Frustum* frustum);
+
+// Calcula a AABB, em coordenadas globais, que envolve a AABB (bbox_min,
+// bbox_max) de um objeto transformada pela sua matriz "model" (método de
+// Arvo, "Transforming Axis-Aligned Bounding Boxes", Graphics Gems, 1990).
+void Frustum_TransformBox(const glm::mat4& model, const glm::vec3& bbox_min, const glm::vec3& bbox_max, glm::vec3* world_min, glm::vec3* world_max);
+
+// Retorna false somente se a AABB estiver completamente fora do frustum.
+// Algumas AABBs fora do frustum, perto dos seus cantos, podem retornar true.
+bool Frustum_IntersectsBox(const Frustum& frustum, const glm::vec3& box_min, const glm::vec3& box_max);
+
+enum FrustumClassification {
+    FRUSTUM_OUTSIDE,    // Completamente fora do frustum
+    FRUSTUM_INTERSECTS, // Possivelmente cortada por algum dos planos
+    FRUSTUM_INSIDE      // Completamente dentro do frustum
+};
+
+// Como Frustum_IntersectsBox(), mas distingue as AABBs completamente dentro
+// do frustum, cujo conteúdo não precisa ser testado (veja
+// SceneBvh_QueryFrustum()).
+FrustumClassification Frustum_ClassifyBox(const Frustum& frustum, const glm::vec3& box_min, const glm::vec3& box_max);
+
+#endif // _FRUSTUM_HPP
@@ -0,0 +1,64 @@
+#ifndef _GPUARENA_HPP
+#define _GPUARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include <glad/glad.h>
+
+// Arena de memória de GPU: um único buffer OpenGL do qual são alocados
+// blocos para várias malhas. Usamos uma arena para os vértices (intercalados)
+// e outra para os índices de todos os modelos da cena, de forma que todos os
+// objetos são desenhados a partir de um único VAO (veja
+// BuildTrianglesAndAddToVirtualScene() em "main.cpp").
+//
+// Os blocos livres são mantidos em uma lista ordenada por posição e
+// fundidos com seus vizinhos ao serem liberados. Quando não há bloco livre
+// grande o suficiente, a arena é compactada (se a fragmentação for a causa)
+// ou o buffer é realocado com o dobro do tamanho. Em ambos os casos o buffer
+// OpenGL muda, e as posições dos blocos também: por isso os blocos são
+// identificados por um GpuArenaHandle, e sua posição atual deve ser
+// consultada com GpuArena_Offset() no momento do uso.
+
+typedef uint32_t GpuArenaHandle;
+
+#define GPUARENA_INVALID_HANDLE 0xFFFFFFFFu
+
+struct GpuArenaBlock {
+    size_t offset;
+    size_t size;
+    bool   live;
+};
+
+struct GpuArena {
+    GLuint                      buffer;    // Buffer OpenGL atual (muda ao crescer ou compactar)
+    size_t                      capacity;  // Tamanho do buffer, em bytes
+    size_t                      alignment; // Todos os blocos começam em múltiplos deste valor
+    size_t                      used;      // Soma dos tamanhos dos blocos alocados
+    unsigned                    generation; // Incrementado sempre que "buffer" muda
+    std::vector<GpuArenaBlock>  blocks;    // Indexado por GpuArenaHandle
+    std::vector<GpuArenaHandle> free_handles;
+    std::map<size_t, size_t>    free_list; // Posição -> tamanho dos intervalos livres
+};
+
+// "alignment" não precisa ser potência de dois; para a arena de vértices
+// usamos o tamanho de um vértice, de forma que a posição de cada bloco
+// dividida pelo tamanho do vértice é o "base vertex" do bloco.
+//
+// Todas as operações usam os pontos de ligação GL_COPY_READ_BUFFER e
+// GL_COPY_WRITE_BUFFER, para não alterar o estado do VAO ligado no momento.
+void GpuArena_Init(GpuArena* arena, size_t initial_capacity, size_t alignment);
+void GpuArena_Destroy(GpuArena* arena);
+
+// Aloca um bloco de "size" bytes e envia "data" (se não for NULL) para ele.
+GpuArenaHandle GpuArena_Allocate(GpuArena* arena, size_t size, const void* data);
+void GpuArena_Free(GpuArena* arena, GpuArenaHandle handle);
+
+size_t GpuArena_Offset(const GpuArena* arena, GpuArenaHandle handle);
+
+// Move todos os blocos para o início do buffer, eliminando a fragmentação.
+void GpuArena_Compact(GpuArena* arena);
+
+#endif // _GPUARENA_HPP
@@ -0,0 +1,91 @@
+#ifndef _GPUDRIVEN_HPP
+#define _GPUDRIVEN_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glad/glad.h>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+
+#include "frustum.hpp"
+
+// Caminho de renderização opcional para OpenGL 4.3 ou superior, em que a
+// GPU decide o que desenhar ("GPU-driven rendering"). Os dados de cada
+// instância estática da cena (matriz "model", AABBs e texturas) ficam em um
+// shader storage buffer (SSBO), e são enviados somente quando mudam. A cada
+// quadro, a CPU envia apenas a lista das instâncias estáticas desenhadas, com
+// a faixa de índices do seu nível de detalhe; um compute shader testa a AABB
+// de cada uma contra o frustum da câmera e contra uma pirâmide de
+// profundidades máximas ("Hi-Z") do quadro anterior, e escreve um comando
+// DrawElementsIndirectCommand por instância (com zero instâncias se for
+// descartada). Todas são então desenhadas por glMultiDrawElementsIndirect(),
+// uma chamada por tipo de índice.
+//
+// A biblioteca GLAD do projeto carrega somente o OpenGL 3.3, então as
+// funções do OpenGL 4.2 e 4.3 usadas aqui são carregadas por
+// GpuDriven_LoadFunctions(). Sem elas, o programa usa o caminho do OpenGL
+// 3.3 (veja DrawVirtualObject() em "main.cpp").
+//
+// Como a pirâmide Hi-Z é do quadro anterior, uma instância que aparece atrás
+// de um objeto que se moveu só é desenhada um quadro depois, como nos testes
+// de "occlusion.hpp".
+
+typedef int32_t GpuDrivenSlot;
+
+#define GPUDRIVEN_INVALID_SLOT (-1)
+
+// Localização do atributo com a posição da instância no SSBO, em
+// "shader_vertex.glsl"
+#define GPUDRIVEN_INSTANCE_ATTRIBUTE 3
+
+// Dados de uma instância estática, com o layout std430 de "StaticInstance" em
+// "shader_vertex.glsl" e no compute shader de descarte.
+struct GpuDrivenInstance {
+    glm::mat4  model;
+    glm::mat4  normal_matrix; // Inversa da transposta de "model"
+    glm::vec4  bbox_min;    // AABB do objeto, no sistema de coordenadas do modelo
+    glm::vec4  bbox_max;
+    glm::vec4  world_min;   // AABB em coordenadas globais, usada no descarte
+    glm::vec4  world_max;
+    glm::ivec4 material;    // (object_id, quantized_vertices, 0, 0)
+    glm::ivec4 texture_kd0; // Como em MakeDrawUniforms(), em "main.cpp"
+    glm::ivec4 texture_kd1;
+};
+
+// Carrega as funções do OpenGL 4.3 usadas por este caminho. Retorna false
+// se o contexto atual é de uma versão anterior.
+bool GpuDriven_LoadFunctions(GLADloadproc load);
+
+// Cria os buffers e os compute shaders, e liga o atributo por instância
+// GPUDRIVEN_INSTANCE_ATTRIBUTE ao VAO "vertex_array", onde estão os vértices
+// e índices de todos os objetos.
+void GpuDriven_Init(GLuint vertex_array);
+
+GpuDrivenSlot GpuDriven_Create();
+void          GpuDriven_Destroy(GpuDrivenSlot slot);
+
+// Atualiza os dados de uma instância. Somente instâncias que mudaram são
+// enviadas para a GPU.
+void GpuDriven_SetInstance(GpuDrivenSlot slot, const GpuDrivenInstance& instance);
+
+// Pede o desenho da instância neste quadro, com "count" índices do tipo
+// "index_type" a partir do índice "first_index" do buffer de índices do VAO,
+// somados a "base_vertex".
+void GpuDriven_Draw(GpuDrivenSlot slot, GLenum index_type, GLuint count, GLuint first_index, GLint base_vertex);
+
+// Descarta e desenha as instâncias pedidas neste quadro com o programa de GPU
+// "program" (a variante GPU_DRIVEN dos shaders da cena, com as matrizes
+// "view" e "projection" já definidas). Retorna o número de instâncias
+// enviadas para o compute shader.
+size_t GpuDriven_Flush(const Frustum& frustum, GLuint program);
+
+// Copia o Z-buffer do framebuffer padrão, de tamanho "width" x "height", e
+// constrói a pirâmide Hi-Z usada pelo próximo GpuDriven_Flush(). Deve ser
+// chamada depois que toda a cena foi desenhada com a matriz
+// "projection_view". Se o driver não permitir a cópia do Z-buffer, o Hi-Z
+// é desligado até o fim da execução.
+void GpuDriven_UpdateDepth(const glm::mat4& projection_view, int width, int height);
+
+#endif // _GPUDRIVEN_HPP
@@ -0,0 +1,94 @@
+#ifndef _MESHCACHE_HPP
+#define _MESHCACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "cachefile.hpp"
+
+// Cache binário de malhas. Na primeira vez que um arquivo ".obj" é carregado,
+// gravamos ao lado dele um arquivo "<nome>.obj.meshcache" contendo exatamente
+// os vetores que são enviados para a GPU em BuildTrianglesAndAddToVirtualScene()
+// (em "main.cpp"). Nas execuções seguintes o arquivo é mapeado em memória e
+// enviado diretamente para a GPU, sem passar pela tinyobjloader.
+
+// Versão do formato. Deve ser incrementada sempre que o formato do arquivo ou
+// o processamento feito antes da escrita do cache mudarem.
+#define MESHCACHE_VERSION 4
+
+// Número máximo de níveis de detalhe simplificados por objeto (além da
+// malha original). Veja "meshlod.hpp".
+#define MESHCACHE_MAX_LODS 4
+
+// Nível de detalhe simplificado de um objeto: índices (no mesmo formato dos
+// índices do objeto) que referenciam os mesmos vértices do objeto.
+struct MeshLod {
+    size_t index_offset; // Posição (em bytes) do primeiro índice do nível dentro do vetor de índices
+    size_t num_indices;  // Número de índices do nível
+    float  error;        // Distância estimada até a malha original, nas unidades do modelo
+};
+
+// Um objeto nomeado ("shape") dentro de um modelo. Cada objeto tem seus
+// próprios vértices (sem repetição) e seus próprios índices, relativos ao seu
+// primeiro vértice "base_vertex". Objetos com menos de 65536 vértices usam
+// índices de 16 bits; os demais, de 32 bits.
+struct MeshShape {
+    std::string name;         // Nome do objeto
+    size_t      index_offset; // Posição (em bytes) do primeiro índice do objeto dentro do vetor de índices
+    size_t      num_indices;  // Número de índices do objeto
+    size_t      index_size;   // Tamanho de cada índice: 2 (uint16_t) ou 4 (uint32_t) bytes
+    size_t      base_vertex;  // Primeiro vértice do objeto
+    size_t      num_vertices; // Número de vértices do objeto
+    glm::vec3   bbox_min;     // Axis-Aligned Bounding Box do objeto
+    glm::vec3   bbox_max;
+    std::vector<MeshLod> lods; // Do mais detalhado ao menos detalhado, sem incluir a malha original
+};
+
+// Vetores prontos para a GPU, armazenados em memória própria. É o resultado
+// do processamento de um ObjModel.
+struct MeshData {
+    std::vector<float>    model_coefficients;   // 4 floats por vértice
+    std::vector<float>    normal_coefficients;  // 4 floats por vértice (pode ser vazio)
+    std::vector<float>    texture_coefficients; // 2 floats por vértice (pode ser vazio)
+    std::vector<uint8_t>  indices;              // Índices de 16 ou 32 bits (veja MeshShape::index_size)
+    std::vector<MeshShape> shapes;
+};
+
+// Visão (sem posse da memória) dos mesmos vetores acima. Pode apontar tanto
+// para um MeshData quanto para um arquivo de cache mapeado em memória.
+struct MeshView {
+    const float*    model_coefficients;
+    size_t          num_model_coefficients;
+    const float*    normal_coefficients;
+    size_t          num_normal_coefficients;
+    const float*    texture_coefficients;
+    size_t          num_texture_coefficients;
+    const uint8_t*  indices;
+    size_t          indices_size; // Tamanho em bytes
+    std::vector<MeshShape> shapes;
+};
+
+// Arquivo de cache aberto. A visão "view" só é válida até MeshCache_Close().
+struct MeshCacheFile {
+    MeshView  view;
+    CacheFile file;
+};
+
+MeshView MeshData_View(const MeshData& mesh);
+
+// Abre o cache do arquivo "obj_filename", caso exista e ainda seja válido
+// (mesma versão, e arquivo fonte com mesmo tamanho e data de modificação, ou
+// então com o mesmo hash de conteúdo). Retorna false caso contrário.
+bool MeshCache_Open(const char* obj_filename, MeshCacheFile* file);
+void MeshCache_Close(MeshCacheFile* file);
+
+// Grava o cache do arquivo "obj_filename". Retorna false em caso de erro
+// (por exemplo, diretório sem permissão de escrita); neste caso o programa
+// continua funcionando normalmente, somente sem cache.
+bool MeshCache_Write(const char* obj_filename, const MeshView& mesh);
+
+#endif // _MESHCACHE_HPP
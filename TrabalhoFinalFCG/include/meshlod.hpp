@@ -0,0 +1,37 @@
+#ifndef _MESHLOD_HPP
+#define _MESHLOD_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Simplificação de malhas para a geração de níveis de detalhe (LODs),
+// executada uma única vez por CookObjModel() (em "main.cpp") antes da
+// gravação do cache de malhas. Usamos colapsos de arestas guiados por
+// quádricas de erro (Garland e Heckbert, "Surface Simplification Using
+// Quadric Error Metrics", SIGGRAPH 1997), com duas restrições que permitem
+// que todos os níveis compartilhem os vértices da malha original:
+//
+//   - cada aresta é colapsada em um dos seus extremos (e não em uma posição
+//     ótima), de forma que um nível simplificado é somente um novo vetor de
+//     índices;
+//   - vértices com a mesma posição e atributos diferentes (costuras de
+//     coordenadas de textura ou de normais) só são colapsados ao longo da
+//     costura, e vértices na borda de superfícies abertas, ao longo da
+//     borda.
+
+// Objetos com menos triângulos que isto não são simplificados.
+#define MESHLOD_MIN_TRIANGLES 64
+
+// Simplifica a malha de triângulos "indices" até no máximo
+// "target_num_indices" índices, ou até que o próximo colapso tenha erro
+// maior que "max_error". "positions" aponta para as coordenadas (x,y,z) do
+// primeiro vértice, com "position_stride" floats entre vértices
+// consecutivos. Os índices da malha simplificada, que referenciam os mesmos
+// vértices, são escritos em "destination".
+//
+// Retorna o erro da malha simplificada: a distância estimada entre ela e a
+// malha original, nas mesmas unidades de "positions".
+float MeshLod_Simplify(const uint32_t* indices, size_t num_indices, const float* positions, size_t position_stride, size_t num_vertices, size_t target_num_indices, float max_error, std::vector<uint32_t>* destination);
+
+#endif // _MESHLOD_HPP
@@ -0,0 +1,55 @@
+#ifndef _MESHOPT_HPP
+#define _MESHOPT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Otimização da ordem de triângulos e de vértices de uma malha indexada
+// (GL_TRIANGLES), executada uma única vez por CookObjModel() (em "main.cpp")
+// antes da gravação do cache de malhas. As três etapas são, em ordem:
+//
+//   1. MeshOpt_OptimizeVertexCache(): reordena os triângulos para reaproveitar
+//      a cache pós-transformação da GPU (algoritmo "Tipsify" de Sander, Nehab
+//      e Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced
+//      Overdraw", SIGGRAPH 2007);
+//   2. MeshOpt_OptimizeOverdraw(): reordena os grupos ("clusters") de
+//      triângulos gerados acima de forma que os voltados para fora da malha
+//      sejam desenhados primeiro, reduzindo o overdraw (mesmo artigo);
+//   3. MeshOpt_OptimizeVertexFetch(): renumera os vértices na ordem em que são
+//      usados pelos índices, melhorando a localidade das leituras dos VBOs.
+
+// Tamanho da cache FIFO de vértices simulada (e usada pelo Tipsify).
+#define MESHOPT_CACHE_SIZE 16
+
+// Estatísticas de uso da cache pós-transformação, para uma cache FIFO de
+// MESHOPT_CACHE_SIZE vértices.
+struct MeshOptStats {
+    float acmr; // Average Cache Miss Ratio: vértices transformados por triângulo (ideal: ~0.5)
+    float atvr; // Average Transformed Vertex Ratio: vértices transformados por vértice único (ideal: 1.0)
+};
+
+MeshOptStats MeshOpt_AnalyzeVertexCache(const uint32_t* indices, size_t num_indices, size_t num_vertices);
+
+// Reordena os triângulos de "indices" (in-place). Se "clusters" não for NULL,
+// recebe a posição (em triângulos) do início de cada grupo de triângulos
+// contíguos gerado pelo algoritmo, para uso por MeshOpt_OptimizeOverdraw().
+void MeshOpt_OptimizeVertexCache(uint32_t* indices, size_t num_indices, size_t num_vertices, std::vector<size_t>* clusters);
+
+// Reordena os grupos de triângulos de "indices" (in-place). "positions" aponta
+// para as coordenadas (x,y,z) do primeiro vértice, com "position_stride"
+// floats entre vértices consecutivos. "threshold" é a piora máxima aceitável
+// no ACMR de cada grupo (por exemplo, 1.05 = 5%) ao dividi-lo em grupos
+// menores.
+void MeshOpt_OptimizeOverdraw(uint32_t* indices, size_t num_indices, const float* positions, size_t position_stride, size_t num_vertices, const std::vector<size_t>& clusters, float threshold);
+
+// Renumera os vértices na ordem em que aparecem em "indices" (in-place).
+// "remap" recebe, para cada vértice antigo, o seu novo número; os atributos
+// dos vértices devem então ser permutados de acordo (veja MeshOpt_Remap()).
+void MeshOpt_OptimizeVertexFetch(uint32_t* indices, size_t num_indices, size_t num_vertices, std::vector<uint32_t>* remap);
+
+// Permuta "num_vertices" vértices de "components" floats cada, a partir de
+// "data", de acordo com um "remap" gerado por MeshOpt_OptimizeVertexFetch().
+void MeshOpt_Remap(float* data, size_t components, size_t num_vertices, const std::vector<uint32_t>& remap);
+
+#endif // _MESHOPT_HPP
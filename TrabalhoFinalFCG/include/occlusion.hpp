@@ -0,0 +1,60 @@
+#ifndef _OCCLUSION_HPP
+#define _OCCLUSION_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+
+// Descarte por oclusão ("occlusion culling") usando consultas de oclusão da
+// GPU (GL_ANY_SAMPLES_PASSED, parte do OpenGL 3.3 core). Depois que toda a
+// cena foi desenhada, Occlusion_Flush() rasteriza a AABB de cada instância
+// testada, sem escrever cor nem profundidade, dentro de uma consulta: se
+// nenhum fragmento passar no teste de profundidade, a instância estava
+// completamente escondida atrás do que já foi desenhado.
+//
+// O resultado de cada consulta só é lido no quadro seguinte, e somente se já
+// estiver disponível (GL_QUERY_RESULT_AVAILABLE), de forma que a CPU nunca
+// espera pela GPU. Uma instância escondida, portanto, só volta a ser
+// desenhada um quadro depois de aparecer.
+//
+// Para limitar o número de consultas, instâncias visíveis são testadas
+// novamente em intervalos que dobram a cada teste visível consecutivo (até
+// OCCLUSION_MAX_INTERVAL quadros); instâncias escondidas são testadas a todo
+// quadro.
+
+typedef int32_t OcclusionId;
+
+#define OCCLUSION_INVALID_ID (-1)
+
+// Objetos com menos triângulos que isto são desenhados sem testes de oclusão
+#define OCCLUSION_MIN_TRIANGLES 512
+
+// Maior intervalo, em quadros, entre testes de uma instância visível
+#define OCCLUSION_MAX_INTERVAL 16
+
+// Cria o programa de GPU e o VAO usados para rasterizar as AABBs. Deve ser
+// chamada depois que o contexto OpenGL foi criado.
+void Occlusion_Init();
+
+// Um identificador destruído só é reutilizado por Occlusion_Create() depois
+// que a sua última consulta terminou, em algum Occlusion_Flush() seguinte.
+OcclusionId Occlusion_Create();
+void        Occlusion_Destroy(OcclusionId id);
+
+// Chamada a cada quadro em que a instância está dentro do frustum da câmera,
+// com a sua AABB em coordenadas globais. Retorna false se o último resultado
+// disponível diz que a instância estava escondida; neste caso ela não deve
+// ser desenhada. Se for o momento de um novo teste, a AABB é guardada para
+// Occlusion_Flush().
+bool Occlusion_Update(OcclusionId id, const glm::vec3& box_min, const glm::vec3& box_max);
+
+// Executa os testes guardados por Occlusion_Update() neste quadro, com o
+// Z-buffer já contendo toda a cena. Instâncias cuja AABB, aumentada por
+// "near_distance", contém a câmera "camera_position" são consideradas
+// visíveis sem consulta (a AABB seria cortada pelo near plane). Retorna o
+// número de consultas enviadas para a GPU.
+size_t Occlusion_Flush(const glm::mat4& projection_view, const glm::vec3& camera_position, float near_distance);
+
+#endif // _OCCLUSION_HPP
@@ -0,0 +1,68 @@
+#ifndef _PROGRAMCACHE_HPP
+#define _PROGRAMCACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <glad/glad.h>
+
+// Cache de programas de GPU já linkados. Na primeira execução, cada programa
+// é compilado a partir do código GLSL e o binário produzido pelo driver
+// (glGetProgramBinary()) é guardado; nas execuções seguintes o programa é
+// criado diretamente do binário (glProgramBinary()), sem compilar nem linkar
+// os shaders. Todos os programas ficam em um único arquivo, lido por
+// ProgramCache_Init() e gravado por ProgramCache_Save().
+//
+// Cada programa é identificado por um hash dos seus códigos-fonte (já com as
+// macros das variantes, veja "shaderpermutation.hpp") e das strings
+// GL_VENDOR, GL_RENDERER e GL_VERSION do driver, de forma que mudanças nos
+// shaders ou no driver geram novas entradas. O driver pode ainda recusar um
+// binário (por exemplo, após uma atualização que não muda estas strings);
+// nesse caso ProgramCache_Load() retorna 0 e o programa é compilado
+// normalmente.
+//
+// glGetProgramBinary() e glProgramBinary() são do OpenGL 4.1 (ou da extensão
+// GL_ARB_get_program_binary), e não são carregadas pela biblioteca GLAD do
+// projeto; sem elas, ou sem nenhum formato de binário suportado, o cache fica
+// desligado.
+
+// Versão do formato. Deve ser incrementada sempre que o formato do arquivo
+// mudar.
+#define PROGRAMCACHE_VERSION 1
+
+struct ProgramCacheStats {
+    size_t hits;            // Programas criados a partir do cache
+    size_t misses;          // Programas compilados a partir do código GLSL
+    size_t rejected;        // Binários recusados pelo driver (também contados em "misses")
+    double seconds_saved;   // Tempo de compilação dos acertos, menos o tempo de carregá-los
+};
+
+// Carrega as funções do OpenGL usadas pelo cache e lê o arquivo "filename".
+// Retorna false (e o cache fica desligado) se o driver não suporta binários
+// de programas.
+bool ProgramCache_Init(GLADloadproc load, const char* filename);
+
+// Grava no arquivo os programas adicionados desde ProgramCache_Init().
+void ProgramCache_Save();
+
+bool ProgramCache_Enabled();
+
+// Chave de um programa a partir dos seus códigos-fonte.
+uint64_t ProgramCache_Key(const std::string* sources, size_t count);
+
+// Deve ser chamada antes de glLinkProgram() para os programas que serão
+// guardados, pedindo ao driver que mantenha o binário disponível.
+void ProgramCache_PrepareLink(GLuint program_id);
+
+// Cria um programa a partir do binário guardado com a chave "key". Retorna 0
+// se não existe, ou se foi recusado pelo driver.
+GLuint ProgramCache_Load(uint64_t key);
+
+// Guarda o binário de um programa linkado com sucesso, que levou
+// "compile_seconds" segundos para ser compilado e linkado.
+void ProgramCache_Store(uint64_t key, GLuint program_id, double compile_seconds);
+
+const ProgramCacheStats& ProgramCache_Stats();
+
+#endif // _PROGRAMCACHE_HPP
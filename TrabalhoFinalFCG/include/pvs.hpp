@@ -0,0 +1,106 @@
+#ifndef _PVS_HPP
+#define _PVS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+
+// Conjuntos potencialmente visíveis ("potentially visible sets", PVS). A
+// área por onde a câmera anda é dividida em uma grade de células e, para
+// cada célula, um conjunto de bits diz quais instâncias estáticas da cena
+// podem ser vistas de algum ponto dela. Durante o desenho, a célula da
+// câmera é encontrada em O(1), e as instâncias cujo bit está zerado são
+// descartadas sem nenhum outro teste.
+//
+// Os conjuntos são calculados uma única vez (veja a opção "--bake-pvs" em
+// "main.cpp") por Pvs_Bake(), que lança raios de pontos amostrados em cada
+// célula para pontos amostrados na AABB de cada instância; uma instância é
+// visível se algum raio não é bloqueado pelos oclusores (os mesmos de
+// "softocclusion.hpp"). Como a visibilidade é amostrada, uma instância que
+// aparece somente por uma fresta pode ser descartada; a opção
+// "--validate-pvs" em "main.cpp" procura estes casos.
+//
+// As instâncias são identificadas pelo nome do objeto e pela translação da
+// sua matriz "model", quantizada (veja Pvs_Key()), e não pela ordem em que
+// são desenhadas. O arquivo guarda um hash das instâncias e dos oclusores
+// usados no cálculo (veja Pvs_SceneHash()); um arquivo calculado para outra
+// cena deve ser descartado.
+
+// Versão do formato. Deve ser incrementada sempre que o formato do arquivo ou
+// o cálculo mudarem.
+#define PVS_VERSION 2
+
+// Tamanho máximo do nome dos objetos guardados no arquivo
+#define PVS_MAX_NAME 48
+
+// Passo da quantização das posições das instâncias
+#define PVS_POSITION_STEP 0.05f
+
+// Uma instância estática: a instância do objeto "object" com a translação
+// "position" (veja Pvs_Key()), com a sua AABB em coordenadas globais.
+struct PvsEntry {
+    std::string object;
+    glm::ivec3  position;
+    glm::vec3   box_min;
+    glm::vec3   box_max;
+};
+
+// Um oclusor: a caixa (box_min, box_max) no sistema de coordenadas de
+// "model". Pontos dentro da caixa (outer_min, outer_max), também neste
+// sistema de coordenadas, não são bloqueados pelo oclusor (a câmera dentro
+// de um prédio, por exemplo).
+struct PvsOccluder {
+    glm::mat4 model;
+    glm::vec3 box_min;
+    glm::vec3 box_max;
+    glm::vec3 outer_min;
+    glm::vec3 outer_max;
+};
+
+struct Pvs {
+    glm::vec3             area_min;  // Área das células em (x,z); altura dos olhos em y
+    glm::vec3             area_max;
+    float                 cell_size;
+    int                   cells_x;
+    int                   cells_z;
+    std::vector<PvsEntry> entries;
+    size_t                words_per_cell;
+    std::vector<uint64_t> bits;      // words_per_cell palavras por célula, com as células em ordem (x + z*cells_x)
+    uint64_t              scene_hash; // Pvs_SceneHash() das instâncias e oclusores do cálculo
+};
+
+// Translação da matriz "model", quantizada em passos de PVS_POSITION_STEP
+glm::ivec3 Pvs_Key(const glm::mat4& model);
+
+// Hash das instâncias e dos oclusores, na ordem dada
+uint64_t Pvs_SceneHash(const std::vector<PvsEntry>& entries, const std::vector<PvsOccluder>& occluders);
+
+// Calcula os conjuntos de cada célula de tamanho "cell_size" dentro de
+// (area_min, area_max). As células são calculadas pelas threads de
+// "assetloader.hpp", que devem estar paradas; "num_threads" é repassado para
+// AssetLoader_Start().
+void Pvs_Bake(Pvs* pvs, const glm::vec3& area_min, const glm::vec3& area_max, float cell_size,
+              const std::vector<PvsEntry>& entries, const std::vector<PvsOccluder>& occluders, unsigned num_threads = 0);
+
+// Retorna a célula que contém "position", ou -1 se estiver fora da área.
+int Pvs_Cell(const Pvs* pvs, const glm::vec3& position);
+
+inline bool Pvs_IsVisible(const Pvs* pvs, int cell, int entry)
+{
+    return (pvs->bits[cell * pvs->words_per_cell + entry / 64] >> (entry % 64)) & 1;
+}
+
+// Retorna a posição em pvs->entries da instância, ou -1 se não existir.
+int Pvs_FindEntry(const Pvs* pvs, const std::string& object, const glm::ivec3& position);
+
+// Número de instâncias visíveis a partir da célula
+size_t Pvs_CountVisible(const Pvs* pvs, int cell);
+
+bool Pvs_Write(const Pvs* pvs, const std::string& filename);
+bool Pvs_Read(Pvs* pvs, const std::string& filename);
+
+#endif // _PVS_HPP
@@ -0,0 +1,90 @@
+#ifndef _RENDERQUEUE_HPP
+#define _RENDERQUEUE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include <glm/mat4x4.hpp>
+
+// Fila de desenhos. Em vez de desenhar cada objeto na ordem do código, os
+// desenhos de um quadro são enviados como pacotes (malha, material, matriz
+// "model" e passo) e, ao final, ordenados por uma chave de 64 bits:
+//
+//   bits 63-60: passo (veja RenderPass)
+//   bits 59-52: programa de GPU
+//   bits 51-40: material ("object_id" dos shaders)
+//   bits 39-32: VAO
+//   bits 31-0:  distância até a câmera
+//
+// Desenhos consecutivos com o mesmo programa, material e VAO não precisam
+// trocar estes estados, e, dentro de cada grupo, os objetos são desenhados do
+// mais próximo ao mais distante, de forma que fragmentos escondidos são
+// descartados pelo teste de profundidade antes do fragment shader ("early-Z").
+//
+// Os programas e VAOs recebem números pequenos na ordem em que aparecem no
+// quadro (veja RenderQueue::programs e RenderQueue::vertex_arrays). As tabelas
+// são esvaziadas a cada quadro, de forma que programas substituídos (recarga
+// dos shaders) não se acumulam nelas.
+
+// Passos de um quadro, na ordem em que são desenhados. Cada passo tem o seu
+// próprio estado do OpenGL, definido por quem executa a fila.
+enum RenderPass {
+    RENDERPASS_SKY = 0,    // Céu, sem escrita no Z-buffer
+    RENDERPASS_OPAQUE,     // Objetos opacos
+    RENDERPASS_HIGHLIGHT,  // Destaques dos objetos sob a mira
+};
+
+// Além dos objetos, a fila recebe desenhos que cobrem várias instâncias de
+// uma vez; o significado de RenderPacket::mesh e RenderPacket::level depende
+// do tipo do pacote.
+enum RenderPacketKind {
+    RENDERPACKET_OBJECT = 0,   // Um objeto ("mesh"), no nível de detalhe "level"
+    RENDERPACKET_STATIC_CHUNK, // Um grupo ("mesh") do agrupamento estático, de número "level"
+    RENDERPACKET_GPU_DRIVEN,   // Os desenhos indiretos das instâncias descartadas na GPU
+};
+
+struct RenderPacket {
+    uint64_t         key;          // Calculada por RenderQueue_Submit()
+    RenderPacketKind kind;
+    RenderPass       pass;
+    GLuint           program;
+    GLuint           vertex_array;
+    int              material;
+    const void*      mesh;         // Objeto a ser desenhado (um SceneObject, em "main.cpp")
+    int              level;        // Nível de detalhe da malha
+    glm::mat4        model;
+};
+
+// Trocas de estado (passo, programa, material ou VAO) entre desenhos
+// consecutivos, na ordem de envio e na ordem da fila.
+struct RenderQueueStats {
+    size_t packets;
+    size_t changes_submitted;
+    size_t changes_sorted;
+};
+
+struct RenderQueue {
+    std::vector<RenderPacket> packets;
+    std::vector<uint32_t>     order;   // Posições em "packets", na ordem de desenho
+    std::vector<GLuint>       programs;
+    std::vector<GLuint>       vertex_arrays;
+    bool                      sort;    // Se falso, os pacotes são desenhados na ordem de envio
+    RenderQueueStats          stats;
+};
+
+void RenderQueue_Init(RenderQueue* queue, bool sort);
+
+// Remove os pacotes e os números de programas e VAOs do quadro anterior.
+void RenderQueue_Clear(RenderQueue* queue);
+
+// Adiciona um pacote, a uma distância "depth" da câmera.
+void RenderQueue_Submit(RenderQueue* queue, const RenderPacket& packet, float depth);
+
+// Ordena os pacotes pela chave (pacotes com a mesma chave ficam na ordem de
+// envio) e calcula queue->stats.
+void RenderQueue_Sort(RenderQueue* queue);
+
+#endif // _RENDERQUEUE_HPP
@@ -0,0 +1,41 @@
+#ifndef _RESIDENCY_HPP
+#define _RESIDENCY_HPP
+
+#include <cstddef>
+#include <functional>
+
+// Gerenciador de residência de recursos (modelos ".obj" e imagens de
+// textura). Cada recurso é identificado pelo nome do seu arquivo, e possui um
+// contador de referências: o número de objetos desenhados pela aplicação que
+// o utilizam (veja g_SceneDrawables em "main.cpp").
+//
+//   - Recursos sem nenhuma referência não são carregados;
+//   - Quando a última referência de um recurso residente é liberada, o
+//     recurso é removido da memória (da GPU) através da função "evict"
+//     informada em Residency_SetResident();
+//   - Para cada recurso, guardamos quantos bytes ele ocupa na memória
+//     principal (CPU) e na memória da GPU após o carregamento, para o
+//     relatório de Residency_PrintReport().
+
+enum AssetType {
+    ASSET_MODEL,
+    ASSET_TEXTURE
+};
+
+typedef int AssetId;
+
+// Retorna o identificador do recurso com o nome dado, registrando-o caso
+// ainda não exista.
+AssetId Residency_Asset(const char* name, AssetType type);
+
+void Residency_AddRef(AssetId asset);
+void Residency_Release(AssetId asset);
+int  Residency_RefCount(AssetId asset);
+
+// Marca o recurso como carregado.
+void Residency_SetResident(AssetId asset, size_t cpu_bytes, size_t gpu_bytes, std::function<void()> evict);
+
+// Imprime no terminal os bytes residentes de cada recurso, e os totais.
+void Residency_PrintReport();
+
+#endif // _RESIDENCY_HPP
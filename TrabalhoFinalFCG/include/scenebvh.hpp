@@ -0,0 +1,88 @@
+#ifndef _SCENEBVH_HPP
+#define _SCENEBVH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "frustum.hpp"
+
+// Hierarquia de volumes envolventes (BVH) dinâmica sobre as instâncias da
+// cena: uma árvore binária de AABBs em coordenadas globais, cujas folhas
+// são as instâncias ("proxies") e cujos nós internos envolvem os seus dois
+// filhos. Segue a "dynamic AABB tree" da Box2D (Erin Catto):
+//
+//   - novas folhas são inseridas ao lado do nó que minimiza o aumento da
+//     área de superfície da árvore (heurística SAH);
+//   - após cada inserção ou remoção, os nós no caminho até a raiz são
+//     rebalanceados com rotações (como em uma árvore AVL), de forma que a
+//     altura da árvore é O(log n);
+//   - a AABB de cada folha é "engordada" por uma margem, de forma que
+//     pequenos movimentos de uma instância (veja SceneBvh_Move()) não
+//     alteram a árvore.
+//
+// As consultas (SceneBvh_QueryFrustum(), SceneBvh_QueryBox() e
+// SceneBvh_QueryRay()) descem somente pelos nós que intersectam a região
+// consultada, e custam O(log n) mais o número de resultados.
+
+typedef int32_t SceneBvhProxy;
+
+#define SCENEBVH_INVALID_PROXY (-1)
+
+struct SceneBvhNode {
+    glm::vec3 box_min; // AABB do nó (engordada, no caso das folhas)
+    glm::vec3 box_max;
+    int32_t   parent;
+    int32_t   child1;  // -1 nas folhas
+    int32_t   child2;
+    int32_t   height;  // 0 nas folhas; -1 em nós livres
+    uint32_t  user_data;
+};
+
+struct SceneBvh {
+    std::vector<SceneBvhNode> nodes;      // Indexado por SceneBvhProxy (folhas) ou pelo número do nó interno
+    std::vector<int32_t>      free_nodes;
+    int32_t                   root;
+    size_t                    num_proxies;
+    float                     margin;     // Margem adicionada à AABB de cada folha
+};
+
+// Um resultado de SceneBvh_QueryRay(): a instância e a distância, ao longo
+// do raio, até a entrada na sua AABB.
+struct SceneBvhHit {
+    uint32_t user_data;
+    float    distance;
+};
+
+void SceneBvh_Init(SceneBvh* bvh, float margin);
+
+// Insere uma instância com AABB (box_min, box_max). "user_data" é devolvido
+// pelas consultas.
+SceneBvhProxy SceneBvh_Insert(SceneBvh* bvh, const glm::vec3& box_min, const glm::vec3& box_max, uint32_t user_data);
+void SceneBvh_Remove(SceneBvh* bvh, SceneBvhProxy proxy);
+
+// Atualiza a AABB de uma instância. Se a nova AABB ainda estiver dentro da
+// AABB engordada da folha, a árvore não muda e a função retorna false; senão
+// a folha é removida e inserida novamente, e a função retorna true.
+bool SceneBvh_Move(SceneBvh* bvh, SceneBvhProxy proxy, const glm::vec3& box_min, const glm::vec3& box_max);
+
+uint32_t SceneBvh_UserData(const SceneBvh* bvh, SceneBvhProxy proxy);
+
+// Altura da árvore (0 se vazia ou com uma única folha).
+int SceneBvh_Height(const SceneBvh* bvh);
+
+// Adicionam a "results" o "user_data" de cada instância cuja AABB
+// engordada intersecta o frustum ou a caixa. Como em
+// Frustum_IntersectsBox(), algumas instâncias fora do frustum, perto dos
+// seus cantos, podem ser incluídas.
+void SceneBvh_QueryFrustum(const SceneBvh* bvh, const Frustum& frustum, std::vector<uint32_t>* results);
+void SceneBvh_QueryBox(const SceneBvh* bvh, const glm::vec3& box_min, const glm::vec3& box_max, std::vector<uint32_t>* results);
+
+// Adiciona a "hits", em ordem crescente de distância, as instâncias cuja
+// AABB engordada é atingida pelo raio a partir de "origin" na direção
+// "direction" (normalizada), até a distância "max_distance".
+void SceneBvh_QueryRay(const SceneBvh* bvh, const glm::vec3& origin, const glm::vec3& direction, float max_distance, std::vector<SceneBvhHit>* hits);
+
+#endif // _SCENEBVH_HPP
@@ -0,0 +1,75 @@
+#ifndef _SHADERPERMUTATION_HPP
+#define _SHADERPERMUTATION_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include <glad/glad.h>
+
+// Variantes ("permutações") do fragment shader da cena, especializadas para
+// um material. Em vez de escolher o mapeamento de coordenadas de textura, o
+// array de texturas e o modelo de iluminação por fragmento a partir dos
+// uniforms do desenho, "shader_fragment.glsl" é compilado com estas escolhas
+// definidas como macros (veja ShaderPermutation_Header()). Os testes passam
+// a ter resultado conhecido em tempo de compilação, e o compilador remove os
+// desvios e o código que não é usado pelo material.
+//
+// Cada permutação distinta é compilada uma única vez e guardada em um
+// ShaderPermutationCache.
+
+// Mapeamento das coordenadas de textura. Os mesmos valores são definidos em
+// "shader_fragment.glsl".
+enum ShaderUvMode {
+    SHADER_UV_NONE = 0,  // Coordenadas (0,0)
+    SHADER_UV_TEXCOORDS, // Coordenadas de textura do arquivo OBJ
+    SHADER_UV_SPHERE,    // Projeção esférica em torno do centro da AABB
+    SHADER_UV_BBOX,      // Projeção planar (xy) na AABB do modelo
+    SHADER_UV_SKY,       // Projeção esférica em torno da origem do modelo
+};
+
+// Modelo de iluminação. Os mesmos valores são definidos em
+// "shader_fragment.glsl".
+enum ShaderLighting {
+    SHADER_LIGHTING_LAMBERT = 0, // Difusa (Lambert) mais ambiente
+    SHADER_LIGHTING_FLAT,        // Cor única ("color_override"), sem texturas
+};
+
+struct ShaderPermutation {
+    ShaderUvMode   uv_mode;
+    int            kd0_array; // Array da textura difusa (-1 se não existe)
+    int            kd1_array; // Array da segunda textura (-1 para objetos com uma textura)
+    ShaderLighting lighting;
+};
+
+struct ShaderPermutationCache {
+    std::map<uint32_t, GLuint> programs;        // Programas de GPU, pela chave da permutação
+    size_t                     compiled;        // Programas compilados desde a criação
+    double                     compile_seconds; // Tempo total das compilações
+};
+
+// Chave única da permutação. Permutações com iluminação
+// SHADER_LIGHTING_FLAT não usam texturas, e têm todas a mesma chave.
+uint32_t ShaderPermutation_Key(const ShaderPermutation& permutation);
+
+// Permutação com a chave "key" (inversa de ShaderPermutation_Key()).
+ShaderPermutation ShaderPermutation_FromKey(uint32_t key);
+
+// Texto que substitui a diretiva "#version" do shader (veja LoadShaderSource()
+// em "main.cpp"), definindo as macros da permutação.
+std::string ShaderPermutation_Header(const ShaderPermutation& permutation, const char* version);
+
+// Programa já compilado para a permutação, ou 0.
+GLuint ShaderPermutation_Find(const ShaderPermutationCache* cache, const ShaderPermutation& permutation);
+
+void ShaderPermutation_Insert(ShaderPermutationCache* cache, const ShaderPermutation& permutation, GLuint program, double seconds);
+
+// Substitui o programa da permutação com a chave "key", deletando o
+// anterior (veja a recarga dos shaders em "shaderreload.hpp").
+void ShaderPermutation_Replace(ShaderPermutationCache* cache, uint32_t key, GLuint program);
+
+// Remove todos os programas (por exemplo, quando os shaders são recarregados).
+void ShaderPermutation_Clear(ShaderPermutationCache* cache);
+
+#endif // _SHADERPERMUTATION_HPP
@@ -0,0 +1,75 @@
+#ifndef _SHADERRELOAD_HPP
+#define _SHADERRELOAD_HPP
+
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+// Recarga dos shaders durante a execução, sem interromper os desenhos.
+//
+// ShaderWatcher observa os arquivos GLSL e informa quando algum deles foi
+// gravado (com inotify no Linux; nos outros sistemas, comparando a data de
+// modificação dos arquivos periodicamente).
+//
+// PendingProgram é um programa de GPU cuja compilação e linkagem foram
+// pedidas ao driver, mas cujo resultado ainda não foi consultado. Com a
+// extensão GL_KHR_parallel_shader_compile (ou GL_ARB_parallel_shader_compile)
+// o driver compila em suas próprias threads, e ShaderReload_Poll() consulta
+// GL_COMPLETION_STATUS_KHR, que não bloqueia; sem a extensão, a consulta do
+// resultado espera o fim da compilação. Enquanto isso os programas
+// anteriores continuam em uso, e só são substituídos quando todos os novos
+// programas foram linkados com sucesso.
+
+struct ShaderWatcher {
+    std::string              directory;
+    std::vector<std::string> filenames;  // Nomes dos arquivos, sem o diretório
+    std::vector<long long>   mtimes;     // Datas de modificação (sem inotify)
+    int                      fd;         // Descritor do inotify, ou -1
+    double                   next_check; // Próxima comparação das datas (sem inotify)
+};
+
+enum PendingProgramStatus {
+    PENDING_PROGRAM_COMPILING = 0,
+    PENDING_PROGRAM_READY,
+    PENDING_PROGRAM_FAILED,
+};
+
+struct PendingProgram {
+    GLuint      vertex_shader;
+    GLuint      fragment_shader;
+    GLuint      program;
+    std::string vertex_filename;   // Usados nas mensagens de erro
+    std::string fragment_filename;
+    double      start;             // Início da compilação (glfwGetTime())
+};
+
+// Carrega a função que define o número de threads de compilação do driver.
+// Retorna true se a compilação em paralelo é suportada.
+bool ShaderReload_Init(GLADloadproc load);
+
+bool ShaderReload_ParallelCompile();
+
+// Começa a observar os arquivos "filenames" do diretório "directory".
+void ShaderWatcher_Init(ShaderWatcher* watcher, const char* directory, const char* const* filenames, size_t count);
+
+// Retorna true se algum dos arquivos foi modificado desde a última chamada.
+// Não bloqueia.
+bool ShaderWatcher_Poll(ShaderWatcher* watcher);
+
+void ShaderWatcher_Destroy(ShaderWatcher* watcher);
+
+// Pede ao driver a compilação dos códigos-fonte e a linkagem do programa,
+// sem esperar pelo resultado.
+void ShaderReload_Begin(PendingProgram* pending, const std::string& vertex_source, const char* vertex_filename,
+                        const std::string& fragment_source, const char* fragment_filename);
+
+// Estado da compilação. Ao retornar PENDING_PROGRAM_FAILED, os logs de
+// compilação e de linkagem já foram impressos no terminal.
+PendingProgramStatus ShaderReload_Poll(const PendingProgram* pending);
+
+// Libera os shaders do programa. Se "keep_program" for falso, o programa
+// também é deletado (compilação cancelada ou com erro).
+void ShaderReload_Finish(PendingProgram* pending, bool keep_program);
+
+#endif // _SHADERRELOAD_HPP
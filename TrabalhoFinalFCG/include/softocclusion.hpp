@@ -0,0 +1,46 @@
+#ifndef _SOFTOCCLUSION_HPP
+#define _SOFTOCCLUSION_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+
+// Descarte por oclusão na CPU, sem nenhuma comunicação com a GPU: um pequeno
+// conjunto de oclusores (em "main.cpp", caixas dentro das paredes dos
+// prédios) é rasterizado em um Z-buffer de baixa resolução, e a AABB de cada
+// objeto é comparada com este Z-buffer antes do seu desenho. Complementa os
+// testes de "occlusion.hpp", que dependem de consultas à GPU e de resultados
+// do quadro anterior.
+//
+// O rasterizador processa 4 pixels por vez com instruções SSE2 (presentes em
+// todo processador x86-64); em outras arquiteturas, usa um laço escalar.
+//
+// Os oclusores devem estar inteiramente contidos nos objetos que
+// representam, já que tudo o que estiver atrás deles é descartado. A
+// cobertura dos oclusores é amostrada no centro de cada pixel do Z-buffer,
+// de forma que objetos que aparecem somente por uma fração de pixel nas
+// bordas de um oclusor podem ser descartados.
+
+#define SOFTOCCLUSION_WIDTH  256 // Múltiplo de 4
+#define SOFTOCCLUSION_HEIGHT 128
+
+// Limpa o Z-buffer, e define a matriz "projection * view" usada pelas
+// funções abaixo.
+void SoftOcclusion_Begin(const glm::mat4& projection_view);
+
+// Rasteriza os triângulos "indices" de uma malha oclusora, com vértices
+// "positions" (x,y,z consecutivos) transformados pela matriz "model".
+// Triângulos que cruzam o near plane são ignorados.
+void SoftOcclusion_RasterizeTriangles(const glm::mat4& model, const float* positions, size_t num_vertices, const uint32_t* indices, size_t num_indices);
+
+// Rasteriza a caixa (box_min, box_max), no sistema de coordenadas de
+// "model", como oclusor.
+void SoftOcclusion_RasterizeBox(const glm::mat4& model, const glm::vec3& box_min, const glm::vec3& box_max);
+
+// Retorna false se a AABB (em coordenadas globais) está completamente atrás
+// dos oclusores rasterizados desde SoftOcclusion_Begin().
+bool SoftOcclusion_TestBox(const glm::vec3& box_min, const glm::vec3& box_max);
+
+#endif // _SOFTOCCLUSION_HPP
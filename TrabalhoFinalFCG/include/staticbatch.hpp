@@ -0,0 +1,83 @@
+#ifndef _STATICBATCH_HPP
+#define _STATICBATCH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+
+#include "vertexformat.hpp"
+
+// Agrupamento estático ("static batching"). As malhas de instâncias que nunca
+// se movem têm os seus vértices transformados para coordenadas globais uma
+// única vez, e são juntadas, por material e por região da cena, em grupos
+// ("chunks") dentro de um único buffer de vértices e um único buffer de
+// índices. Cada grupo é desenhado com uma única chamada, com a matriz
+// "model" identidade, e guarda a sua AABB em coordenadas globais para que
+// ainda possa ser descartado.
+//
+// Os vértices dos grupos estão sempre no formato com floats de
+// "vertexformat.hpp" (o formato compacto depende da bounding box de cada
+// objeto), com índices de 32 bits relativos ao primeiro vértice do grupo.
+//
+// Quando as instâncias mudam, StaticBatch_Build() é chamada novamente com
+// todas as instâncias. Somente os grupos cujas instâncias mudaram são
+// montados na CPU; os demais são copiados dos buffers antigos para os novos
+// na própria GPU, com glCopyBufferSubData().
+
+// Uma instância a ser agrupada: a malha de um objeto, com índices relativos
+// ao seu primeiro vértice, desenhada com a matriz "model" e o material (o
+// "object_id" dos shaders) "material".
+struct StaticBatchSource {
+    const FloatVertex* vertices;
+    size_t             num_vertices;
+    const uint32_t*    indices;
+    size_t             num_indices;
+    glm::vec3          bbox_min; // AABB da malha, no sistema de coordenadas do modelo
+    glm::vec3          bbox_max;
+    glm::mat4          model;
+    int                material;
+    size_t             id; // Identificador único da instância com esta matriz "model" (veja StaticBatch_Build())
+};
+
+struct StaticBatchChunk {
+    int                 material;
+    glm::vec3           world_min; // AABB dos vértices do grupo, em coordenadas globais
+    glm::vec3           world_max;
+    size_t              first_index; // Posição do primeiro índice do grupo no buffer de índices
+    size_t              num_indices;
+    size_t              first_vertex; // Posição do primeiro vértice do grupo no buffer de vértices
+    size_t              num_vertices;
+    std::vector<size_t> sources; // Instâncias do grupo (posições no vetor passado a StaticBatch_Build())
+    std::vector<size_t> ids;     // StaticBatchSource::id das mesmas instâncias
+};
+
+struct StaticBatch {
+    GLuint                        vertex_array;
+    GLuint                        vertex_buffer;
+    GLuint                        index_buffer;
+    size_t                        vertex_bytes;
+    std::vector<StaticBatchChunk> chunks;
+};
+
+// Agrupa as instâncias de "sources" pelo material e pela célula, de tamanho
+// "chunk_size" no plano (x,z), que contém o centro da sua AABB, e envia os
+// grupos para a GPU, substituindo os grupos anteriores de "batch". Um grupo
+// com exatamente os mesmos identificadores de um grupo anterior é copiado
+// dele, sem ler "vertices" e "indices". Os atributos do VAO criado
+// correspondem a "(location = 0)", "(location = 1)" e "(location = 2)" em
+// "shader_vertex.glsl".
+void StaticBatch_Build(StaticBatch* batch, const std::vector<StaticBatchSource>& sources, float chunk_size);
+
+// Remove os buffers da GPU e os grupos.
+void StaticBatch_Destroy(StaticBatch* batch);
+
+// Desenha um grupo. Os uniforms dos shaders (matriz "model" e material)
+// devem ser definidos antes.
+void StaticBatch_Draw(const StaticBatch* batch, size_t chunk);
+
+#endif // _STATICBATCH_HPP
@@ -0,0 +1,82 @@
+#ifndef _TEXTUREARRAY_HPP
+#define _TEXTUREARRAY_HPP
+
+#include <cstddef>
+
+#include <glad/glad.h>
+
+#include "texturecache.hpp"
+
+// Arrays de texturas (GL_TEXTURE_2D_ARRAY). Em vez de ocupar uma unidade de
+// textura por imagem, as texturas com mesmas dimensões e mesmo formato são
+// agrupadas como camadas ("layers") de um único array, e cada array ocupa uma
+// única unidade de textura. Um objeto escolhe a sua textura pelo par (array,
+// camada), enviado ao fragment shader antes de cada desenho (veja
+// SetObjectMaterial() em "main.cpp" e SampleTexture() em
+// "shader_fragment.glsl"). Como as texturas são reduzidas a poucos tamanhos
+// pelo cozimento (veja TextureCompress_Cook()), o número de arrays, e
+// portanto de unidades ocupadas, não cresce com o número de texturas.
+
+// Número máximo de arrays. Deve ser igual ao tamanho do vetor "TextureArrays"
+// em "shader_fragment.glsl".
+#define TEXTUREARRAY_MAX_ARRAYS 12
+
+typedef int TextureHandle;
+
+#define TEXTUREARRAY_INVALID_HANDLE (-1)
+
+// Níveis de mipmap com no máximo este tamanho (a "cauda" da cadeia de
+// mipmaps) são enviados para a GPU imediatamente por TextureArray_Build(), de
+// forma que todos os objetos podem ser desenhados desde o primeiro quadro. Os
+// níveis maiores são enviados aos poucos por TextureArray_Stream().
+#define TEXTUREARRAY_TAIL_SIZE 64
+
+// Posição de uma textura: índice do array (entre 0 e
+// TEXTUREARRAY_MAX_ARRAYS-1) e camada dentro do array, e o menor nível de
+// mipmap já enviado para a GPU (os níveis menores que este ainda não podem
+// ser amostrados). Texturas inexistentes ou removidas têm array == -1.
+struct TextureBinding {
+    int array;
+    int layer;
+    int min_level;
+};
+
+// Verifica se a GPU suporta arrays de texturas comprimidas nos formatos S3TC
+// em sRGB (BC1/BC3). Alguns drivers anunciam GL_EXT_texture_compression_s3tc,
+// mas não as suas variantes sRGB; por isso criamos um array de teste.
+bool TextureArray_CompressionSupported();
+
+// Registra uma textura com nome "name", copiando os seus dados. As texturas
+// são enviadas para a GPU somente em TextureArray_Build(), quando o número de
+// camadas de cada array já é conhecido, e TextureArray_Stream(). A cópia é
+// liberada quando todos os níveis tiverem sido enviados.
+TextureHandle TextureArray_Add(const char* name, const TextureView& texture);
+
+// Cria os arrays e envia a cauda da cadeia de mipmaps de todas as texturas
+// registradas (veja TEXTUREARRAY_TAIL_SIZE). O array i é ligado à unidade de
+// textura "first_unit + i". Se "compressed" for false (GPU sem suporte a
+// S3TC), os níveis são descomprimidos antes do envio.
+void TextureArray_Build(GLuint first_unit, bool compressed);
+
+TextureHandle  TextureArray_Find(const char* name);
+TextureBinding TextureArray_Binding(TextureHandle texture);
+
+// Tamanho, em bytes, que a textura ocupa (ou ocupará) na GPU.
+size_t TextureArray_Bytes(TextureHandle texture, bool compressed);
+
+// Informa que a textura aparece na tela com "pixels" texels de largura (por
+// exemplo, o tamanho projetado do objeto que a usa). Usado para priorizar o
+// envio dos níveis de mipmap em TextureArray_Stream().
+void TextureArray_Request(TextureHandle texture, float pixels);
+
+// Envia para a GPU, através de um pixel buffer object, o próximo nível de
+// mipmap das texturas de maior prioridade, até "byte_budget" bytes. Deve ser
+// chamada uma vez por quadro. Retorna o número de bytes enviados (zero quando
+// todas as texturas já estão completas).
+size_t TextureArray_Stream(size_t byte_budget);
+
+// Libera a camada da textura. O array é removido da GPU quando todas as suas
+// camadas forem liberadas.
+void TextureArray_Release(TextureHandle texture);
+
+#endif // _TEXTUREARRAY_HPP
@@ -0,0 +1,76 @@
+#ifndef _TEXTURECACHE_HPP
+#define _TEXTURECACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "cachefile.hpp"
+
+// Cache de texturas comprimidas. Na primeira vez que uma imagem é carregada,
+// a mesma é decodificada, reduzida para gerar todos os níveis de mipmap e
+// comprimida em blocos (veja "texturecompress.hpp"); o resultado é gravado ao
+// lado da imagem em um arquivo "<nome>.texcache". Nas execuções seguintes o
+// arquivo é mapeado em memória e cada nível é enviado diretamente para a GPU
+// com glCompressedTexImage2D(), sem decodificar a imagem e sem
+// glGenerateMipmap().
+
+// Versão do formato. Deve ser incrementada sempre que o formato do arquivo ou
+// a compressão mudarem.
+#define TEXTURECACHE_VERSION 3
+
+// Formato dos blocos de 4x4 texels. Ambos armazenam cores em sRGB.
+enum TextureFormat {
+    TEXTURE_FORMAT_BC1 = 1, // RGB, 8 bytes por bloco (4 bits por texel)
+    TEXTURE_FORMAT_BC3 = 3, // RGBA, 16 bytes por bloco (8 bits por texel)
+};
+
+// Um nível de mipmap, armazenado em "size" bytes a partir da posição
+// "offset" do vetor de dados da textura.
+struct TextureLevel {
+    int    width;
+    int    height;
+    size_t offset;
+    size_t size;
+};
+
+// Textura comprimida armazenada em memória própria. É o resultado de
+// TextureCompress_Cook().
+struct TextureData {
+    TextureFormat             format;
+    int                       width;
+    int                       height;
+    std::vector<uint8_t>      data;
+    std::vector<TextureLevel> levels; // levels[0] é a imagem original
+};
+
+// Visão (sem posse da memória) da mesma textura. Pode apontar tanto para um
+// TextureData quanto para um arquivo de cache mapeado em memória.
+struct TextureView {
+    TextureFormat             format;
+    int                       width;
+    int                       height;
+    const uint8_t*            data;
+    size_t                    data_size;
+    std::vector<TextureLevel> levels;
+};
+
+// Arquivo de cache aberto. A visão "view" só é válida até TextureCache_Close().
+struct TextureCacheFile {
+    TextureView view;
+    CacheFile   file;
+};
+
+TextureView TextureData_View(const TextureData& texture);
+
+// Abre o cache da imagem "image_filename", caso exista e ainda seja válido
+// (mesma versão, e arquivo fonte com mesmo tamanho e data de modificação, ou
+// então com o mesmo hash de conteúdo). Retorna false caso contrário.
+bool TextureCache_Open(const char* image_filename, TextureCacheFile* file);
+void TextureCache_Close(TextureCacheFile* file);
+
+// Grava o cache da imagem "image_filename". Retorna false em caso de erro;
+// neste caso o programa continua funcionando normalmente, somente sem cache.
+bool TextureCache_Write(const char* image_filename, const TextureView& texture);
+
+#endif // _TEXTURECACHE_HPP
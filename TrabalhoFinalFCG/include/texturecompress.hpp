@@ -0,0 +1,38 @@
+#ifndef _TEXTURECOMPRESS_HPP
+#define _TEXTURECOMPRESS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "texturecache.hpp"
+
+// Compressão de texturas nos formatos BC1 e BC3 (também conhecidos como DXT1
+// e DXT5, da extensão GL_EXT_texture_compression_s3tc). A imagem é dividida
+// em blocos de 4x4 texels, e cada bloco armazena duas cores de referência
+// (RGB 5:6:5) e, para cada texel, um índice de 2 bits que escolhe uma das
+// quatro cores interpoladas entre as duas. O BC3 acrescenta a cada bloco o
+// canal alfa, com dois valores de referência e índices de 3 bits.
+//
+// A compressão é feita uma única vez, ao gravar o cache de texturas (veja
+// "texturecache.hpp"), e portanto favorece a qualidade em vez da velocidade.
+
+// Tamanho em bytes de um nível de "width" x "height" texels.
+size_t TextureCompress_LevelSize(TextureFormat format, int width, int height);
+
+// Gera todos os níveis de mipmap da imagem "rgba" (4 bytes por texel, em sRGB)
+// e comprime cada um deles. A largura e a altura da imagem são antes
+// arredondadas para potências de dois, de forma que as texturas se dividem em
+// poucos tamanhos e podem ser agrupadas em arrays (veja "texturearray.hpp"),
+// sem esticar imagens que não são quadradas.
+// Os níveis são obtidos por um filtro caixa aplicado às cores convertidas para
+// o espaço linear, e não diretamente aos valores sRGB (o que escureceria os
+// níveis menores). Imagens totalmente opacas são comprimidas em BC1; as
+// demais, em BC3.
+void TextureCompress_Cook(const uint8_t* rgba, int width, int height, TextureData* texture);
+
+// Descomprime um nível para RGBA (4 bytes por texel). Usado quando a GPU não
+// suporta texturas S3TC.
+void TextureCompress_Decompress(const TextureView& texture, size_t level, std::vector<uint8_t>* rgba);
+
+#endif // _TEXTURECOMPRESS_HPP
@@ -0,0 +1,43 @@
+#ifndef _UNIFORMBUFFER_HPP
+#define _UNIFORMBUFFER_HPP
+
+#include <cstddef>
+
+#include <glad/glad.h>
+
+// Buffer circular de uniforms ("uniform buffer object", UBO). Os dados de cada
+// desenho (e os dados do quadro) são copiados para o próximo trecho livre do
+// buffer, alinhado a GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, e o trecho é ligado
+// a um "binding point" por glBindBufferRange(). Trechos já usados não são
+// sobrescritos no mesmo quadro, de forma que a GPU pode ler os dados de um
+// desenho enquanto a CPU escreve os dos próximos.
+//
+// No início de cada quadro, UniformRing_BeginFrame() troca o conteúdo do
+// buffer por uma nova região de memória (glBufferData() com NULL, o
+// "orphaning"); o driver mantém a região anterior até que a GPU termine os
+// desenhos que a usam.
+
+struct UniformRing {
+    GLuint   buffer;
+    size_t   size;
+    size_t   head;       // Próximo byte livre
+    size_t   alignment;
+    unsigned generation; // Incrementado quando o buffer é trocado no meio de um quadro
+};
+
+void UniformRing_Init(UniformRing* ring, size_t size);
+
+void UniformRing_BeginFrame(UniformRing* ring);
+
+// Tamanho de um trecho de "size" bytes, incluindo o alinhamento
+size_t UniformRing_Stride(const UniformRing* ring, size_t size);
+
+// Copia "size" bytes de "data" para o buffer e retorna a posição da cópia.
+// Se não há espaço, o buffer é trocado (veja UniformRing::generation): os
+// trechos ligados antes devem ser enviados novamente.
+size_t UniformRing_Upload(UniformRing* ring, const void* data, size_t size);
+
+// Liga o trecho em "offset" ao "binding point" "binding" de GL_UNIFORM_BUFFER.
+void UniformRing_Bind(const UniformRing* ring, GLuint binding, size_t offset, size_t size);
+
+#endif // _UNIFORMBUFFER_HPP
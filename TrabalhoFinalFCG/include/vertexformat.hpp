@@ -0,0 +1,46 @@
+#ifndef _VERTEXFORMAT_HPP
+#define _VERTEXFORMAT_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "meshcache.hpp"
+
+// Formato compacto de vértices enviado para a GPU (16 bytes por vértice, em
+// vez dos 40 bytes do formato com floats):
+//
+//   - posição: 3 inteiros de 16 bits sem sinal, normalizados para [0,1]
+//     dentro da bounding box do objeto (MeshShape::bbox_min/bbox_max);
+//   - normal:  2 inteiros de 16 bits com sinal, normalizados para [-1,1],
+//     com a normal codificada em coordenadas octaédricas;
+//   - coordenadas de textura: 2 "half floats".
+//
+// A decodificação é feita pelo vertex shader ("shader_vertex.glsl"), usando as
+// variáveis uniformes bbox_min e bbox_max do objeto sendo desenhado.
+struct PackedVertex {
+    uint16_t position[4]; // x, y, z e um valor não utilizado (alinhamento)
+    int16_t  normal[2];
+    uint16_t texcoord[2];
+};
+
+// Formato com floats (40 bytes por vértice), usado com a opção
+// "--float-vertices". Os mesmos atributos de MeshData, intercalados.
+struct FloatVertex {
+    float position[4];
+    float normal[4];
+    float texcoord[2];
+};
+
+// Converte os vértices de "mesh" (no formato com floats) para o formato
+// compacto. Vértices sem normal ou sem coordenadas de textura recebem zeros.
+void VertexFormat_Pack(const MeshView& mesh, std::vector<PackedVertex>* vertices);
+
+// Operação inversa de VertexFormat_Pack(): decodifica "count" vértices de um
+// objeto com a bounding box (bbox_min, bbox_max), como o vertex shader.
+void VertexFormat_Unpack(const PackedVertex* vertices, size_t count, const glm::vec3& bbox_min, const glm::vec3& bbox_max, FloatVertex* out);
+
+// Intercala os vetores de "mesh" em um único vetor de FloatVertex. Vértices
+// sem normal ou sem coordenadas de textura recebem zeros.
+void VertexFormat_Interleave(const MeshView& mesh, std::vector<FloatVertex>* vertices);
+
+#endif // _VERTEXFORMAT_HPP
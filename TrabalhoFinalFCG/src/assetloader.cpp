@@ -0,0 +1,144 @@
+#include "assetloader.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Um recurso submetido. "done" e "error" são protegidos por g_Mutex.
+struct AssetJob {
+    std::function<void()> work;
+    std::function<void()> commit;
+    bool                  done;
+    std::exception_ptr    error;
+};
+
+static std::vector<std::thread>                g_Workers;
+static std::deque< std::unique_ptr<AssetJob> > g_Jobs;    // Todos os recursos, em ordem de submissão
+static std::deque<AssetJob*>                   g_Pending; // Recursos cujo "work" ainda não começou
+static std::mutex                              g_Mutex;
+static std::condition_variable                 g_WorkAvailable;
+static std::condition_variable                 g_WorkDone;
+static bool                                    g_Stopping = false;
+
+static void AssetLoader_WorkerMain()
+{
+    for (;;)
+    {
+        AssetJob* job;
+        {
+            std::unique_lock<std::mutex> lock(g_Mutex);
+            g_WorkAvailable.wait(lock, []{ return g_Stopping || !g_Pending.empty(); });
+            if (g_Pending.empty())
+                return;
+            job = g_Pending.front();
+            g_Pending.pop_front();
+        }
+
+        std::exception_ptr error;
+        try
+        {
+            job->work();
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(g_Mutex);
+            job->done  = true;
+            job->error = error;
+        }
+        g_WorkDone.notify_all();
+    }
+}
+
+// Encerra as threads auxiliares, descartando recursos ainda não iniciados.
+static void AssetLoader_Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(g_Mutex);
+        g_Stopping = true;
+        g_Pending.clear();
+    }
+    g_WorkAvailable.notify_all();
+
+    for (size_t i = 0; i < g_Workers.size(); ++i)
+        g_Workers[i].join();
+
+    g_Workers.clear();
+    g_Jobs.clear();
+    g_Stopping = false;
+}
+
+void AssetLoader_Start(unsigned num_threads)
+{
+    if (!g_Workers.empty())
+        return;
+
+    if (num_threads == 0)
+        num_threads = std::thread::hardware_concurrency();
+    if (num_threads == 0)
+        num_threads = 4;
+
+    for (unsigned i = 0; i < num_threads; ++i)
+        g_Workers.push_back(std::thread(AssetLoader_WorkerMain));
+}
+
+void AssetLoader_Submit(std::function<void()> work, std::function<void()> commit)
+{
+    if (g_Workers.empty())
+    {
+        work();
+        commit();
+        return;
+    }
+
+    std::unique_ptr<AssetJob> job(new AssetJob);
+    job->work   = work;
+    job->commit = commit;
+    job->done   = false;
+
+    {
+        std::lock_guard<std::mutex> lock(g_Mutex);
+        g_Pending.push_back(job.get());
+        g_Jobs.push_back(std::move(job));
+    }
+    g_WorkAvailable.notify_one();
+}
+
+void AssetLoader_Finish()
+{
+    if (g_Workers.empty())
+        return;
+
+    for (size_t i = 0; i < g_Jobs.size(); ++i)
+    {
+        AssetJob* job = g_Jobs[i].get();
+        std::exception_ptr error;
+        {
+            std::unique_lock<std::mutex> lock(g_Mutex);
+            g_WorkDone.wait(lock, [job]{ return job->done; });
+            error = job->error;
+        }
+
+        if (error)
+        {
+            AssetLoader_Stop();
+            std::rethrow_exception(error);
+        }
+
+        job->commit();
+
+        // Libera o quanto antes a memória capturada pelas duas etapas (por
+        // exemplo, a imagem decodificada), em vez de esperar o fim da carga.
+        job->work   = nullptr;
+        job->commit = nullptr;
+    }
+
+    AssetLoader_Stop();
+}
@@ -0,0 +1,189 @@
+#include "cachefile.hpp"
+
+#include <cstdlib>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+bool CacheFile_Map(const std::string& filename, CacheFile* file)
+{
+    file->data = NULL;
+    file->size = 0;
+    file->mapped = false;
+
+#ifndef _WIN32
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    file->data = data;
+    file->size = (size_t)st.st_size;
+    file->mapped = true;
+    return true;
+#else
+    FILE* f = fopen(filename.c_str(), "rb");
+    if (f == NULL)
+        return false;
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size <= 0)
+    {
+        fclose(f);
+        return false;
+    }
+
+    void* data = malloc((size_t)size);
+    if (data == NULL || fread(data, 1, (size_t)size, f) != (size_t)size)
+    {
+        free(data);
+        fclose(f);
+        return false;
+    }
+    fclose(f);
+
+    file->data = data;
+    file->size = (size_t)size;
+    return true;
+#endif
+}
+
+void CacheFile_Unmap(CacheFile* file)
+{
+    if (file->data == NULL)
+        return;
+
+#ifndef _WIN32
+    if (file->mapped)
+        munmap(file->data, file->size);
+    else
+        free(file->data);
+#else
+    free(file->data);
+#endif
+
+    file->data = NULL;
+    file->size = 0;
+}
+
+bool CacheFile_InBounds(const CacheFile* file, uint64_t offset, uint64_t count, size_t element_size)
+{
+    if (offset > file->size)
+        return false;
+    return count <= (file->size - offset) / element_size;
+}
+
+bool CacheFile_StatSource(const char* filename, uint64_t* size, int64_t* mtime)
+{
+    struct stat st;
+    if (stat(filename, &st) != 0)
+        return false;
+
+    *size  = (uint64_t)st.st_size;
+
+    // Usamos a resolução de nanossegundos quando disponível, para detectar
+    // alterações feitas dentro de um mesmo segundo.
+#if defined(__linux__)
+    *mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#elif defined(__APPLE__)
+    *mtime = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    *mtime = (int64_t)st.st_mtime;
+#endif
+    return true;
+}
+
+bool CacheFile_HashSource(const char* filename, uint64_t* hash)
+{
+    FILE* f = fopen(filename, "rb");
+    if (f == NULL)
+        return false;
+
+    uint64_t h = 14695981039346656037ULL;
+    unsigned char buffer[64*1024];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            h ^= buffer[i];
+            h *= 1099511628211ULL;
+        }
+    }
+    fclose(f);
+
+    *hash = h;
+    return true;
+}
+
+bool CacheFile_UpdateSourceMtime(const std::string& filename, size_t offset, int64_t mtime)
+{
+    FILE* f = fopen(filename.c_str(), "r+b");
+    if (f == NULL)
+        return false;
+
+    bool ok = fseek(f, (long)offset, SEEK_SET) == 0
+           && fwrite(&mtime, sizeof(mtime), 1, f) == 1;
+    return (fclose(f) == 0) && ok;
+}
+
+size_t CacheFile_Align(size_t offset)
+{
+    return (offset + 15) & ~(size_t)15;
+}
+
+bool CacheFile_WriteBlock(FILE* f, const void* data, size_t size, size_t* offset)
+{
+    // Preenchemos com zeros até a próxima posição alinhada
+    static const char zeros[16] = { 0 };
+    size_t aligned = CacheFile_Align(*offset);
+    if (aligned != *offset && fwrite(zeros, 1, aligned - *offset, f) != aligned - *offset)
+        return false;
+    *offset = aligned;
+
+    if (size > 0 && fwrite(data, 1, size, f) != size)
+        return false;
+    *offset += size;
+    return true;
+}
+
+bool CacheFile_Commit(FILE* f, const std::string& tmp_filename, const std::string& filename, bool ok)
+{
+    if (fclose(f) != 0)
+        ok = false;
+
+    if (!ok)
+    {
+        remove(tmp_filename.c_str());
+        return false;
+    }
+
+    // Em Windows, rename() falha caso o destino já exista.
+    remove(filename.c_str());
+    if (rename(tmp_filename.c_str(), filename.c_str()) != 0)
+    {
+        remove(tmp_filename.c_str());
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,96 @@
+#include "frustum.hpp"
+
+#include <cmath>
+
+void Frustum_FromMatrix(const glm::mat4& projection_view, Frustum* frustum)
+{
+    // Linhas da matriz (a GLM armazena as matrizes por colunas)
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; ++i)
+        rows[i] = glm::vec4(projection_view[0][i], projection_view[1][i], projection_view[2][i], projection_view[3][i]);
+
+    // Um ponto está dentro do frustum se -w <= x,y,z <= w em coordenadas
+    // de recorte, ou seja, se (rows[3] ± rows[i]) . p >= 0.
+    frustum->planes[0] = rows[3] + rows[0]; // Esquerda
+    frustum->planes[1] = rows[3] - rows[0]; // Direita
+    frustum->planes[2] = rows[3] + rows[1]; // Baixo
+    frustum->planes[3] = rows[3] - rows[1]; // Cima
+    frustum->planes[4] = rows[3] + rows[2]; // Near
+    frustum->planes[5] = rows[3] - rows[2]; // Far
+
+    for (int i = 0; i < 6; ++i)
+    {
+        glm::vec4& plane = frustum->planes[i];
+        float length = std::sqrt(plane.x*plane.x + plane.y*plane.y + plane.z*plane.z);
+        if (length > 0.0f)
+            plane /= length;
+    }
+}
+
+void Frustum_TransformBox(const glm::mat4& model, const glm::vec3& bbox_min, const glm::vec3& bbox_max, glm::vec3* world_min, glm::vec3* world_max)
+{
+    // Começamos pela translação e somamos, para cada elemento da parte
+    // linear da matriz, o menor e o maior dos seus produtos pelos limites da
+    // caixa.
+    glm::vec3 out_min = glm::vec3(model[3]);
+    glm::vec3 out_max = glm::vec3(model[3]);
+
+    for (int column = 0; column < 3; ++column)
+    {
+        for (int row = 0; row < 3; ++row)
+        {
+            float a = model[column][row] * bbox_min[column];
+            float b = model[column][row] * bbox_max[column];
+            out_min[row] += (a < b) ? a : b;
+            out_max[row] += (a < b) ? b : a;
+        }
+    }
+
+    *world_min = out_min;
+    *world_max = out_max;
+}
+
+bool Frustum_IntersectsBox(const Frustum& frustum, const glm::vec3& box_min, const glm::vec3& box_max)
+{
+    for (int i = 0; i < 6; ++i)
+    {
+        const glm::vec4& plane = frustum.planes[i];
+
+        // Canto da caixa mais à frente na direção da normal do plano: se
+        // ele está fora, a caixa inteira está.
+        glm::vec3 corner(plane.x >= 0.0f ? box_max.x : box_min.x,
+                         plane.y >= 0.0f ? box_max.y : box_min.y,
+                         plane.z >= 0.0f ? box_max.z : box_min.z);
+
+        if (plane.x*corner.x + plane.y*corner.y + plane.z*corner.z + plane.w < 0.0f)
+            return false;
+    }
+
+    return true;
+}
+
+FrustumClassification Frustum_ClassifyBox(const Frustum& frustum, const glm::vec3& box_min, const glm::vec3& box_max)
+{
+    FrustumClassification classification = FRUSTUM_INSIDE;
+
+    for (int i = 0; i < 6; ++i)
+    {
+        const glm::vec4& plane = frustum.planes[i];
+
+        // Cantos da caixa mais à frente e mais atrás na direção da normal
+        glm::vec3 front(plane.x >= 0.0f ? box_max.x : box_min.x,
+                        plane.y >= 0.0f ? box_max.y : box_min.y,
+                        plane.z >= 0.0f ? box_max.z : box_min.z);
+        glm::vec3 back(plane.x >= 0.0f ? box_min.x : box_max.x,
+                       plane.y >= 0.0f ? box_min.y : box_max.y,
+                       plane.z >= 0.0f ? box_min.z : box_max.z);
+
+        if (plane.x*front.x + plane.y*front.y + plane.z*front.z + plane.w < 0.0f)
+            return FRUSTUM_OUTSIDE;
+
+        if (plane.x*back.x + plane.y*back.y + plane.z*back.z + plane.w < 0.0f)
+            classification = FRUSTUM_INTERSECTS;
+    }
+
+    return classification;
+}
@@ -0,0 +1,187 @@
+#include "gpuarena.hpp"
+
+#include <algorithm>
+
+static size_t GpuArena_Align(const GpuArena* arena, size_t value)
+{
+    return (value + arena->alignment - 1) / arena->alignment * arena->alignment;
+}
+
+static GLuint GpuArena_CreateBuffer(size_t capacity)
+{
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, capacity, NULL, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return buffer;
+}
+
+// Insere um intervalo livre, fundindo-o com os intervalos vizinhos.
+static void GpuArena_InsertFree(GpuArena* arena, size_t offset, size_t size)
+{
+    std::map<size_t, size_t>::iterator next = arena->free_list.lower_bound(offset);
+
+    if (next != arena->free_list.begin())
+    {
+        std::map<size_t, size_t>::iterator prev = next;
+        --prev;
+        if (prev->first + prev->second == offset)
+        {
+            offset = prev->first;
+            size += prev->second;
+            arena->free_list.erase(prev);
+        }
+    }
+
+    if (next != arena->free_list.end() && offset + size == next->first)
+    {
+        size += next->second;
+        arena->free_list.erase(next);
+    }
+
+    arena->free_list[offset] = size;
+}
+
+void GpuArena_Init(GpuArena* arena, size_t initial_capacity, size_t alignment)
+{
+    arena->alignment  = alignment;
+    arena->capacity   = GpuArena_Align(arena, std::max(initial_capacity, alignment));
+    arena->buffer     = GpuArena_CreateBuffer(arena->capacity);
+    arena->used       = 0;
+    arena->generation = 0;
+    arena->blocks.clear();
+    arena->free_handles.clear();
+    arena->free_list.clear();
+    arena->free_list[0] = arena->capacity;
+}
+
+void GpuArena_Destroy(GpuArena* arena)
+{
+    if (arena->buffer != 0)
+        glDeleteBuffers(1, &arena->buffer);
+    arena->buffer = 0;
+    arena->capacity = 0;
+    arena->used = 0;
+    arena->blocks.clear();
+    arena->free_handles.clear();
+    arena->free_list.clear();
+}
+
+// Troca o buffer da arena por um novo com "capacity" bytes, copiando todos
+// os blocos para o início do novo buffer (na ordem em que estavam).
+static void GpuArena_Relocate(GpuArena* arena, size_t capacity)
+{
+    GLuint buffer = GpuArena_CreateBuffer(capacity);
+
+    std::vector<GpuArenaHandle> order;
+    for (size_t h = 0; h < arena->blocks.size(); ++h)
+        if (arena->blocks[h].live)
+            order.push_back((GpuArenaHandle)h);
+    std::sort(order.begin(), order.end(), [arena](GpuArenaHandle a, GpuArenaHandle b) {
+        return arena->blocks[a].offset < arena->blocks[b].offset;
+    });
+
+    glBindBuffer(GL_COPY_READ_BUFFER, arena->buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+
+    size_t offset = 0;
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        GpuArenaBlock& block = arena->blocks[order[i]];
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, block.offset, offset, block.size);
+        block.offset = offset;
+        offset += block.size;
+    }
+
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    glDeleteBuffers(1, &arena->buffer);
+    arena->buffer = buffer;
+    arena->capacity = capacity;
+    arena->generation += 1;
+
+    arena->free_list.clear();
+    if (offset < capacity)
+        arena->free_list[offset] = capacity - offset;
+}
+
+void GpuArena_Compact(GpuArena* arena)
+{
+    GpuArena_Relocate(arena, arena->capacity);
+}
+
+GpuArenaHandle GpuArena_Allocate(GpuArena* arena, size_t size, const void* data)
+{
+    size_t aligned_size = GpuArena_Align(arena, std::max(size, (size_t)1));
+
+    // Primeiro intervalo livre grande o suficiente ("first fit")
+    std::map<size_t, size_t>::iterator it = arena->free_list.begin();
+    while (it != arena->free_list.end() && it->second < aligned_size)
+        ++it;
+
+    if (it == arena->free_list.end())
+    {
+        // Se a memória livre total é suficiente, o problema é somente a
+        // fragmentação; senão, dobramos o tamanho do buffer.
+        size_t capacity = arena->capacity;
+        if (capacity - arena->used < aligned_size)
+            capacity = GpuArena_Align(arena, std::max(2*capacity, arena->used + aligned_size));
+
+        GpuArena_Relocate(arena, capacity);
+        it = arena->free_list.begin();
+    }
+
+    size_t offset = it->first;
+    size_t remaining = it->second - aligned_size;
+    arena->free_list.erase(it);
+    if (remaining > 0)
+        arena->free_list[offset + aligned_size] = remaining;
+
+    GpuArenaBlock block;
+    block.offset = offset;
+    block.size = aligned_size;
+    block.live = true;
+
+    GpuArenaHandle handle;
+    if (!arena->free_handles.empty())
+    {
+        handle = arena->free_handles.back();
+        arena->free_handles.pop_back();
+        arena->blocks[handle] = block;
+    }
+    else
+    {
+        handle = (GpuArenaHandle)arena->blocks.size();
+        arena->blocks.push_back(block);
+    }
+    arena->used += aligned_size;
+
+    if (data != NULL && size > 0)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, arena->buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    return handle;
+}
+
+void GpuArena_Free(GpuArena* arena, GpuArenaHandle handle)
+{
+    if (handle >= arena->blocks.size() || !arena->blocks[handle].live)
+        return;
+
+    GpuArenaBlock& block = arena->blocks[handle];
+    block.live = false;
+    arena->used -= block.size;
+    arena->free_handles.push_back(handle);
+
+    GpuArena_InsertFree(arena, block.offset, block.size);
+}
+
+size_t GpuArena_Offset(const GpuArena* arena, GpuArenaHandle handle)
+{
+    return arena->blocks[handle].offset;
+}
@@ -0,0 +1,560 @@
+#include "gpudriven.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "utils.h"
+
+// Constantes do OpenGL 4.2 e 4.3, que não fazem parte do OpenGL 3.3 core
+#define GL_SHADER_STORAGE_BUFFER           0x90D2
+#define GL_DRAW_INDIRECT_BUFFER            0x8F3F
+#define GL_COMPUTE_SHADER                  0x91B9
+#define GL_SHADER_STORAGE_BARRIER_BIT      0x00002000
+#define GL_COMMAND_BARRIER_BIT             0x00000040
+#define GL_TEXTURE_FETCH_BARRIER_BIT       0x00000008
+
+typedef void (APIENTRYP GpuDrivenDispatchComputeProc)(GLuint num_groups_x, GLuint num_groups_y, GLuint num_groups_z);
+typedef void (APIENTRYP GpuDrivenMemoryBarrierProc)(GLbitfield barriers);
+typedef void (APIENTRYP GpuDrivenBindImageTextureProc)(GLuint unit, GLuint texture, GLint level, GLboolean layered, GLint layer, GLenum access, GLenum format);
+typedef void (APIENTRYP GpuDrivenMultiDrawElementsIndirectProc)(GLenum mode, GLenum type, const void* indirect, GLsizei drawcount, GLsizei stride);
+
+static GpuDrivenDispatchComputeProc           g_DispatchCompute;
+static GpuDrivenMemoryBarrierProc             g_MemoryBarrier;
+static GpuDrivenBindImageTextureProc          g_BindImageTexture;
+static GpuDrivenMultiDrawElementsIndirectProc g_MultiDrawElementsIndirect;
+
+// Descarte das instâncias pedidas no quadro. Cada thread testa uma instância
+// e escreve o seu comando de desenho. O teste Hi-Z projeta a AABB com a
+// matriz do quadro em que a pirâmide foi construída, e escolhe o nível em que
+// o retângulo da AABB na tela cobre no máximo 2x2 texels: a instância está
+// escondida se o ponto mais próximo da AABB está atrás da maior
+// profundidade destes texels.
+const GLchar* const gpudrivencullshader_source = ""
+"#version 430 core\n"
+"layout (local_size_x = 64) in;\n"
+"struct StaticInstance {\n"
+"    mat4  model;\n"
+"    mat4  normal_matrix;\n"
+"    vec4  bbox_min;\n"
+"    vec4  bbox_max;\n"
+"    vec4  world_min;\n"
+"    vec4  world_max;\n"
+"    ivec4 material;\n"
+"    ivec4 texture_kd0;\n"
+"    ivec4 texture_kd1;\n"
+"};\n"
+"struct Draw {\n"
+"    uint count;\n"
+"    uint first_index;\n"
+"    int  base_vertex;\n"
+"    uint slot;\n"
+"};\n"
+"struct Command {\n"
+"    uint count;\n"
+"    uint instance_count;\n"
+"    uint first_index;\n"
+"    int  base_vertex;\n"
+"    uint base_instance;\n"
+"};\n"
+"layout (std430, binding = 0) readonly buffer StaticInstances { StaticInstance instances[]; };\n"
+"layout (std430, binding = 1) readonly buffer Draws { Draw draws[]; };\n"
+"layout (std430, binding = 2) writeonly buffer Commands { Command commands[]; };\n"
+"uniform uint num_draws;\n"
+"uniform vec4 planes[6];\n"
+"uniform bool use_hiz;\n"
+"uniform mat4 hiz_projection_view;\n"
+"uniform int hiz_levels;\n"
+"uniform sampler2D hiz;\n"
+"bool InsideFrustum(vec3 box_min, vec3 box_max)\n"
+"{\n"
+"    for (int i = 0; i < 6; ++i)\n"
+"    {\n"
+"        vec3 p = mix(box_min, box_max, step(vec3(0.0), planes[i].xyz));\n"
+"        if (dot(planes[i].xyz, p) + planes[i].w < 0.0)\n"
+"            return false;\n"
+"    }\n"
+"    return true;\n"
+"}\n"
+"bool VisibleHiZ(vec3 box_min, vec3 box_max)\n"
+"{\n"
+"    vec3 screen_min = vec3(1.0);\n"
+"    vec3 screen_max = vec3(0.0);\n"
+"    for (int i = 0; i < 8; ++i)\n"
+"    {\n"
+"        vec3 corner = mix(box_min, box_max, vec3(i & 1, (i >> 1) & 1, (i >> 2) & 1));\n"
+"        vec4 clip = hiz_projection_view * vec4(corner, 1.0);\n"
+"        if (clip.w <= 1e-6 || clip.z < -clip.w)\n"
+"            return true;\n"
+"        vec3 p = clip.xyz / clip.w * 0.5 + 0.5;\n"
+"        screen_min = min(screen_min, p);\n"
+"        screen_max = max(screen_max, p);\n"
+"    }\n"
+"    screen_min.xy = clamp(screen_min.xy, 0.0, 1.0);\n"
+"    screen_max.xy = clamp(screen_max.xy, 0.0, 1.0);\n"
+"    vec2 size = (screen_max.xy - screen_min.xy) * vec2(textureSize(hiz, 0));\n"
+"    int level = clamp(int(ceil(log2(max(max(size.x, size.y), 1.0)))), 0, hiz_levels - 1);\n"
+"    ivec2 p0, p1;\n"
+"    for (;;)\n"
+"    {\n"
+"        ivec2 level_size = textureSize(hiz, level);\n"
+"        p0 = clamp(ivec2(screen_min.xy * vec2(level_size)), ivec2(0), level_size - 1);\n"
+"        p1 = clamp(ivec2(screen_max.xy * vec2(level_size)), ivec2(0), level_size - 1);\n"
+"        if (level == hiz_levels - 1 || all(lessThanEqual(p1 - p0, ivec2(1))))\n"
+"            break;\n"
+"        level += 1;\n"
+"    }\n"
+"    float depth = 0.0;\n"
+"    for (int y = p0.y; y <= p1.y; ++y)\n"
+"        for (int x = p0.x; x <= p1.x; ++x)\n"
+"            depth = max(depth, texelFetch(hiz, ivec2(x, y), level).r);\n"
+"    return screen_min.z <= depth;\n"
+"}\n"
+"void main()\n"
+"{\n"
+"    uint i = gl_GlobalInvocationID.x;\n"
+"    if (i >= num_draws)\n"
+"        return;\n"
+"    Draw draw = draws[i];\n"
+"    vec3 box_min = instances[draw.slot].world_min.xyz;\n"
+"    vec3 box_max = instances[draw.slot].world_max.xyz;\n"
+"    bool visible = InsideFrustum(box_min, box_max) && (!use_hiz || VisibleHiZ(box_min, box_max));\n"
+"    commands[i].count          = draw.count;\n"
+"    commands[i].instance_count = visible ? 1u : 0u;\n"
+"    commands[i].first_index    = draw.first_index;\n"
+"    commands[i].base_vertex    = draw.base_vertex;\n"
+"    commands[i].base_instance  = draw.slot;\n"
+"}\n"
+"\0";
+
+// Constrói um nível da pirâmide Hi-Z a partir do nível anterior (ou do
+// Z-buffer, para o nível 0). Cada texel guarda a maior profundidade de todos
+// os texels do nível anterior que ele cobre; com tamanhos ímpares, isto
+// inclui uma terceira linha ou coluna.
+const GLchar* const gpudrivenreduceshader_source = ""
+"#version 430 core\n"
+"layout (local_size_x = 8, local_size_y = 8) in;\n"
+"layout (r32f, binding = 0) writeonly uniform image2D destination;\n"
+"uniform sampler2D source;\n"
+"uniform int source_level;\n"
+"void main()\n"
+"{\n"
+"    ivec2 p = ivec2(gl_GlobalInvocationID.xy);\n"
+"    ivec2 destination_size = imageSize(destination);\n"
+"    if (any(greaterThanEqual(p, destination_size)))\n"
+"        return;\n"
+"    ivec2 source_size = textureSize(source, source_level);\n"
+"    ivec2 first = (p * source_size) / destination_size;\n"
+"    ivec2 last  = min(((p + 1) * source_size + destination_size - 1) / destination_size - 1, source_size - 1);\n"
+"    float depth = 0.0;\n"
+"    for (int y = first.y; y <= last.y; ++y)\n"
+"        for (int x = first.x; x <= last.x; ++x)\n"
+"            depth = max(depth, texelFetch(source, ivec2(x, y), source_level).r);\n"
+"    imageStore(destination, p, vec4(depth));\n"
+"}\n"
+"\0";
+
+// Uma instância pedida no quadro, com o layout std430 de "Draw" no compute
+// shader de descarte.
+struct GpuDrivenDraw {
+    GLuint count;
+    GLuint first_index;
+    GLint  base_vertex;
+    GLuint slot;
+};
+
+// Layout de DrawElementsIndirectCommand, definido pelo OpenGL
+struct GpuDrivenCommand {
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint  base_vertex;
+    GLuint base_instance;
+};
+
+static std::vector<GpuDrivenInstance> g_GpuDrivenInstances; // Cópia do SSBO de instâncias
+static std::vector<GpuDrivenSlot>     g_FreeGpuDrivenSlots;
+static size_t                         g_GpuDrivenCapacity;
+
+// Instâncias pedidas neste quadro, separadas pelo tipo dos seus índices
+static std::vector<GpuDrivenDraw> g_GpuDrivenDraws16;
+static std::vector<GpuDrivenDraw> g_GpuDrivenDraws32;
+static std::vector<GpuDrivenDraw> g_GpuDrivenDraws;
+
+static GLuint g_GpuDrivenVAO;
+static GLuint g_GpuDrivenInstanceBuffer;  // SSBO com os GpuDrivenInstance
+static GLuint g_GpuDrivenSlotBuffer;      // Atributo por instância: 0, 1, 2, ...
+static GLuint g_GpuDrivenDrawBuffer;
+static GLuint g_GpuDrivenCommandBuffer;
+static size_t g_GpuDrivenCommandCapacity;
+
+static GLuint g_GpuDrivenCullProgram;
+static GLint  g_GpuDrivenNumDrawsUniform;
+static GLint  g_GpuDrivenPlanesUniform;
+static GLint  g_GpuDrivenUseHiZUniform;
+static GLint  g_GpuDrivenHiZProjectionViewUniform;
+static GLint  g_GpuDrivenHiZLevelsUniform;
+
+static GLuint g_GpuDrivenReduceProgram;
+static GLint  g_GpuDrivenSourceLevelUniform;
+
+// Cópia do Z-buffer e pirâmide Hi-Z, com metade da sua resolução no nível 0
+static GLuint    g_GpuDrivenDepthTexture;
+static GLuint    g_GpuDrivenHiZTexture;
+static int       g_GpuDrivenDepthWidth;
+static int       g_GpuDrivenDepthHeight;
+static int       g_GpuDrivenHiZLevels;
+static bool      g_GpuDrivenHiZValid;
+static bool      g_GpuDrivenHiZDisabled; // A cópia do Z-buffer falhou; Hi-Z desligado até o fim da execução
+static glm::mat4 g_GpuDrivenHiZProjectionView;
+
+bool GpuDriven_LoadFunctions(GLADloadproc load)
+{
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if ( major < 4 || (major == 4 && minor < 3) )
+        return false;
+
+    g_DispatchCompute           = (GpuDrivenDispatchComputeProc)load("glDispatchCompute");
+    g_MemoryBarrier             = (GpuDrivenMemoryBarrierProc)load("glMemoryBarrier");
+    g_BindImageTexture          = (GpuDrivenBindImageTextureProc)load("glBindImageTexture");
+    g_MultiDrawElementsIndirect = (GpuDrivenMultiDrawElementsIndirectProc)load("glMultiDrawElementsIndirect");
+
+    return g_DispatchCompute && g_MemoryBarrier && g_BindImageTexture && g_MultiDrawElementsIndirect;
+}
+
+static GLuint GpuDriven_CreateComputeProgram(const GLchar* const shader_string)
+{
+    GLuint shader_id = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(shader_id, 1, &shader_string, NULL);
+    glCompileShader(shader_id);
+
+    GLint compiled_ok;
+    glGetShaderiv(shader_id, GL_COMPILE_STATUS, &compiled_ok);
+    if ( !compiled_ok )
+    {
+        GLchar log[1024];
+        glGetShaderInfoLog(shader_id, sizeof(log), NULL, log);
+        fprintf(stderr, "ERROR: OpenGL compilation failed.\n== Start of compilation log\n%s== End of compilation log\n", log);
+    }
+
+    GLuint program_id = glCreateProgram();
+    glAttachShader(program_id, shader_id);
+    glLinkProgram(program_id);
+
+    GLint linked_ok;
+    glGetProgramiv(program_id, GL_LINK_STATUS, &linked_ok);
+    if ( !linked_ok )
+    {
+        GLchar log[1024];
+        glGetProgramInfoLog(program_id, sizeof(log), NULL, log);
+        fprintf(stderr, "ERROR: OpenGL linking of program failed.\n== Start of link log\n%s\n== End of link log\n", log);
+    }
+
+    glDeleteShader(shader_id);
+    return program_id;
+}
+
+// Aumenta o SSBO de instâncias e o buffer do atributo por instância para
+// "capacity" instâncias, reenviando as instâncias existentes.
+static void GpuDriven_Reserve(size_t capacity)
+{
+    if ( capacity <= g_GpuDrivenCapacity )
+        return;
+
+    capacity = std::max(capacity, 2 * g_GpuDrivenCapacity);
+
+    std::vector<GpuDrivenInstance> instances(g_GpuDrivenInstances);
+    instances.resize(capacity);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, g_GpuDrivenInstanceBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(GpuDrivenInstance), instances.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    // Com "baseInstance" igual à posição da instância e uma única instância
+    // por comando, o atributo (com divisor 1) lido pelo vertex shader é a
+    // própria posição.
+    std::vector<GLuint> slots(capacity);
+    for (size_t i = 0; i < capacity; ++i)
+        slots[i] = (GLuint)i;
+
+    glBindVertexArray(g_GpuDrivenVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, g_GpuDrivenSlotBuffer);
+    glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(GLuint), slots.data(), GL_STATIC_DRAW);
+    glVertexAttribIPointer(GPUDRIVEN_INSTANCE_ATTRIBUTE, 1, GL_UNSIGNED_INT, 0, 0);
+    glVertexAttribDivisor(GPUDRIVEN_INSTANCE_ATTRIBUTE, 1);
+    glEnableVertexAttribArray(GPUDRIVEN_INSTANCE_ATTRIBUTE);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glCheckError();
+
+    g_GpuDrivenCapacity = capacity;
+}
+
+void GpuDriven_Init(GLuint vertex_array)
+{
+    g_GpuDrivenVAO = vertex_array;
+
+    g_GpuDrivenCullProgram = GpuDriven_CreateComputeProgram(gpudrivencullshader_source);
+    g_GpuDrivenNumDrawsUniform          = glGetUniformLocation(g_GpuDrivenCullProgram, "num_draws");
+    g_GpuDrivenPlanesUniform            = glGetUniformLocation(g_GpuDrivenCullProgram, "planes");
+    g_GpuDrivenUseHiZUniform            = glGetUniformLocation(g_GpuDrivenCullProgram, "use_hiz");
+    g_GpuDrivenHiZProjectionViewUniform = glGetUniformLocation(g_GpuDrivenCullProgram, "hiz_projection_view");
+    g_GpuDrivenHiZLevelsUniform         = glGetUniformLocation(g_GpuDrivenCullProgram, "hiz_levels");
+
+    g_GpuDrivenReduceProgram = GpuDriven_CreateComputeProgram(gpudrivenreduceshader_source);
+    g_GpuDrivenSourceLevelUniform = glGetUniformLocation(g_GpuDrivenReduceProgram, "source_level");
+
+    // As duas texturas são lidas pela unidade de textura 0 (veja
+    // GpuDriven_Flush() e GpuDriven_UpdateDepth()).
+    glUseProgram(g_GpuDrivenCullProgram);
+    glUniform1i(glGetUniformLocation(g_GpuDrivenCullProgram, "hiz"), 0);
+    glUseProgram(g_GpuDrivenReduceProgram);
+    glUniform1i(glGetUniformLocation(g_GpuDrivenReduceProgram, "source"), 0);
+    glUseProgram(0);
+
+    glGenBuffers(1, &g_GpuDrivenInstanceBuffer);
+    glGenBuffers(1, &g_GpuDrivenSlotBuffer);
+    glGenBuffers(1, &g_GpuDrivenDrawBuffer);
+    glGenBuffers(1, &g_GpuDrivenCommandBuffer);
+    glGenTextures(1, &g_GpuDrivenDepthTexture);
+    glGenTextures(1, &g_GpuDrivenHiZTexture);
+    glCheckError();
+
+    GpuDriven_Reserve(256);
+}
+
+GpuDrivenSlot GpuDriven_Create()
+{
+    GpuDrivenSlot slot;
+    if ( !g_FreeGpuDrivenSlots.empty() )
+    {
+        slot = g_FreeGpuDrivenSlots.back();
+        g_FreeGpuDrivenSlots.pop_back();
+    }
+    else
+    {
+        slot = (GpuDrivenSlot)g_GpuDrivenInstances.size();
+        g_GpuDrivenInstances.push_back(GpuDrivenInstance());
+        GpuDriven_Reserve(g_GpuDrivenInstances.size());
+    }
+
+    // Preenchida com zeros, a instância difere de qualquer instância
+    // válida, e será enviada na primeira chamada a GpuDriven_SetInstance().
+    memset(&g_GpuDrivenInstances[slot], 0, sizeof(GpuDrivenInstance));
+    return slot;
+}
+
+void GpuDriven_Destroy(GpuDrivenSlot slot)
+{
+    g_FreeGpuDrivenSlots.push_back(slot);
+}
+
+void GpuDriven_SetInstance(GpuDrivenSlot slot, const GpuDrivenInstance& instance)
+{
+    if ( memcmp(&g_GpuDrivenInstances[slot], &instance, sizeof(GpuDrivenInstance)) == 0 )
+        return;
+
+    g_GpuDrivenInstances[slot] = instance;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, g_GpuDrivenInstanceBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, slot * sizeof(GpuDrivenInstance), sizeof(GpuDrivenInstance), &instance);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void GpuDriven_Draw(GpuDrivenSlot slot, GLenum index_type, GLuint count, GLuint first_index, GLint base_vertex)
+{
+    GpuDrivenDraw draw = { count, first_index, base_vertex, (GLuint)slot };
+    if ( index_type == GL_UNSIGNED_SHORT )
+        g_GpuDrivenDraws16.push_back(draw);
+    else
+        g_GpuDrivenDraws32.push_back(draw);
+}
+
+size_t GpuDriven_Flush(const Frustum& frustum, GLuint program)
+{
+    size_t num_draws16 = g_GpuDrivenDraws16.size();
+    size_t num_draws   = num_draws16 + g_GpuDrivenDraws32.size();
+    if ( num_draws == 0 )
+        return 0;
+
+    g_GpuDrivenDraws.assign(g_GpuDrivenDraws16.begin(), g_GpuDrivenDraws16.end());
+    g_GpuDrivenDraws.insert(g_GpuDrivenDraws.end(), g_GpuDrivenDraws32.begin(), g_GpuDrivenDraws32.end());
+    g_GpuDrivenDraws16.clear();
+    g_GpuDrivenDraws32.clear();
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, g_GpuDrivenDrawBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, num_draws * sizeof(GpuDrivenDraw), g_GpuDrivenDraws.data(), GL_STREAM_DRAW);
+    if ( num_draws > g_GpuDrivenCommandCapacity )
+    {
+        g_GpuDrivenCommandCapacity = std::max(num_draws, 2 * g_GpuDrivenCommandCapacity);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, g_GpuDrivenCommandBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, g_GpuDrivenCommandCapacity * sizeof(GpuDrivenCommand), NULL, GL_DYNAMIC_DRAW);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    GLint previous_program;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &previous_program);
+
+    // Descarte
+    glUseProgram(g_GpuDrivenCullProgram);
+    glUniform1ui(g_GpuDrivenNumDrawsUniform, (GLuint)num_draws);
+    glUniform4fv(g_GpuDrivenPlanesUniform, 6, glm::value_ptr(frustum.planes[0]));
+    glUniform1i(g_GpuDrivenUseHiZUniform, g_GpuDrivenHiZValid);
+    glUniformMatrix4fv(g_GpuDrivenHiZProjectionViewUniform, 1, GL_FALSE, glm::value_ptr(g_GpuDrivenHiZProjectionView));
+    glUniform1i(g_GpuDrivenHiZLevelsUniform, g_GpuDrivenHiZLevels);
+    GLint previous_unit, previous_texture;
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &previous_unit);
+    glActiveTexture(GL_TEXTURE0);
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous_texture);
+    glBindTexture(GL_TEXTURE_2D, g_GpuDrivenHiZTexture);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, g_GpuDrivenInstanceBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, g_GpuDrivenDrawBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, g_GpuDrivenCommandBuffer);
+    g_DispatchCompute((GLuint)(num_draws + 63) / 64, 1, 1);
+    g_MemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+    glBindTexture(GL_TEXTURE_2D, previous_texture);
+    glActiveTexture(previous_unit);
+
+    // Desenho: um glMultiDrawElementsIndirect() por tipo de índice
+    glUseProgram(program);
+    glBindVertexArray(g_GpuDrivenVAO);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, g_GpuDrivenCommandBuffer);
+    if ( num_draws16 > 0 )
+        g_MultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, (void*)0, (GLsizei)num_draws16, 0);
+    if ( num_draws > num_draws16 )
+        g_MultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(num_draws16 * sizeof(GpuDrivenCommand)), (GLsizei)(num_draws - num_draws16), 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    glUseProgram(previous_program);
+    glCheckError();
+
+    return num_draws;
+}
+
+// Formato da cópia do Z-buffer. glCopyTexSubImage2D() exige o mesmo formato
+// de profundidade (e de stencil) do framebuffer padrão, que depende do
+// driver: por exemplo, GL_DEPTH24_STENCIL8 quando a janela tem stencil.
+static void GpuDriven_DepthFormat(GLenum* internal_format, GLenum* format, GLenum* type)
+{
+    GLint depth_bits = 0, stencil_bits = 0, component_type = GL_UNSIGNED_NORMALIZED;
+    glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, GL_DEPTH, GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE, &depth_bits);
+    glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, GL_DEPTH, GL_FRAMEBUFFER_ATTACHMENT_COMPONENT_TYPE, &component_type);
+    glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, GL_STENCIL, GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE, &stencil_bits);
+
+    if ( component_type == GL_FLOAT )
+    {
+        *internal_format = stencil_bits > 0 ? GL_DEPTH32F_STENCIL8 : GL_DEPTH_COMPONENT32F;
+        *format          = stencil_bits > 0 ? GL_DEPTH_STENCIL : GL_DEPTH_COMPONENT;
+        *type            = stencil_bits > 0 ? GL_FLOAT_32_UNSIGNED_INT_24_8_REV : GL_FLOAT;
+    }
+    else if ( stencil_bits > 0 )
+    {
+        *internal_format = GL_DEPTH24_STENCIL8;
+        *format          = GL_DEPTH_STENCIL;
+        *type            = GL_UNSIGNED_INT_24_8;
+    }
+    else
+    {
+        *internal_format = depth_bits == 16 ? GL_DEPTH_COMPONENT16 : depth_bits == 32 ? GL_DEPTH_COMPONENT32 : GL_DEPTH_COMPONENT24;
+        *format          = GL_DEPTH_COMPONENT;
+        *type            = GL_UNSIGNED_INT;
+    }
+}
+
+void GpuDriven_UpdateDepth(const glm::mat4& projection_view, int width, int height)
+{
+    if ( g_GpuDrivenHiZDisabled || width < 2 || height < 2 )
+    {
+        g_GpuDrivenHiZValid = false;
+        return;
+    }
+
+    GLint previous_unit, previous_texture;
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &previous_unit);
+    glActiveTexture(GL_TEXTURE0);
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous_texture);
+
+    if ( width != g_GpuDrivenDepthWidth || height != g_GpuDrivenDepthHeight )
+    {
+        g_GpuDrivenDepthWidth  = width;
+        g_GpuDrivenDepthHeight = height;
+
+        GLenum internal_format, format, type;
+        GpuDriven_DepthFormat(&internal_format, &format, &type);
+
+        // Com stencil, a textura é lida como profundidade (o padrão de
+        // GL_DEPTH_STENCIL_TEXTURE_MODE).
+        glBindTexture(GL_TEXTURE_2D, g_GpuDrivenDepthTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format, type, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+
+        // Níveis da pirâmide, do nível 0 (metade do Z-buffer) até 1x1
+        int level_width  = std::max(1, width / 2);
+        int level_height = std::max(1, height / 2);
+        g_GpuDrivenHiZLevels = 0;
+        glBindTexture(GL_TEXTURE_2D, g_GpuDrivenHiZTexture);
+        for (;;)
+        {
+            glTexImage2D(GL_TEXTURE_2D, g_GpuDrivenHiZLevels, GL_R32F, level_width, level_height, 0, GL_RED, GL_FLOAT, NULL);
+            g_GpuDrivenHiZLevels += 1;
+            if ( level_width == 1 && level_height == 1 )
+                break;
+            level_width  = std::max(1, level_width / 2);
+            level_height = std::max(1, level_height / 2);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, g_GpuDrivenHiZLevels - 1);
+    }
+
+    // Cópia do Z-buffer do framebuffer padrão. Erros anteriores são
+    // informados antes, para que não sejam confundidos com os da cópia. Se
+    // mesmo assim o driver recusar a cópia, o Hi-Z é desligado, e a GPU
+    // passa a descartar somente pelo frustum.
+    glCheckError();
+    glBindTexture(GL_TEXTURE_2D, g_GpuDrivenDepthTexture);
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
+    if ( glGetError() != GL_NO_ERROR )
+    {
+        fprintf(stderr, "WARNING: cópia do Z-buffer para o Hi-Z falhou; Hi-Z desligado.\n");
+        g_GpuDrivenHiZDisabled = true;
+        g_GpuDrivenHiZValid = false;
+        glBindTexture(GL_TEXTURE_2D, previous_texture);
+        glActiveTexture(previous_unit);
+        return;
+    }
+
+    // Redução, nível por nível
+    GLint previous_program;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &previous_program);
+    glUseProgram(g_GpuDrivenReduceProgram);
+
+    int level_width  = std::max(1, width / 2);
+    int level_height = std::max(1, height / 2);
+    for (int level = 0; level < g_GpuDrivenHiZLevels; ++level)
+    {
+        glBindTexture(GL_TEXTURE_2D, level == 0 ? g_GpuDrivenDepthTexture : g_GpuDrivenHiZTexture);
+        glUniform1i(g_GpuDrivenSourceLevelUniform, level == 0 ? 0 : level - 1);
+        g_BindImageTexture(0, g_GpuDrivenHiZTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        g_DispatchCompute((GLuint)(level_width + 7) / 8, (GLuint)(level_height + 7) / 8, 1);
+        g_MemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+        level_width  = std::max(1, level_width / 2);
+        level_height = std::max(1, level_height / 2);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, previous_texture);
+    glActiveTexture(previous_unit);
+    glUseProgram(previous_program);
+    glCheckError();
+
+    g_GpuDrivenHiZProjectionView = projection_view;
+    g_GpuDrivenHiZValid = true;
+}
@@ -17,12 +17,16 @@
 //    #include <cstdio> // Em C++
 //
 #include <cmath>
+#include <cstddef>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
 
 // Headers abaixo são específicos de C++
 #include <map>
+#include <set>
+#include <unordered_map>
 #include <stack>
 #include <string>
 #include <vector>
@@ -31,6 +35,7 @@
 #include <sstream>
 #include <stdexcept>
 #include <algorithm>
+#include <memory>
 
 // Headers das bibliotecas OpenGL
 #include <glad/glad.h>   // Criação de contexto OpenGL 3.3
@@ -50,6 +55,28 @@
 #include "utils.h"
 #include "matrices.h"
 #include "collisions.hpp"
+#include "meshcache.hpp"
+#include "assetloader.hpp"
+#include "meshopt.hpp"
+#include "meshlod.hpp"
+#include "vertexformat.hpp"
+#include "gpuarena.hpp"
+#include "residency.hpp"
+#include "texturecache.hpp"
+#include "texturecompress.hpp"
+#include "texturearray.hpp"
+#include "frustum.hpp"
+#include "scenebvh.hpp"
+#include "occlusion.hpp"
+#include "softocclusion.hpp"
+#include "pvs.hpp"
+#include "gpudriven.hpp"
+#include "staticbatch.hpp"
+#include "renderqueue.hpp"
+#include "uniformbuffer.hpp"
+#include "shaderpermutation.hpp"
+#include "programcache.hpp"
+#include "shaderreload.hpp"
 
 // Constantes
 #define VelocidadeBase 12.0f
@@ -121,6 +148,23 @@ struct ObjModel
     }
 };
 
+// Textura comprimida lida do cache, ou gerada a partir de uma imagem, ainda
+// não enviada para a GPU. Veja LoadTextureImage().
+struct LoadedTexture
+{
+    bool             from_cache;
+    TextureCacheFile cache;   // Válido se from_cache == true
+    TextureData      texture; // Válido se from_cache == false
+};
+
+// Malha lida de um arquivo ".obj" ou de seu cache, ainda não enviada para a
+// GPU. Veja LoadObjModelToVirtualScene().
+struct LoadedMesh
+{
+    bool          from_cache;
+    MeshCacheFile cache; // Válido se from_cache == true
+    MeshData      mesh;  // Válido se from_cache == false
+};
 
 // Declaração de funções utilizadas para pilha de matrizes de modelagem.
 void PushMatrix(glm::mat4 M);
@@ -128,20 +172,56 @@ void PopMatrix(glm::mat4& M);
 
 // Declaração de várias funções utilizadas em main().  Essas estão definidas
 // logo após a definição de main() neste arquivo.
-void BuildTrianglesAndAddToVirtualScene(ObjModel*); // Constrói representação de um ObjModel como malha de triângulos para renderização
+void LoadObjModelToVirtualScene(const char* filename); // Carrega um arquivo ".obj" (ou seu cache binário) e adiciona seus objetos em g_VirtualScene
+void LoadMesh(const char* filename, LoadedMesh* loaded); // Etapa de LoadObjModelToVirtualScene() executada em uma thread auxiliar
+void UploadMesh(const char* filename, LoadedMesh* loaded); // Etapa de LoadObjModelToVirtualScene() executada na thread do contexto OpenGL
+void CookObjModel(ObjModel* model, MeshData* mesh); // Constrói os vetores prontos para a GPU a partir de um ObjModel
+void BuildTrianglesAndAddToVirtualScene(const MeshView& mesh); // Envia uma malha de triângulos para a GPU e adiciona seus objetos em g_VirtualScene
+void InitSceneArenas(); // Cria as arenas de vértices e índices da cena e o seu VAO
+void UnloadSceneMesh(size_t mesh_id); // Remove um modelo da GPU e seus objetos de g_VirtualScene
+void AcquireSceneDrawables(); // Registra as referências de g_SceneDrawables aos modelos e texturas
+void ReleaseSceneDrawables(); // Desfaz as referências registradas por AcquireSceneDrawables()
+void InitObjectMaterials(); // Define as texturas de cada objeto (g_ObjectMaterials)
+void SetObjectMaterial(int object_id); // Define o "object_id" do próximo objeto desenhado por DrawVirtualObject()
+void SetModelMatrix(const glm::mat4& model); // Define a matriz "model" do próximo objeto desenhado por DrawVirtualObject()
+struct DrawUniforms;
+DrawUniforms MakeDrawUniforms(const glm::mat4& model, int object_id, const glm::vec3& bbox_min, const glm::vec3& bbox_max, bool quantized_vertices); // Preenche o bloco "DrawUniforms" de um desenho
+void BindDrawUniforms(const DrawUniforms& draw); // Envia o bloco "DrawUniforms" de um desenho para g_UniformRing e o liga
+void UploadFrameUniforms(const glm::mat4& view, const glm::mat4& projection); // Envia o bloco "FrameUniforms" para g_UniformRing e o liga
+void FindVisibleSceneInstances(); // Consulta g_SceneBvh com o frustum da câmera
+void RasterizeSceneOccluders(const glm::mat4& projection_view, const glm::vec3& view_position); // Prepara o descarte por oclusão na CPU
+void ValidatePvs();  // Procura instâncias descartadas incorretamente pelo PVS
+void BakeScenePvs(); // Calcula o PVS e grava em g_PvsFilename
+void CheckScenePvs(); // Confere se o PVS lido corresponde à cena
+void GatherScenePvsInput(std::vector<PvsEntry>* entries, std::vector<PvsOccluder>* occluders); // Instâncias estáticas e oclusores do quadro atual
+void UpdateSceneVertexArray(); // Atualiza o VAO da cena após mudanças nos buffers das arenas
+void ParseCommandLine(int argc, char* argv[], std::vector<const char*>* model_filenames); // Aplica as opções da linha de comando
 void ComputeNormals(ObjModel* model); // Computa normais de um ObjModel, caso não existam.
 void LoadShadersFromFiles(); // Carrega os shaders de vértice e fragmento, criando um programa de GPU
+void SetupSceneProgram(GLuint program_id); // Liga os blocos de uniforms e as unidades de textura de um programa da cena
+GLuint GetMaterialProgram(int object_id, bool flat); // Programa de GPU especializado para o material de um objeto
+void PrecompileMaterialPrograms(); // Compila os programas de todos os materiais antes do primeiro quadro
+void UpdateShaderReload(); // Recarrega os shaders modificados, sem interromper os desenhos
+void BeginShaderReload(); // Pede ao driver a compilação de todos os programas da cena a partir dos arquivos
+void BeginShaderReloadTarget(GLuint* program_id, uint32_t permutation_key, const std::string& vertex_source, const std::string& fragment_source); // Compilação de um dos programas acima
+void CancelShaderReload(); // Descarta os programas ainda em compilação
+void ApplyShaderReload(); // Substitui os programas da cena pelos recém-compilados
 void LoadTextureImage(const char* filename); // Função que carrega imagens de textura
+void DecodeTextureImage(const char* filename, LoadedTexture* loaded); // Etapa de LoadTextureImage() executada em uma thread auxiliar
+void UploadTextureImage(const char* filename, LoadedTexture* loaded); // Etapa de LoadTextureImage() executada na thread do contexto OpenGL
 void DrawVirtualObject(const char* object_name); // Desenha um objeto armazenado em g_VirtualScene
-GLuint LoadShader_Vertex(const char* filename);   // Carrega um vertex shader
-GLuint LoadShader_Fragment(const char* filename); // Carrega um fragment shader
-void LoadShader(const char* filename, GLuint shader_id); // Função utilizada pelas duas acima
+std::string LoadShaderSource(const char* filename, const char* header); // Lê o código de um shader, substituindo a diretiva "#version" por "header"
+bool ReadShaderSource(const char* filename, const char* header, std::string* source); // Idem, retornando false se o arquivo não pode ser lido
+void CompileShader(const char* filename, const std::string& source, GLuint shader_id); // Compila o código de um shader
+GLuint LoadGpuProgram(const char* vertex_filename, const char* vertex_header, const char* fragment_filename, const char* fragment_header); // Cria um programa de GPU a partir de arquivos, usando o cache de programas
 GLuint CreateGpuProgram(GLuint vertex_shader_id, GLuint fragment_shader_id); // Cria um programa de GPU
 void PrintObjModelInfo(ObjModel*); // Função para debugging
 
 // Declaração de funções auxiliares para renderizar texto dentro da janela
 // OpenGL. Estas funções estão definidas no arquivo "textrendering.cpp".
 void TextRendering_Init();
+void TextRendering_SetWindowSize(int width, int height);
+void TextRendering_Flush();
 float TextRendering_LineHeight(GLFWwindow* window);
 float TextRendering_CharWidth(GLFWwindow* window);
 void TextRendering_PrintString(GLFWwindow* window, const std::string &str, float x, float y, float scale = 1.0f);
@@ -178,12 +258,79 @@ void DrawCashierDialog(GLFWwindow* window);
 struct SceneObject
 {
     std::string  name;        // Nome do objeto
-    size_t       first_index; // Índice do primeiro vértice dentro do vetor indices[] definido em BuildTrianglesAndAddToVirtualScene()
-    size_t       num_indices; // Número de índices do objeto dentro do vetor indices[] definido em BuildTrianglesAndAddToVirtualScene()
+    size_t       mesh_id;     // Modelo (posição em g_SceneMeshes) ao qual o objeto pertence
+    size_t       index_offset; // Posição (em bytes) do primeiro índice do objeto dentro do bloco de índices do seu modelo
+    size_t       num_indices; // Número de índices do objeto
+    GLenum       index_type;  // Tipo dos índices: GL_UNSIGNED_SHORT ou GL_UNSIGNED_INT
+    GLint        base_vertex; // Primeiro vértice do objeto dentro do bloco de vértices do seu modelo (veja glDrawElementsBaseVertex())
+    size_t       num_vertices; // Número de vértices (sem repetição) do objeto
+    bool         quantized_vertices; // Vértices no formato compacto de "vertexformat.hpp"
     GLenum       rendering_mode; // Modo de rasterização (GL_TRIANGLES, GL_TRIANGLE_STRIP, etc.)
     GLuint       vertex_array_object_id; // ID do VAO onde estão armazenados os atributos do modelo
     glm::vec3    bbox_min; // Axis-Aligned Bounding Box do objeto
     glm::vec3    bbox_max;
+    std::vector<MeshLod> lods; // Níveis de detalhe simplificados (veja "meshlod.hpp"), com posições relativas ao bloco de índices do modelo
+    bool         occluder;    // Oclusor para o descarte na CPU (veja g_SceneDrawables e RasterizeSceneOccluders())
+    bool         static_world; // Parte do cenário estático, desenhada pelo caminho de "gpudriven.hpp" ou agrupada por "staticbatch.hpp"
+
+    // Cópia na memória principal da malha original, no formato com floats e
+    // com índices relativos ao primeiro vértice do objeto, usada para montar
+    // os grupos de g_StaticBatch. Somente objetos estáticos sem níveis de
+    // detalhe (os únicos agrupados) têm esta cópia.
+    std::vector<FloatVertex> batch_vertices;
+    std::vector<uint32_t>    batch_indices;
+
+    // Instâncias do objeto (posições em g_SceneInstances). Cada chamada a
+    // DrawVirtualObject() dentro de um quadro desenha uma instância, e as
+    // instâncias são identificadas pela ordem destas chamadas.
+    std::vector<size_t> instances;
+    unsigned     instance_frame; // Quadro (g_FrameIndex) do último desenho
+    size_t       next_instance;  // Próxima instância a ser desenhada neste quadro
+};
+
+void DrawObjectLevel(const SceneObject& object, int level, GLsizei num_instances = 0); // Desenha um nível de detalhe de um objeto, sem descarte
+size_t AddInstanceToBatch(const SceneObject& object, int level, int object_id, const glm::mat4& model, size_t position); // Guarda uma instância em g_InstanceBatches
+void BeginInstancedDraws(); // Envia as matrizes de g_InstanceBatches e liga os atributos das instâncias
+void DrawInstanceBatch(size_t i); // Desenha um grupo de g_InstanceBatches com uma única chamada
+void EndInstancedDraws();   // Desliga os atributos das instâncias e esvazia g_InstanceBatches
+void GetObjectLevelRange(const SceneObject& object, int level, GLuint* count, size_t* index_offset, GLint* base_vertex); // Índices de um nível de detalhe nas arenas
+void BuildStaticBatches();   // Agrupa as instâncias de g_StaticBatchCapture em g_StaticBatch
+void DestroyStaticBatches(); // Desfaz os grupos de g_StaticBatch
+void SubmitStaticBatches();  // Descarta os grupos de g_StaticBatch e os envia para g_RenderQueue
+void UpdateStaticBatches();  // Monta novamente os grupos de g_StaticBatch que mudaram
+void FlushRenderQueue();     // Ordena e desenha os pacotes de g_RenderQueue
+void BeginRenderPass(RenderPass pass); // Define o estado do OpenGL de um passo de g_RenderQueue
+void EndRenderPass(RenderPass pass);   // Restaura o estado do OpenGL após um passo
+
+// Estado de uma instância de um objeto da cena, mantido entre quadros.
+struct SceneInstance
+{
+    const SceneObject* object;   // Objeto da instância (em g_VirtualScene)
+    SceneBvhProxy proxy;         // Folha em g_SceneBvh, ou SCENEBVH_INVALID_PROXY se a instância não está na árvore
+    int           lod;           // Nível de detalhe atual (veja SelectObjectLod())
+    unsigned      visible_frame; // Último quadro em que a instância foi encontrada no frustum por SceneBvh_QueryFrustum()
+    unsigned      drawn_frame;   // Último quadro em que a instância foi desenhada
+    OcclusionId   occlusion;     // Estado dos testes de oclusão (veja "occlusion.hpp"), ou OCCLUSION_INVALID_ID
+    int           pvs_entry;     // Instância correspondente em g_Pvs, ou -1
+    glm::vec3     world_min;     // AABB, em coordenadas globais, do último desenho
+    glm::vec3     world_max;
+    GpuDrivenSlot gpu_slot;      // Instância em "gpudriven.hpp", ou GPUDRIVEN_INVALID_SLOT
+    glm::mat4     last_model;    // Matriz "model" e "object_id" do último desenho
+    int           last_object_id;
+    int           static_chunk;  // Grupo em g_StaticBatch.chunks que contém a instância, ou -1
+    unsigned      batched_frame; // Último quadro em que a instância foi deixada para o seu grupo
+};
+
+bool StaticInstanceVisible(const SceneInstance& instance); // Descartes de uma instância pela AABB do último desenho
+
+// Modelo (arquivo ".obj") enviado para a GPU: blocos com seus vértices e
+// índices nas arenas g_VertexArena e g_IndexArena, e os nomes dos seus
+// objetos em g_VirtualScene.
+struct SceneMesh
+{
+    GpuArenaHandle           vertex_block;
+    GpuArenaHandle           index_block;
+    std::vector<std::string> objects;
 };
 
 // Abaixo definimos variáveis globais utilizadas em várias funções do código.
@@ -194,12 +341,65 @@ struct SceneObject
 // estes são acessados.
 std::map<std::string, SceneObject> g_VirtualScene;
 
+// Modelos enviados para a GPU, e as arenas onde estão armazenados seus
+// vértices e índices. Todos os objetos são desenhados com o VAO g_SceneVAO.
+std::vector<SceneMesh> g_SceneMeshes;
+GpuArena g_VertexArena;
+GpuArena g_IndexArena;
+GLuint   g_SceneVAO = 0;
+unsigned g_SceneVAOVertexGeneration; // Versões dos buffers das arenas apontadas pelo VAO
+unsigned g_SceneVAOIndexGeneration;
+
+// Objetos desenhados pelo laço de renderização em main(), com o arquivo
+// ".obj" de onde vêm e as imagens de textura que o fragment shader usa para
+// desenhá-los (veja "shader_fragment.glsl"). Cada entrada é uma referência a
+// estes recursos (veja "residency.hpp"); modelos e texturas que não aparecem
+// aqui não são carregados. Ao adicionar um novo objeto ao laço de
+// renderização, adicione-o também nesta tabela.
+//
+// Prédios fechados por paredes são marcados como oclusores para o descarte
+// na CPU (veja RasterizeSceneOccluders()). O posto de gasolina, aberto sob a
+// cobertura, não é. Os objetos do cenário que nunca se movem (chão,
+// calçadas, postes e construções) são marcados como estáticos, e podem ser
+// desenhados pela GPU (veja g_UseGpuDriven).
+struct SceneDrawable
+{
+    const char* object;
+    const char* model;
+    const char* textures[4];
+    bool        occluder;
+    bool        static_world;
+};
+
+static const SceneDrawable g_SceneDrawables[] = {
+    { "the_sphere",        "../../data/sphere.obj",     { "../../data/tc-earth_daymap_surface.jpg", "../../data/tc-earth_nightmap_citylights.gif", // SPHERE
+                                                          "../../data/TexturaLua.jpg", "../../data/ceuEstrelado.jpg" } },                                // LUA, SKY
+    { "the_bunny",         "../../data/bunny.obj",      { "../../data/goldTexture.jpg" } },
+    { "the_plane",         "../../data/plane.obj",      { "../../data/asfalto.png", "../../data/grassTexture.png" }, false, true },
+    { "the_mainbuild",     "../../data/mainbuild.obj",  { "../../data/oldWallTexture.jpg" }, true, true },
+    { "calcada",           "../../data/calcada.obj",    { "../../data/texturaCalcada.png" }, false, true },
+    { "the_baguete",       "../../data/baguete.obj",    { "../../data/baguete_COLOR.png" } },
+    { "the_eggs",          "../../data/eggs.obj",       { "../../data/tc-earth_daymap_surface.jpg", "../../data/tc-earth_nightmap_citylights.gif" } },
+    { "the_butter",        "../../data/butter.obj",     { "../../data/queijo.jpg" } },
+    { "the_cheese",        "../../data/cheese.obj",     { "../../data/goldTexture.jpg" } },
+    { "the_pole",          "../../data/pole.obj",       { "../../data/poleTexture.png" }, false, true },
+    { "the_smallHouse",    "../../data/smallHouse.obj", { "../../data/smallHouseTexture.jpg" }, true, true },
+    { "the_gasstation",    "../../data/gasStation.obj", { "../../data/gasStationTexture.jpg" }, false, true },
+    { "myHouse",           "../../data/myhouse.obj",    { "../../data/myhouseTexture.png" }, true, true },
+    { "the_longhouse",     "../../data/longHouse.obj",  { "../../data/longHouseTexture.jpg" }, true, true },
+    { "the_woodhouse",     "../../data/woodhouse.obj",  { "../../data/woodHouseTexture.png" }, true, true },
+    { "maquina_pagamento", "../../data/maquina.obj",    { "../../data/maquinaTextura.png" }, false, true },
+};
+
 // Pilha que guardará as matrizes de modelagem.
 std::stack<glm::mat4>  g_MatrixStack;
 
 // Razão de proporção da janela (largura/altura). Veja função FramebufferSizeCallback().
 float g_ScreenRatio = 1.0f;
 
+// Altura da janela, em pixels. Veja função FramebufferSizeCallback().
+int g_ScreenHeight = 600;
+
 // Ângulos de Euler que controlam a rotação de um dos cubos da cena virtual
 float g_AngleX = 0.0f;
 float g_AngleY = 0.0f;
@@ -235,15 +435,301 @@ bool g_ShowInfoText = true;
 
 // Variáveis que definem um programa de GPU (shaders). Veja função LoadShadersFromFiles().
 GLuint g_GpuProgramID = 0;
-GLint g_model_uniform;
-GLint g_view_uniform;
-GLint g_projection_uniform;
-GLint g_object_id_uniform;
-GLint g_bbox_min_uniform;
-GLint g_bbox_max_uniform;
 
-// Número de texturas carregadas pela função LoadTextureImage()
-GLuint g_NumLoadedTextures = 0;
+// Blocos de uniforms dos shaders, com o layout std140 de "shader_vertex.glsl"
+// e "shader_fragment.glsl". Os dados do quadro (FrameUniforms) são enviados
+// uma vez por quadro; os de cada desenho (DrawUniforms) são copiados para um
+// trecho de g_UniformRing, ligado antes do desenho. Os blocos são ligados
+// aos "binding points" abaixo em LoadShadersFromFiles().
+#define FRAME_UNIFORMS_BINDING 0
+#define DRAW_UNIFORMS_BINDING  1
+
+struct FrameUniforms
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec4 camera_position; // Posição da câmera, em coordenadas globais
+    glm::vec4 light_direction; // Sentido da fonte de luz, em coordenadas globais
+    glm::vec4 time;            // (segundos desde o início do programa, 0, 0, 0)
+};
+
+struct DrawUniforms
+{
+    glm::mat4  model;
+    glm::mat4  normal_matrix;  // Inversa da transposta de "model"
+    glm::vec4  bbox_min;       // AABB do objeto, no sistema de coordenadas do modelo
+    glm::vec4  bbox_max;
+    glm::ivec4 material;       // (object_id, quantized_vertices, use_color_override, instanced)
+    glm::ivec4 texture_kd0;    // (array, camada, menor nível de mipmap, mapeamento UV). Veja "texturearray.hpp".
+    glm::ivec4 texture_kd1;
+    glm::vec4  color_override; // Cor dos destaques (RENDERPASS_HIGHLIGHT)
+};
+
+UniformRing   g_UniformRing;
+size_t        g_UniformRingSize = 4 * 1024 * 1024;
+FrameUniforms g_FrameUniforms;
+unsigned      g_FrameUniformsGeneration = 0; // Valor de g_UniformRing.generation quando o bloco do quadro foi enviado
+glm::vec4     g_LightDirection = glm::vec4(0.70710678f, 0.70710678f, 0.0f, 0.0f); // normalize((1,1,0,0))
+
+// Se verdadeiro, a GPU suporta texturas comprimidas nos formatos S3TC
+// (BC1/BC3) e as texturas são enviadas comprimidas; senão, cada nível é
+// descomprimido antes do envio (veja "texturearray.hpp").
+bool g_TextureCompressionSupported = false;
+
+// Texturas e mapeamento das coordenadas de textura de cada objeto,
+// indexados pelo seu "object_id". Veja InitObjectMaterials().
+struct ObjectMaterial
+{
+    TextureHandle kd0;
+    TextureHandle kd1; // TEXTUREARRAY_INVALID_HANDLE para objetos com uma única textura
+    ShaderUvMode  uv_mode;
+};
+std::vector<ObjectMaterial> g_ObjectMaterials;
+
+// Permutações do fragment shader da cena (veja "shaderpermutation.hpp"). Cada
+// pacote de g_RenderQueue é desenhado com o programa especializado para o
+// seu material (veja GetMaterialProgram()), de forma que a ordenação da fila
+// agrupa os desenhos por permutação. Desligado com a opção
+// "--no-shader-permutations", que desenha tudo com g_GpuProgramID.
+ShaderPermutationCache g_ShaderPermutations;
+bool                   g_UseShaderPermutations = true;
+
+// Recarga dos shaders durante a execução (veja "shaderreload.hpp"). A tecla R,
+// ou a gravação de um dos arquivos observados por g_ShaderWatcher, pede uma
+// recarga. Os novos programas são compilados enquanto os anteriores continuam
+// em uso, e só os substituem quando todos foram linkados com sucesso (veja
+// UpdateShaderReload()).
+struct ShaderReloadTarget
+{
+    GLuint*        program_id;      // Programa substituído (g_GpuProgramID ou g_GpuDrivenProgramID), ou NULL para uma permutação
+    uint32_t       permutation_key; // Chave em g_ShaderPermutations, se "program_id" é NULL
+    uint64_t       cache_key;       // Chave no cache de programas
+    bool           from_cache;      // Programa lido do cache, sem compilação
+    PendingProgram pending;
+};
+ShaderWatcher                   g_ShaderWatcher;
+std::vector<ShaderReloadTarget> g_ShaderReloadTargets; // Programas em compilação
+bool                            g_ShaderReloadRequested = false;
+double                          g_ShaderReloadStart = 0.0;
+
+// Cache de programas de GPU (veja "programcache.hpp"), gravado em
+// g_ProgramCacheFilename ao final do programa. Desligado com a opção
+// "--no-program-cache", ou se o driver não suporta binários de programas.
+const char* g_ProgramCacheFilename = "../../data/shaders.progcache";
+bool        g_UseProgramCache = true;
+
+// "object_id" passado para a última chamada de SetObjectMaterial().
+int g_CurrentObjectId = 0;
+
+// Matriz "model" passada para a última chamada de SetModelMatrix(), e
+// matrizes da câmera do quadro atual, usadas para estimar o tamanho na tela
+// de cada objeto desenhado (veja DrawVirtualObject()).
+glm::mat4 g_ModelMatrix;
+glm::mat4 g_ViewMatrix;
+glm::mat4 g_ProjectionMatrix;
+
+// Número máximo de bytes de níveis de mipmap enviados para a GPU a cada
+// quadro. Veja TextureArray_Stream().
+size_t g_TextureStreamBudget = 1024*1024;
+
+// Se verdadeiro, os vértices dos modelos são enviados para a GPU no formato
+// compacto de "vertexformat.hpp" (16 bytes por vértice); senão, como floats
+// (40 bytes por vértice). Pode ser desligado com a opção "--float-vertices"
+// na linha de comando, para comparação.
+bool g_UseQuantizedVertices = true;
+
+// Total de bytes de atributos de vértices enviados para a GPU por
+// BuildTrianglesAndAddToVirtualScene()
+size_t g_VertexBufferBytes = 0;
+
+// Se verdadeiro, objetos distantes são desenhados com os níveis de detalhe
+// simplificados gerados por CookObjModel(). Pode ser desligado com a opção
+// "--no-lod" na linha de comando, para comparação.
+bool g_UseMeshLods = true;
+
+// Erro máximo, em pixels, de um nível de detalhe na tela. Um nível menos
+// detalhado só é escolhido quando o seu erro projetado é menor que
+// (1 - g_LodHysteresis) vezes este valor, para que objetos próximos da
+// distância de transição não troquem de nível a cada quadro.
+float g_LodPixelError = 1.0f;
+float g_LodHysteresis = 0.25f;
+
+// Número do quadro atual, e número de triângulos desenhados no quadro por
+// DrawVirtualObject().
+unsigned g_FrameIndex = 0;
+size_t   g_TrianglesDrawn = 0;
+
+// Todas as instâncias desenhadas (veja SceneObject::instances), e as
+// posições livres do vetor. Cada instância é uma folha da hierarquia de
+// volumes envolventes g_SceneBvh, atualizada a cada desenho, que é
+// consultada uma vez por quadro para encontrar as instâncias dentro do
+// frustum da câmera. Veja "scenebvh.hpp".
+std::vector<SceneInstance> g_SceneInstances;
+std::vector<size_t>        g_FreeSceneInstances;
+SceneBvh                   g_SceneBvh;
+
+// Frustum da câmera no quadro atual, e número de objetos desenhados e
+// descartados por estarem fora dele (veja DrawVirtualObject()). O descarte
+// pode ser desligado com a opção "--no-cull" na linha de comando, para
+// comparação.
+Frustum g_ViewFrustum;
+bool    g_UseFrustumCulling = true;
+size_t  g_ObjectsVisible = 0;
+size_t  g_ObjectsCulled = 0;
+
+// Descarte de objetos escondidos atrás de outros (veja "occlusion.hpp"),
+// desligado com a opção "--no-occlusion"; número de objetos descartados e de
+// consultas de oclusão enviadas no quadro atual.
+bool    g_UseOcclusionCulling = true;
+size_t  g_ObjectsOccluded = 0;
+size_t  g_OcclusionQueries = 0;
+
+// Descarte por oclusão na CPU (veja "softocclusion.hpp"), desligado com a
+// opção "--no-soft-occlusion". O oclusor de cada instância de um objeto
+// marcado em g_SceneDrawables é uma caixa dentro da sua AABB, no sistema de
+// coordenadas do modelo: com uma fração g_OccluderWidth da largura e da
+// profundidade, centrada, e uma fração g_OccluderHeight da altura, a partir
+// da base, abaixo do telhado. Os oclusores de um quadro são os prédios
+// desenhados no quadro anterior, pois as matrizes "model" são definidas
+// somente no laço de renderização.
+struct SceneOccluder
+{
+    glm::mat4 model;
+    glm::vec3 bbox_min;
+    glm::vec3 bbox_max;
+};
+std::vector<SceneOccluder> g_SceneOccluders;
+std::vector<SceneOccluder> g_NextSceneOccluders;
+bool    g_UseSoftwareOcclusion = true;
+float   g_OccluderWidth  = 0.7f;
+float   g_OccluderHeight = 0.6f;
+size_t  g_ObjectsOccludedCpu = 0;
+
+// Conjuntos potencialmente visíveis (veja "pvs.hpp") da área por onde a
+// câmera anda, lidos de g_PvsFilename. As instâncias dos objetos estáticos
+// (veja g_SceneDrawables) desenhadas no primeiro quadro são as instâncias do
+// PVS; as demais nunca são descartadas por ele. O arquivo só é usado a
+// partir do segundo quadro, se corresponder às instâncias e oclusores do
+// primeiro (veja CheckScenePvs()). Durante o desenho, uma instância só é
+// descartada pelo PVS enquanto a sua AABB estiver dentro da AABB calculada
+// (aumentada por g_PvsMargin). Opções na linha de comando:
+//
+//   --bake-pvs:     recalcula o arquivo a partir do primeiro quadro e
+//                   encerra o programa;
+//   --validate-pvs: desenha, sem alterar a imagem, as instâncias descartadas
+//                   pelo PVS, e informa no terminal as que teriam pixels
+//                   visíveis (veja ValidatePvs());
+//   --no-pvs:       desliga o descarte.
+const char* g_PvsFilename = "../../data/scene.pvs";
+Pvs     g_Pvs;
+bool    g_PvsLoaded = false;
+bool    g_PvsPending = false; // Arquivo lido, à espera de CheckScenePvs()
+bool    g_UsePvs = true;
+bool    g_BakePvs = false;
+bool    g_ValidatePvs = false;
+float   g_PvsMargin = 0.25f;
+float   g_PvsCellSize = 5.0f;
+int     g_PvsCell = -1; // Célula da câmera no quadro atual, ou -1 fora da área do PVS
+size_t  g_ObjectsPvsCulled = 0;
+
+// Instâncias descartadas pelo PVS no quadro atual, desenhadas por
+// ValidatePvs() com a opção "--validate-pvs".
+struct PvsValidationDraw
+{
+    const SceneObject* object;
+    glm::mat4          model;
+    int                pvs_entry;
+};
+std::vector<PvsValidationDraw> g_PvsValidationDraws;
+
+// Caminho "GPU-driven" (veja "gpudriven.hpp"), ligado com a opção
+// "--gpu-driven" na linha de comando quando o contexto OpenGL 4.3 está
+// disponível. Uma instância de um objeto estático (veja g_SceneDrawables)
+// desenhada com a mesma matriz "model" e o mesmo "object_id" em dois quadros
+// consecutivos, fora dos destaques com o stencil buffer, deixa de ser
+// desenhada por DrawVirtualObject() e passa a ser descartada e desenhada
+// pela GPU, com g_GpuDrivenProgramID (a variante GPU_DRIVEN dos shaders da
+// cena), por um pacote RENDERPACKET_GPU_DRIVEN no passo RENDERPASS_OPAQUE de
+// g_RenderQueue.
+bool    g_UseGpuDriven = false;
+GLuint  g_GpuDrivenProgramID = 0;
+size_t  g_ObjectsGpuDriven = 0; // Instâncias enviadas para o descarte na GPU no quadro atual
+
+// Fila de desenhos (veja "renderqueue.hpp"). DrawVirtualObject() não desenha
+// as instâncias que passam pelos testes de descarte, mas envia um pacote para
+// g_RenderQueue, no passo g_CurrentRenderPass; FlushRenderQueue() desenha os
+// pacotes ordenados ao final do quadro, junto com os grupos estáticos e os
+// desenhos indiretos do caminho "GPU-driven", que também são pacotes. A
+// ordenação é desligada com a opção "--no-render-sort" (os passos continuam
+// na ordem).
+RenderQueue g_RenderQueue;
+RenderPass  g_CurrentRenderPass = RENDERPASS_OPAQUE;
+bool        g_SortRenderQueue = true;
+
+// Desenho instanciado: os pacotes de objetos do passo RENDERPASS_OPAQUE são
+// agrupados por objeto, nível de detalhe e "object_id" antes dos desenhos de
+// FlushRenderQueue(); cada grupo é desenhado com uma única chamada a
+// glDrawElementsInstancedBaseVertex(), com as matrizes "model" e as matrizes
+// das normais das instâncias em g_InstanceBuffer (os atributos
+// "instance_model" e "instance_normal_matrix" de "shader_vertex.glsl").
+// Desligado com a opção "--no-instancing".
+//
+// Cada grupo é desenhado na posição do seu primeiro pacote na ordem da fila,
+// ou seja, do pacote mais próximo da câmera, entre os grupos estáticos e os
+// demais pacotes. As outras instâncias do grupo são desenhadas junto com
+// ela: o desenho instanciado troca a ordem de profundidade de cada objeto
+// por menos chamadas.
+struct InstanceBatch
+{
+    const SceneObject*     object;
+    int                    level;
+    int                    object_id;
+    size_t                 first_position; // Posição do primeiro pacote na ordem de g_RenderQueue
+    size_t                 first_model;    // Primeira matriz do grupo em g_InstanceBuffer
+    std::vector<glm::mat4> models;
+};
+std::vector<InstanceBatch> g_InstanceBatches;
+size_t  g_NumInstanceBatches = 0; // Grupos em uso em g_InstanceBatches (os demais são reaproveitados)
+bool    g_UseInstancing = true;
+GLuint  g_InstanceBuffer = 0;
+
+// Agrupamento estático (veja "staticbatch.hpp"). As transformações dos
+// objetos são definidas somente no laço de renderização, então os grupos são
+// montados a partir de um quadro: as instâncias de objetos estáticos (veja
+// g_SceneDrawables) desenhadas com a mesma matriz "model" e o mesmo
+// "object_id" em dois quadros consecutivos, fora dos destaques com o stencil
+// buffer, são guardadas em g_StaticBatchCapture e, ao final do quadro,
+// agrupadas em g_StaticBatch. A partir do quadro seguinte, DrawVirtualObject()
+// deixa estas instâncias para SubmitStaticBatches(), que envia cada grupo
+// para g_RenderQueue como um único pacote, desenhado com uma única chamada.
+// Se alguma delas muda ou deixa de ser desenhada, ela sai de
+// g_StaticBatchCapture, as demais instâncias do seu grupo são enviadas
+// individualmente naquele quadro, e somente este grupo é montado novamente
+// (veja StaticBatch_Build()). Desligado com a opção
+// "--no-static-batching", e com "--gpu-driven", que já desenha estas
+// instâncias.
+//
+// Objetos com níveis de detalhe (veja "meshlod.hpp"), como as casas e os
+// prédios, não são agrupados: os grupos guardam somente a malha original, e
+// são descartados como um todo. Estes objetos continuam no caminho de cada
+// instância, com a escolha do nível de detalhe e os descartes por PVS e por
+// oclusão de cada instância; os grupos ficam com as malhas pequenas (chão,
+// calçadas, postes), para as quais uma chamada por instância custaria mais
+// que o desenho.
+struct StaticBatchCapture
+{
+    const SceneObject* object;
+    size_t             instance_id; // Posição em g_SceneInstances
+    glm::mat4          model;
+    int                object_id;
+    size_t             id;          // Número da captura (veja StaticBatchSource::id)
+};
+std::vector<StaticBatchCapture> g_StaticBatchCapture;
+size_t  g_NextStaticBatchCapture = 0;
+StaticBatch g_StaticBatch;
+bool    g_UseStaticBatching = true;
+float   g_StaticBatchChunkSize = 40.0f; // Tamanho, em (x,z), das regiões da cena agrupadas
+size_t  g_StaticChunksDrawn = 0; // Grupos desenhados no quadro atual
 
 
 // Variáveis globais que armazenam a última posição do cursor do mouse, para
@@ -318,6 +804,12 @@ extern struct BoundingBox g_PlayerBox;
 extern struct BoundingBox g_CashierBox;
 extern struct BoundingBox g_HouseBox;
 
+// Caixas de colisão do jogador, na ordem em que são resolvidas, indexadas
+// por g_CollisionBvh (veja "scenebvh.hpp"): a cada movimento, somente as
+// caixas que intersectam a do jogador são testadas com ResolveBoxCollision().
+std::vector<BoundingBox> g_CollisionBoxes;
+SceneBvh                 g_CollisionBvh;
+
 glm::vec4 g_CashierPosition = glm::vec4(-5.0f, -1.0f, -20.0f, 1.0f);
 glm::vec4 g_BunnyPosition = glm::vec4(1.0f, 0.0f, 0.0f, 1.0f);
 
@@ -619,8 +1111,64 @@ void GerarCalcadas() {
 
 }
 
+// Opções da linha de comando. Cada opção atribui "value" a uma das variáveis
+// globais acima; os demais argumentos são modelos ".obj" adicionais (veja
+// ParseCommandLine()).
+struct CommandLineOption
+{
+    const char* name;
+    bool*       variable;
+    bool        value;
+};
+
+const CommandLineOption g_CommandLineOptions[] = {
+    { "--float-vertices",          &g_UseQuantizedVertices,  false },
+    { "--no-lod",                  &g_UseMeshLods,           false },
+    { "--no-cull",                 &g_UseFrustumCulling,     false },
+    { "--no-occlusion",            &g_UseOcclusionCulling,   false },
+    { "--no-soft-occlusion",       &g_UseSoftwareOcclusion,  false },
+    { "--no-pvs",                  &g_UsePvs,                false },
+    { "--bake-pvs",                &g_BakePvs,               true  },
+    { "--validate-pvs",            &g_ValidatePvs,           true  },
+    { "--gpu-driven",              &g_UseGpuDriven,          true  },
+    { "--no-instancing",           &g_UseInstancing,         false },
+    { "--no-static-batching",      &g_UseStaticBatching,     false },
+    { "--no-render-sort",          &g_SortRenderQueue,       false },
+    { "--no-shader-permutations",  &g_UseShaderPermutations, false },
+    { "--no-program-cache",        &g_UseProgramCache,       false },
+};
+
+// Aplica as opções da linha de comando, e guarda em "model_filenames" os
+// demais argumentos. Argumentos que começam com "--" mas não são opções
+// conhecidas são ignorados, em vez de serem carregados como modelos.
+void ParseCommandLine(int argc, char* argv[], std::vector<const char*>* model_filenames)
+{
+    const size_t num_options = sizeof(g_CommandLineOptions) / sizeof(g_CommandLineOptions[0]);
+    for (int i = 1; i < argc; ++i)
+    {
+        bool is_option = false;
+        for (size_t j = 0; j < num_options && !is_option; ++j)
+        {
+            if ( strcmp(argv[i], g_CommandLineOptions[j].name) == 0 )
+            {
+                *g_CommandLineOptions[j].variable = g_CommandLineOptions[j].value;
+                is_option = true;
+            }
+        }
+
+        if ( !is_option && strncmp(argv[i], "--", 2) == 0 )
+            fprintf(stderr, "WARNING: Opção desconhecida \"%s\" ignorada.\n", argv[i]);
+        else if ( !is_option )
+            model_filenames->push_back(argv[i]);
+    }
+}
+
 int main(int argc, char* argv[])
 {
+    // Opções e modelos adicionais passados na linha de comando
+    std::vector<const char*> model_filenames;
+    ParseCommandLine(argc, argv, &model_filenames);
+
     // Inicializamos a biblioteca GLFW, utilizada para criar uma janela do
     // sistema operacional, onde poderemos renderizar com OpenGL.
     int success = glfwInit();
@@ -641,8 +1189,10 @@ int main(int argc, char* argv[])
     // Definimos o callback para impressão de erros da GLFW no terminal
     glfwSetErrorCallback(ErrorCallback);
 
-    // Pedimos para utilizar OpenGL versão 3.3 (ou superior)
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    // Pedimos para utilizar OpenGL versão 3.3 (ou superior). Com a opção
+    // "--gpu-driven" na linha de comando, pedimos primeiro a versão 4.3
+    // (veja g_UseGpuDriven), e usamos a 3.3 se ela não estiver disponível.
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, g_UseGpuDriven ? 4 : 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 
     #ifdef __APPLE__
@@ -657,6 +1207,11 @@ int main(int argc, char* argv[])
     // de pixels, e com título "INF01047 ...".
     GLFWwindow* window;
     window = glfwCreateWindow(800, 600, "Neighborhood", NULL, NULL);
+    if (!window && g_UseGpuDriven)
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        window = glfwCreateWindow(800, 600, "Neighborhood", NULL, NULL);
+    }
     if (!window)
     {
         glfwTerminate();
@@ -712,126 +1267,130 @@ int main(int argc, char* argv[])
 
     printf("GPU: %s, %s, OpenGL %s, GLSL %s\n", vendor, renderer, glversion, glslversion);
 
+    g_TextureCompressionSupported = TextureArray_CompressionSupported();
+
+    if ( g_UseGpuDriven )
+    {
+        g_UseGpuDriven = GpuDriven_LoadFunctions((GLADloadproc) glfwGetProcAddress);
+        printf(g_UseGpuDriven ? "Cenário estático descartado e desenhado pela GPU (OpenGL 4.3).\n"
+                              : "OpenGL 4.3 não disponível; a opção \"--gpu-driven\" foi ignorada.\n");
+    }
+
+    // Os programas de GPU criados abaixo (incluindo o do texto, em
+    // TextRendering_Init()) são lidos do cache quando possível.
+    if ( g_UseProgramCache )
+        g_UseProgramCache = ProgramCache_Init((GLADloadproc) glfwGetProcAddress, g_ProgramCacheFilename);
+
     // Carregamos os shaders de vértices e de fragmentos que serão utilizados
     // para renderização. Veja slides 180-200 do documento Aula_03_Rendering_Pipeline_Grafico.pdf.
     //
     LoadShadersFromFiles();
 
-    // Carregamos duas imagens para serem utilizadas como textura
-    LoadTextureImage("../../data/tc-earth_daymap_surface.jpg");      // TextureImage0
-    LoadTextureImage("../../data/tc-earth_nightmap_citylights.gif"); // TextureImage1
-
-    /// texturas adicionadas
-
-    LoadTextureImage("../../data/baguete_COLOR.png");               // TextureImage2
-    LoadTextureImage("../../data/asfalto.png");                     // TextureImage3
-    LoadTextureImage("../../data/poleTexture.png");                 // TextureImage4
-    LoadTextureImage("../../data/TexturaLua.jpg");                  // TextureImage5
-    LoadTextureImage("../../data/texturaCalcada.png");              // TextureImage6
-    LoadTextureImage("../../data/smallHouseTexture.jpg");           // TextureImage7
-    LoadTextureImage("../../data/grassTexture.png");                // TextureImage8
-    LoadTextureImage("../../data/gasStationTexture.jpg");           // TextureImage9
-    LoadTextureImage("../../data/myhouseTexture.png");              // TextureImage10
-    LoadTextureImage("../../data/longHouseTexture.jpg");            // TextureImage11
-    LoadTextureImage("../../data/woodHouseTexture.png");            // TextureImage12
-    LoadTextureImage("../../data/lastHouseTexture.png");            // TextureImage13
-    LoadTextureImage("../../data/lilHouseTexture.png");             // TextureImage14
-    LoadTextureImage("../../data/maquinaTextura.png");              // TextureImage15
-    LoadTextureImage("../../data/ceuEstrelado.jpg");                // TextureImage16
-    LoadTextureImage("../../data/goldTexture.jpg");                 // TextureImage17
-    LoadTextureImage("../../data/queijo.jpg");                      // TextureImage18
-    LoadTextureImage("../../data/parmaTexture.jpg");                // TextureImage19
-    LoadTextureImage("../../data/oldWallTexture.jpg");              // TextureImage20
-
-    // Construímos a representação de objetos geométricos através de malhas de triângulos
-    ObjModel spheremodel("../../data/sphere.obj");
-    ComputeNormals(&spheremodel);
-    BuildTrianglesAndAddToVirtualScene(&spheremodel);
-
-    ObjModel bunnymodel("../../data/bunny.obj");
-    ComputeNormals(&bunnymodel);
-    BuildTrianglesAndAddToVirtualScene(&bunnymodel);
-
-    ObjModel planemodel("../../data/plane.obj");
-    ComputeNormals(&planemodel);
-    BuildTrianglesAndAddToVirtualScene(&planemodel);
+    // Os shaders são recarregados quando os arquivos são modificados (veja
+    // UpdateShaderReload()).
+    const char* shader_filenames[] = { "shader_vertex.glsl", "shader_fragment.glsl" };
+    ShaderWatcher_Init(&g_ShaderWatcher, "../../src", shader_filenames, 2);
+    ShaderReload_Init((GLADloadproc) glfwGetProcAddress);
 
-    /// .obj adicionados
-
-    ObjModel mainbuildmodel("../../data/mainbuild.obj");
-    ComputeNormals(&mainbuildmodel);
-    BuildTrianglesAndAddToVirtualScene(&mainbuildmodel);
-
-    // Carregando o modelo da calçada
-    ObjModel calcadamodel("../../data/calcada.obj");
-    ComputeNormals(&calcadamodel);
-    BuildTrianglesAndAddToVirtualScene(&calcadamodel);
-
-    // baguete
-    ObjModel baguetemodel("../../data/baguete.obj");
-    ComputeNormals(&baguetemodel);
-    BuildTrianglesAndAddToVirtualScene(&baguetemodel);
+    // Buffer dos blocos de uniforms dos shaders
+    UniformRing_Init(&g_UniformRing, g_UniformRingSize);
 
-    ObjModel eggmodel("../../data/eggs.obj");
-    ComputeNormals(&eggmodel);
-    BuildTrianglesAndAddToVirtualScene(&eggmodel);
+    RenderQueue_Init(&g_RenderQueue, g_SortRenderQueue);
 
-    ObjModel buttermodel("../../data/butter.obj");
-    ComputeNormals(&buttermodel);
-    BuildTrianglesAndAddToVirtualScene(&buttermodel);
+    // O caminho "GPU-driven" já desenha as instâncias estáticas.
+    if ( g_UseGpuDriven )
+        g_UseStaticBatching = false;
 
-    ObjModel cheesemodel("../../data/cheese.obj");
-    ComputeNormals(&cheesemodel);
-    BuildTrianglesAndAddToVirtualScene(&cheesemodel);
+    // As texturas e os modelos abaixo são lidos e processados em paralelo por
+    // threads auxiliares; os envios para a GPU acontecem somente dentro de
+    // AssetLoader_Finish(), nesta thread e na ordem das chamadas abaixo. Veja
+    // o arquivo "assetloader.hpp".
+    SceneBvh_Init(&g_SceneBvh, 0.25f);
 
-    ObjModel personagemmodel("../../data/objs/personagem/personagem.obj");
-    ComputeNormals(&personagemmodel);
-    BuildTrianglesAndAddToVirtualScene(&personagemmodel);
+    AssetLoader_Start();
 
-    ObjModel mansionmodel("../../data/mansion.obj");
-    ComputeNormals(&mansionmodel);
-    BuildTrianglesAndAddToVirtualScene(&mansionmodel);
+    // Somente os modelos e texturas utilizados pelos objetos desenhados são
+    // carregados. Veja g_SceneDrawables e o arquivo "residency.hpp".
+    AcquireSceneDrawables();
 
-    ObjModel polemodel("../../data/pole.obj");
-    ComputeNormals(&polemodel);
-    BuildTrianglesAndAddToVirtualScene(&polemodel);
-
-    ObjModel smallhousemodel("../../data/smallHouse.obj");
-    ComputeNormals(&smallhousemodel);
-    BuildTrianglesAndAddToVirtualScene(&smallhousemodel);
+    // Carregamos duas imagens para serem utilizadas como textura
+    LoadTextureImage("../../data/tc-earth_daymap_surface.jpg");
+    LoadTextureImage("../../data/tc-earth_nightmap_citylights.gif");
 
-    ObjModel gasstationmodel("../../data/gasStation.obj");
-    ComputeNormals(&gasstationmodel);
-    BuildTrianglesAndAddToVirtualScene(&gasstationmodel);
+    /// texturas adicionadas
 
-    ObjModel myhousemodel("../../data/myhouse.obj");
-    ComputeNormals(&myhousemodel);
-    BuildTrianglesAndAddToVirtualScene(&myhousemodel);
+    LoadTextureImage("../../data/baguete_COLOR.png");
+    LoadTextureImage("../../data/asfalto.png");
+    LoadTextureImage("../../data/poleTexture.png");
+    LoadTextureImage("../../data/TexturaLua.jpg");
+    LoadTextureImage("../../data/texturaCalcada.png");
+    LoadTextureImage("../../data/smallHouseTexture.jpg");
+    LoadTextureImage("../../data/grassTexture.png");
+    LoadTextureImage("../../data/gasStationTexture.jpg");
+    LoadTextureImage("../../data/myhouseTexture.png");
+    LoadTextureImage("../../data/longHouseTexture.jpg");
+    LoadTextureImage("../../data/woodHouseTexture.png");
+    LoadTextureImage("../../data/lastHouseTexture.png");
+    LoadTextureImage("../../data/lilHouseTexture.png");
+    LoadTextureImage("../../data/maquinaTextura.png");
+    LoadTextureImage("../../data/ceuEstrelado.jpg");
+    LoadTextureImage("../../data/goldTexture.jpg");
+    LoadTextureImage("../../data/queijo.jpg");
+    LoadTextureImage("../../data/parmaTexture.jpg");
+    LoadTextureImage("../../data/oldWallTexture.jpg");
+
+    // Construímos a representação de objetos geométricos através de malhas de triângulos.
+    // Veja LoadObjModelToVirtualScene() e o arquivo "meshcache.hpp".
+    LoadObjModelToVirtualScene("../../data/sphere.obj");
+    LoadObjModelToVirtualScene("../../data/bunny.obj");
+    LoadObjModelToVirtualScene("../../data/plane.obj");
 
-    ObjModel longhousemodel("../../data/longHouse.obj");
-    ComputeNormals(&longhousemodel);
-    BuildTrianglesAndAddToVirtualScene(&longhousemodel);
+    /// .obj adicionados
 
-    ObjModel woodhousemodel("../../data/woodhouse.obj");
-    ComputeNormals(&woodhousemodel);
-    BuildTrianglesAndAddToVirtualScene(&woodhousemodel);
+    LoadObjModelToVirtualScene("../../data/mainbuild.obj");
+    LoadObjModelToVirtualScene("../../data/calcada.obj");   // Modelo da calçada
+    LoadObjModelToVirtualScene("../../data/baguete.obj");
+    LoadObjModelToVirtualScene("../../data/eggs.obj");
+    LoadObjModelToVirtualScene("../../data/butter.obj");
+    LoadObjModelToVirtualScene("../../data/cheese.obj");
+    LoadObjModelToVirtualScene("../../data/objs/personagem/personagem.obj");
+    LoadObjModelToVirtualScene("../../data/mansion.obj");
+    LoadObjModelToVirtualScene("../../data/pole.obj");
+    LoadObjModelToVirtualScene("../../data/smallHouse.obj");
+    LoadObjModelToVirtualScene("../../data/gasStation.obj");
+    LoadObjModelToVirtualScene("../../data/myhouse.obj");
+    LoadObjModelToVirtualScene("../../data/longHouse.obj");
+    LoadObjModelToVirtualScene("../../data/woodhouse.obj");
+    LoadObjModelToVirtualScene("../../data/lasthouse.obj");
+    LoadObjModelToVirtualScene("../../data/lilhouse.obj");
+    LoadObjModelToVirtualScene("../../data/maquina.obj");
+
+    // Modelos ".obj" adicionais passados na linha de comando
+    for (size_t i = 0; i < model_filenames.size(); ++i)
+    {
+        Residency_AddRef(Residency_Asset(model_filenames[i], ASSET_MODEL));
+        LoadObjModelToVirtualScene(model_filenames[i]);
+    }
 
-    ObjModel lasthousemodel("../../data/lasthouse.obj");
-    ComputeNormals(&lasthousemodel);
-    BuildTrianglesAndAddToVirtualScene(&lasthousemodel);
+    AssetLoader_Finish();
 
-    ObjModel lilhousemodel("../../data/lilhouse.obj");
-    ComputeNormals(&lilhousemodel);
-    BuildTrianglesAndAddToVirtualScene(&lilhousemodel);
+    // Todas as texturas já foram carregadas; agrupamos as mesmas em arrays
+    // e definimos as texturas de cada objeto.
+    TextureArray_Build(0, g_TextureCompressionSupported);
+    InitObjectMaterials();
+    PrecompileMaterialPrograms();
 
-    ObjModel maquinamodel("../../data/maquina.obj");
-    ComputeNormals(&maquinamodel);
-    BuildTrianglesAndAddToVirtualScene(&maquinamodel);
+    printf("Atributos de vértices na GPU: %.1f MiB (%s).\n", g_VertexBufferBytes / (1024.0 * 1024.0),
+           g_UseQuantizedVertices ? "formato compacto" : "floats");
+    Residency_PrintReport();
 
-    if ( argc > 1 )
+    if ( !g_BakePvs )
     {
-        ObjModel model(argv[1]);
-        BuildTrianglesAndAddToVirtualScene(&model);
+        g_PvsPending = Pvs_Read(&g_Pvs, g_PvsFilename);
+        if ( g_PvsPending )
+            printf("PVS: %dx%d células, %d instâncias estáticas.\n", g_Pvs.cells_x, g_Pvs.cells_z, (int)g_Pvs.entries.size());
+        else
+            printf("PVS: arquivo \"%s\" não encontrado; use a opção \"--bake-pvs\" para gerá-lo.\n", g_PvsFilename);
     }
 
     g_CashierBox.min = glm::vec4(g_CashierPosition.x - 1.0f, g_CashierPosition.y - 1.0f, g_CashierPosition.z - 1.0f, 1.0f);
@@ -840,6 +1399,12 @@ int main(int argc, char* argv[])
     g_HouseBox.min = glm::vec4(-20.0f, -1.3f, 45.0f, 1.0f);
     g_HouseBox.max = glm::vec4(20.0f, 3.0f, 70.0f, 1.0f);
 
+    g_CollisionBoxes.push_back(g_HouseBox);
+    g_CollisionBoxes.push_back(g_CashierBox);
+    SceneBvh_Init(&g_CollisionBvh, 0.0f);
+    for (size_t i = 0; i < g_CollisionBoxes.size(); ++i)
+        SceneBvh_Insert(&g_CollisionBvh, glm::vec3(g_CollisionBoxes[i].min), glm::vec3(g_CollisionBoxes[i].max), (uint32_t)i);
+
 
     // Define os planos que limitam o mapa
     Plane boundary_plane_north = {
@@ -865,6 +1430,17 @@ int main(int argc, char* argv[])
     // Inicializamos o código para renderização de texto.
     TextRendering_Init();
 
+    // Inicializamos os testes de oclusão
+    Occlusion_Init();
+
+    // O atributo por instância do caminho "GPU-driven" é ligado ao VAO único
+    // da cena.
+    if ( g_UseGpuDriven )
+    {
+        InitSceneArenas();
+        GpuDriven_Init(g_SceneVAO);
+    }
+
     // Habilitamos o Z-buffer. Veja slides 104-116 do documento Aula_09_Projecoes.pdf.
     glEnable(GL_DEPTH_TEST);
 
@@ -890,6 +1466,23 @@ int main(int argc, char* argv[])
         // e também resetamos todos os pixels do Z-buffer (depth buffer).
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+        // Enviamos para a GPU os próximos níveis de mipmap das texturas,
+        // priorizando as que apareceram maiores na tela no quadro anterior.
+        TextureArray_Stream(g_TextureStreamBudget);
+
+        g_FrameIndex += 1;
+        g_TrianglesDrawn = 0;
+        g_ObjectsVisible = 0;
+        g_ObjectsCulled = 0;
+        g_ObjectsOccluded = 0;
+        g_ObjectsOccludedCpu = 0;
+        g_ObjectsPvsCulled = 0;
+        g_ObjectsGpuDriven = 0;
+        g_StaticChunksDrawn = 0;
+        RenderQueue_Clear(&g_RenderQueue);
+        UniformRing_BeginFrame(&g_UniformRing);
+        UpdateShaderReload();
+
         // Pedimos para a GPU utilizar o programa de GPU criado acima (contendo
         // os shaders de vértice e fragmentos).
         glUseProgram(g_GpuProgramID);
@@ -1002,16 +1595,22 @@ int main(int argc, char* argv[])
             g_PlayerBox.min = new_camera_position - glm::vec4(0.5f, 0.5f, 0.5f, 0.0f);
             g_PlayerBox.max = new_camera_position + glm::vec4(0.5f, 0.5f, 0.5f, 0.0f);
 
-            // Verifica e resolve colisão com a casa
-            CollisionResult houseCollision = ResolveBoxCollision(g_PlayerBox, g_HouseBox, g_camera_position_c, new_camera_position);
-            if (houseCollision.collided) {
-                new_camera_position = houseCollision.correctedPosition;
-            }
-
-            // Verifica e resolve colisão com a máquina
-            CollisionResult cashierCollision = ResolveBoxCollision(g_PlayerBox, g_CashierBox, g_camera_position_c, new_camera_position);
-            if (cashierCollision.collided) {
-                new_camera_position = cashierCollision.correctedPosition;
+            // Verifica e resolve colisão com a casa e com a máquina. As
+            // colisões ignoram a altura (veja ResolveBoxCollision()), então a
+            // caixa consultada em g_CollisionBvh cobre todas as alturas.
+            static std::vector<uint32_t> colliders;
+            colliders.clear();
+            SceneBvh_QueryBox(&g_CollisionBvh,
+                              glm::vec3(g_PlayerBox.min.x, -std::numeric_limits<float>::max(), g_PlayerBox.min.z),
+                              glm::vec3(g_PlayerBox.max.x,  std::numeric_limits<float>::max(), g_PlayerBox.max.z),
+                              &colliders);
+            std::sort(colliders.begin(), colliders.end());
+            for (size_t i = 0; i < colliders.size(); ++i)
+            {
+                CollisionResult collision = ResolveBoxCollision(g_PlayerBox, g_CollisionBoxes[colliders[i]], g_camera_position_c, new_camera_position);
+                if (collision.collided) {
+                    new_camera_position = collision.correctedPosition;
+                }
             }
 
             // Verifica colisão com os planos limite do mapa
@@ -1080,10 +1679,18 @@ int main(int argc, char* argv[])
         }
 
         // Enviamos as matrizes "view" e "projection" para a placa de vídeo
-        // (GPU). Veja o arquivo "shader_vertex.glsl", onde estas são
+        // (GPU), no bloco "FrameUniforms" usado por todos os desenhos do
+        // quadro. Veja o arquivo "shader_vertex.glsl", onde estas são
         // efetivamente aplicadas em todos os pontos.
-        glUniformMatrix4fv(g_view_uniform       , 1 , GL_FALSE , glm::value_ptr(view));
-        glUniformMatrix4fv(g_projection_uniform , 1 , GL_FALSE , glm::value_ptr(projection));
+        UploadFrameUniforms(view, projection);
+        g_ViewMatrix       = view;
+        g_ProjectionMatrix = projection;
+        Frustum_FromMatrix(projection * view, &g_ViewFrustum);
+        FindVisibleSceneInstances();
+
+        glm::vec3 view_position = glm::vec3(glm::inverse(view)[3]); // Posição da câmera em coordenadas globais
+        RasterizeSceneOccluders(projection * view, view_position);
+        g_PvsCell = (g_UsePvs && g_PvsLoaded) ? Pvs_Cell(&g_Pvs, view_position) : -1;
 
         #define SPHERE 0
         #define BUNNY  1
@@ -1112,55 +1719,53 @@ int main(int argc, char* argv[])
 
         /// desenhos adicionados
 
-        // Skybox
-        glCullFace(GL_FRONT);
-        glDepthMask(GL_FALSE);
+        // Skybox, desenhado antes de todos os objetos e sem escrita no
+        // z-buffer (veja BeginRenderPass())
+        g_CurrentRenderPass = RENDERPASS_SKY;
         model = Matrix_Translate(camera_position_c.x, camera_position_c.y, camera_position_c.z - 50.0)
         * Matrix_Scale(200.0f, 200.0f, 200.0f);  // Aumenta o tamanho para evitar flickering nas bordas
-        glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-        glUniform1i(g_object_id_uniform, SKY);
+        SetModelMatrix(model);
+        SetObjectMaterial(SKY);
         DrawVirtualObject("the_sphere");
-        // Reativa escrita no z-buffer
-        glDepthMask(GL_TRUE);
-        glCullFace(GL_BACK);
+        g_CurrentRenderPass = RENDERPASS_OPAQUE;
 
         // Construções
         model = Matrix_Translate(13.0f,-1.0f,-165.0f)  // x, y, z (y = -1.1f coloca no mesmo nível do chão)
         * Matrix_Scale(0.4f, 0.4f, 0.4f)
         * Matrix_Rotate(165.0f, glm::vec4(0.0f, 1.0f, 0.0f, 0.0f));
-        glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-        glUniform1i(g_object_id_uniform, MAINBUILD);
+        SetModelMatrix(model);
+        SetObjectMaterial(MAINBUILD);
         DrawVirtualObject("the_mainbuild");
 
         // Desenhamos o modelo da casa
         model = Matrix_Translate(-25.0f, -1.1f, -20.0f)
         * Matrix_Rotate_Y(M_PI/2.0f)
         * Matrix_Scale(0.7f, 0.7f, 0.7f);
-        glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-        glUniform1i(g_object_id_uniform, SMALLHOUSE);
+        SetModelMatrix(model);
+        SetObjectMaterial(SMALLHOUSE);
         DrawVirtualObject("the_smallHouse");
 
         model = Matrix_Translate(33.0f, -1.1f, -75.0f)
         * Matrix_Rotate_Y(M_PI*2)
         * Matrix_Scale(0.7f, 0.7f, 0.7f);
-        glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-        glUniform1i(g_object_id_uniform, SMALLHOUSE);
+        SetModelMatrix(model);
+        SetObjectMaterial(SMALLHOUSE);
         DrawVirtualObject("the_smallHouse");
 
         // Desenhamos o modelo do posto de gasolina
         model = Matrix_Translate(-70.0f, -1.3f, -105.0f)
         * Matrix_Rotate_Y(M_PI)
         * Matrix_Scale(0.55f, 0.55f, 0.55f);
-        glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-        glUniform1i(g_object_id_uniform, GASSTATION);
+        SetModelMatrix(model);
+        SetObjectMaterial(GASSTATION);
         DrawVirtualObject("the_gasstation");
 
         // Desenhamos o modelo da nossa casa
         model = Matrix_Translate(0.0f, -1.3f, 58.0f)
         * Matrix_Rotate_Y(M_PI/2)
         * Matrix_Scale(1.0f, 1.0f, 1.0f);
-        glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-        glUniform1i(g_object_id_uniform, MYHOUSE);
+        SetModelMatrix(model);
+        SetObjectMaterial(MYHOUSE);
         DrawVirtualObject("myHouse");
 
         // Salvamos a matriz do caixa para uso no raycasting
@@ -1177,38 +1782,38 @@ int main(int argc, char* argv[])
         model = Matrix_Translate(40.0f, -1.3f, -30.0f)
         * Matrix_Rotate_Y(M_PI)
         * Matrix_Scale(0.90f, 0.90f, 0.90f);
-        glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-        glUniform1i(g_object_id_uniform, LONGHOUSE);
+        SetModelMatrix(model);
+        SetObjectMaterial(LONGHOUSE);
         DrawVirtualObject("the_longhouse");
 
         // Desenhamos o modelo da casa de madeira 1
         model = Matrix_Translate(60.0f, -1.3f, 17.50f)
         * Matrix_Rotate_Y(M_PI)
         * Matrix_Scale(0.40f, 0.40f, 0.40f);
-        glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-        glUniform1i(g_object_id_uniform, WOODHOUSE);
+        SetModelMatrix(model);
+        SetObjectMaterial(WOODHOUSE);
         DrawVirtualObject("the_woodhouse");
 
         // Desenhamos o modelo da casa de madeira 2
         model = Matrix_Translate(-60.0f, -1.3f, 17.50f)
         * Matrix_Rotate_Y(M_PI*2)
         * Matrix_Scale(0.40f, 0.40f, 0.40f);
-        glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-        glUniform1i(g_object_id_uniform, WOODHOUSE);
+        SetModelMatrix(model);
+        SetObjectMaterial(WOODHOUSE);
         DrawVirtualObject("the_woodhouse");
 
         // Desenhamos o modelo da casa de madeira 3
         model = Matrix_Translate(-30.0f, -1.3f, -50.50f)
         * Matrix_Rotate_Y(M_PI/2)
         * Matrix_Scale(0.40f, 0.40f, 0.40f);
-        glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-        glUniform1i(g_object_id_uniform, WOODHOUSE);
+        SetModelMatrix(model);
+        SetObjectMaterial(WOODHOUSE);
         DrawVirtualObject("the_woodhouse");
 
        // Desenhamos todas as instâncias da calçada
         for(const Calcada& calcada : calcadas) {
-            glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(calcada.model));
-            glUniform1i(g_object_id_uniform, CALCADA);
+            SetModelMatrix(calcada.model);
+            SetObjectMaterial(CALCADA);
             DrawVirtualObject("calcada");
 
 
@@ -1217,76 +1822,76 @@ int main(int argc, char* argv[])
             //asfalto
             model = Matrix_Translate(0.0f,-1.1f,-73.5f)
             * Matrix_Scale(5.0f, 1.0f, 76.5f); // Aumentar o tamanho do plano
-            glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-            glUniform1i(g_object_id_uniform, PLANE);
+            SetModelMatrix(model);
+            SetObjectMaterial(PLANE);
             DrawVirtualObject("the_plane");
 
             model = Matrix_Translate(0.0f,-1.1f,16.0f)
             * Matrix_Scale(35.0f, 1.0f, 13.0f);
-            glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-            glUniform1i(g_object_id_uniform, PLANE_ASPHALT);
+            SetModelMatrix(model);
+            SetObjectMaterial(PLANE_ASPHALT);
             DrawVirtualObject("the_plane");
         }
 
         //grama
         model = Matrix_Translate(45.0f,-1.1f,-97.0f)
         * Matrix_Scale(40.0f, 1.0f, 100.0f); // Aumentar o tamanho do plano
-        glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-        glUniform1i(g_object_id_uniform, PLANE_GRASS);
+        SetModelMatrix(model);
+        SetObjectMaterial(PLANE_GRASS);
         DrawVirtualObject("the_plane");
 
         model = Matrix_Translate(-45.0f,-1.1f,-97.0f)
         * Matrix_Scale(40.0f, 1.0f, 100.0f); // Aumentar o tamanho do plano
-        glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-        glUniform1i(g_object_id_uniform, PLANE_GRASS);
+        SetModelMatrix(model);
+        SetObjectMaterial(PLANE_GRASS);
         DrawVirtualObject("the_plane");
 
         model = Matrix_Translate(60.0f,-1.1f,43.0f)
         * Matrix_Scale(25.0f, 1.0f, 40.0f); // Aumentar o tamanho do plano
-        glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-        glUniform1i(g_object_id_uniform, PLANE_GRASS);
+        SetModelMatrix(model);
+        SetObjectMaterial(PLANE_GRASS);
         DrawVirtualObject("the_plane");
 
         model = Matrix_Translate(-60.0f,-1.1f,43.0f)
         * Matrix_Scale(25.0f, 1.0f, 40.0f); // Aumentar o tamanho do plano
-        glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-        glUniform1i(g_object_id_uniform, PLANE_GRASS);
+        SetModelMatrix(model);
+        SetObjectMaterial(PLANE_GRASS);
         DrawVirtualObject("the_plane");
 
         model = Matrix_Translate(0.0f,-1.1f,55.5f)
         * Matrix_Scale(35.0f, 1.0f, 27.5f); // Aumentar o tamanho do plano
-        glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-        glUniform1i(g_object_id_uniform, PLANE_GRASS);
+        SetModelMatrix(model);
+        SetObjectMaterial(PLANE_GRASS);
         DrawVirtualObject("the_plane");
 
         model = Matrix_Translate(0.0f,-1.1f,-173.5f)
         * Matrix_Scale(5.0f, 1.0f, 23.5f); // Aumentar o tamanho do plano
-        glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-        glUniform1i(g_object_id_uniform, PLANE_GRASS);
+        SetModelMatrix(model);
+        SetObjectMaterial(PLANE_GRASS);
         DrawVirtualObject("the_plane");
 
         // Desenhamos o poste
         model = Matrix_Translate(-7.0f, -1.1f, -5.5f)
         * Matrix_Rotate_Y(-M_PI/2)
         * Matrix_Scale(0.6f, 0.6f, 0.6f);
-        glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-        glUniform1i(g_object_id_uniform, POLE);
+        SetModelMatrix(model);
+        SetObjectMaterial(POLE);
         DrawVirtualObject("the_pole");
 
         // Desenhamos o poste
         model = Matrix_Translate(-7.0f, -1.1f, -42.0f)
         * Matrix_Rotate_Y(-M_PI/2)
         * Matrix_Scale(0.6f, 0.6f, 0.6f);
-        glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-        glUniform1i(g_object_id_uniform, POLE);
+        SetModelMatrix(model);
+        SetObjectMaterial(POLE);
         DrawVirtualObject("the_pole");
 
         // Desenhamos o poste
         model = Matrix_Translate(-7.0f, -1.1f, -78.5f)
         * Matrix_Rotate_Y(-M_PI/2)
         * Matrix_Scale(0.6f, 0.6f, 0.6f);
-        glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-        glUniform1i(g_object_id_uniform, POLE);
+        SetModelMatrix(model);
+        SetObjectMaterial(POLE);
         DrawVirtualObject("the_pole");
 
         //Desenhamos o modelo da lua
@@ -1295,16 +1900,16 @@ int main(int argc, char* argv[])
         * Matrix_Rotate_Z(g_AngleY/5)
         * Matrix_Rotate_X(g_AngleY/10)
         * Matrix_Scale(6.0f, 6.0f, 6.0f);
-        glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-        glUniform1i(g_object_id_uniform, LUA);
+        SetModelMatrix(model);
+        SetObjectMaterial(LUA);
         DrawVirtualObject("the_sphere");
 
         //Desenhamos o modelo da maquina de pagamento
         model = Matrix_Translate(15.0f, -1.1f, -147.5f)
         * Matrix_Rotate_Y(M_PI*2)
         * Matrix_Scale(1.5f, 1.5f, 1.5f);
-        glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-        glUniform1i(g_object_id_uniform, MAQUINA);
+        SetModelMatrix(model);
+        SetObjectMaterial(MAQUINA);
         DrawVirtualObject("maquina_pagamento");
 
         // Salvamos a matriz do caixa para uso no raycasting
@@ -1353,8 +1958,8 @@ int main(int argc, char* argv[])
         {
             model = Matrix_Translate(10.0f, -1.0f, -156.0f)
             * Matrix_Scale(0.5f, 0.5f, 0.5f);
-            glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-            glUniform1i(g_object_id_uniform, CHEESE);
+            SetModelMatrix(model);
+            SetObjectMaterial(CHEESE);
             DrawVirtualObject("the_cheese");
 
             // Salvamos a matriz do objeto para uso no raycasting
@@ -1384,8 +1989,8 @@ int main(int argc, char* argv[])
         {
             model = Matrix_Translate(10.0f, -1.0f, -160.0f)
             * Matrix_Scale(0.3f, 0.3f, 0.3f);
-            glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-            glUniform1i(g_object_id_uniform, BUTTER);
+            SetModelMatrix(model);
+            SetObjectMaterial(BUTTER);
             DrawVirtualObject("the_butter");
 
             // Salvamos a matriz do objeto para uso no raycasting
@@ -1416,8 +2021,8 @@ int main(int argc, char* argv[])
         {
             model = Matrix_Translate(-6.0f, -1.0f, -156.0f)
             * Matrix_Scale(0.60f, 0.60f, 0.60f);
-            glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-            glUniform1i(g_object_id_uniform, EGG);
+            SetModelMatrix(model);
+            SetObjectMaterial(EGG);
             DrawVirtualObject("the_eggs");
 
             // Salvamos a matriz do ovo para uso no raycasting
@@ -1447,8 +2052,8 @@ int main(int argc, char* argv[])
         {
             model = Matrix_Translate(-6.0f, 0.0f, -160.0f)
             * Matrix_Scale(0.15f, 0.15f, 0.15f);
-            glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-            glUniform1i(g_object_id_uniform, BAGUETE);
+            SetModelMatrix(model);
+            SetObjectMaterial(BAGUETE);
             DrawVirtualObject("the_baguete");
 
             // Salvamos a matriz da baguete para uso no raycasting
@@ -1477,8 +2082,8 @@ int main(int argc, char* argv[])
         {
             model = Matrix_Translate(50.0f,0.0f,-40.0f)
             * Matrix_Rotate_X(g_AngleX + (float)glfwGetTime() * 0.1f);
-            glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-            glUniform1i(g_object_id_uniform, BUNNY);
+            SetModelMatrix(model);
+            SetObjectMaterial(BUNNY);
             DrawVirtualObject("the_bunny");
 
             glm::vec4 bunny_position = model * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
@@ -1505,163 +2110,100 @@ int main(int argc, char* argv[])
 
         // Se o coelho está sob o crosshair, desenhamos ele novamente com destaque amarelo
         if (g_object_highlighted == BUNNY && !bunny_picked) {
-            glEnable(GL_STENCIL_TEST);
-            glStencilFunc(GL_ALWAYS, 1, 0xFF);
-            glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
-            glStencilMask(0xFF);
-
             // Transformações geométricas do coelho
             model = Matrix_Translate(1.0f,0.0f,0.0f)
                   * Matrix_Scale(1.3f, 1.3f, 1.3f)  // escala que aumentamos o coelho
                   * Matrix_Rotate_X(g_AngleX + (float)glfwGetTime() * 0.1f);
 
-            glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-
-            // Ativamos a sobreposição de cor
-            glUniform1i(glGetUniformLocation(g_GpuProgramID, "use_color_override"), true);
-            glUniform4f(glGetUniformLocation(g_GpuProgramID, "color_override"), 1.0f, 1.0f, 0.0f, 1.0f); // cor que destacamos ele
+            SetModelMatrix(model);
 
+            // Desenhamos no passo dos destaques, com a cor de destaque (veja
+            // BeginRenderPass())
+            g_CurrentRenderPass = RENDERPASS_HIGHLIGHT;
             DrawVirtualObject("the_bunny");
-
-            // Desativamos a sobreposição de cor para os próximos objetos
-            glUniform1i(glGetUniformLocation(g_GpuProgramID, "use_color_override"), false);
-            glDisable(GL_STENCIL_TEST);
+            g_CurrentRenderPass = RENDERPASS_OPAQUE;
         }
 
         else if (g_object_highlighted == BAGUETE && !baguete_picked)
         {
-            glEnable(GL_STENCIL_TEST);
-            glStencilFunc(GL_ALWAYS, 1, 0xFF);
-            glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
-            glStencilMask(0xFF);
-
             model = Matrix_Translate(-6.0f, 0.0f, -160.0f)
             * Matrix_Scale(0.195f, 0.195f, 0.195f);  // Escala um pouco maior para o highlight
 
-            glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-
-            // Ativamos a sobreposição de cor
-            glUniform1i(glGetUniformLocation(g_GpuProgramID, "use_color_override"), true);
-            glUniform4f(glGetUniformLocation(g_GpuProgramID, "color_override"), 1.0f, 1.0f, 0.0f, 1.0f);
+            SetModelMatrix(model);
 
+            // Desenhamos no passo dos destaques, com a cor de destaque (veja
+            // BeginRenderPass())
+            g_CurrentRenderPass = RENDERPASS_HIGHLIGHT;
             DrawVirtualObject("the_baguete");
-
-            // Desativamos a sobreposição de cor para os próximos objetos
-            glUniform1i(glGetUniformLocation(g_GpuProgramID, "use_color_override"), false);
-            glDisable(GL_STENCIL_TEST);
+            g_CurrentRenderPass = RENDERPASS_OPAQUE;
         }
         else if (g_object_highlighted == EGG && !egg_picked)
         {
-            glEnable(GL_STENCIL_TEST);
-            glStencilFunc(GL_ALWAYS, 1, 0xFF);
-            glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
-            glStencilMask(0xFF);
-
             model = Matrix_Translate(-6.0f, -1.0f, -156.0f)
             * Matrix_Scale(1.20f, 1.20f, 1.20f);  // Escala um pouco maior para o highlight
 
-            glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-
-            // Ativamos a sobreposição de cor
-            glUniform1i(glGetUniformLocation(g_GpuProgramID, "use_color_override"), true);
-            glUniform4f(glGetUniformLocation(g_GpuProgramID, "color_override"), 1.0f, 1.0f, 0.0f, 1.0f);
+            SetModelMatrix(model);
 
+            // Desenhamos no passo dos destaques, com a cor de destaque (veja
+            // BeginRenderPass())
+            g_CurrentRenderPass = RENDERPASS_HIGHLIGHT;
             DrawVirtualObject("the_eggs");
-
-            // Desativamos a sobreposição de cor para os próximos objetos
-            glUniform1i(glGetUniformLocation(g_GpuProgramID, "use_color_override"), false);
-            glDisable(GL_STENCIL_TEST);
+            g_CurrentRenderPass = RENDERPASS_OPAQUE;
         }
 
         else if (g_object_highlighted == BUTTER && !butter_picked)
         {
-            glEnable(GL_STENCIL_TEST);
-            glStencilFunc(GL_ALWAYS, 1, 0xFF);
-            glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
-            glStencilMask(0xFF);
-
             model = Matrix_Translate(10.0f, -1.0f, -160.0f)
             * Matrix_Scale(0.5f, 0.5f, 0.5f);  // Escala um pouco maior para o highlight
 
-            glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-
-            // Ativamos a sobreposição de cor
-            glUniform1i(glGetUniformLocation(g_GpuProgramID, "use_color_override"), true);
-            glUniform4f(glGetUniformLocation(g_GpuProgramID, "color_override"), 1.0f, 1.0f, 0.0f, 1.0f);
+            SetModelMatrix(model);
 
+            // Desenhamos no passo dos destaques, com a cor de destaque (veja
+            // BeginRenderPass())
+            g_CurrentRenderPass = RENDERPASS_HIGHLIGHT;
             DrawVirtualObject("the_butter");
-
-            // Desativamos a sobreposição de cor para os próximos objetos
-            glUniform1i(glGetUniformLocation(g_GpuProgramID, "use_color_override"), false);
-            glDisable(GL_STENCIL_TEST);
+            g_CurrentRenderPass = RENDERPASS_OPAQUE;
         }
 
         else if (g_object_highlighted == CHEESE && !cheese_picked)
         {
-            glEnable(GL_STENCIL_TEST);
-            glStencilFunc(GL_ALWAYS, 1, 0xFF);
-            glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
-            glStencilMask(0xFF);
-
             model = Matrix_Translate(10.0f, -1.0f, -156.0f)
             * Matrix_Scale(0.6f, 0.6f, 0.6f);  // Escala um pouco maior para o highlight
 
-            glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-
-            // Ativamos a sobreposição de cor
-            glUniform1i(glGetUniformLocation(g_GpuProgramID, "use_color_override"), true);
-            glUniform4f(glGetUniformLocation(g_GpuProgramID, "color_override"), 1.0f, 1.0f, 0.0f, 1.0f);
+            SetModelMatrix(model);
 
+            // Desenhamos no passo dos destaques, com a cor de destaque (veja
+            // BeginRenderPass())
+            g_CurrentRenderPass = RENDERPASS_HIGHLIGHT;
             DrawVirtualObject("the_cheese");
-
-            // Desativamos a sobreposição de cor para os próximos objetos
-            glUniform1i(glGetUniformLocation(g_GpuProgramID, "use_color_override"), false);
-            glDisable(GL_STENCIL_TEST);
+            g_CurrentRenderPass = RENDERPASS_OPAQUE;
         }
         else if (g_object_highlighted == MAQUINA)
         {
-            glEnable(GL_STENCIL_TEST);
-            glStencilFunc(GL_ALWAYS, 1, 0xFF);
-            glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
-            glStencilMask(0xFF);
-
             model = Matrix_Translate(15.0f, -1.1f, -147.5f)
             * Matrix_Scale(1.9f, 1.9f, 1.9f);  // Escala um pouco maior para o highlight
 
-            glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-
-            // Ativamos a sobreposição de cor
-            glUniform1i(glGetUniformLocation(g_GpuProgramID, "use_color_override"), true);
-            glUniform4f(glGetUniformLocation(g_GpuProgramID, "color_override"), 1.0f, 1.0f, 0.0f, 1.0f);
+            SetModelMatrix(model);
 
+            // Desenhamos no passo dos destaques, com a cor de destaque (veja
+            // BeginRenderPass())
+            g_CurrentRenderPass = RENDERPASS_HIGHLIGHT;
             DrawVirtualObject("maquina_pagamento");
-
-            // Desativamos a sobreposição de cor para os próximos objetos
-            glUniform1i(glGetUniformLocation(g_GpuProgramID, "use_color_override"), false);
-            glDisable(GL_STENCIL_TEST);
+            g_CurrentRenderPass = RENDERPASS_OPAQUE;
         }
 
         else if (g_object_highlighted == MYHOUSE && g_PaymentCompleted)
         {
-            glEnable(GL_STENCIL_TEST);
-            glStencilFunc(GL_ALWAYS, 1, 0xFF);
-            glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
-            glStencilMask(0xFF);
-
             model = Matrix_Translate(0.0f, -1.3f, 58.0f)
                   * Matrix_Scale(1.3f, 1.3f, 1.3f);  // Escala um pouco maior para o highlight
 
-            glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-
-            // Ativamos a sobreposição de cor
-            glUniform1i(glGetUniformLocation(g_GpuProgramID, "use_color_override"), true);
-            glUniform4f(glGetUniformLocation(g_GpuProgramID, "color_override"), 1.0f, 1.0f, 0.0f, 1.0f);
+            SetModelMatrix(model);
 
+            // Desenhamos no passo dos destaques, com a cor de destaque (veja
+            // BeginRenderPass())
+            g_CurrentRenderPass = RENDERPASS_HIGHLIGHT;
             DrawVirtualObject("myHouse");
-
-            // Desativamos a sobreposição de cor para os próximos objetos
-            glUniform1i(glGetUniformLocation(g_GpuProgramID, "use_color_override"), false);
-            glDisable(GL_STENCIL_TEST);
+            g_CurrentRenderPass = RENDERPASS_OPAQUE;
         }
 
 
@@ -1669,33 +2211,87 @@ int main(int argc, char* argv[])
         glm::vec4 sphere_position = AtualizaPonto(current_time * ControleVelocidadeCurva , p0, p1, p2, p3);
         model = Matrix_Translate(sphere_position.x, sphere_position.y, sphere_position.z)
             * Matrix_Scale(0.1f, 0.1f, 0.1f);
-        glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(model));
-        glUniform1i(g_object_id_uniform, SPHERE);
+        SetModelMatrix(model);
+        SetObjectMaterial(SPHERE);
         DrawVirtualObject("the_sphere");
 
+        // Enviamos os grupos de instâncias estáticas
+        if ( g_UseStaticBatching )
+            SubmitStaticBatches();
+
+        // As instâncias estáticas entregues à GPU neste quadro são desenhadas
+        // com os objetos opacos, por um único pacote.
+        if ( g_UseGpuDriven )
+        {
+            RenderPacket packet;
+            packet.kind         = RENDERPACKET_GPU_DRIVEN;
+            packet.pass         = RENDERPASS_OPAQUE;
+            packet.program      = g_GpuDrivenProgramID;
+            packet.vertex_array = 0;
+            packet.material     = 0;
+            packet.mesh         = NULL;
+            packet.level        = 0;
+            packet.model        = Matrix_Identity();
+            RenderQueue_Submit(&g_RenderQueue, packet, 0.0f);
+        }
+
+        // Desenhamos os pacotes enviados neste quadro por DrawVirtualObject()
+        // e pelos caminhos acima, ordenados
+        FlushRenderQueue();
+
+        // Montamos os grupos de instâncias estáticas que mudaram, e os das
+        // instâncias guardadas neste quadro.
+        if ( g_UseStaticBatching )
+            UpdateStaticBatches();
+
+        // Guardamos o Z-buffer com toda a cena para o descarte na GPU do
+        // próximo quadro.
+        if ( g_UseGpuDriven )
+        {
+            int framebuffer_width, framebuffer_height;
+            glfwGetFramebufferSize(window, &framebuffer_width, &framebuffer_height);
+            GpuDriven_UpdateDepth(projection * view, framebuffer_width, framebuffer_height);
+        }
+
+        // Com o Z-buffer contendo toda a cena, testamos a oclusão das
+        // instâncias desenhadas neste quadro. Os resultados são usados por
+        // DrawVirtualObject() a partir do próximo quadro.
+        if ( g_UseOcclusionCulling )
+            g_OcclusionQueries = Occlusion_Flush(projection * view, view_position, 1.0f);
+
+        if ( g_ValidatePvs )
+            ValidatePvs();
+
+        if ( g_PvsPending )
+            CheckScenePvs();
+
+        // Com todas as instâncias do primeiro quadro conhecidas, calculamos
+        // o PVS e encerramos o programa.
+        if ( g_BakePvs )
+        {
+            BakeScenePvs();
+            glfwSetWindowShouldClose(window, GL_TRUE);
+        }
+
 
 
         ///crosshair("+")
         glUseProgram(g_GpuProgramID);
 
-        // Salvamos as matrizes atuais para restaurar depois
-        glm::mat4 saved_projection = projection;
-        glm::mat4 saved_view = view;
-
         // Configuramos uma projeção ortográfica especial para o crosshair
         glm::mat4 crosshair_projection = Matrix_Orthographic(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f);
         // View matrix identidade para o crosshair ficar fixo na tela
         glm::mat4 crosshair_view = Matrix_Identity();
 
-        // Enviamos as novas matrizes para a GPU
-        glUniformMatrix4fv(g_projection_uniform, 1, GL_FALSE, glm::value_ptr(crosshair_projection));
-        glUniformMatrix4fv(g_view_uniform, 1, GL_FALSE, glm::value_ptr(crosshair_view));
+        // Enviamos as novas matrizes para a GPU, em um novo bloco do quadro
+        UploadFrameUniforms(crosshair_view, crosshair_projection);
 
         // Configuramos a cor do crosshair para preto
-        glUniform4f(glGetUniformLocation(g_GpuProgramID, "color"), 0.0f, 0.0f, 0.0f, 1.0f);
-
         glm::mat4 crosshair_model = Matrix_Identity();
-        glUniformMatrix4fv(g_model_uniform, 1, GL_FALSE, glm::value_ptr(crosshair_model));
+        DrawUniforms crosshair = MakeDrawUniforms(crosshair_model, SPHERE, glm::vec3(-1.0f), glm::vec3(1.0f), false);
+        crosshair.material.z     = true;
+        crosshair.color_override = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        BindDrawUniforms(crosshair);
 
         // Desabilitamos o teste de profundidade para o crosshair sempre aparecer sobre tudo
         glDisable(GL_DEPTH_TEST);
@@ -1736,8 +2332,7 @@ int main(int argc, char* argv[])
         glDeleteVertexArrays(1, &VAO_crosshair);
 
         // Restauramos as matrizes originais
-        glUniformMatrix4fv(g_projection_uniform, 1, GL_FALSE, glm::value_ptr(saved_projection));
-        glUniformMatrix4fv(g_view_uniform, 1, GL_FALSE, glm::value_ptr(saved_view));
+        UploadFrameUniforms(view, projection);
 
 /// ######
 
@@ -1752,6 +2347,10 @@ int main(int argc, char* argv[])
             DrawCashierDialog(window);
         }
 
+        // Os textos impressos acima são desenhados juntos, com uma única
+        // chamada de desenho.
+        TextRendering_Flush();
+
         // O framebuffer onde OpenGL executa as operações de renderização não
         // é o mesmo que está sendo mostrado para o usuário, caso contrário
         // seria possível ver artefatos conhecidos como "screen tearing". A
@@ -1768,6 +2367,27 @@ int main(int argc, char* argv[])
         glfwPollEvents();
     }
 
+    CancelShaderReload();
+    ShaderWatcher_Destroy(&g_ShaderWatcher);
+
+    // Desfazemos as referências aos modelos e texturas da cena, enquanto o
+    // contexto OpenGL ainda existe. Cada recurso sem referências é removido
+    // da GPU (veja "residency.hpp"), e o relatório deve terminar zerado.
+    DestroyStaticBatches();
+    ReleaseSceneDrawables();
+    for (size_t i = 0; i < model_filenames.size(); ++i)
+        Residency_Release(Residency_Asset(model_filenames[i], ASSET_MODEL));
+    Residency_PrintReport();
+
+    // Gravamos os programas de GPU compilados nesta execução
+    if ( g_UseProgramCache )
+    {
+        const ProgramCacheStats& stats = ProgramCache_Stats();
+        printf("Cache de programas: %d lidos, %d compilados (%d recusados pelo driver), %.1f ms de compilação economizados.\n",
+               (int)stats.hits, (int)stats.misses, (int)stats.rejected, stats.seconds_saved * 1000.0);
+        ProgramCache_Save();
+    }
+
     // Finalizamos o uso dos recursos do sistema operacional
     glfwTerminate();
 
@@ -1809,269 +2429,1442 @@ bool RayOBBIntersection(glm::vec4 ray_origin, glm::vec4 ray_direction, glm::vec4
 
 int GetObjectUnderCrosshair(glm::vec4 camera_position, glm::vec4 camera_view, std::map<std::string, SceneObject>& virtual_scene, std::map<std::string, glm::mat4>& object_matrices)
 {
+    // Objetos que podem ser apontados, e o "object_id" retornado para cada um
+    static const struct { const char* name; int object_id; } pickable[] = {
+        { "the_bunny",         BUNNY },
+        { "the_baguete",       BAGUETE },
+        { "the_eggs",          EGG },
+        { "the_butter",        BUTTER },
+        { "the_cheese",        CHEESE },
+        { "maquina_pagamento", MAQUINA },
+        { "myHouse",           MYHOUSE },
+    };
+
     // Direção do raio é a direção da visão da câmera
     glm::vec4 ray_direction = normalize(camera_view);
 
-    // Testamos interseção com cada objeto da cena
-    for (const auto& obj : virtual_scene) {
-        if (obj.first == "the_bunny") {
-            glm::vec4 box_center = object_matrices[obj.first] * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
-            glm::vec4 box_extent = glm::vec4(0.5f, 0.5f, 0.5f, 0.0f);
-
-            if (RayOBBIntersection(camera_position, ray_direction, box_center, box_extent, object_matrices[obj.first])) {
-                return BUNNY;
-            }
-        }
-        else if (obj.first == "the_baguete") {
-            glm::vec4 box_center = object_matrices[obj.first] * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
-            glm::vec4 box_extent = glm::vec4(0.5f, 0.5f, 0.5f, 0.0f);
-
-            if (RayOBBIntersection(camera_position, ray_direction, box_center, box_extent, object_matrices[obj.first])) {
-                return BAGUETE;
-            }
-        }
-        else if (obj.first == "the_eggs")
-        {
-            glm::vec4 box_center = object_matrices[obj.first] * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
-            glm::vec4 box_extent = glm::vec4(0.5f, 0.5f, 0.5f, 0.0f);
-
-            if (RayOBBIntersection(camera_position, ray_direction, box_center, box_extent, object_matrices[obj.first]))
-            {
-                return EGG;
-            }
-        }
-
-        else if (obj.first == "the_butter")
-        {
-            glm::vec4 box_center = object_matrices[obj.first] * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
-            glm::vec4 box_extent = glm::vec4(0.5f, 0.5f, 0.5f, 0.0f);
-
-            if (RayOBBIntersection(camera_position, ray_direction, box_center, box_extent, object_matrices[obj.first]))
-            {
-                return BUTTER;
-            }
-        }
-
-        else if (obj.first == "the_cheese")
-        {
-            glm::vec4 box_center = object_matrices[obj.first] * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
-            glm::vec4 box_extent = glm::vec4(0.5f, 0.5f, 0.5f, 0.0f);
+    // Em vez de testar cada objeto da cena, consultamos g_SceneBvh: somente
+    // as instâncias cuja AABB é atingida pelo raio são testadas, da mais
+    // próxima para a mais distante.
+    static std::vector<SceneBvhHit> hits;
+    hits.clear();
+    SceneBvh_QueryRay(&g_SceneBvh, glm::vec3(camera_position), glm::vec3(ray_direction), std::numeric_limits<float>::infinity(), &hits);
 
-            if (RayOBBIntersection(camera_position, ray_direction, box_center, box_extent, object_matrices[obj.first]))
-            {
-                return CHEESE;
-            }
-        }
+    for (size_t i = 0; i < hits.size(); ++i)
+    {
+        const SceneObject* object = g_SceneInstances[hits[i].user_data].object;
+        if ( virtual_scene.find(object->name) == virtual_scene.end() )
+            continue;
 
-        else if (obj.first == "maquina_pagamento")
+        for (size_t p = 0; p < sizeof(pickable) / sizeof(pickable[0]); ++p)
         {
-            glm::vec4 box_center = object_matrices[obj.first] * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
-            glm::vec4 box_extent = glm::vec4(0.5f, 0.5f, 0.5f, 0.0f);
+            if ( object->name != pickable[p].name )
+                continue;
 
-            if (RayOBBIntersection(camera_position, ray_direction, box_center, box_extent, object_matrices[obj.first]))
-            {
-                return MAQUINA;
-            }
-        }
+            std::map<std::string, glm::mat4>::const_iterator matrix = object_matrices.find(object->name);
+            if ( matrix == object_matrices.end() )
+                continue;
 
-        else if (obj.first == "myHouse")
-        {
-            glm::vec4 box_center = object_matrices[obj.first] * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+            glm::vec4 box_center = matrix->second * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
             glm::vec4 box_extent = glm::vec4(0.5f, 0.5f, 0.5f, 0.0f);
 
-            if (RayOBBIntersection(camera_position, ray_direction, box_center, box_extent, object_matrices[obj.first]))
-            {
-                return MYHOUSE;
-            }
+            if (RayOBBIntersection(camera_position, ray_direction, box_center, box_extent, matrix->second))
+                return pickable[p].object_id;
         }
-
     }
     return -1; // Nenhum objeto encontrado
 }
 
 
-// Função que carrega uma imagem para ser utilizada como textura
+// Função que carrega uma imagem para ser utilizada como textura. A leitura e
+// decodificação da imagem são feitas por DecodeTextureImage() em uma thread
+// auxiliar (veja "assetloader.hpp"), e o envio para a GPU por
+// UploadTextureImage() na thread do contexto OpenGL, na ordem das chamadas
+// desta função; assim a textura recebe sempre a mesma unidade de textura.
 void LoadTextureImage(const char* filename)
 {
-    printf("Carregando imagem \"%s\"... ", filename);
-
-    // Primeiro fazemos a leitura da imagem do disco
+    // stbi_set_flip_vertically_on_load() altera uma variável global da
+    // stb_image, portanto é chamada aqui (na thread principal) e não durante
+    // a decodificação.
     stbi_set_flip_vertically_on_load(true);
-    int width;
-    int height;
-    int channels;
-    unsigned char *data = stbi_load(filename, &width, &height, &channels, 3);
 
-    if ( data == NULL )
+    std::string name(filename);
+
+    // Imagens não utilizadas por nenhum objeto não são carregadas.
+    if ( Residency_RefCount(Residency_Asset(filename, ASSET_TEXTURE)) == 0 )
     {
-        fprintf(stderr, "ERROR: Cannot open image file \"%s\".\n", filename);
-        std::exit(EXIT_FAILURE);
+        AssetLoader_Submit(
+            []{},
+            [name]{ printf("Ignorando imagem \"%s\" (não utilizada).\n", name.c_str()); }
+        );
+        return;
     }
 
-    printf("OK (%dx%d).\n", width, height);
-
-    // Agora criamos objetos na GPU com OpenGL para armazenar a textura
-    GLuint texture_id;
-    GLuint sampler_id;
-    glGenTextures(1, &texture_id);
-    glGenSamplers(1, &sampler_id);
+    std::shared_ptr<LoadedTexture> loaded = std::make_shared<LoadedTexture>();
 
-    // Veja slides 95-96 do documento Aula_20_Mapeamento_de_Texturas.pdf
-    glSamplerParameteri(sampler_id, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glSamplerParameteri(sampler_id, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-    // Parâmetros de amostragem da textura.
-    glSamplerParameteri(sampler_id, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glSamplerParameteri(sampler_id, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    AssetLoader_Submit(
+        [name, loaded]{ DecodeTextureImage(name.c_str(), loaded.get()); },
+        [name, loaded]{ UploadTextureImage(name.c_str(), loaded.get()); }
+    );
+}
 
-    // Agora enviamos a imagem lida do disco para a GPU
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
-    glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
-    glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+// Obtém a textura comprimida de uma imagem: do cache, se existir e estiver
+// atualizado (veja "texturecache.hpp"); senão, decodifica a imagem, gera os
+// níveis de mipmap, comprime cada um (veja "texturecompress.hpp") e grava o
+// cache para as próximas execuções. Não utiliza OpenGL, e pode ser executada
+// em qualquer thread.
+void DecodeTextureImage(const char* filename, LoadedTexture* loaded)
+{
+    loaded->from_cache = TextureCache_Open(filename, &loaded->cache);
+    if ( loaded->from_cache )
+        return;
 
-    GLuint textureunit = g_NumLoadedTextures;
-    glActiveTexture(GL_TEXTURE0 + textureunit);
-    glBindTexture(GL_TEXTURE_2D, texture_id);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glBindSampler(textureunit, sampler_id);
+    int width, height, channels;
+    unsigned char* data = stbi_load(filename, &width, &height, &channels, 4);
+    if ( data == NULL )
+        return;
 
+    TextureCompress_Cook(data, width, height, &loaded->texture);
     stbi_image_free(data);
 
-    g_NumLoadedTextures += 1;
+    if ( !TextureCache_Write(filename, TextureData_View(loaded->texture)) )
+        fprintf(stderr, "WARNING: Não foi possível gravar o cache de \"%s\".\n", filename);
 }
 
-// Função que desenha um objeto armazenado em g_VirtualScene. Veja definição
-// dos objetos na função BuildTrianglesAndAddToVirtualScene().
-void DrawVirtualObject(const char* object_name)
+// Registra uma textura obtida por DecodeTextureImage() em um dos arrays de
+// texturas, que são enviados para a GPU após o carregamento de todas as
+// texturas (veja TextureArray_Build()), e libera a memória de CPU
+// correspondente.
+void UploadTextureImage(const char* filename, LoadedTexture* loaded)
 {
-    // "Ligamos" o VAO. Informamos que queremos utilizar os atributos de
-    // vértices apontados pelo VAO criado pela função BuildTrianglesAndAddToVirtualScene(). Veja
-    // comentários detalhados dentro da definição de BuildTrianglesAndAddToVirtualScene().
-    glBindVertexArray(g_VirtualScene[object_name].vertex_array_object_id);
+    TextureView texture = loaded->from_cache ? loaded->cache.view : TextureData_View(loaded->texture);
 
-    // Setamos as variáveis "bbox_min" e "bbox_max" do fragment shader
-    // com os parâmetros da axis-aligned bounding box (AABB) do modelo.
-    glm::vec3 bbox_min = g_VirtualScene[object_name].bbox_min;
-    glm::vec3 bbox_max = g_VirtualScene[object_name].bbox_max;
-    glUniform4f(g_bbox_min_uniform, bbox_min.x, bbox_min.y, bbox_min.z, 1.0f);
-    glUniform4f(g_bbox_max_uniform, bbox_max.x, bbox_max.y, bbox_max.z, 1.0f);
+    printf("Carregando imagem \"%s\"%s... ", filename, loaded->from_cache ? " do cache" : "");
 
-    // Pedimos para a GPU rasterizar os vértices dos eixos XYZ
-    // apontados pelo VAO como linhas. Veja a definição de
-    // g_VirtualScene[""] dentro da função BuildTrianglesAndAddToVirtualScene(), e veja
-    // a documentação da função glDrawElements() em
-    // http://docs.gl/gl3/glDrawElements.
-    glDrawElements(
-        g_VirtualScene[object_name].rendering_mode,
-        g_VirtualScene[object_name].num_indices,
-        GL_UNSIGNED_INT,
-        (void*)(g_VirtualScene[object_name].first_index * sizeof(GLuint))
-    );
+    if ( texture.levels.empty() )
+    {
+        fprintf(stderr, "ERROR: Cannot open image file \"%s\".\n", filename);
+        std::exit(EXIT_FAILURE);
+    }
 
-    // "Desligamos" o VAO, evitando assim que operações posteriores venham a
-    // alterar o mesmo. Isso evita bugs.
-    glBindVertexArray(0);
-}
+    printf("OK (%dx%d, %s, %d níveis).\n", texture.width, texture.height,
+           texture.format == TEXTURE_FORMAT_BC3 ? "BC3" : "BC1", (int)texture.levels.size());
 
-// Função que carrega os shaders de vértices e de fragmentos que serão
-// utilizados para renderização. Veja slides 180-200 do documento Aula_03_Rendering_Pipeline_Grafico.pdf.
-//
-void LoadShadersFromFiles()
-{
-    // Note que o caminho para os arquivos "shader_vertex.glsl" e
-    // "shader_fragment.glsl" estão fixados, sendo que assumimos a existência
-    // da seguinte estrutura no sistema de arquivos:
-    //
-    //    + FCG_Lab_01/
-    //    |
-    //    +--+ bin/
-    //    |  |
-    //    |  +--+ Release/  (ou Debug/ ou Linux/)
-    //    |     |
-    //    |     o-- main.exe
-    //    |
-    //    +--+ src/
-    //       |
-    //       o-- shader_vertex.glsl
-    //       |
-    //       o-- shader_fragment.glsl
-    //
-    GLuint vertex_shader_id = LoadShader_Vertex("../../src/shader_vertex.glsl");
-    GLuint fragment_shader_id = LoadShader_Fragment("../../src/shader_fragment.glsl");
+    TextureHandle handle = TextureArray_Add(filename, texture);
 
-    // Deletamos o programa de GPU anterior, caso ele exista.
-    if ( g_GpuProgramID != 0 )
-        glDeleteProgram(g_GpuProgramID);
+    if ( loaded->from_cache )
+        TextureCache_Close(&loaded->cache);
+    else
+        loaded->texture = TextureData();
 
-    // Criamos um programa de GPU utilizando os shaders carregados acima.
-    g_GpuProgramID = CreateGpuProgram(vertex_shader_id, fragment_shader_id);
-
-    // Buscamos o endereço das variáveis definidas dentro do Vertex Shader.
-    // Utilizaremos estas variáveis para enviar dados para a placa de vídeo
-    // (GPU)! Veja arquivo "shader_vertex.glsl" e "shader_fragment.glsl".
-    g_model_uniform      = glGetUniformLocation(g_GpuProgramID, "model"); // Variável da matriz "model"
-    g_view_uniform       = glGetUniformLocation(g_GpuProgramID, "view"); // Variável da matriz "view" em shader_vertex.glsl
-    g_projection_uniform = glGetUniformLocation(g_GpuProgramID, "projection"); // Variável da matriz "projection" em shader_vertex.glsl
-    g_object_id_uniform  = glGetUniformLocation(g_GpuProgramID, "object_id"); // Variável "object_id" em shader_fragment.glsl
-    g_bbox_min_uniform   = glGetUniformLocation(g_GpuProgramID, "bbox_min");
-    g_bbox_max_uniform   = glGetUniformLocation(g_GpuProgramID, "bbox_max");
-
-    // Variáveis em "shader_fragment.glsl" para acesso das imagens de textura
-    glUseProgram(g_GpuProgramID);
-    glUniform1i(glGetUniformLocation(g_GpuProgramID, "TextureImage0"), 0);
-    glUniform1i(glGetUniformLocation(g_GpuProgramID, "TextureImage1"), 1);
-
-    /// Variáveis em "shader_fragment.glsl" para acesso das imagens de textura adicionadas
-    glUniform1i(glGetUniformLocation(g_GpuProgramID, "TextureImage2"), 2); // Textura da baguete
-    glUniform1i(glGetUniformLocation(g_GpuProgramID, "TextureImage3"), 3); // Textura do asfalto
-    glUniform1i(glGetUniformLocation(g_GpuProgramID, "TextureImage4"), 4); // Textura do poste
-    glUniform1i(glGetUniformLocation(g_GpuProgramID, "TextureImage5"), 5); // Textura do lua
-    glUniform1i(glGetUniformLocation(g_GpuProgramID, "TextureImage6"), 6); // Textura do calcada
-    glUniform1i(glGetUniformLocation(g_GpuProgramID, "TextureImage7"), 7); // Textura da casa pequena
-    glUniform1i(glGetUniformLocation(g_GpuProgramID, "TextureImage8"), 8); // Textura da grama
-    glUniform1i(glGetUniformLocation(g_GpuProgramID, "TextureImage9"), 9); // Textura do posto de gasolina
-    glUniform1i(glGetUniformLocation(g_GpuProgramID, "TextureImage10"), 10); // Textura do nossa casa
-    glUniform1i(glGetUniformLocation(g_GpuProgramID, "TextureImage11"), 11); // Textura de uma das casa
-    glUniform1i(glGetUniformLocation(g_GpuProgramID, "TextureImage12"), 12); // Textura de uma da casa de madeira
-    glUniform1i(glGetUniformLocation(g_GpuProgramID, "TextureImage13"), 13); // Textura da ultima casa
-    glUniform1i(glGetUniformLocation(g_GpuProgramID, "TextureImage14"), 14); // Textura da casa pequena
-    glUniform1i(glGetUniformLocation(g_GpuProgramID, "TextureImage15"), 15); // Textura da maquina de pagamento
-    glUniform1i(glGetUniformLocation(g_GpuProgramID, "TextureImage16"), 16); // Textura do ceu estrelado
-    glUniform1i(glGetUniformLocation(g_GpuProgramID, "TextureImage17"), 17); // Textura do coelho dourado
-    glUniform1i(glGetUniformLocation(g_GpuProgramID, "TextureImage18"), 18); // Textura do queijo
-    glUniform1i(glGetUniformLocation(g_GpuProgramID, "TextureImage19"), 19); // Textura do queijo
-    glUniform1i(glGetUniformLocation(g_GpuProgramID, "TextureImage20"), 20); // Textura do queijo
-    glUseProgram(0);
+    Residency_SetResident(Residency_Asset(filename, ASSET_TEXTURE), 0,
+        TextureArray_Bytes(handle, g_TextureCompressionSupported),
+        [handle]{ TextureArray_Release(handle); });
 }
 
-// Função que pega a matriz M e guarda a mesma no topo da pilha
-void PushMatrix(glm::mat4 M)
+// Retorna a próxima instância de "object" a ser desenhada neste quadro (uma
+// posição em g_SceneInstances), criando-a se necessário.
+size_t NextObjectInstance(SceneObject& object)
 {
-    g_MatrixStack.push(M);
-}
+    if ( object.instance_frame != g_FrameIndex )
+    {
+        object.instance_frame = g_FrameIndex;
+        object.next_instance = 0;
+    }
 
-// Função que remove a matriz atualmente no topo da pilha e armazena a mesma na variável M
-void PopMatrix(glm::mat4& M)
-{
-    if ( g_MatrixStack.empty() )
+    size_t instance = object.next_instance++;
+    if ( instance < object.instances.size() )
+        return object.instances[instance];
+
+    SceneInstance state;
+    state.object = &object;
+    state.proxy = SCENEBVH_INVALID_PROXY;
+    state.lod = 0;
+    state.visible_frame = 0;
+    state.drawn_frame = 0;
+    state.occlusion = OCCLUSION_INVALID_ID;
+    state.pvs_entry = -1;
+    state.gpu_slot = GPUDRIVEN_INVALID_SLOT;
+    state.last_object_id = -1;
+    state.static_chunk = -1;
+    state.batched_frame = 0;
+
+    size_t id;
+    if ( !g_FreeSceneInstances.empty() )
     {
-        M = Matrix_Identity();
+        id = g_FreeSceneInstances.back();
+        g_FreeSceneInstances.pop_back();
+        g_SceneInstances[id] = state;
     }
     else
     {
-        M = g_MatrixStack.top();
-        g_MatrixStack.pop();
+        id = g_SceneInstances.size();
+        g_SceneInstances.push_back(state);
     }
+
+    object.instances.push_back(id);
+    return id;
 }
 
-// Função que computa as normais de um ObjModel, caso elas não tenham sido
-// especificadas dentro do arquivo ".obj"
-void ComputeNormals(ObjModel* model)
+// Remove as instâncias de um objeto de g_SceneBvh e de g_SceneInstances.
+void ReleaseObjectInstances(SceneObject& object)
 {
-    if ( !model->attrib.normals.empty() )
-        return;
+    for (size_t i = 0; i < object.instances.size(); ++i)
+    {
+        SceneInstance& instance = g_SceneInstances[object.instances[i]];
+        if ( instance.proxy != SCENEBVH_INVALID_PROXY )
+            SceneBvh_Remove(&g_SceneBvh, instance.proxy);
+        if ( instance.occlusion != OCCLUSION_INVALID_ID )
+            Occlusion_Destroy(instance.occlusion);
+        if ( instance.gpu_slot != GPUDRIVEN_INVALID_SLOT )
+            GpuDriven_Destroy(instance.gpu_slot);
+        if ( instance.static_chunk >= 0 )
+            DestroyStaticBatches();
+        instance.proxy = SCENEBVH_INVALID_PROXY;
+        instance.occlusion = OCCLUSION_INVALID_ID;
+        instance.gpu_slot = GPUDRIVEN_INVALID_SLOT;
+        g_FreeSceneInstances.push_back(object.instances[i]);
+    }
+    object.instances.clear();
+}
+
+void FindVisibleSceneInstances()
+{
+    static std::vector<uint32_t> visible;
+    visible.clear();
+    SceneBvh_QueryFrustum(&g_SceneBvh, g_ViewFrustum, &visible);
+
+    for (size_t i = 0; i < visible.size(); ++i)
+    {
+        SceneInstance& instance = g_SceneInstances[visible[i]];
+
+        // Instâncias que deixaram de ser desenhadas (por exemplo, itens já
+        // pegos pelo jogador) são removidas da árvore quando aparecem em uma
+        // consulta; se voltarem a ser desenhadas, são inseridas novamente.
+        if ( instance.drawn_frame + 1 < g_FrameIndex )
+        {
+            SceneBvh_Remove(&g_SceneBvh, instance.proxy);
+            instance.proxy = SCENEBVH_INVALID_PROXY;
+            continue;
+        }
+
+        instance.visible_frame = g_FrameIndex;
+    }
+}
+
+// Caixa do oclusor, dentro da AABB do prédio (veja g_OccluderWidth)
+void SceneOccluderBox(const SceneOccluder& occluder, glm::vec3* box_min, glm::vec3* box_max)
+{
+    glm::vec3 size   = occluder.bbox_max - occluder.bbox_min;
+    glm::vec3 center = 0.5f * (occluder.bbox_min + occluder.bbox_max);
+    *box_min = glm::vec3(center.x - 0.5f * g_OccluderWidth * size.x, occluder.bbox_min.y, center.z - 0.5f * g_OccluderWidth * size.z);
+    *box_max = glm::vec3(center.x + 0.5f * g_OccluderWidth * size.x, occluder.bbox_min.y + g_OccluderHeight * size.y, center.z + 0.5f * g_OccluderWidth * size.z);
+}
+
+void RasterizeSceneOccluders(const glm::mat4& projection_view, const glm::vec3& view_position)
+{
+    SoftOcclusion_Begin(projection_view);
+
+    if ( g_UseSoftwareOcclusion )
+    {
+        for (size_t i = 0; i < g_SceneOccluders.size(); ++i)
+        {
+            const SceneOccluder& occluder = g_SceneOccluders[i];
+
+            // Um prédio com a câmera dentro da sua AABB não esconde nada:
+            // ela pode estar entre as paredes e o oclusor.
+            glm::vec3 local_view = glm::vec3(glm::inverse(occluder.model) * glm::vec4(view_position, 1.0f));
+            if ( glm::all(glm::greaterThanEqual(local_view, occluder.bbox_min)) && glm::all(glm::lessThanEqual(local_view, occluder.bbox_max)) )
+                continue;
+
+            glm::vec3 box_min, box_max;
+            SceneOccluderBox(occluder, &box_min, &box_max);
+            SoftOcclusion_RasterizeBox(occluder.model, box_min, box_max);
+        }
+    }
+
+    g_SceneOccluders.swap(g_NextSceneOccluders);
+    g_NextSceneOccluders.clear();
+}
+
+// Escolhe o nível de detalhe de uma instância de "object", onde uma unidade
+// do modelo ocupa "pixels_per_unit" pixels na tela. Retorna 0 para a malha
+// original, ou i+1 para o nível object.lods[i].
+int SelectObjectLod(const SceneObject& object, SceneInstance& instance, float pixels_per_unit)
+{
+    if ( !g_UseMeshLods || object.lods.empty() )
+        return 0;
+
+    int current = std::min(instance.lod, (int)object.lods.size());
+
+    // Nível menos detalhado cujo erro na tela não ultrapassa g_LodPixelError
+    int level = 0;
+    for (size_t i = 0; i < object.lods.size(); ++i)
+        if ( object.lods[i].error * pixels_per_unit <= g_LodPixelError )
+            level = (int)i + 1;
+
+    // Trocamos para um nível mais detalhado imediatamente, mas para um
+    // menos detalhado somente com uma folga de g_LodHysteresis.
+    while ( level > current && object.lods[level - 1].error * pixels_per_unit > g_LodPixelError * (1.0f - g_LodHysteresis) )
+        level -= 1;
+
+    instance.lod = level;
+    return level;
+}
+
+// Função que desenha um objeto armazenado em g_VirtualScene. Veja definição
+// dos objetos na função BuildTrianglesAndAddToVirtualScene().
+void DrawVirtualObject(const char* object_name)
+{
+    // Objetos que não foram carregados (ou que foram removidos da memória,
+    // veja "residency.hpp") são ignorados.
+    std::map<std::string, SceneObject>::iterator it = g_VirtualScene.find(object_name);
+    if ( it == g_VirtualScene.end() )
+        return;
+
+    SceneObject& object = it->second;
+
+    glm::vec3 bbox_min = object.bbox_min;
+    glm::vec3 bbox_max = object.bbox_max;
+
+    // Estimamos o tamanho do objeto na tela, em pixels, a partir da esfera
+    // que envolve a sua bounding box.
+    glm::vec4 center = g_ViewMatrix * g_ModelMatrix * glm::vec4(0.5f*(bbox_min + bbox_max), 1.0f);
+    float scale = std::max(glm::length(glm::vec3(g_ModelMatrix[0])),
+                  std::max(glm::length(glm::vec3(g_ModelMatrix[1])), glm::length(glm::vec3(g_ModelMatrix[2]))));
+    float radius = 0.5f * scale * glm::length(bbox_max - bbox_min);
+    float depth = -center.z;
+    float pixels = (depth > radius) ? radius * g_ProjectionMatrix[1][1] * g_ScreenHeight / depth : (float)g_ScreenHeight * 16.0f;
+
+    size_t instance_id = NextObjectInstance(object);
+    SceneInstance& instance = g_SceneInstances[instance_id];
+    bool drawn_last_frame = instance.drawn_frame + 1 == g_FrameIndex;
+    instance.drawn_frame = g_FrameIndex;
+
+    // Escolhemos o nível de detalhe a partir do tamanho na tela de uma
+    // unidade do modelo, à distância do centro do objeto.
+    float pixels_per_unit = (radius > 0.0f) ? 0.5f * pixels / (0.5f * glm::length(bbox_max - bbox_min)) : 0.0f;
+    int level = SelectObjectLod(object, instance, pixels_per_unit);
+
+    // Atualizamos a AABB da instância, em coordenadas globais, em
+    // g_SceneBvh. Se a árvore não mudou, a consulta feita no início do
+    // quadro (veja FindVisibleSceneInstances()) já diz se a instância está
+    // dentro do frustum da câmera; senão, testamos a AABB diretamente.
+    glm::vec3 world_min, world_max;
+    Frustum_TransformBox(g_ModelMatrix, bbox_min, bbox_max, &world_min, &world_max);
+    instance.world_min = world_min;
+    instance.world_max = world_max;
+
+    if ( object.occluder )
+    {
+        SceneOccluder occluder = { g_ModelMatrix, bbox_min, bbox_max };
+        g_NextSceneOccluders.push_back(occluder);
+    }
+
+    bool visible;
+    if ( instance.proxy == SCENEBVH_INVALID_PROXY )
+    {
+        instance.proxy = SceneBvh_Insert(&g_SceneBvh, world_min, world_max, (uint32_t)instance_id);
+        visible = Frustum_IntersectsBox(g_ViewFrustum, world_min, world_max);
+    }
+    else if ( SceneBvh_Move(&g_SceneBvh, instance.proxy, world_min, world_max) )
+    {
+        visible = Frustum_IntersectsBox(g_ViewFrustum, world_min, world_max);
+    }
+    else
+    {
+        visible = instance.visible_frame == g_FrameIndex;
+    }
+
+    // Instâncias estáticas que não mudaram desde o quadro anterior são
+    // entregues à GPU, que faz o descarte (veja g_UseGpuDriven). Os destaques
+    // (RENDERPASS_HIGHLIGHT) continuam neste caminho.
+    bool unchanged = drawn_last_frame && instance.last_object_id == g_CurrentObjectId && instance.last_model == g_ModelMatrix;
+
+    // A instância correspondente no PVS depende da posição, e é procurada
+    // novamente sempre que a matriz "model" muda.
+    if ( g_PvsLoaded && object.static_world && (!drawn_last_frame || instance.last_model != g_ModelMatrix) )
+        instance.pvs_entry = Pvs_FindEntry(&g_Pvs, object.name, Pvs_Key(g_ModelMatrix));
+
+    instance.last_model = g_ModelMatrix;
+    instance.last_object_id = g_CurrentObjectId;
+
+    if ( g_UseGpuDriven && object.static_world && unchanged && g_CurrentRenderPass == RENDERPASS_OPAQUE )
+    {
+        if ( instance.gpu_slot == GPUDRIVEN_INVALID_SLOT )
+            instance.gpu_slot = GpuDriven_Create();
+
+        const ObjectMaterial& material = g_ObjectMaterials[g_CurrentObjectId];
+        TextureBinding kd0 = TextureArray_Binding(material.kd0);
+        TextureBinding kd1 = TextureArray_Binding(material.kd1);
+
+        GpuDrivenInstance data;
+        data.model         = g_ModelMatrix;
+        data.normal_matrix = glm::inverse(glm::transpose(g_ModelMatrix));
+        data.bbox_min    = glm::vec4(bbox_min, 1.0f);
+        data.bbox_max    = glm::vec4(bbox_max, 1.0f);
+        data.world_min   = glm::vec4(world_min, 1.0f);
+        data.world_max   = glm::vec4(world_max, 1.0f);
+        data.material    = glm::ivec4(g_CurrentObjectId, object.quantized_vertices, 0, 0);
+        data.texture_kd0 = glm::ivec4(kd0.array, kd0.layer, kd0.min_level, material.uv_mode);
+        data.texture_kd1 = glm::ivec4(kd1.array, kd1.layer, kd1.min_level, 0);
+        GpuDriven_SetInstance(instance.gpu_slot, data);
+
+        GLuint count;
+        size_t index_offset;
+        GLint  base_vertex;
+        GetObjectLevelRange(object, level, &count, &index_offset, &base_vertex);
+        GLuint index_size = (object.index_type == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+        GpuDriven_Draw(instance.gpu_slot, object.index_type, count, (GLuint)(index_offset / index_size), base_vertex);
+
+        // Não sabemos se a GPU vai descartar a instância, então as suas
+        // texturas são pedidas como se ela fosse visível.
+        TextureArray_Request(material.kd0, pixels);
+        TextureArray_Request(material.kd1, pixels);
+        g_ObjectsGpuDriven += 1;
+        return;
+    }
+
+    // Da mesma forma, sem o caminho acima, estas instâncias são deixadas para
+    // os grupos de g_StaticBatch; se ainda não estão em um grupo, são
+    // guardadas para montá-lo ao final do quadro (veja SubmitStaticBatches()).
+    if ( g_UseStaticBatching && object.static_world && unchanged && g_CurrentRenderPass == RENDERPASS_OPAQUE )
+    {
+        if ( instance.static_chunk >= 0 )
+        {
+            instance.batched_frame = g_FrameIndex;
+
+            const ObjectMaterial& material = g_ObjectMaterials[g_CurrentObjectId];
+            TextureArray_Request(material.kd0, pixels);
+            TextureArray_Request(material.kd1, pixels);
+            return;
+        }
+
+        if ( !object.batch_indices.empty() )
+        {
+            StaticBatchCapture capture = { &object, instance_id, g_ModelMatrix, g_CurrentObjectId, g_NextStaticBatchCapture++ };
+            g_StaticBatchCapture.push_back(capture);
+        }
+    }
+
+    // Descartamos instâncias completamente fora do frustum da câmera
+    if ( g_UseFrustumCulling && !visible )
+    {
+        g_ObjectsCulled += 1;
+        return;
+    }
+
+    // Descartamos instâncias estáticas que não podem ser vistas da célula
+    // da câmera, segundo o PVS
+    if ( g_PvsCell >= 0 && instance.pvs_entry >= 0 && !Pvs_IsVisible(&g_Pvs, g_PvsCell, instance.pvs_entry) )
+    {
+        const PvsEntry& entry = g_Pvs.entries[instance.pvs_entry];
+        if ( glm::all(glm::greaterThanEqual(world_min, entry.box_min)) && glm::all(glm::lessThanEqual(world_max, entry.box_max)) )
+        {
+            if ( g_ValidatePvs )
+            {
+                PvsValidationDraw draw = { &object, g_ModelMatrix, instance.pvs_entry };
+                g_PvsValidationDraws.push_back(draw);
+            }
+            g_ObjectsPvsCulled += 1;
+            return;
+        }
+    }
+
+    // Descartamos instâncias escondidas atrás dos oclusores rasterizados
+    // na CPU
+    if ( g_UseSoftwareOcclusion && !SoftOcclusion_TestBox(world_min, world_max) )
+    {
+        g_ObjectsOccluded += 1;
+        g_ObjectsOccludedCpu += 1;
+        return;
+    }
+
+    // Descartamos instâncias que estavam escondidas atrás de outros objetos
+    // no último teste de oclusão. Objetos pequenos não valem uma consulta.
+    if ( g_UseOcclusionCulling && object.num_indices / 3 >= OCCLUSION_MIN_TRIANGLES )
+    {
+        if ( instance.occlusion == OCCLUSION_INVALID_ID )
+            instance.occlusion = Occlusion_Create();
+
+        if ( !Occlusion_Update(instance.occlusion, world_min, world_max) )
+        {
+            g_ObjectsOccluded += 1;
+            return;
+        }
+    }
+    g_ObjectsVisible += 1;
+
+    // Informamos o tamanho na tela para as texturas do objeto (veja
+    // TextureArray_Stream()).
+    const ObjectMaterial& material = g_ObjectMaterials[g_CurrentObjectId];
+    TextureArray_Request(material.kd0, pixels);
+    TextureArray_Request(material.kd1, pixels);
+
+    size_t num_indices = (level == 0) ? object.num_indices : object.lods[level - 1].num_indices;
+    g_TrianglesDrawn += num_indices / 3;
+
+    // O desenho é feito por FlushRenderQueue(), ao final do quadro
+    RenderPacket packet;
+    packet.kind         = RENDERPACKET_OBJECT;
+    packet.pass         = g_CurrentRenderPass;
+    packet.program      = GetMaterialProgram(g_CurrentObjectId, g_CurrentRenderPass == RENDERPASS_HIGHLIGHT);
+    packet.vertex_array = object.vertex_array_object_id;
+    packet.material     = g_CurrentObjectId;
+    packet.mesh         = &object;
+    packet.level        = level;
+    packet.model        = g_ModelMatrix;
+    RenderQueue_Submit(&g_RenderQueue, packet, depth);
+}
+
+// Adiciona uma instância, com a matriz "model" e o "object_id" "object_id",
+// ao grupo do seu objeto e nível de detalhe, e retorna a posição do grupo em
+// g_InstanceBatches. "position" é a posição do pacote da instância na ordem
+// de desenho de g_RenderQueue. Veja g_InstanceBatches.
+size_t AddInstanceToBatch(const SceneObject& object, int level, int object_id, const glm::mat4& model, size_t position)
+{
+    for (size_t i = 0; i < g_NumInstanceBatches; ++i)
+    {
+        InstanceBatch& batch = g_InstanceBatches[i];
+        if ( batch.object == &object && batch.level == level && batch.object_id == object_id )
+        {
+            batch.models.push_back(model);
+            return i;
+        }
+    }
+
+    if ( g_NumInstanceBatches == g_InstanceBatches.size() )
+        g_InstanceBatches.push_back(InstanceBatch());
+
+    InstanceBatch& batch = g_InstanceBatches[g_NumInstanceBatches];
+    batch.object         = &object;
+    batch.level          = level;
+    batch.object_id      = object_id;
+    batch.first_position = position;
+    batch.models.clear();
+    batch.models.push_back(model);
+    return g_NumInstanceBatches++;
+}
+
+void BeginInstancedDraws()
+{
+    if ( g_NumInstanceBatches == 0 )
+        return;
+
+    // As matrizes de todos os grupos são enviadas juntas, cada matriz
+    // "model" seguida da sua matriz das normais, e cada grupo aponta os
+    // atributos "instance_model" e "instance_normal_matrix" para o seu trecho
+    // do buffer.
+    static std::vector<glm::mat4> matrices;
+    matrices.clear();
+    for (size_t i = 0; i < g_NumInstanceBatches; ++i)
+    {
+        InstanceBatch& batch = g_InstanceBatches[i];
+        batch.first_model = matrices.size() / 2;
+        for (size_t m = 0; m < batch.models.size(); ++m)
+        {
+            matrices.push_back(batch.models[m]);
+            matrices.push_back(glm::inverse(glm::transpose(batch.models[m])));
+        }
+    }
+
+    if ( g_InstanceBuffer == 0 )
+        glGenBuffers(1, &g_InstanceBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, g_InstanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, matrices.size() * sizeof(glm::mat4), matrices.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // Uma matriz ocupa quatro atributos consecutivos, um por coluna: a
+    // matriz "model" a partir de "(location = 4)", e a das normais a partir
+    // de "(location = 8)".
+    glBindVertexArray(g_SceneVAO);
+    for (int column = 0; column < 8; ++column)
+    {
+        glVertexAttribDivisor(4 + column, 1);
+        glEnableVertexAttribArray(4 + column);
+    }
+}
+
+// Desenha o grupo "i" de g_InstanceBatches com o programa em uso, que é o
+// programa do material do grupo (veja FlushRenderQueue()).
+void DrawInstanceBatch(size_t i)
+{
+    const InstanceBatch& batch = g_InstanceBatches[i];
+
+    glBindVertexArray(g_SceneVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, g_InstanceBuffer);
+    for (int column = 0; column < 8; ++column)
+        glVertexAttribPointer(4 + column, 4, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::mat4), (void*)((batch.first_model * 8 + column) * sizeof(glm::vec4)));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    DrawUniforms draw = MakeDrawUniforms(Matrix_Identity(), batch.object_id, batch.object->bbox_min, batch.object->bbox_max, batch.object->quantized_vertices);
+    draw.material.w = true;
+    BindDrawUniforms(draw);
+    DrawObjectLevel(*batch.object, batch.level, (GLsizei)batch.models.size());
+}
+
+void EndInstancedDraws()
+{
+    if ( g_NumInstanceBatches == 0 )
+        return;
+
+    glBindVertexArray(g_SceneVAO);
+    for (int column = 0; column < 8; ++column)
+        glDisableVertexAttribArray(4 + column);
+    g_NumInstanceBatches = 0;
+}
+
+void FlushRenderQueue()
+{
+    RenderQueue_Sort(&g_RenderQueue);
+
+    // Os blocos "DrawUniforms" dos pacotes desenhados individualmente (os
+    // objetos do passo RENDERPASS_OPAQUE são agrupados em g_InstanceBatches,
+    // se o desenho instanciado está ligado) são montados na ordem de desenho
+    // e enviados em poucas cópias para g_UniformRing; cada desenho somente
+    // liga o seu trecho.
+    static std::vector<DrawUniforms> draws;
+    static std::vector<size_t>       draw_index; // Posição em "draws" (ou em g_InstanceBatches) de cada pacote, na ordem de desenho
+    draws.clear();
+    draw_index.assign(g_RenderQueue.order.size(), 0);
+    g_NumInstanceBatches = 0;
+    for (size_t i = 0; i < g_RenderQueue.order.size(); ++i)
+    {
+        const RenderPacket& packet = g_RenderQueue.packets[g_RenderQueue.order[i]];
+        if ( packet.kind == RENDERPACKET_GPU_DRIVEN )
+            continue;
+        if ( packet.kind == RENDERPACKET_OBJECT && packet.pass == RENDERPASS_OPAQUE && g_UseInstancing )
+        {
+            draw_index[i] = AddInstanceToBatch(*(const SceneObject*)packet.mesh, packet.level, packet.material, packet.model, i);
+            continue;
+        }
+
+        // Os vértices dos grupos estáticos já estão em coordenadas globais,
+        // no formato com floats.
+        DrawUniforms draw;
+        if ( packet.kind == RENDERPACKET_STATIC_CHUNK )
+        {
+            const StaticBatchChunk& chunk = *(const StaticBatchChunk*)packet.mesh;
+            draw = MakeDrawUniforms(packet.model, packet.material, chunk.world_min, chunk.world_max, false);
+        }
+        else
+        {
+            const SceneObject& object = *(const SceneObject*)packet.mesh;
+            draw = MakeDrawUniforms(packet.model, packet.material, object.bbox_min, object.bbox_max, object.quantized_vertices);
+        }
+        if ( packet.pass == RENDERPASS_HIGHLIGHT )
+        {
+            // Os destaques são desenhados com uma única cor
+            draw.material.z     = true;
+            draw.color_override = glm::vec4(1.0f, 1.0f, 0.0f, 1.0f);
+        }
+        draw_index[i] = draws.size();
+        draws.push_back(draw);
+    }
+
+    const size_t stride      = UniformRing_Stride(&g_UniformRing, sizeof(DrawUniforms));
+    const size_t block_draws = 1024; // Desenhos por cópia para g_UniformRing
+    static std::vector<unsigned char> block;
+    size_t block_first  = 0; // Primeiro desenho da cópia atual
+    size_t block_offset = 0; // Posição da cópia atual em g_UniformRing
+    size_t block_count  = 0;
+    unsigned block_generation = g_UniformRing.generation;
+
+    int    pass     = -1;
+    GLuint program  = g_GpuProgramID;
+
+    for (size_t i = 0; i < g_RenderQueue.order.size(); ++i)
+    {
+        const RenderPacket& packet = g_RenderQueue.packets[g_RenderQueue.order[i]];
+
+        if ( packet.pass != pass )
+        {
+            if ( pass >= 0 )
+                EndRenderPass((RenderPass)pass);
+            BeginRenderPass(packet.pass);
+            pass = packet.pass;
+        }
+
+        if ( packet.program != program )
+        {
+            glUseProgram(packet.program);
+            program = packet.program;
+        }
+
+        // GpuDriven_Flush() descarta as instâncias e as desenha com o
+        // programa do pacote, e restaura o programa em uso.
+        if ( packet.kind == RENDERPACKET_GPU_DRIVEN )
+        {
+            GpuDriven_Flush(g_ViewFrustum, packet.program);
+            continue;
+        }
+
+        // Um grupo de instâncias é desenhado no lugar do seu primeiro pacote
+        if ( packet.kind == RENDERPACKET_OBJECT && packet.pass == RENDERPASS_OPAQUE && g_UseInstancing )
+        {
+            if ( g_InstanceBatches[draw_index[i]].first_position == i )
+                DrawInstanceBatch(draw_index[i]);
+            continue;
+        }
+
+        size_t draw = draw_index[i];
+        // Uma nova cópia é enviada ao fim da anterior, ou se o buffer foi
+        // trocado desde ela (por exemplo, por DrawInstanceBatch()).
+        if ( draw >= block_first + block_count || g_UniformRing.generation != block_generation )
+        {
+            block_first = draw;
+            block_count = std::min(block_draws, draws.size() - draw);
+            block.assign(block_count * stride, 0);
+            for (size_t d = 0; d < block_count; ++d)
+                memcpy(&block[d * stride], &draws[block_first + d], sizeof(DrawUniforms));
+
+            block_offset = UniformRing_Upload(&g_UniformRing, block.data(), block.size());
+            block_generation = g_UniformRing.generation;
+            if ( g_UniformRing.generation != g_FrameUniformsGeneration )
+                UploadFrameUniforms(g_FrameUniforms.view, g_FrameUniforms.projection);
+        }
+
+        UniformRing_Bind(&g_UniformRing, DRAW_UNIFORMS_BINDING, block_offset + (draw - block_first) * stride, sizeof(DrawUniforms));
+        if ( packet.kind == RENDERPACKET_STATIC_CHUNK )
+            StaticBatch_Draw(&g_StaticBatch, (size_t)packet.level);
+        else
+            DrawObjectLevel(*(const SceneObject*)packet.mesh, packet.level);
+    }
+
+    if ( pass >= 0 )
+        EndRenderPass((RenderPass)pass);
+    if ( program != g_GpuProgramID )
+        glUseProgram(g_GpuProgramID);
+}
+
+void BeginRenderPass(RenderPass pass)
+{
+    switch ( pass )
+    {
+    case RENDERPASS_SKY:
+        // O céu é visto por dentro da esfera, e fica atrás de todos os
+        // objetos desenhados depois dele.
+        glCullFace(GL_FRONT);
+        glDepthMask(GL_FALSE);
+        break;
+
+    case RENDERPASS_OPAQUE:
+        // Os objetos opacos têm todos o mesmo estado do OpenGL, e podem ser
+        // agrupados em desenhos instanciados (veja g_InstanceBatches).
+        BeginInstancedDraws();
+        break;
+
+    case RENDERPASS_HIGHLIGHT:
+        // Os destaques são desenhados com uma única cor (veja
+        // FlushRenderQueue()), marcando o stencil buffer.
+        glEnable(GL_STENCIL_TEST);
+        glStencilFunc(GL_ALWAYS, 1, 0xFF);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+        glStencilMask(0xFF);
+        break;
+    }
+}
+
+void EndRenderPass(RenderPass pass)
+{
+    switch ( pass )
+    {
+    case RENDERPASS_SKY:
+        glDepthMask(GL_TRUE);
+        glCullFace(GL_BACK);
+        break;
+
+    case RENDERPASS_OPAQUE:
+        EndInstancedDraws();
+        break;
+
+    case RENDERPASS_HIGHLIGHT:
+        glDisable(GL_STENCIL_TEST);
+        break;
+    }
+}
+
+// Monta os grupos de g_StaticBatch com as instâncias de g_StaticBatchCapture,
+// a partir das cópias das malhas em SceneObject::batch_vertices. Grupos cujas
+// instâncias não mudaram são copiados na GPU (veja StaticBatch_Build()).
+void BuildStaticBatches()
+{
+    std::vector<StaticBatchSource> sources(g_StaticBatchCapture.size());
+    for (size_t i = 0; i < g_StaticBatchCapture.size(); ++i)
+    {
+        const StaticBatchCapture& capture = g_StaticBatchCapture[i];
+        const SceneObject& object = *capture.object;
+
+        StaticBatchSource& source = sources[i];
+        source.vertices     = object.batch_vertices.data();
+        source.num_vertices = object.batch_vertices.size();
+        source.indices      = object.batch_indices.data();
+        source.num_indices  = object.batch_indices.size();
+        source.bbox_min     = object.bbox_min;
+        source.bbox_max     = object.bbox_max;
+        source.model        = capture.model;
+        source.material     = capture.object_id;
+        source.id           = capture.id;
+    }
+
+    StaticBatch_Build(&g_StaticBatch, sources, g_StaticBatchChunkSize);
+
+    for (size_t c = 0; c < g_StaticBatch.chunks.size(); ++c)
+    {
+        const StaticBatchChunk& chunk = g_StaticBatch.chunks[c];
+        for (size_t s = 0; s < chunk.sources.size(); ++s)
+            g_SceneInstances[g_StaticBatchCapture[chunk.sources[s]].instance_id].static_chunk = (int)c;
+    }
+}
+
+void DestroyStaticBatches()
+{
+    for (size_t i = 0; i < g_StaticBatchCapture.size(); ++i)
+        g_SceneInstances[g_StaticBatchCapture[i].instance_id].static_chunk = -1;
+
+    g_StaticBatchCapture.clear();
+    StaticBatch_Destroy(&g_StaticBatch);
+}
+
+// Testa se uma instância passa pelos descartes por frustum, PVS e oclusão na
+// CPU, como em DrawVirtualObject(), pela AABB do seu último desenho.
+bool StaticInstanceVisible(const SceneInstance& instance)
+{
+    if ( g_UseFrustumCulling && !Frustum_IntersectsBox(g_ViewFrustum, instance.world_min, instance.world_max) )
+        return false;
+
+    if ( g_PvsCell >= 0 && instance.pvs_entry >= 0 && !Pvs_IsVisible(&g_Pvs, g_PvsCell, instance.pvs_entry) )
+    {
+        const PvsEntry& entry = g_Pvs.entries[instance.pvs_entry];
+        if ( glm::all(glm::greaterThanEqual(instance.world_min, entry.box_min)) && glm::all(glm::lessThanEqual(instance.world_max, entry.box_max)) )
+            return false;
+    }
+
+    if ( g_UseSoftwareOcclusion && !SoftOcclusion_TestBox(instance.world_min, instance.world_max) )
+        return false;
+
+    return true;
+}
+
+// Envia para g_RenderQueue, no passo RENDERPASS_OPAQUE, os grupos de
+// g_StaticBatch que passam pelos descartes, à distância do centro da sua AABB.
+void SubmitStaticBatches()
+{
+    // Um grupo muda se alguma das suas instâncias mudou ou não foi desenhada
+    // neste quadro (veja UpdateStaticBatches()). As demais instâncias do
+    // grupo são enviadas individualmente, com os descartes de cada
+    // instância. Instâncias guardadas neste quadro, ainda sem grupo, já
+    // foram enviadas por DrawVirtualObject().
+    std::vector<bool> changed(g_StaticBatch.chunks.size(), false);
+    for (size_t i = 0; i < g_StaticBatchCapture.size(); ++i)
+    {
+        const SceneInstance& instance = g_SceneInstances[g_StaticBatchCapture[i].instance_id];
+        if ( instance.static_chunk >= 0 && instance.batched_frame != g_FrameIndex )
+            changed[instance.static_chunk] = true;
+    }
+
+    for (size_t c = 0; c < g_StaticBatch.chunks.size(); ++c)
+    {
+        const StaticBatchChunk& chunk = g_StaticBatch.chunks[c];
+
+        if ( changed[c] )
+        {
+            for (size_t s = 0; s < chunk.sources.size(); ++s)
+            {
+                const StaticBatchCapture& capture = g_StaticBatchCapture[chunk.sources[s]];
+                const SceneInstance& instance = g_SceneInstances[capture.instance_id];
+                if ( instance.batched_frame != g_FrameIndex || !StaticInstanceVisible(instance) )
+                    continue;
+
+                const SceneObject& object = *capture.object;
+                glm::vec4 center = g_ViewMatrix * capture.model * glm::vec4(0.5f*(object.bbox_min + object.bbox_max), 1.0f);
+
+                RenderPacket packet;
+                packet.kind         = RENDERPACKET_OBJECT;
+                packet.pass         = RENDERPASS_OPAQUE;
+                packet.program      = GetMaterialProgram(capture.object_id, false);
+                packet.vertex_array = object.vertex_array_object_id;
+                packet.material     = capture.object_id;
+                packet.mesh         = &object;
+                packet.level        = 0;
+                packet.model        = capture.model;
+                RenderQueue_Submit(&g_RenderQueue, packet, -center.z);
+
+                g_TrianglesDrawn += object.num_indices / 3;
+            }
+            continue;
+        }
+
+        // O grupo é descartado como uma instância, pela sua AABB. Pelo PVS,
+        // ele é visível se alguma das suas instâncias é.
+        bool pvs_visible = g_PvsCell < 0;
+        for (size_t s = 0; s < chunk.sources.size() && !pvs_visible; ++s)
+        {
+            const SceneInstance& instance = g_SceneInstances[g_StaticBatchCapture[chunk.sources[s]].instance_id];
+            if ( instance.pvs_entry < 0 || Pvs_IsVisible(&g_Pvs, g_PvsCell, instance.pvs_entry) )
+                pvs_visible = true;
+        }
+
+        if ( g_UseFrustumCulling && !Frustum_IntersectsBox(g_ViewFrustum, chunk.world_min, chunk.world_max) )
+            continue;
+        if ( !pvs_visible )
+            continue;
+        if ( g_UseSoftwareOcclusion && !SoftOcclusion_TestBox(chunk.world_min, chunk.world_max) )
+            continue;
+
+        glm::vec4 center = g_ViewMatrix * glm::vec4(0.5f*(chunk.world_min + chunk.world_max), 1.0f);
+
+        RenderPacket packet;
+        packet.kind         = RENDERPACKET_STATIC_CHUNK;
+        packet.pass         = RENDERPASS_OPAQUE;
+        packet.program      = GetMaterialProgram(chunk.material, false);
+        packet.vertex_array = g_StaticBatch.vertex_array;
+        packet.material     = chunk.material;
+        packet.mesh         = &chunk;
+        packet.level        = (int)c;
+        packet.model        = Matrix_Identity();
+        RenderQueue_Submit(&g_RenderQueue, packet, -center.z);
+
+        g_StaticChunksDrawn += 1;
+        g_TrianglesDrawn += chunk.num_indices / 3;
+    }
+}
+
+// Retira de g_StaticBatchCapture as instâncias que mudaram ou não foram
+// desenhadas neste quadro, e monta novamente os grupos que mudaram, junto com
+// as instâncias guardadas neste quadro. Como os pacotes enviados por
+// SubmitStaticBatches() apontam para os grupos atuais, deve ser chamada após
+// FlushRenderQueue().
+void UpdateStaticBatches()
+{
+    bool rebuild = false;
+    size_t kept = 0;
+    for (size_t i = 0; i < g_StaticBatchCapture.size(); ++i)
+    {
+        SceneInstance& instance = g_SceneInstances[g_StaticBatchCapture[i].instance_id];
+        if ( instance.static_chunk < 0 )
+        {
+            rebuild = true;
+        }
+        else if ( instance.batched_frame != g_FrameIndex )
+        {
+            instance.static_chunk = -1;
+            rebuild = true;
+            continue;
+        }
+        g_StaticBatchCapture[kept++] = g_StaticBatchCapture[i];
+    }
+    g_StaticBatchCapture.resize(kept);
+
+    if ( rebuild )
+        BuildStaticBatches();
+}
+
+// Desenha o nível de detalhe "level" de um objeto (0 para a malha original,
+// ou i+1 para object.lods[i]) com o bloco "DrawUniforms" ligado, sem nenhum
+// teste. Se "num_instances" for maior que zero, desenha este número de
+// instâncias, com as matrizes do atributo "instance_model" (veja
+// DrawInstanceBatch()).
+void DrawObjectLevel(const SceneObject& object, int level, GLsizei num_instances)
+{
+    // "Ligamos" o VAO. Todos os objetos usam o mesmo VAO, que aponta para as
+    // arenas de vértices e de índices (veja BuildTrianglesAndAddToVirtualScene()),
+    // de forma que ele permanece ligado entre desenhos consecutivos.
+    glBindVertexArray(object.vertex_array_object_id);
+
+    GLuint num_indices;
+    size_t index_offset;
+    GLint  base_vertex;
+    GetObjectLevelRange(object, level, &num_indices, &index_offset, &base_vertex);
+
+    // Pedimos para a GPU rasterizar os vértices dos eixos XYZ
+    // apontados pelo VAO como linhas. Veja a definição de
+    // g_VirtualScene[""] dentro da função BuildTrianglesAndAddToVirtualScene(), e veja
+    // a documentação da função glDrawElementsBaseVertex() em
+    // http://docs.gl/gl3/glDrawElementsBaseVertex.
+    if ( num_instances > 0 )
+    {
+        glDrawElementsInstancedBaseVertex(
+            object.rendering_mode,
+            num_indices,
+            object.index_type,
+            (void*)index_offset,
+            num_instances,
+            base_vertex
+        );
+        return;
+    }
+
+    glDrawElementsBaseVertex(
+        object.rendering_mode,
+        num_indices,
+        object.index_type,
+        (void*)index_offset,
+        base_vertex
+    );
+}
+
+// Retorna o número de índices, a posição (em bytes) do primeiro índice no
+// buffer de g_IndexArena e o primeiro vértice em g_VertexArena do nível de
+// detalhe "level" de um objeto.
+void GetObjectLevelRange(const SceneObject& object, int level, GLuint* count, size_t* index_offset, GLint* base_vertex)
+{
+    const SceneMesh& mesh = g_SceneMeshes[object.mesh_id];
+
+    size_t num_indices = (level == 0) ? object.num_indices : object.lods[level - 1].num_indices;
+    size_t lod_offset  = (level == 0) ? object.index_offset : object.lods[level - 1].index_offset;
+
+    // Os vértices e índices do objeto estão dentro dos blocos do seu modelo
+    // nas arenas, cujas posições podem mudar caso as arenas sejam
+    // compactadas; por isso as consultamos a cada desenho.
+    *count        = (GLuint)num_indices;
+    *base_vertex  = (GLint)(GpuArena_Offset(&g_VertexArena, mesh.vertex_block) / g_VertexArena.alignment) + object.base_vertex;
+    *index_offset = GpuArena_Offset(&g_IndexArena, mesh.index_block) + lod_offset;
+}
+
+// Desenha as instâncias descartadas pelo PVS neste quadro, sem escrever cor
+// nem profundidade, contando os fragmentos que passam no teste de
+// profundidade: são os pixels em que a imagem sem o PVS seria
+// diferente da imagem desenhada. Cada instância com pixels visíveis é
+// informada no terminal uma vez por célula.
+void ValidatePvs()
+{
+    static std::vector<GLuint> queries;
+    static std::set< std::pair<int, int> > reported;
+
+    size_t num_draws = g_PvsValidationDraws.size();
+    while ( queries.size() < num_draws )
+    {
+        GLuint query;
+        glGenQueries(1, &query);
+        queries.push_back(query);
+    }
+
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+    for (size_t i = 0; i < num_draws; ++i)
+    {
+        const SceneObject& object = *g_PvsValidationDraws[i].object;
+        BindDrawUniforms(MakeDrawUniforms(g_PvsValidationDraws[i].model, 0, object.bbox_min, object.bbox_max, object.quantized_vertices));
+        glBeginQuery(GL_SAMPLES_PASSED, queries[i]);
+        DrawObjectLevel(object, 0);
+        glEndQuery(GL_SAMPLES_PASSED);
+    }
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDepthMask(GL_TRUE);
+
+    // Somente para validação: esperamos pelos resultados neste quadro.
+    for (size_t i = 0; i < num_draws; ++i)
+    {
+        GLuint samples = 0;
+        glGetQueryObjectuiv(queries[i], GL_QUERY_RESULT, &samples);
+
+        const PvsEntry& entry = g_Pvs.entries[g_PvsValidationDraws[i].pvs_entry];
+        if ( samples > 0 && reported.insert(std::make_pair(g_PvsCell, g_PvsValidationDraws[i].pvs_entry)).second )
+            fprintf(stderr, "PVS: %s em (%.2f, %.2f, %.2f) foi descartado na célula %d, mas teria %u pixels visíveis.\n",
+                    entry.object.c_str(), entry.position.x * PVS_POSITION_STEP, entry.position.y * PVS_POSITION_STEP,
+                    entry.position.z * PVS_POSITION_STEP, g_PvsCell, samples);
+    }
+
+    g_PvsValidationDraws.clear();
+}
+
+// Monta as instâncias do PVS a partir das instâncias dos objetos estáticos
+// desenhadas no quadro atual, e os oclusores a partir dos desenhados.
+void GatherScenePvsInput(std::vector<PvsEntry>* entries, std::vector<PvsOccluder>* occluders)
+{
+    entries->clear();
+    for (std::map<std::string, SceneObject>::iterator it = g_VirtualScene.begin(); it != g_VirtualScene.end(); ++it)
+    {
+        const SceneObject& object = it->second;
+        if ( !object.static_world || object.name.size() >= PVS_MAX_NAME )
+            continue;
+
+        for (size_t i = 0; i < object.instances.size(); ++i)
+        {
+            const SceneInstance& instance = g_SceneInstances[object.instances[i]];
+            if ( instance.drawn_frame != g_FrameIndex )
+                continue;
+
+            PvsEntry entry;
+            entry.object   = object.name;
+            entry.position = Pvs_Key(instance.last_model);
+            entry.box_min  = instance.world_min - glm::vec3(g_PvsMargin);
+            entry.box_max  = instance.world_max + glm::vec3(g_PvsMargin);
+            entries->push_back(entry);
+        }
+    }
+
+    occluders->clear();
+    for (size_t i = 0; i < g_NextSceneOccluders.size(); ++i)
+    {
+        PvsOccluder occluder;
+        occluder.model     = g_NextSceneOccluders[i].model;
+        occluder.outer_min = g_NextSceneOccluders[i].bbox_min;
+        occluder.outer_max = g_NextSceneOccluders[i].bbox_max;
+        SceneOccluderBox(g_NextSceneOccluders[i], &occluder.box_min, &occluder.box_max);
+        occluders->push_back(occluder);
+    }
+}
+
+// Ao final do primeiro quadro, compara o PVS lido de g_PvsFilename com as
+// instâncias e os oclusores da cena. Se a cena mudou desde o cálculo, o
+// arquivo é descartado; senão, o PVS passa a ser usado.
+void CheckScenePvs()
+{
+    g_PvsPending = false;
+
+    std::vector<PvsEntry> entries;
+    std::vector<PvsOccluder> occluders;
+    GatherScenePvsInput(&entries, &occluders);
+
+    if ( Pvs_SceneHash(entries, occluders) != g_Pvs.scene_hash )
+    {
+        fprintf(stderr, "WARNING: O PVS em \"%s\" foi calculado para outra cena e não será usado; use a opção \"--bake-pvs\" para recalculá-lo.\n", g_PvsFilename);
+        g_Pvs = Pvs();
+        return;
+    }
+
+    g_PvsLoaded = true;
+    for (std::map<std::string, SceneObject>::iterator it = g_VirtualScene.begin(); it != g_VirtualScene.end(); ++it)
+    {
+        const SceneObject& object = it->second;
+        if ( !object.static_world )
+            continue;
+
+        for (size_t i = 0; i < object.instances.size(); ++i)
+        {
+            SceneInstance& instance = g_SceneInstances[object.instances[i]];
+            instance.pvs_entry = Pvs_FindEntry(&g_Pvs, object.name, Pvs_Key(instance.last_model));
+        }
+    }
+}
+
+// Calcula o PVS a partir das instâncias e dos oclusores desenhados no quadro
+// atual, e o grava em g_PvsFilename.
+void BakeScenePvs()
+{
+    std::vector<PvsEntry> entries;
+    std::vector<PvsOccluder> occluders;
+    GatherScenePvsInput(&entries, &occluders);
+
+    // As células cobrem a área onde a câmera pode andar (veja os limites da
+    // posição da câmera em main()), na altura fixa dos olhos.
+    printf("PVS: calculando para %d instâncias e %d oclusores...\n", (int)entries.size(), (int)occluders.size());
+    double start = glfwGetTime();
+
+    Pvs_Bake(&g_Pvs, glm::vec3(-85.0f, g_CameraAlturaFixa, -195.0f), glm::vec3(85.0f, g_CameraAlturaFixa, 83.0f), g_PvsCellSize, entries, occluders);
+
+    size_t num_cells = g_Pvs.cells_x * g_Pvs.cells_z;
+    size_t total_visible = 0;
+    for (size_t cell = 0; cell < num_cells; ++cell)
+        total_visible += Pvs_CountVisible(&g_Pvs, (int)cell);
+
+    printf("PVS: %dx%d células em %.1f s, em média %.1f instâncias visíveis por célula.\n",
+           g_Pvs.cells_x, g_Pvs.cells_z, glfwGetTime() - start, (double)total_visible / num_cells);
+
+    if ( !Pvs_Write(&g_Pvs, g_PvsFilename) )
+        fprintf(stderr, "ERROR: Não foi possível gravar \"%s\".\n", g_PvsFilename);
+}
+
+// Função que carrega os shaders de vértices e de fragmentos que serão
+// utilizados para renderização. Veja slides 180-200 do documento Aula_03_Rendering_Pipeline_Grafico.pdf.
+//
+void LoadShadersFromFiles()
+{
+    // Note que o caminho para os arquivos "shader_vertex.glsl" e
+    // "shader_fragment.glsl" estão fixados, sendo que assumimos a existência
+    // da seguinte estrutura no sistema de arquivos:
+    //
+    //    + FCG_Lab_01/
+    //    |
+    //    +--+ bin/
+    //    |  |
+    //    |  +--+ Release/  (ou Debug/ ou Linux/)
+    //    |     |
+    //    |     o-- main.exe
+    //    |
+    //    +--+ src/
+    //       |
+    //       o-- shader_vertex.glsl
+    //       |
+    //       o-- shader_fragment.glsl
+    //
+    // Deletamos o programa de GPU anterior, caso ele exista.
+    if ( g_GpuProgramID != 0 )
+        glDeleteProgram(g_GpuProgramID);
+
+    // Criamos um programa de GPU utilizando os shaders dos arquivos acima.
+    g_GpuProgramID = LoadGpuProgram("../../src/shader_vertex.glsl", NULL, "../../src/shader_fragment.glsl", NULL);
+
+    SetupSceneProgram(g_GpuProgramID);
+
+    // As permutações dos shaders são compiladas novamente a partir dos
+    // arquivos, na primeira vez em que forem usadas.
+    ShaderPermutation_Clear(&g_ShaderPermutations);
+
+    // Variante dos mesmos shaders para as instâncias desenhadas pela GPU
+    // (veja g_UseGpuDriven). A diretiva "#line" mantém os números das linhas
+    // dos erros de compilação iguais aos dos arquivos.
+    if ( g_UseGpuDriven )
+    {
+        const char* header = "#version 430 core\n#define GPU_DRIVEN\n#line 1\n";
+
+        if ( g_GpuDrivenProgramID != 0 )
+            glDeleteProgram(g_GpuDrivenProgramID);
+        g_GpuDrivenProgramID = LoadGpuProgram("../../src/shader_vertex.glsl", header, "../../src/shader_fragment.glsl", header);
+        SetupSceneProgram(g_GpuDrivenProgramID);
+    }
+}
+
+// Liga os blocos de uniforms definidos em "shader_vertex.glsl" e
+// "shader_fragment.glsl" aos seus "binding points", e as variáveis de acesso
+// das imagens de textura às suas unidades de textura. Os dados são enviados
+// para a placa de vídeo (GPU) por UploadFrameUniforms() e BindDrawUniforms(),
+// sem nenhuma outra consulta ao programa.
+void SetupSceneProgram(GLuint program_id)
+{
+    GLuint frame_block = glGetUniformBlockIndex(program_id, "FrameUniforms");
+    GLuint draw_block  = glGetUniformBlockIndex(program_id, "DrawUniforms");
+    if ( frame_block != GL_INVALID_INDEX )
+        glUniformBlockBinding(program_id, frame_block, FRAME_UNIFORMS_BINDING);
+    if ( draw_block != GL_INVALID_INDEX ) // A variante GPU_DRIVEN não tem este bloco
+        glUniformBlockBinding(program_id, draw_block, DRAW_UNIFORMS_BINDING);
+
+    // O array de texturas i está sempre na unidade de textura i.
+    GLint texture_units[TEXTUREARRAY_MAX_ARRAYS];
+    for (int i = 0; i < TEXTUREARRAY_MAX_ARRAYS; ++i)
+        texture_units[i] = i;
+
+    // O programa atual é restaurado, pois esta função também é chamada
+    // durante os desenhos (veja GetMaterialProgram()).
+    GLint current_program = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &current_program);
+    glUseProgram(program_id);
+    glUniform1iv(glGetUniformLocation(program_id, "TextureArrays"), TEXTUREARRAY_MAX_ARRAYS, texture_units);
+    glUseProgram(current_program);
+}
+
+// Retorna o programa de GPU com a permutação do fragment shader para o
+// material do objeto "object_id" (ou, se "flat" for verdadeiro, para os
+// desenhos com uma única cor), compilando-o se ainda não existe. Todos os
+// programas são compilados antes do primeiro quadro, por
+// PrecompileMaterialPrograms(), e substituídos juntos pela recarga dos
+// shaders, de forma que durante os desenhos esta função só os encontra.
+GLuint GetMaterialProgram(int object_id, bool flat)
+{
+    if ( !g_UseShaderPermutations )
+        return g_GpuProgramID;
+
+    const ObjectMaterial& material = g_ObjectMaterials[object_id];
+
+    ShaderPermutation permutation;
+    permutation.uv_mode   = material.uv_mode;
+    permutation.kd0_array = TextureArray_Binding(material.kd0).array;
+    permutation.kd1_array = TextureArray_Binding(material.kd1).array;
+    permutation.lighting  = flat ? SHADER_LIGHTING_FLAT : SHADER_LIGHTING_LAMBERT;
+
+    GLuint program_id = ShaderPermutation_Find(&g_ShaderPermutations, permutation);
+    if ( program_id != 0 )
+        return program_id;
+
+    double start = glfwGetTime();
+    std::string header = ShaderPermutation_Header(permutation, "#version 330 core");
+    program_id = LoadGpuProgram("../../src/shader_vertex.glsl", NULL, "../../src/shader_fragment.glsl", header.c_str());
+    SetupSceneProgram(program_id);
+
+    ShaderPermutation_Insert(&g_ShaderPermutations, permutation, program_id, glfwGetTime() - start);
+    return program_id;
+}
+
+// Compila as permutações de todos os materiais de g_ObjectMaterials, e a dos
+// destaques, logo após InitObjectMaterials(): os arrays de texturas dos
+// materiais já estão definidos, e nenhum programa é compilado no meio de um
+// quadro. Programas já compilados em execuções anteriores vêm do cache de
+// programas (veja LoadGpuProgram()).
+void PrecompileMaterialPrograms()
+{
+    if ( !g_UseShaderPermutations )
+        return;
+
+    double start = glfwGetTime();
+    size_t compiled = g_ShaderPermutations.compiled;
+
+    for (size_t object_id = 0; object_id < g_ObjectMaterials.size(); ++object_id)
+        GetMaterialProgram((int)object_id, false);
+    GetMaterialProgram(0, true);
+
+    printf("Permutações dos shaders: %d programas em %.0f ms.\n",
+           (int)(g_ShaderPermutations.compiled - compiled), (glfwGetTime() - start) * 1000.0);
+}
+
+// Chamada no início de cada quadro. Começa a recarga dos shaders quando ela é
+// pedida (tecla R ou arquivos modificados), e substitui os programas quando a
+// compilação termina. Até lá, e também se algum shader tem erros, os desenhos
+// continuam com os programas anteriores.
+void UpdateShaderReload()
+{
+    if ( ShaderWatcher_Poll(&g_ShaderWatcher) )
+        g_ShaderReloadRequested = true;
+
+    // Um novo pedido durante uma compilação a reinicia com os arquivos atuais
+    if ( g_ShaderReloadRequested )
+    {
+        g_ShaderReloadRequested = false;
+        CancelShaderReload();
+        BeginShaderReload();
+    }
+
+    if ( g_ShaderReloadTargets.empty() )
+        return;
+
+    bool compiling = false;
+    for (size_t i = 0; i < g_ShaderReloadTargets.size(); ++i)
+    {
+        PendingProgramStatus status = ShaderReload_Poll(&g_ShaderReloadTargets[i].pending);
+        if ( status == PENDING_PROGRAM_FAILED )
+        {
+            fprintf(stderr, "Shaders não recarregados; os programas anteriores continuam em uso.\n");
+            CancelShaderReload();
+            return;
+        }
+        if ( status == PENDING_PROGRAM_COMPILING )
+            compiling = true;
+    }
+
+    if ( !compiling )
+        ApplyShaderReload();
+}
+
+// Começa a compilação do programa principal, da variante GPU_DRIVEN e de
+// todas as permutações já usadas, com os códigos lidos dos arquivos.
+void BeginShaderReload()
+{
+    std::string vertex_source, fragment_source;
+    if ( !ReadShaderSource("../../src/shader_vertex.glsl", NULL, &vertex_source)
+      || !ReadShaderSource("../../src/shader_fragment.glsl", NULL, &fragment_source) )
+    {
+        fprintf(stderr, "Shaders não recarregados; não foi possível ler os arquivos.\n");
+        return;
+    }
+
+    g_ShaderReloadStart = glfwGetTime();
+
+    BeginShaderReloadTarget(&g_GpuProgramID, 0, vertex_source, fragment_source);
+
+    if ( g_UseGpuDriven && g_GpuDrivenProgramID != 0 )
+    {
+        const char* header = "#version 430 core\n#define GPU_DRIVEN\n#line 1\n";
+        std::string gpudriven_vertex_source, gpudriven_fragment_source;
+        ReadShaderSource("../../src/shader_vertex.glsl", header, &gpudriven_vertex_source);
+        ReadShaderSource("../../src/shader_fragment.glsl", header, &gpudriven_fragment_source);
+        BeginShaderReloadTarget(&g_GpuDrivenProgramID, 0, gpudriven_vertex_source, gpudriven_fragment_source);
+    }
+
+    // As permutações usam o mesmo vertex shader, e o fragment shader com a
+    // diretiva "#version" substituída (veja ShaderPermutation_Header()).
+    std::string fragment_body = fragment_source.substr(std::min(fragment_source.find('\n'), fragment_source.size()));
+    for (std::map<uint32_t, GLuint>::const_iterator it = g_ShaderPermutations.programs.begin(); it != g_ShaderPermutations.programs.end(); ++it)
+    {
+        std::string header = ShaderPermutation_Header(ShaderPermutation_FromKey(it->first), "#version 330 core");
+        BeginShaderReloadTarget(NULL, it->first, vertex_source, header + fragment_body);
+    }
+}
+
+void BeginShaderReloadTarget(GLuint* program_id, uint32_t permutation_key, const std::string& vertex_source, const std::string& fragment_source)
+{
+    ShaderReloadTarget target;
+    target.program_id      = program_id;
+    target.permutation_key = permutation_key;
+    target.from_cache      = false;
+
+    // Um programa já compilado antes (por exemplo, ao desfazer uma
+    // modificação) é lido do cache de programas, sem compilação.
+    std::string sources[2] = { vertex_source, fragment_source };
+    target.cache_key = ProgramCache_Key(sources, 2);
+
+    GLuint cached_program_id = ProgramCache_Load(target.cache_key);
+    if ( cached_program_id != 0 )
+    {
+        target.from_cache              = true;
+        target.pending.vertex_shader   = 0;
+        target.pending.fragment_shader = 0;
+        target.pending.program         = cached_program_id;
+        target.pending.start           = glfwGetTime();
+    }
+    else
+    {
+        ShaderReload_Begin(&target.pending, vertex_source, "../../src/shader_vertex.glsl", fragment_source, "../../src/shader_fragment.glsl");
+    }
+
+    g_ShaderReloadTargets.push_back(target);
+}
+
+void CancelShaderReload()
+{
+    for (size_t i = 0; i < g_ShaderReloadTargets.size(); ++i)
+        ShaderReload_Finish(&g_ShaderReloadTargets[i].pending, false);
+    g_ShaderReloadTargets.clear();
+}
+
+// Todos os programas foram linkados: os blocos de uniforms e as texturas são
+// ligados nos novos programas, que substituem os anteriores.
+void ApplyShaderReload()
+{
+    for (size_t i = 0; i < g_ShaderReloadTargets.size(); ++i)
+    {
+        ShaderReloadTarget& target = g_ShaderReloadTargets[i];
+        GLuint program_id = target.pending.program;
+
+        if ( !target.from_cache )
+            ProgramCache_Store(target.cache_key, program_id, glfwGetTime() - target.pending.start);
+        ShaderReload_Finish(&target.pending, true);
+        SetupSceneProgram(program_id);
+
+        if ( target.program_id != NULL )
+        {
+            glDeleteProgram(*target.program_id);
+            *target.program_id = program_id;
+        }
+        else
+        {
+            ShaderPermutation_Replace(&g_ShaderPermutations, target.permutation_key, program_id);
+        }
+    }
+
+    fprintf(stdout, "Shaders recarregados! (%d programas em %.0f ms)\n",
+            (int)g_ShaderReloadTargets.size(), (glfwGetTime() - g_ShaderReloadStart) * 1000.0);
+    fflush(stdout);
+
+    g_ShaderReloadTargets.clear();
+}
+
+// Função que pega a matriz M e guarda a mesma no topo da pilha
+void PushMatrix(glm::mat4 M)
+{
+    g_MatrixStack.push(M);
+}
+
+// Função que remove a matriz atualmente no topo da pilha e armazena a mesma na variável M
+void PopMatrix(glm::mat4& M)
+{
+    if ( g_MatrixStack.empty() )
+    {
+        M = Matrix_Identity();
+    }
+    else
+    {
+        M = g_MatrixStack.top();
+        g_MatrixStack.pop();
+    }
+}
+
+// Função que computa as normais de um ObjModel, caso elas não tenham sido
+// especificadas dentro do arquivo ".obj"
+void ComputeNormals(ObjModel* model)
+{
+    if ( !model->attrib.normals.empty() )
+        return;
 
     // Primeiro computamos as normais para todos os TRIÂNGULOS.
     // Segundo, computamos as normais dos VÉRTICES através do método proposto
@@ -2129,21 +3922,298 @@ void ComputeNormals(ObjModel* model)
     }
 }
 
-// Constrói triângulos para futura renderização a partir de um ObjModel.
-void BuildTrianglesAndAddToVirtualScene(ObjModel* model)
+// Carrega um modelo geométrico de um arquivo ".obj" e adiciona todos os seus
+// objetos em g_VirtualScene. Caso exista um cache binário válido para o
+// arquivo (veja "meshcache.hpp"), os vetores prontos para a GPU são lidos
+// diretamente do cache, sem a leitura do arquivo texto pela tinyobjloader e
+// sem o cálculo das normais. Caso contrário, o modelo é processado e o cache é
+// gravado para as próximas execuções.
+//
+// Assim como em LoadTextureImage(), a leitura e o processamento do modelo são
+// feitos em uma thread auxiliar (veja "assetloader.hpp"), e somente o envio
+// para a GPU é feito na thread do contexto OpenGL, na ordem das chamadas.
+void LoadObjModelToVirtualScene(const char* filename)
+{
+    std::string name(filename);
+
+    // Modelos sem nenhum objeto desenhado não são carregados.
+    if ( Residency_RefCount(Residency_Asset(filename, ASSET_MODEL)) == 0 )
+    {
+        printf("Ignorando modelo \"%s\" (não utilizado).\n", filename);
+        return;
+    }
+
+    std::shared_ptr<LoadedMesh> loaded = std::make_shared<LoadedMesh>();
+
+    AssetLoader_Submit(
+        [name, loaded]{ LoadMesh(name.c_str(), loaded.get()); },
+        [name, loaded]{ UploadMesh(name.c_str(), loaded.get()); }
+    );
+}
+
+// Obtém os vetores prontos para a GPU de um arquivo ".obj", do cache ou
+// processando o arquivo. Não utiliza OpenGL, e pode ser executada em qualquer
+// thread.
+void LoadMesh(const char* filename, LoadedMesh* loaded)
+{
+    loaded->from_cache = MeshCache_Open(filename, &loaded->cache);
+    if ( loaded->from_cache )
+        return;
+
+    ObjModel model(filename);
+    ComputeNormals(&model);
+
+    CookObjModel(&model, &loaded->mesh);
+
+    if ( !MeshCache_Write(filename, MeshData_View(loaded->mesh)) )
+        fprintf(stderr, "WARNING: Não foi possível gravar o cache de \"%s\".\n", filename);
+}
+
+// Envia para a GPU uma malha obtida por LoadMesh(), e libera a memória de CPU
+// correspondente: após o envio, somente os SceneObject do modelo (com as
+// cópias em SceneObject::batch_vertices) permanecem na memória principal.
+void UploadMesh(const char* filename, LoadedMesh* loaded)
+{
+    if ( loaded->from_cache )
+    {
+        printf("Carregando objetos do cache de \"%s\"... ", filename);
+        BuildTrianglesAndAddToVirtualScene(loaded->cache.view);
+        printf("OK (%d objetos).\n", (int)loaded->cache.view.shapes.size());
+        MeshCache_Close(&loaded->cache);
+    }
+    else
+    {
+        BuildTrianglesAndAddToVirtualScene(MeshData_View(loaded->mesh));
+        loaded->mesh = MeshData();
+    }
+
+    size_t mesh_id = g_SceneMeshes.size() - 1;
+    const SceneMesh& scenemesh = g_SceneMeshes[mesh_id];
+
+    size_t cpu_bytes = sizeof(SceneMesh);
+    for (size_t i = 0; i < scenemesh.objects.size(); ++i)
+    {
+        const SceneObject& object = g_VirtualScene[scenemesh.objects[i]];
+        cpu_bytes += sizeof(SceneObject) + 2*scenemesh.objects[i].capacity()
+                   + object.batch_vertices.capacity() * sizeof(FloatVertex)
+                   + object.batch_indices.capacity() * sizeof(uint32_t);
+    }
+    size_t gpu_bytes = g_VertexArena.blocks[scenemesh.vertex_block].size
+                     + g_IndexArena.blocks[scenemesh.index_block].size;
+
+    Residency_SetResident(Residency_Asset(filename, ASSET_MODEL), cpu_bytes, gpu_bytes,
+        [mesh_id]{ UnloadSceneMesh(mesh_id); });
+}
+
+// Remove um modelo das arenas de vértices e índices, e seus objetos de
+// g_VirtualScene. O espaço liberado nas arenas é reaproveitado pelos próximos
+// modelos carregados.
+void UnloadSceneMesh(size_t mesh_id)
+{
+    SceneMesh& scenemesh = g_SceneMeshes[mesh_id];
+
+    for (size_t i = 0; i < scenemesh.objects.size(); ++i)
+    {
+        std::map<std::string, SceneObject>::iterator it = g_VirtualScene.find(scenemesh.objects[i]);
+        if ( it != g_VirtualScene.end() && it->second.mesh_id == mesh_id )
+        {
+            ReleaseObjectInstances(it->second);
+            g_VirtualScene.erase(it);
+        }
+    }
+    scenemesh.objects.clear();
+
+    GpuArena_Free(&g_VertexArena, scenemesh.vertex_block);
+    GpuArena_Free(&g_IndexArena, scenemesh.index_block);
+    scenemesh.vertex_block = GPUARENA_INVALID_HANDLE;
+    scenemesh.index_block  = GPUARENA_INVALID_HANDLE;
+}
+
+// Registra uma referência de cada objeto de g_SceneDrawables ao seu modelo e
+// às suas texturas. Deve ser chamada antes do carregamento dos recursos.
+void AcquireSceneDrawables()
+{
+    size_t num_drawables = sizeof(g_SceneDrawables) / sizeof(g_SceneDrawables[0]);
+    for (size_t i = 0; i < num_drawables; ++i)
+    {
+        const SceneDrawable& drawable = g_SceneDrawables[i];
+        Residency_AddRef(Residency_Asset(drawable.model, ASSET_MODEL));
+        for (size_t t = 0; t < 4 && drawable.textures[t] != NULL; ++t)
+            Residency_AddRef(Residency_Asset(drawable.textures[t], ASSET_TEXTURE));
+    }
+}
+
+// Desfaz as referências registradas por AcquireSceneDrawables(). Modelos e
+// texturas que ficam sem referências são removidos da memória.
+void ReleaseSceneDrawables()
+{
+    size_t num_drawables = sizeof(g_SceneDrawables) / sizeof(g_SceneDrawables[0]);
+    for (size_t i = 0; i < num_drawables; ++i)
+    {
+        const SceneDrawable& drawable = g_SceneDrawables[i];
+        Residency_Release(Residency_Asset(drawable.model, ASSET_MODEL));
+        for (size_t t = 0; t < 4 && drawable.textures[t] != NULL; ++t)
+            Residency_Release(Residency_Asset(drawable.textures[t], ASSET_TEXTURE));
+    }
+}
+
+// Define as texturas de cada objeto, indexadas pelo "object_id" usado no laço
+// de renderização e em "shader_fragment.glsl". Deve ser chamada após
+// TextureArray_Build(). Objetos que não aparecem na tabela abaixo (como os
+// ovos) usam as texturas da Terra.
+void InitObjectMaterials()
+{
+    struct { int object_id; const char* kd0; const char* kd1; ShaderUvMode uv_mode; } materials[] = {
+        { SPHERE,        "../../data/tc-earth_daymap_surface.jpg", "../../data/tc-earth_nightmap_citylights.gif",   SHADER_UV_SPHERE },
+        { BUNNY,         "../../data/goldTexture.jpg",             NULL,                                            SHADER_UV_BBOX },
+        { PLANE,         "../../data/asfalto.png",                 NULL,                                            SHADER_UV_TEXCOORDS },
+        { MAINBUILD,     "../../data/oldWallTexture.jpg",          NULL,                                            SHADER_UV_TEXCOORDS },
+        { BAGUETE,       "../../data/baguete_COLOR.png",           NULL,                                            SHADER_UV_TEXCOORDS },
+        { BUTTER,        "../../data/queijo.jpg",                  NULL,                                            SHADER_UV_TEXCOORDS },
+        { CHEESE,        "../../data/goldTexture.jpg",             NULL,                                            SHADER_UV_TEXCOORDS },
+        { LUA,           "../../data/TexturaLua.jpg",              NULL,                                            SHADER_UV_SPHERE },
+        { PLANE_ASPHALT, "../../data/asfalto.png",                 NULL,                                            SHADER_UV_TEXCOORDS },
+        { PLANE_GRASS,   "../../data/grassTexture.png",            NULL,                                            SHADER_UV_TEXCOORDS },
+        { SMALLHOUSE,    "../../data/smallHouseTexture.jpg",       NULL,                                            SHADER_UV_TEXCOORDS },
+        { GASSTATION,    "../../data/gasStationTexture.jpg",       NULL,                                            SHADER_UV_TEXCOORDS },
+        { MYHOUSE,       "../../data/myhouseTexture.png",          NULL,                                            SHADER_UV_TEXCOORDS },
+        { LONGHOUSE,     "../../data/longHouseTexture.jpg",        NULL,                                            SHADER_UV_TEXCOORDS },
+        { WOODHOUSE,     "../../data/woodHouseTexture.png",        NULL,                                            SHADER_UV_TEXCOORDS },
+        { LASTHOUSE,     "../../data/lastHouseTexture.png",        NULL,                                            SHADER_UV_TEXCOORDS },
+        { POLE,          "../../data/poleTexture.png",             NULL,                                            SHADER_UV_TEXCOORDS },
+        { CALCADA,       "../../data/texturaCalcada.png",          NULL,                                            SHADER_UV_TEXCOORDS },
+        { LILHOUSE,      "../../data/lilHouseTexture.png",         NULL,                                            SHADER_UV_TEXCOORDS },
+        { MAQUINA,       "../../data/maquinaTextura.png",          NULL,                                            SHADER_UV_TEXCOORDS },
+        { SKY,           "../../data/ceuEstrelado.jpg",            NULL,                                            SHADER_UV_SKY },
+    };
+
+    ObjectMaterial earth;
+    earth.kd0 = TextureArray_Find(materials[0].kd0);
+    earth.kd1 = TextureArray_Find(materials[0].kd1);
+    earth.uv_mode = SHADER_UV_NONE;
+    g_ObjectMaterials.assign(SKY + 1, earth);
+
+    for (size_t i = 0; i < sizeof(materials) / sizeof(materials[0]); ++i)
+    {
+        ObjectMaterial& material = g_ObjectMaterials[materials[i].object_id];
+        material.kd0 = TextureArray_Find(materials[i].kd0);
+        material.kd1 = materials[i].kd1 ? TextureArray_Find(materials[i].kd1) : TEXTUREARRAY_INVALID_HANDLE;
+        material.uv_mode = materials[i].uv_mode;
+    }
+}
+
+// Definem a matriz "model" e o "object_id" usados pela próxima chamada a
+// DrawVirtualObject(). Nada é enviado para a GPU: o objeto é desenhado mais
+// tarde, por FlushRenderQueue().
+void SetModelMatrix(const glm::mat4& model)
+{
+    g_ModelMatrix = model;
+}
+
+void SetObjectMaterial(int object_id)
+{
+    g_CurrentObjectId = object_id;
+}
+
+// Preenche o bloco "DrawUniforms" de um desenho com a matriz "model", a
+// matriz das normais (computada aqui, uma vez por desenho, em vez de uma vez
+// por vértice no shader), a AABB do objeto, o "object_id" e a posição das
+// suas texturas nos arrays de texturas (veja "texturearray.hpp").
+DrawUniforms MakeDrawUniforms(const glm::mat4& model, int object_id, const glm::vec3& bbox_min, const glm::vec3& bbox_max, bool quantized_vertices)
+{
+    const ObjectMaterial& material = g_ObjectMaterials[object_id];
+    TextureBinding kd0 = TextureArray_Binding(material.kd0);
+    TextureBinding kd1 = TextureArray_Binding(material.kd1);
+
+    DrawUniforms draw;
+    draw.model          = model;
+    draw.normal_matrix  = glm::inverse(glm::transpose(model));
+    draw.bbox_min       = glm::vec4(bbox_min, 1.0f);
+    draw.bbox_max       = glm::vec4(bbox_max, 1.0f);
+    draw.material       = glm::ivec4(object_id, quantized_vertices, false, false);
+    draw.texture_kd0    = glm::ivec4(kd0.array, kd0.layer, kd0.min_level, material.uv_mode);
+    draw.texture_kd1    = glm::ivec4(kd1.array, kd1.layer, kd1.min_level, 0);
+    draw.color_override = glm::vec4(0.0f);
+    return draw;
+}
+
+void BindDrawUniforms(const DrawUniforms& draw)
+{
+    size_t offset = UniformRing_Upload(&g_UniformRing, &draw, sizeof(DrawUniforms));
+
+    // Se o buffer foi trocado, o bloco do quadro também precisa ser enviado
+    // novamente.
+    if ( g_UniformRing.generation != g_FrameUniformsGeneration )
+        UploadFrameUniforms(g_FrameUniforms.view, g_FrameUniforms.projection);
+
+    UniformRing_Bind(&g_UniformRing, DRAW_UNIFORMS_BINDING, offset, sizeof(DrawUniforms));
+}
+
+void UploadFrameUniforms(const glm::mat4& view, const glm::mat4& projection)
+{
+    g_FrameUniforms.view            = view;
+    g_FrameUniforms.projection      = projection;
+    g_FrameUniforms.camera_position = glm::inverse(view)[3]; // Posição da câmera em coordenadas globais
+    g_FrameUniforms.light_direction = g_LightDirection;
+    g_FrameUniforms.time            = glm::vec4((float)glfwGetTime(), 0.0f, 0.0f, 0.0f);
+
+    size_t offset = UniformRing_Upload(&g_UniformRing, &g_FrameUniforms, sizeof(FrameUniforms));
+    g_FrameUniformsGeneration = g_UniformRing.generation;
+    UniformRing_Bind(&g_UniformRing, FRAME_UNIFORMS_BINDING, offset, sizeof(FrameUniforms));
+}
+
+// Chave de um vértice do ObjModel: a tripla de índices (posição, normal,
+// coordenada de textura) de um canto de triângulo. Cantos com a mesma tripla
+// são o mesmo vértice, e são armazenados uma única vez. Veja CookObjModel().
+struct ObjVertexKey
+{
+    int vertex_index;
+    int normal_index;
+    int texcoord_index;
+
+    bool operator==(const ObjVertexKey& other) const
+    {
+        return vertex_index == other.vertex_index
+            && normal_index == other.normal_index
+            && texcoord_index == other.texcoord_index;
+    }
+};
+
+struct ObjVertexKeyHash
+{
+    size_t operator()(const ObjVertexKey& key) const
+    {
+        size_t h = (size_t)key.vertex_index * 73856093u;
+        h ^= (size_t)key.normal_index * 19349663u;
+        h ^= (size_t)key.texcoord_index * 83492791u;
+        return h;
+    }
+};
+
+// Constrói triângulos para futura renderização a partir de um ObjModel. O
+// resultado são os vetores exatamente como serão enviados para a GPU por
+// BuildTrianglesAndAddToVirtualScene(), e que podem ser gravados no cache.
+//
+// Os cantos de triângulos que referenciam a mesma tripla (posição, normal,
+// coordenada de textura) são unificados em um único vértice, e os triângulos
+// são descritos por um vetor de índices. Assim cada vértice é armazenado e
+// processado pelo vertex shader uma única vez (e pode ser reaproveitado pela
+// cache pós-transformação da GPU). Cada objeto tem seus próprios vértices e
+// índices, de 16 bits se o objeto tiver menos de 65536 vértices. Por fim, a
+// ordem dos triângulos e dos vértices de cada objeto é otimizada (veja
+// "meshopt.hpp"), e o ACMR/ATVR antes e depois é impresso no terminal.
+void CookObjModel(ObjModel* model, MeshData* mesh)
 {
-    GLuint vertex_array_object_id;
-    glGenVertexArrays(1, &vertex_array_object_id);
-    glBindVertexArray(vertex_array_object_id);
+    std::vector<uint8_t>& indices              = mesh->indices;
+    std::vector<float>&   model_coefficients   = mesh->model_coefficients;
+    std::vector<float>&   normal_coefficients  = mesh->normal_coefficients;
+    std::vector<float>&   texture_coefficients = mesh->texture_coefficients;
 
-    std::vector<GLuint> indices;
-    std::vector<float>  model_coefficients;
-    std::vector<float>  normal_coefficients;
-    std::vector<float>  texture_coefficients;
+    std::string report;
 
     for (size_t shape = 0; shape < model->shapes.size(); ++shape)
     {
-        size_t first_index = indices.size();
+        size_t base_vertex = model_coefficients.size() / 4;
         size_t num_triangles = model->shapes[shape].mesh.num_face_vertices.size();
 
         const float minval = std::numeric_limits<float>::min();
@@ -2152,6 +4222,13 @@ void BuildTrianglesAndAddToVirtualScene(ObjModel* model)
         glm::vec3 bbox_min = glm::vec3(maxval,maxval,maxval);
         glm::vec3 bbox_max = glm::vec3(minval,minval,minval);
 
+        // Índices (relativos a base_vertex) de cada canto de triângulo
+        std::vector<uint32_t> shape_indices;
+        shape_indices.reserve(3*num_triangles);
+
+        std::unordered_map<ObjVertexKey, uint32_t, ObjVertexKeyHash> unique_vertices;
+        unique_vertices.reserve(3*num_triangles);
+
         for (size_t triangle = 0; triangle < num_triangles; ++triangle)
         {
             assert(model->shapes[shape].mesh.num_face_vertices[triangle] == 3);
@@ -2160,7 +4237,15 @@ void BuildTrianglesAndAddToVirtualScene(ObjModel* model)
             {
                 tinyobj::index_t idx = model->shapes[shape].mesh.indices[3*triangle + vertex];
 
-                indices.push_back(first_index + 3*triangle + vertex);
+                ObjVertexKey key = { idx.vertex_index, idx.normal_index, idx.texcoord_index };
+                uint32_t new_index = (uint32_t)unique_vertices.size();
+                auto inserted = unique_vertices.insert(std::make_pair(key, new_index));
+
+                shape_indices.push_back(inserted.first->second);
+
+                // Vértice já visto em outro triângulo
+                if ( !inserted.second )
+                    continue;
 
                 const float vx = model->attrib.vertices[3*idx.vertex_index + 0];
                 const float vy = model->attrib.vertices[3*idx.vertex_index + 1];
@@ -2204,121 +4289,348 @@ void BuildTrianglesAndAddToVirtualScene(ObjModel* model)
             }
         }
 
-        size_t last_index = indices.size() - 1;
+        // Otimizamos a ordem dos triângulos e dos vértices do objeto. Veja
+        // "meshopt.hpp".
+        size_t num_vertices = unique_vertices.size();
+        MeshOptStats before = MeshOpt_AnalyzeVertexCache(shape_indices.data(), shape_indices.size(), num_vertices);
+
+        std::vector<size_t> clusters;
+        MeshOpt_OptimizeVertexCache(shape_indices.data(), shape_indices.size(), num_vertices, &clusters);
+        MeshOpt_OptimizeOverdraw(shape_indices.data(), shape_indices.size(), &model_coefficients[4*base_vertex], 4, num_vertices, clusters, 1.05f);
+
+        std::vector<uint32_t> remap;
+        MeshOpt_OptimizeVertexFetch(shape_indices.data(), shape_indices.size(), num_vertices, &remap);
+        MeshOpt_Remap(&model_coefficients[4*base_vertex], 4, num_vertices, remap);
+        if ( normal_coefficients.size() == model_coefficients.size() )
+            MeshOpt_Remap(&normal_coefficients[4*base_vertex], 4, num_vertices, remap);
+        if ( texture_coefficients.size() == 2*(model_coefficients.size()/4) )
+            MeshOpt_Remap(&texture_coefficients[2*base_vertex], 2, num_vertices, remap);
+
+        MeshOptStats after = MeshOpt_AnalyzeVertexCache(shape_indices.data(), shape_indices.size(), num_vertices);
+
+        char line[256];
+        snprintf(line, sizeof(line), "- Objeto '%s': %d vértices, %d triângulos, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+                 model->shapes[shape].name.c_str(), (int)num_vertices, (int)(shape_indices.size()/3),
+                 before.acmr, after.acmr, before.atvr, after.atvr);
+        report += line;
+
+        // Geramos os níveis de detalhe do objeto (veja "meshlod.hpp"), todos
+        // a partir da malha original, cada um com cerca de 35% dos triângulos
+        // do anterior. Paramos quando a simplificação não consegue mais
+        // reduzir o número de triângulos sem ultrapassar um erro de 5% do
+        // tamanho do objeto.
+        std::vector< std::vector<uint32_t> > lod_indices;
+        std::vector<float> lod_errors;
+        float max_error = 0.05f * glm::length(bbox_max - bbox_min);
+
+        while ( shape_indices.size()/3 >= MESHLOD_MIN_TRIANGLES && lod_indices.size() < MESHCACHE_MAX_LODS )
+        {
+            size_t previous = lod_indices.empty() ? shape_indices.size() : lod_indices.back().size();
+            size_t target = (size_t)(0.35f * previous) / 3 * 3;
+
+            std::vector<uint32_t> lod;
+            float error = MeshLod_Simplify(shape_indices.data(), shape_indices.size(), &model_coefficients[4*base_vertex], 4, num_vertices, target, max_error, &lod);
+            if ( lod.empty() || lod.size() > 0.8f * previous )
+                break;
+
+            MeshOpt_OptimizeVertexCache(lod.data(), lod.size(), num_vertices, NULL);
+            lod_indices.push_back(lod);
+            lod_errors.push_back(error);
+
+            snprintf(line, sizeof(line), "  LOD %d: %d triângulos, erro %.4f\n", (int)lod_indices.size(), (int)(lod.size()/3), error);
+            report += line;
+        }
+
+        MeshShape theshape;
+        theshape.name         = model->shapes[shape].name;
+        theshape.num_indices  = shape_indices.size(); // Número de indices
+        theshape.base_vertex  = base_vertex;
+        theshape.num_vertices = num_vertices;
+        theshape.index_size   = theshape.num_vertices < 65536 ? sizeof(uint16_t) : sizeof(uint32_t);
+        theshape.bbox_min     = bbox_min;
+        theshape.bbox_max     = bbox_max;
+
+        // Os índices de cada objeto devem começar em uma posição múltipla do
+        // tamanho de um índice.
+        while ( indices.size() % theshape.index_size != 0 )
+            indices.push_back(0);
+
+        // Os índices dos níveis de detalhe seguem os da malha original, no
+        // mesmo formato.
+        for (size_t level = 0; level <= lod_indices.size(); ++level)
+        {
+            const std::vector<uint32_t>& level_indices = (level == 0) ? shape_indices : lod_indices[level - 1];
+            size_t offset = indices.size();
+            indices.resize(indices.size() + level_indices.size() * theshape.index_size);
+
+            if ( theshape.index_size == sizeof(uint16_t) )
+            {
+                uint16_t* dst = (uint16_t*)(indices.data() + offset);
+                for (size_t i = 0; i < level_indices.size(); ++i)
+                    dst[i] = (uint16_t)level_indices[i];
+            }
+            else
+            {
+                memcpy(indices.data() + offset, level_indices.data(), level_indices.size() * sizeof(uint32_t));
+            }
+
+            if ( level == 0 )
+            {
+                theshape.index_offset = offset; // Primeiro índice
+            }
+            else
+            {
+                MeshLod lod;
+                lod.index_offset = offset;
+                lod.num_indices  = level_indices.size();
+                lod.error        = lod_errors[level - 1];
+                theshape.lods.push_back(lod);
+            }
+        }
+
+        mesh->shapes.push_back(theshape);
+    }
+
+    // Imprimimos tudo de uma só vez, pois esta função pode estar executando
+    // em paralelo com outras (veja "assetloader.hpp").
+    printf("Otimização da cache de vértices (FIFO de %d vértices) e níveis de detalhe:\n%s", MESHOPT_CACHE_SIZE, report.c_str());
+}
+
+// Envia para a GPU os vetores de uma malha de triângulos (construídos por
+// CookObjModel() ou lidos do cache), e adiciona seus objetos em g_VirtualScene.
+void BuildTrianglesAndAddToVirtualScene(const MeshView& mesh)
+{
+    // Convertemos os vértices para o formato intercalado que será enviado
+    // para a GPU. Veja "vertexformat.hpp".
+    std::vector<PackedVertex> packed_vertices;
+    std::vector<FloatVertex>  float_vertices;
+    const void* vertex_data;
+    size_t      vertex_data_size;
+
+    if ( g_UseQuantizedVertices )
+    {
+        VertexFormat_Pack(mesh, &packed_vertices);
+        vertex_data      = packed_vertices.data();
+        vertex_data_size = packed_vertices.size() * sizeof(PackedVertex);
+    }
+    else
+    {
+        VertexFormat_Interleave(mesh, &float_vertices);
+        vertex_data      = float_vertices.data();
+        vertex_data_size = float_vertices.size() * sizeof(FloatVertex);
+    }
+
+    // Alocamos um bloco para os vértices e outro para os índices do modelo
+    // nas arenas compartilhadas por todos os modelos. Veja "gpuarena.hpp".
+    InitSceneArenas();
+
+    SceneMesh scenemesh;
+    scenemesh.vertex_block = GpuArena_Allocate(&g_VertexArena, vertex_data_size, vertex_data);
+    scenemesh.index_block  = GpuArena_Allocate(&g_IndexArena, mesh.indices_size, mesh.indices);
 
+    size_t mesh_id = g_SceneMeshes.size();
+
+    for (size_t shape = 0; shape < mesh.shapes.size(); ++shape)
+    {
         SceneObject theobject;
-        theobject.name           = model->shapes[shape].name;
-        theobject.first_index    = first_index; // Primeiro índice
-        theobject.num_indices    = last_index - first_index + 1; // Número de indices
+        theobject.name           = mesh.shapes[shape].name;
+        theobject.mesh_id        = mesh_id;
+        theobject.index_offset   = mesh.shapes[shape].index_offset; // Primeiro índice
+        theobject.num_indices    = mesh.shapes[shape].num_indices; // Número de indices
+        theobject.index_type     = mesh.shapes[shape].index_size == sizeof(GLushort) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        theobject.base_vertex    = (GLint)mesh.shapes[shape].base_vertex;
+        theobject.num_vertices   = mesh.shapes[shape].num_vertices;
+        theobject.quantized_vertices = g_UseQuantizedVertices;
         theobject.rendering_mode = GL_TRIANGLES;       // Índices correspondem ao tipo de rasterização GL_TRIANGLES.
-        theobject.vertex_array_object_id = vertex_array_object_id;
+        theobject.vertex_array_object_id = g_SceneVAO;
+
+        theobject.bbox_min = mesh.shapes[shape].bbox_min;
+        theobject.bbox_max = mesh.shapes[shape].bbox_max;
+        theobject.lods     = mesh.shapes[shape].lods;
+        theobject.occluder = false;
+        theobject.static_world = false;
+        for (size_t i = 0; i < sizeof(g_SceneDrawables) / sizeof(g_SceneDrawables[0]); ++i)
+        {
+            if ( mesh.shapes[shape].name == g_SceneDrawables[i].object )
+            {
+                theobject.occluder = g_SceneDrawables[i].occluder;
+                theobject.static_world = g_SceneDrawables[i].static_world;
+            }
+        }
+
+        // Objetos que podem ser agrupados guardam uma cópia da malha (veja
+        // SceneObject::batch_vertices), sem precisar lê-la de volta da GPU.
+        if ( theobject.static_world && theobject.lods.empty() )
+        {
+            if ( float_vertices.empty() )
+                VertexFormat_Interleave(mesh, &float_vertices);
+
+            const MeshShape& meshshape = mesh.shapes[shape];
+            theobject.batch_vertices.assign(float_vertices.begin() + meshshape.base_vertex,
+                                            float_vertices.begin() + meshshape.base_vertex + meshshape.num_vertices);
+            theobject.batch_indices.resize(meshshape.num_indices);
+            for (size_t i = 0; i < meshshape.num_indices; ++i)
+            {
+                const uint8_t* index = mesh.indices + meshshape.index_offset + i * meshshape.index_size;
+                if ( meshshape.index_size == sizeof(uint16_t) )
+                {
+                    uint16_t value;
+                    memcpy(&value, index, sizeof(value));
+                    theobject.batch_indices[i] = value;
+                }
+                else
+                {
+                    memcpy(&theobject.batch_indices[i], index, sizeof(uint32_t));
+                }
+            }
+        }
 
-        theobject.bbox_min = bbox_min;
-        theobject.bbox_max = bbox_max;
+        theobject.instance_frame = 0;
+        theobject.next_instance = 0;
 
-        g_VirtualScene[model->shapes[shape].name] = theobject;
+        // Um objeto com o mesmo nome, de outro modelo, é substituído
+        std::map<std::string, SceneObject>::iterator previous = g_VirtualScene.find(mesh.shapes[shape].name);
+        if ( previous != g_VirtualScene.end() )
+            ReleaseObjectInstances(previous->second);
+
+        g_VirtualScene[mesh.shapes[shape].name] = theobject;
+        scenemesh.objects.push_back(mesh.shapes[shape].name);
     }
 
-    GLuint VBO_model_coefficients_id;
-    glGenBuffers(1, &VBO_model_coefficients_id);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO_model_coefficients_id);
-    glBufferData(GL_ARRAY_BUFFER, model_coefficients.size() * sizeof(float), NULL, GL_STATIC_DRAW);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, model_coefficients.size() * sizeof(float), model_coefficients.data());
-    GLuint location = 0; // "(location = 0)" em "shader_vertex.glsl"
-    GLint  number_of_dimensions = 4; // vec4 em "shader_vertex.glsl"
-    glVertexAttribPointer(location, number_of_dimensions, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(location);
+    g_SceneMeshes.push_back(scenemesh);
+    g_VertexBufferBytes += vertex_data_size;
+
+    // As alocações acima podem ter trocado os buffers das arenas.
+    UpdateSceneVertexArray();
+}
+
+// Cria as arenas de vértices e de índices e o VAO único da cena, caso ainda
+// não existam.
+void InitSceneArenas()
+{
+    if ( g_SceneVAO != 0 )
+        return;
+
+    size_t vertex_size = g_UseQuantizedVertices ? sizeof(PackedVertex) : sizeof(FloatVertex);
+    GpuArena_Init(&g_VertexArena, 4*1024*1024, vertex_size);
+    GpuArena_Init(&g_IndexArena, 1024*1024, sizeof(GLuint));
+
+    glGenVertexArrays(1, &g_SceneVAO);
+    g_SceneVAOVertexGeneration = g_VertexArena.generation - 1;
+    g_SceneVAOIndexGeneration  = g_IndexArena.generation - 1;
+    UpdateSceneVertexArray();
+}
+
+// Aponta os atributos do VAO da cena para os buffers atuais das arenas. Deve
+// ser chamada sempre que uma arena crescer ou for compactada.
+void UpdateSceneVertexArray()
+{
+    if ( g_SceneVAOVertexGeneration == g_VertexArena.generation
+      && g_SceneVAOIndexGeneration == g_IndexArena.generation )
+        return;
+
+    glBindVertexArray(g_SceneVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, g_VertexArena.buffer);
+
+    // Os atributos abaixo correspondem a "(location = 0)", "(location = 1)"
+    // e "(location = 2)" em "shader_vertex.glsl".
+    if ( g_UseQuantizedVertices )
+    {
+        GLsizei stride = sizeof(PackedVertex);
+        glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)offsetof(PackedVertex, position));
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, stride, (void*)offsetof(PackedVertex, normal));
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)offsetof(PackedVertex, texcoord));
+    }
+    else
+    {
+        GLsizei stride = sizeof(FloatVertex);
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(FloatVertex, position));
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(FloatVertex, normal));
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(FloatVertex, texcoord));
+    }
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-    if ( !normal_coefficients.empty() )
-    {
-        GLuint VBO_normal_coefficients_id;
-        glGenBuffers(1, &VBO_normal_coefficients_id);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO_normal_coefficients_id);
-        glBufferData(GL_ARRAY_BUFFER, normal_coefficients.size() * sizeof(float), NULL, GL_STATIC_DRAW);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, normal_coefficients.size() * sizeof(float), normal_coefficients.data());
-        location = 1; // "(location = 1)" em "shader_vertex.glsl"
-        number_of_dimensions = 4; // vec4 em "shader_vertex.glsl"
-        glVertexAttribPointer(location, number_of_dimensions, GL_FLOAT, GL_FALSE, 0, 0);
-        glEnableVertexAttribArray(location);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-    }
-
-    if ( !texture_coefficients.empty() )
-    {
-        GLuint VBO_texture_coefficients_id;
-        glGenBuffers(1, &VBO_texture_coefficients_id);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO_texture_coefficients_id);
-        glBufferData(GL_ARRAY_BUFFER, texture_coefficients.size() * sizeof(float), NULL, GL_STATIC_DRAW);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, texture_coefficients.size() * sizeof(float), texture_coefficients.data());
-        location = 2; // "(location = 1)" em "shader_vertex.glsl"
-        number_of_dimensions = 2; // vec2 em "shader_vertex.glsl"
-        glVertexAttribPointer(location, number_of_dimensions, GL_FLOAT, GL_FALSE, 0, 0);
-        glEnableVertexAttribArray(location);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-    }
-
-    GLuint indices_id;
-    glGenBuffers(1, &indices_id);
-
-    // "Ligamos" o buffer. Note que o tipo agora é GL_ELEMENT_ARRAY_BUFFER.
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_id);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), NULL, GL_STATIC_DRAW);
-    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indices.size() * sizeof(GLuint), indices.data());
-    // glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0); // XXX Errado!
-    //
+    // "Ligamos" o buffer de índices. Note que o tipo agora é
+    // GL_ELEMENT_ARRAY_BUFFER, e que este faz parte do estado do VAO.
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_IndexArena.buffer);
 
     // "Desligamos" o VAO, evitando assim que operações posteriores venham a
     // alterar o mesmo. Isso evita bugs.
     glBindVertexArray(0);
+
+    g_SceneVAOVertexGeneration = g_VertexArena.generation;
+    g_SceneVAOIndexGeneration  = g_IndexArena.generation;
 }
 
-// Carrega um Vertex Shader de um arquivo GLSL. Veja definição de LoadShader() abaixo.
-GLuint LoadShader_Vertex(const char* filename)
+// Cria um programa de GPU com o vertex shader e o fragment shader dos
+// arquivos indicados (com as diretivas "#version" substituídas por
+// "vertex_header" e "fragment_header", se não forem NULL). Se o mesmo código
+// já foi compilado em uma execução anterior, o programa é lido do cache de
+// programas (veja "programcache.hpp"), sem compilar os shaders.
+GLuint LoadGpuProgram(const char* vertex_filename, const char* vertex_header, const char* fragment_filename, const char* fragment_header)
 {
-    // Criamos um identificador (ID) para este shader, informando que o mesmo
-    // será aplicado nos vértices.
-    GLuint vertex_shader_id = glCreateShader(GL_VERTEX_SHADER);
+    std::string sources[2];
+    sources[0] = LoadShaderSource(vertex_filename, vertex_header);
+    sources[1] = LoadShaderSource(fragment_filename, fragment_header);
 
-    // Carregamos e compilamos o shader
-    LoadShader(filename, vertex_shader_id);
+    uint64_t key = ProgramCache_Key(sources, 2);
+    GLuint program_id = ProgramCache_Load(key);
+    if ( program_id != 0 )
+        return program_id;
 
-    // Retorna o ID gerado acima
-    return vertex_shader_id;
-}
+    double start = glfwGetTime();
 
-// Carrega um Fragment Shader de um arquivo GLSL . Veja definição de LoadShader() abaixo.
-GLuint LoadShader_Fragment(const char* filename)
-{
-    // Criamos um identificador (ID) para este shader, informando que o mesmo
-    // será aplicado nos fragmentos.
+    GLuint vertex_shader_id = glCreateShader(GL_VERTEX_SHADER);
+    CompileShader(vertex_filename, sources[0], vertex_shader_id);
     GLuint fragment_shader_id = glCreateShader(GL_FRAGMENT_SHADER);
+    CompileShader(fragment_filename, sources[1], fragment_shader_id);
+    program_id = CreateGpuProgram(vertex_shader_id, fragment_shader_id);
 
-    // Carregamos e compilamos o shader
-    LoadShader(filename, fragment_shader_id);
-
-    // Retorna o ID gerado acima
-    return fragment_shader_id;
+    ProgramCache_Store(key, program_id, glfwGetTime() - start);
+    return program_id;
 }
 
-// Função auxilar, utilizada pelas duas funções acima. Carrega código de GPU de
-// um arquivo GLSL e faz sua compilação.
-void LoadShader(const char* filename, GLuint shader_id)
+// Lê o código de GPU de um arquivo GLSL. Se "header" não for NULL, ele
+// substitui a primeira linha do arquivo (a diretiva "#version").
+std::string LoadShaderSource(const char* filename, const char* header)
 {
-    // Lemos o arquivo de texto indicado pela variável "filename"
-    // e colocamos seu conteúdo em memória, apontado pela variável
-    // "shader_string".
-    std::ifstream file;
-    try {
-        file.exceptions(std::ifstream::failbit);
-        file.open(filename);
-    } catch ( std::exception& e ) {
+    std::string str;
+    if ( !ReadShaderSource(filename, header, &str) )
+    {
         fprintf(stderr, "ERROR: Cannot open file \"%s\".\n", filename);
         std::exit(EXIT_FAILURE);
     }
+    return str;
+}
+
+// Igual a LoadShaderSource(), mas retorna false em vez de encerrar o programa
+// se o arquivo não pode ser lido (por exemplo, durante a gravação do arquivo
+// por um editor; veja UpdateShaderReload()).
+bool ReadShaderSource(const char* filename, const char* header, std::string* source)
+{
+    // Lemos o arquivo de texto indicado pela variável "filename"
+    // e colocamos seu conteúdo em memória.
+    std::ifstream file(filename);
+    if ( !file )
+        return false;
+
     std::stringstream shader;
     shader << file.rdbuf();
     std::string str = shader.str();
+    if ( header != NULL )
+        str = std::string(header) + str.substr(std::min(str.find('\n'), str.size()));
+    *source = str;
+    return true;
+}
+
+// Compila o código de GPU "source", lido do arquivo "filename", no shader
+// "shader_id", e imprime no terminal os erros de compilação.
+void CompileShader(const char* filename, const std::string& source, GLuint shader_id)
+{
+    const std::string& str = source;
     const GLchar* shader_string = str.c_str();
     const GLint   shader_string_length = static_cast<GLint>( str.length() );
 
@@ -2382,6 +4694,10 @@ GLuint CreateGpuProgram(GLuint vertex_shader_id, GLuint fragment_shader_id)
     glAttachShader(program_id, vertex_shader_id);
     glAttachShader(program_id, fragment_shader_id);
 
+    // Pedimos ao driver que guarde o binário do programa (veja
+    // "programcache.hpp")
+    ProgramCache_PrepareLink(program_id);
+
     // Linkagem dos shaders acima ao programa
     glLinkProgram(program_id);
 
@@ -2441,6 +4757,15 @@ void FramebufferSizeCallback(GLFWwindow* window, int width, int height)
     // O cast para float é necessário pois números inteiros são arredondados ao
     // serem divididos!
     g_ScreenRatio = (float)width / height;
+    g_ScreenHeight = height;
+
+    // O tamanho dos caracteres do texto é definido em função do tamanho da
+    // janela (que difere do tamanho do framebuffer em telas de alta
+    // densidade).
+    int window_width, window_height;
+    glfwGetWindowSize(window, &window_width, &window_height);
+    if ( window_width > 0 && window_height > 0 )
+        TextRendering_SetWindowSize(window_width, window_height);
 }
 
 // Função callback chamada sempre que o usuário aperta algum dos botões do mouse
@@ -2641,12 +4966,11 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mod)
         g_ShowInfoText = !g_ShowInfoText;
     }
 
-    // Se o usuário apertar a tecla R, recarregamos os shaders dos arquivos "shader_fragment.glsl" e "shader_vertex.glsl".
+    // Se o usuário apertar a tecla R, recarregamos os shaders dos arquivos
+    // "shader_fragment.glsl" e "shader_vertex.glsl" (veja UpdateShaderReload()).
     if (key == GLFW_KEY_R && action == GLFW_PRESS)
     {
-        LoadShadersFromFiles();
-        fprintf(stdout,"Shaders recarregados!\n");
-        fflush(stdout);
+        g_ShaderReloadRequested = true;
     }
     if (key == GLFW_KEY_W)
     {
@@ -2906,6 +5230,30 @@ void TextRendering_ShowFramesPerSecond(GLFWwindow* window)
     float charwidth = TextRendering_CharWidth(window);
 
     TextRendering_PrintString(window, buffer, 1.0f-(numchars + 1)*charwidth, 1.0f-lineheight, 1.0f);
+
+    // Número de triângulos e de objetos desenhados neste quadro, e de
+    // objetos descartados pelo frustum culling e pelo PVS (veja
+    // DrawVirtualObject()).
+    char line[128];
+    int line_chars = snprintf(line, sizeof(line), "%d tris, %d visible, %d culled, %d pvs",
+                              (int)g_TrianglesDrawn, (int)g_ObjectsVisible, (int)g_ObjectsCulled, (int)g_ObjectsPvsCulled);
+    TextRendering_PrintString(window, line, 1.0f-(line_chars + 1)*charwidth, 1.0f-2*lineheight, 1.0f);
+
+    // Objetos descartados pelos testes de oclusão, dos quais na CPU, número
+    // de consultas de oclusão e altura de g_SceneBvh.
+    line_chars = snprintf(line, sizeof(line), "%d occluded (%d cpu, %d queries), bvh %d",
+                          (int)g_ObjectsOccluded, (int)g_ObjectsOccludedCpu, (int)g_OcclusionQueries, SceneBvh_Height(&g_SceneBvh));
+    TextRendering_PrintString(window, line, 1.0f-(line_chars + 1)*charwidth, 1.0f-3*lineheight, 1.0f);
+
+    // Número de instâncias entregues à GPU (veja g_UseGpuDriven), que não
+    // entram nos outros números, número de grupos de g_StaticBatch
+    // desenhados, trocas de estado entre os pacotes de g_RenderQueue, na
+    // ordem da fila e na ordem de envio, e permutações dos shaders
+    // compiladas.
+    line_chars = snprintf(line, sizeof(line), "gpu %d, static %d, changes %d/%d, shaders %d",
+                          (int)g_ObjectsGpuDriven, (int)g_StaticChunksDrawn, (int)g_RenderQueue.stats.changes_sorted,
+                          (int)g_RenderQueue.stats.changes_submitted, (int)g_ShaderPermutations.programs.size());
+    TextRendering_PrintString(window, line, 1.0f-(line_chars + 1)*charwidth, 1.0f-4*lineheight, 1.0f);
 }
 
 /// funções usadas para sortear itens e imprimi-los na tela
@@ -0,0 +1,291 @@
+#include "meshcache.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+// Cabeçalho do arquivo de cache. Todos os campos têm tamanho fixo, e os
+// vetores de dados começam em posições alinhadas a 16 bytes, de forma que
+// podem ser usados diretamente a partir do arquivo mapeado em memória.
+struct MeshCacheHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t num_shapes;
+    uint64_t source_size;
+    int64_t  source_mtime;
+    uint64_t source_hash;
+    uint64_t num_model_coefficients;
+    uint64_t num_normal_coefficients;
+    uint64_t num_texture_coefficients;
+    uint64_t indices_size;
+    uint64_t offset_model_coefficients;
+    uint64_t offset_normal_coefficients;
+    uint64_t offset_texture_coefficients;
+    uint64_t offset_indices;
+    uint64_t offset_shapes;
+};
+
+// Registro de tamanho fixo de cada objeto na tabela de objetos, gravado logo
+// após o nome do objeto.
+struct MeshCacheShape {
+    uint64_t index_offset;
+    uint64_t num_indices;
+    uint64_t index_size;
+    uint64_t base_vertex;
+    uint64_t num_vertices;
+    float    bbox[6];
+    uint32_t num_lods;
+    float    lod_error[MESHCACHE_MAX_LODS];
+    uint64_t lod_index_offset[MESHCACHE_MAX_LODS];
+    uint64_t lod_num_indices[MESHCACHE_MAX_LODS];
+};
+
+static const char MESHCACHE_MAGIC[8] = { 'F', 'C', 'G', 'M', 'E', 'S', 'H', '\0' };
+
+static std::string MeshCache_Filename(const char* obj_filename)
+{
+    return std::string(obj_filename) + ".meshcache";
+}
+
+MeshView MeshData_View(const MeshData& mesh)
+{
+    MeshView view;
+    view.model_coefficients       = mesh.model_coefficients.data();
+    view.num_model_coefficients   = mesh.model_coefficients.size();
+    view.normal_coefficients      = mesh.normal_coefficients.data();
+    view.num_normal_coefficients  = mesh.normal_coefficients.size();
+    view.texture_coefficients     = mesh.texture_coefficients.data();
+    view.num_texture_coefficients = mesh.texture_coefficients.size();
+    view.indices                  = mesh.indices.data();
+    view.indices_size             = mesh.indices.size();
+    view.shapes                   = mesh.shapes;
+    return view;
+}
+
+void MeshCache_Close(MeshCacheFile* file)
+{
+    CacheFile_Unmap(&file->file);
+    file->view = MeshView();
+}
+
+bool MeshCache_Open(const char* obj_filename, MeshCacheFile* file)
+{
+    file->view = MeshView();
+
+    uint64_t source_size;
+    int64_t  source_mtime;
+    if (!CacheFile_StatSource(obj_filename, &source_size, &source_mtime))
+        return false;
+
+    if (!CacheFile_Map(MeshCache_Filename(obj_filename), &file->file))
+        return false;
+
+    MeshCacheHeader header;
+    if (file->file.size < sizeof(header))
+    {
+        MeshCache_Close(file);
+        return false;
+    }
+    memcpy(&header, file->file.data, sizeof(header));
+
+    if (memcmp(header.magic, MESHCACHE_MAGIC, sizeof(MESHCACHE_MAGIC)) != 0
+        || header.version != MESHCACHE_VERSION
+        || header.source_size != source_size)
+    {
+        MeshCache_Close(file);
+        return false;
+    }
+
+    // Se a data de modificação mudou, só aceitamos o cache caso o conteúdo
+    // do arquivo fonte continue idêntico.
+    if (header.source_mtime != source_mtime)
+    {
+        uint64_t source_hash;
+        if (!CacheFile_HashSource(obj_filename, &source_hash) || source_hash != header.source_hash)
+        {
+            MeshCache_Close(file);
+            return false;
+        }
+
+        // O conteúdo é o mesmo: guardamos a nova data no cache, evitando
+        // calcular o hash do arquivo fonte nas próximas execuções.
+        CacheFile_UpdateSourceMtime(MeshCache_Filename(obj_filename), offsetof(MeshCacheHeader, source_mtime), source_mtime);
+    }
+
+    if (!CacheFile_InBounds(&file->file, header.offset_model_coefficients, header.num_model_coefficients, sizeof(float))
+        || !CacheFile_InBounds(&file->file, header.offset_normal_coefficients, header.num_normal_coefficients, sizeof(float))
+        || !CacheFile_InBounds(&file->file, header.offset_texture_coefficients, header.num_texture_coefficients, sizeof(float))
+        || !CacheFile_InBounds(&file->file, header.offset_indices, header.indices_size, 1)
+        || header.offset_shapes > file->file.size)
+    {
+        fprintf(stderr, "WARNING: Cache de malha corrompido para \"%s\".\n", obj_filename);
+        MeshCache_Close(file);
+        return false;
+    }
+
+    const char* base = (const char*)file->file.data;
+
+    MeshView& view = file->view;
+    view.model_coefficients       = (const float*)(base + header.offset_model_coefficients);
+    view.num_model_coefficients   = (size_t)header.num_model_coefficients;
+    view.normal_coefficients      = (const float*)(base + header.offset_normal_coefficients);
+    view.num_normal_coefficients  = (size_t)header.num_normal_coefficients;
+    view.texture_coefficients     = (const float*)(base + header.offset_texture_coefficients);
+    view.num_texture_coefficients = (size_t)header.num_texture_coefficients;
+    view.indices                  = (const uint8_t*)(base + header.offset_indices);
+    view.indices_size             = (size_t)header.indices_size;
+
+    // Tabela de objetos: para cada objeto, o tamanho do nome, o nome e um
+    // MeshCacheShape.
+    size_t offset = (size_t)header.offset_shapes;
+    for (uint32_t i = 0; i < header.num_shapes; ++i)
+    {
+        uint32_t name_length;
+        MeshCacheShape record;
+
+        if (file->file.size - offset < sizeof(name_length))
+            break;
+        memcpy(&name_length, base + offset, sizeof(name_length));
+        offset += sizeof(name_length);
+
+        if (file->file.size - offset < name_length + sizeof(record))
+            break;
+
+        MeshShape shape;
+        shape.name.assign(base + offset, name_length);
+        offset += name_length;
+        memcpy(&record, base + offset, sizeof(record));
+        offset += sizeof(record);
+
+        // Os índices e os vértices do objeto devem estar dentro dos vetores
+        if ((record.index_size != 2 && record.index_size != 4)
+            || record.index_offset > view.indices_size
+            || record.num_indices > (view.indices_size - record.index_offset) / record.index_size
+            || record.base_vertex > view.num_model_coefficients / 4
+            || record.num_vertices > view.num_model_coefficients / 4 - record.base_vertex
+            || record.num_lods > MESHCACHE_MAX_LODS)
+            break;
+
+        bool lods_ok = true;
+        for (uint32_t lod = 0; lod < record.num_lods; ++lod)
+        {
+            lods_ok = lods_ok
+                && record.lod_index_offset[lod] <= view.indices_size
+                && record.lod_num_indices[lod] <= (view.indices_size - record.lod_index_offset[lod]) / record.index_size;
+        }
+        if (!lods_ok)
+            break;
+
+        shape.index_offset = (size_t)record.index_offset;
+        shape.num_indices  = (size_t)record.num_indices;
+        shape.index_size   = (size_t)record.index_size;
+        shape.base_vertex  = (size_t)record.base_vertex;
+        shape.num_vertices = (size_t)record.num_vertices;
+        shape.bbox_min = glm::vec3(record.bbox[0], record.bbox[1], record.bbox[2]);
+        shape.bbox_max = glm::vec3(record.bbox[3], record.bbox[4], record.bbox[5]);
+        for (uint32_t lod = 0; lod < record.num_lods; ++lod)
+        {
+            MeshLod level;
+            level.index_offset = (size_t)record.lod_index_offset[lod];
+            level.num_indices  = (size_t)record.lod_num_indices[lod];
+            level.error        = record.lod_error[lod];
+            shape.lods.push_back(level);
+        }
+        view.shapes.push_back(shape);
+    }
+
+    if (view.shapes.size() != header.num_shapes)
+    {
+        fprintf(stderr, "WARNING: Cache de malha corrompido para \"%s\".\n", obj_filename);
+        MeshCache_Close(file);
+        return false;
+    }
+
+    return true;
+}
+
+bool MeshCache_Write(const char* obj_filename, const MeshView& mesh)
+{
+    MeshCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MESHCACHE_MAGIC, sizeof(MESHCACHE_MAGIC));
+    header.version    = MESHCACHE_VERSION;
+    header.num_shapes = (uint32_t)mesh.shapes.size();
+
+    if (!CacheFile_StatSource(obj_filename, &header.source_size, &header.source_mtime)
+        || !CacheFile_HashSource(obj_filename, &header.source_hash))
+        return false;
+
+    header.num_model_coefficients   = mesh.num_model_coefficients;
+    header.num_normal_coefficients  = mesh.num_normal_coefficients;
+    header.num_texture_coefficients = mesh.num_texture_coefficients;
+    header.indices_size             = mesh.indices_size;
+
+    // Calculamos a posição de cada bloco dentro do arquivo
+    size_t offset = sizeof(header);
+    offset = CacheFile_Align(offset);
+    header.offset_model_coefficients = offset;
+    offset += mesh.num_model_coefficients * sizeof(float);
+    offset = CacheFile_Align(offset);
+    header.offset_normal_coefficients = offset;
+    offset += mesh.num_normal_coefficients * sizeof(float);
+    offset = CacheFile_Align(offset);
+    header.offset_texture_coefficients = offset;
+    offset += mesh.num_texture_coefficients * sizeof(float);
+    offset = CacheFile_Align(offset);
+    header.offset_indices = offset;
+    offset += mesh.indices_size;
+    offset = CacheFile_Align(offset);
+    header.offset_shapes = offset;
+
+    // Escrevemos em um arquivo temporário e depois renomeamos, para que uma
+    // execução interrompida nunca deixe um cache pela metade.
+    std::string filename = MeshCache_Filename(obj_filename);
+    std::string tmp_filename = filename + ".tmp";
+
+    FILE* f = fopen(tmp_filename.c_str(), "wb");
+    if (f == NULL)
+        return false;
+
+    size_t written = 0;
+    bool ok = CacheFile_WriteBlock(f, &header, sizeof(header), &written)
+           && CacheFile_WriteBlock(f, mesh.model_coefficients, mesh.num_model_coefficients * sizeof(float), &written)
+           && CacheFile_WriteBlock(f, mesh.normal_coefficients, mesh.num_normal_coefficients * sizeof(float), &written)
+           && CacheFile_WriteBlock(f, mesh.texture_coefficients, mesh.num_texture_coefficients * sizeof(float), &written)
+           && CacheFile_WriteBlock(f, mesh.indices, mesh.indices_size, &written)
+           && CacheFile_WriteBlock(f, NULL, 0, &written);
+
+    for (size_t i = 0; ok && i < mesh.shapes.size(); ++i)
+    {
+        const MeshShape& shape = mesh.shapes[i];
+        uint32_t name_length = (uint32_t)shape.name.size();
+
+        MeshCacheShape record;
+        memset(&record, 0, sizeof(record));
+        record.index_offset = shape.index_offset;
+        record.num_indices  = shape.num_indices;
+        record.index_size   = shape.index_size;
+        record.base_vertex  = shape.base_vertex;
+        record.num_vertices = shape.num_vertices;
+        record.bbox[0] = shape.bbox_min.x;
+        record.bbox[1] = shape.bbox_min.y;
+        record.bbox[2] = shape.bbox_min.z;
+        record.bbox[3] = shape.bbox_max.x;
+        record.bbox[4] = shape.bbox_max.y;
+        record.bbox[5] = shape.bbox_max.z;
+        record.num_lods = (uint32_t)std::min(shape.lods.size(), (size_t)MESHCACHE_MAX_LODS);
+        for (uint32_t lod = 0; lod < record.num_lods; ++lod)
+        {
+            record.lod_error[lod]        = shape.lods[lod].error;
+            record.lod_index_offset[lod] = shape.lods[lod].index_offset;
+            record.lod_num_indices[lod]  = shape.lods[lod].num_indices;
+        }
+
+        ok = fwrite(&name_length, sizeof(name_length), 1, f) == 1
+          && (name_length == 0 || fwrite(shape.name.data(), 1, name_length, f) == name_length)
+          && fwrite(&record, sizeof(record), 1, f) == 1;
+    }
+
+    return CacheFile_Commit(f, tmp_filename, filename, ok);
+}
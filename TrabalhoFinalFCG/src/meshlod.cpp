@@ -0,0 +1,486 @@
+#include "meshlod.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+// Quádrica de erro: soma ponderada dos quadrados das distâncias de um ponto
+// "p" a um conjunto de planos, Q(p) = p^T A p + 2 b^T p + c, com A
+// simétrica. "w" é a soma dos pesos, usada para normalizar o erro.
+struct MeshLodQuadric {
+    double a00, a11, a22, a01, a02, a12;
+    double b0, b1, b2;
+    double c;
+    double w;
+};
+
+// Posição de um vértice, usada para encontrar vértices com a mesma posição.
+struct MeshLodPosition {
+    float p[3];
+
+    bool operator==(const MeshLodPosition& other) const
+    {
+        return memcmp(p, other.p, sizeof(p)) == 0;
+    }
+};
+
+struct MeshLodPositionHash {
+    size_t operator()(const MeshLodPosition& position) const
+    {
+        uint32_t h[3];
+        memcpy(h, position.p, sizeof(h));
+        return (size_t)((h[0] * 73856093u) ^ (h[1] * 19349663u) ^ (h[2] * 83492791u));
+    }
+};
+
+// Colapso candidato da posição "v" na posição "u".
+struct MeshLodCollapse {
+    uint32_t v;
+    uint32_t u;
+    double   cost;
+
+    bool operator<(const MeshLodCollapse& other) const
+    {
+        return cost < other.cost;
+    }
+};
+
+// Classificação de cada posição de acordo com as arestas de borda (arestas
+// usadas por um único triângulo) que a tocam.
+enum MeshLodKind {
+    MESHLOD_MANIFOLD, // Nenhuma aresta de borda
+    MESHLOD_BORDER,   // Exatamente duas arestas de borda
+    MESHLOD_LOCKED    // Topologia mais complexa: a posição nunca é removida
+};
+
+static void MeshLod_AddPlane(MeshLodQuadric* q, const double n[3], double d, double weight)
+{
+    q->a00 += weight * n[0] * n[0];
+    q->a11 += weight * n[1] * n[1];
+    q->a22 += weight * n[2] * n[2];
+    q->a01 += weight * n[0] * n[1];
+    q->a02 += weight * n[0] * n[2];
+    q->a12 += weight * n[1] * n[2];
+    q->b0  += weight * n[0] * d;
+    q->b1  += weight * n[1] * d;
+    q->b2  += weight * n[2] * d;
+    q->c   += weight * d * d;
+    q->w   += weight;
+}
+
+static void MeshLod_AddQuadric(MeshLodQuadric* q, const MeshLodQuadric& r)
+{
+    q->a00 += r.a00; q->a11 += r.a11; q->a22 += r.a22;
+    q->a01 += r.a01; q->a02 += r.a02; q->a12 += r.a12;
+    q->b0  += r.b0;  q->b1  += r.b1;  q->b2  += r.b2;
+    q->c   += r.c;
+    q->w   += r.w;
+}
+
+// Quadrado da distância média ponderada de "p" aos planos de "q".
+static double MeshLod_Error(const MeshLodQuadric& q, const float* p)
+{
+    double x = p[0], y = p[1], z = p[2];
+    double e = q.a00*x*x + q.a11*y*y + q.a22*z*z
+             + 2.0*(q.a01*x*y + q.a02*x*z + q.a12*y*z)
+             + 2.0*(q.b0*x + q.b1*y + q.b2*z)
+             + q.c;
+    return q.w > 0.0 ? std::fabs(e) / q.w : 0.0;
+}
+
+static void MeshLod_Normal(const float* p0, const float* p1, const float* p2, double n[3])
+{
+    double e1[3] = { (double)p1[0] - p0[0], (double)p1[1] - p0[1], (double)p1[2] - p0[2] };
+    double e2[3] = { (double)p2[0] - p0[0], (double)p2[1] - p0[1], (double)p2[2] - p0[2] };
+    n[0] = e1[1]*e2[2] - e1[2]*e2[1];
+    n[1] = e1[2]*e2[0] - e1[0]*e2[2];
+    n[2] = e1[0]*e2[1] - e1[1]*e2[0];
+}
+
+static uint64_t MeshLod_EdgeKey(uint32_t a, uint32_t b)
+{
+    return ((uint64_t)a << 32) | b;
+}
+
+// Estado da simplificação. Os índices da malha referenciam vértices; as
+// quádricas, a topologia e os colapsos são calculados sobre as posições
+// ("welded[v]" é o primeiro vértice com a mesma posição de "v").
+struct MeshLodState {
+    const float*                 positions;
+    size_t                       stride;
+    std::vector<uint32_t>&       indices;
+    std::vector<uint32_t>        welded;
+    std::vector<MeshLodQuadric>  quadrics;   // Indexado por posição
+    std::vector<uint32_t>        offsets;    // Triângulos de cada posição: adjacency[offsets[w] .. offsets[w+1]-1]
+    std::vector<uint32_t>        adjacency;
+    std::unordered_set<uint64_t> edges;      // Arestas orientadas (a,b) entre posições
+    std::vector<unsigned char>   kind;       // MeshLodKind de cada posição
+
+    MeshLodState(const float* positions, size_t stride, std::vector<uint32_t>& indices)
+        : positions(positions), stride(stride), indices(indices)
+    {
+    }
+
+    const float* Position(uint32_t vertex) const
+    {
+        return positions + vertex * stride;
+    }
+
+    uint32_t Corner(size_t triangle, size_t k) const
+    {
+        return welded[indices[3*triangle + k]];
+    }
+
+    bool IsBorderEdge(uint32_t a, uint32_t b) const
+    {
+        return edges.count(MeshLod_EdgeKey(a, b)) == 0 || edges.count(MeshLod_EdgeKey(b, a)) == 0;
+    }
+};
+
+// Remove os triângulos com duas posições iguais.
+static void MeshLod_RemoveDegenerate(MeshLodState* state)
+{
+    std::vector<uint32_t>& indices = state->indices;
+    size_t write = 0;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        uint32_t a = state->welded[indices[i + 0]];
+        uint32_t b = state->welded[indices[i + 1]];
+        uint32_t c = state->welded[indices[i + 2]];
+        if (a == b || b == c || a == c)
+            continue;
+
+        indices[write + 0] = indices[i + 0];
+        indices[write + 1] = indices[i + 1];
+        indices[write + 2] = indices[i + 2];
+        write += 3;
+    }
+    indices.resize(write);
+}
+
+// Recalcula a adjacência, as arestas e a classificação das posições a
+// partir dos índices atuais.
+static void MeshLod_BuildTopology(MeshLodState* state, size_t num_vertices)
+{
+    size_t num_triangles = state->indices.size() / 3;
+
+    state->offsets.assign(num_vertices + 1, 0);
+    for (size_t i = 0; i < state->indices.size(); ++i)
+        state->offsets[state->welded[state->indices[i]] + 1] += 1;
+    for (size_t w = 0; w < num_vertices; ++w)
+        state->offsets[w + 1] += state->offsets[w];
+
+    std::vector<uint32_t> cursor(state->offsets.begin(), state->offsets.end() - 1);
+    state->adjacency.resize(state->indices.size());
+    for (size_t t = 0; t < num_triangles; ++t)
+        for (size_t k = 0; k < 3; ++k)
+            state->adjacency[cursor[state->Corner(t, k)]++] = (uint32_t)t;
+
+    state->edges.clear();
+    state->edges.reserve(state->indices.size());
+    for (size_t t = 0; t < num_triangles; ++t)
+        for (size_t k = 0; k < 3; ++k)
+            state->edges.insert(MeshLod_EdgeKey(state->Corner(t, k), state->Corner(t, (k + 1) % 3)));
+
+    std::vector<unsigned> border_edges(num_vertices, 0);
+    for (size_t t = 0; t < num_triangles; ++t)
+        for (size_t k = 0; k < 3; ++k)
+        {
+            uint32_t a = state->Corner(t, k);
+            uint32_t b = state->Corner(t, (k + 1) % 3);
+            if (state->edges.count(MeshLod_EdgeKey(b, a)) == 0)
+            {
+                border_edges[a] += 1;
+                border_edges[b] += 1;
+            }
+        }
+
+    state->kind.resize(num_vertices);
+    for (size_t w = 0; w < num_vertices; ++w)
+        state->kind[w] = border_edges[w] == 0 ? MESHLOD_MANIFOLD : (border_edges[w] == 2 ? MESHLOD_BORDER : MESHLOD_LOCKED);
+}
+
+// Verifica se a posição "v" pode ser colapsada em "u". Cada vértice de "v"
+// (um por combinação de atributos) deve ser substituído por um vértice de
+// "u" com o qual compartilha uma aresta; se algum vértice de "v" não tiver
+// um único vértice correspondente, o colapso rasgaria uma costura. Os pares
+// (vértice de "v", vértice de "u") são escritos em "pairs".
+static bool MeshLod_CanCollapse(const MeshLodState& state, uint32_t v, uint32_t u, std::vector< std::pair<uint32_t, uint32_t> >* pairs)
+{
+    if (state.kind[v] == MESHLOD_LOCKED)
+        return false;
+
+    // Posições na borda só podem deslizar ao longo da borda
+    if (state.kind[v] == MESHLOD_BORDER && (state.kind[u] == MESHLOD_MANIFOLD || !state.IsBorderEdge(v, u)))
+        return false;
+
+    pairs->clear();
+    std::vector<uint32_t> used;
+
+    for (uint32_t i = state.offsets[v]; i < state.offsets[v + 1]; ++i)
+    {
+        uint32_t t = state.adjacency[i];
+
+        uint32_t vertex_v = 0, vertex_u = 0;
+        bool has_u = false;
+        for (size_t k = 0; k < 3; ++k)
+        {
+            uint32_t vertex = state.indices[3*t + k];
+            if (state.welded[vertex] == v)
+                vertex_v = vertex;
+            else if (state.welded[vertex] == u)
+            {
+                vertex_u = vertex;
+                has_u = true;
+            }
+        }
+
+        if (std::find(used.begin(), used.end(), vertex_v) == used.end())
+            used.push_back(vertex_v);
+
+        if (!has_u)
+            continue;
+
+        bool found = false;
+        for (size_t p = 0; p < pairs->size(); ++p)
+        {
+            if ((*pairs)[p].first != vertex_v)
+                continue;
+            if ((*pairs)[p].second != vertex_u)
+                return false;
+            found = true;
+        }
+        if (!found)
+            pairs->push_back(std::make_pair(vertex_v, vertex_u));
+    }
+
+    // Posições em nenhuma aresta com "u"
+    if (pairs->empty())
+        return false;
+
+    for (size_t i = 0; i < used.size(); ++i)
+    {
+        bool found = false;
+        for (size_t p = 0; p < pairs->size(); ++p)
+            found = found || (*pairs)[p].first == used[i];
+        if (!found)
+            return false;
+    }
+
+    return true;
+}
+
+// Verifica se o colapso de "v" em "u" inverte (ou gira demais) algum dos
+// triângulos que permanecem.
+static bool MeshLod_Flips(const MeshLodState& state, uint32_t v, uint32_t u)
+{
+    const float* pu = state.Position(u);
+
+    for (uint32_t i = state.offsets[v]; i < state.offsets[v + 1]; ++i)
+    {
+        uint32_t t = state.adjacency[i];
+
+        const float* p[3];
+        const float* q[3];
+        bool removed = false;
+        for (size_t k = 0; k < 3; ++k)
+        {
+            uint32_t w = state.Corner(t, k);
+            removed = removed || w == u;
+            p[k] = state.Position(state.indices[3*t + k]);
+            q[k] = (w == v) ? pu : p[k];
+        }
+        if (removed)
+            continue;
+
+        double n0[3], n1[3];
+        MeshLod_Normal(p[0], p[1], p[2], n0);
+        MeshLod_Normal(q[0], q[1], q[2], n1);
+
+        double dot = n0[0]*n1[0] + n0[1]*n1[1] + n0[2]*n1[2];
+        double len = std::sqrt((n0[0]*n0[0] + n0[1]*n0[1] + n0[2]*n0[2]) * (n1[0]*n1[0] + n1[1]*n1[1] + n1[2]*n1[2]));
+        if (dot <= 0.25 * len)
+            return true;
+    }
+
+    return false;
+}
+
+float MeshLod_Simplify(const uint32_t* indices, size_t num_indices, const float* positions, size_t position_stride, size_t num_vertices, size_t target_num_indices, float max_error, std::vector<uint32_t>* destination)
+{
+    destination->assign(indices, indices + num_indices);
+
+    MeshLodState state(positions, position_stride, *destination);
+
+    // Encontramos os vértices com a mesma posição
+    state.welded.resize(num_vertices);
+    {
+        std::unordered_map<MeshLodPosition, uint32_t, MeshLodPositionHash> first_vertex;
+        first_vertex.reserve(num_vertices);
+        for (size_t v = 0; v < num_vertices; ++v)
+        {
+            MeshLodPosition key;
+            memcpy(key.p, state.Position((uint32_t)v), sizeof(key.p));
+            state.welded[v] = first_vertex.insert(std::make_pair(key, (uint32_t)v)).first->second;
+        }
+    }
+
+    MeshLod_RemoveDegenerate(&state);
+    MeshLod_BuildTopology(&state, num_vertices);
+
+    // Quádricas iniciais: o plano de cada triângulo, com peso igual à sua
+    // área, e, nas arestas de borda, um plano perpendicular ao triângulo com
+    // peso maior, que penaliza o deslocamento da borda.
+    MeshLodQuadric zero;
+    memset(&zero, 0, sizeof(zero));
+    state.quadrics.assign(num_vertices, zero);
+
+    for (size_t t = 0; t < state.indices.size() / 3; ++t)
+    {
+        const float* p[3];
+        for (size_t k = 0; k < 3; ++k)
+            p[k] = state.Position(state.indices[3*t + k]);
+
+        double n[3];
+        MeshLod_Normal(p[0], p[1], p[2], n);
+        double length = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+        if (length == 0.0)
+            continue;
+        n[0] /= length; n[1] /= length; n[2] /= length;
+
+        double area = 0.5 * length;
+        double d = -(n[0]*p[0][0] + n[1]*p[0][1] + n[2]*p[0][2]);
+        for (size_t k = 0; k < 3; ++k)
+            MeshLod_AddPlane(&state.quadrics[state.Corner(t, k)], n, d, area);
+
+        for (size_t k = 0; k < 3; ++k)
+        {
+            uint32_t a = state.Corner(t, k);
+            uint32_t b = state.Corner(t, (k + 1) % 3);
+            if (state.edges.count(MeshLod_EdgeKey(b, a)) != 0)
+                continue;
+
+            const float* pa = p[k];
+            const float* pb = p[(k + 1) % 3];
+            double e[3] = { (double)pb[0] - pa[0], (double)pb[1] - pa[1], (double)pb[2] - pa[2] };
+            double m[3] = { e[1]*n[2] - e[2]*n[1], e[2]*n[0] - e[0]*n[2], e[0]*n[1] - e[1]*n[0] };
+            double m_length = std::sqrt(m[0]*m[0] + m[1]*m[1] + m[2]*m[2]);
+            if (m_length == 0.0)
+                continue;
+            m[0] /= m_length; m[1] /= m_length; m[2] /= m_length;
+
+            double md = -(m[0]*pa[0] + m[1]*pa[1] + m[2]*pa[2]);
+            double weight = 10.0 * (e[0]*e[0] + e[1]*e[1] + e[2]*e[2]);
+            MeshLod_AddPlane(&state.quadrics[a], m, md, weight);
+            MeshLod_AddPlane(&state.quadrics[b], m, md, weight);
+        }
+    }
+
+    double error_limit = (double)max_error * max_error;
+    double worst_error = 0.0;
+
+    std::vector<uint32_t> remap(num_vertices);
+    std::vector<unsigned char> locked(num_vertices);
+    std::vector<MeshLodCollapse> collapses;
+    std::vector< std::pair<uint32_t, uint32_t> > pairs;
+
+    // Cada passo ordena os colapsos possíveis por custo e executa os mais
+    // baratos cujas vizinhanças não se sobrepõem; a topologia é então
+    // recalculada para o próximo passo.
+    while (state.indices.size() > target_num_indices)
+    {
+        size_t num_triangles = state.indices.size() / 3;
+
+        collapses.clear();
+        for (size_t t = 0; t < num_triangles; ++t)
+            for (size_t k = 0; k < 3; ++k)
+            {
+                uint32_t a = state.Corner(t, k);
+                uint32_t b = state.Corner(t, (k + 1) % 3);
+
+                // Cada aresta interna aparece em dois triângulos, uma vez
+                // em cada sentido
+                if (a > b && !state.IsBorderEdge(a, b))
+                    continue;
+
+                MeshLodCollapse best;
+                best.cost = -1.0;
+                if (MeshLod_CanCollapse(state, a, b, &pairs))
+                {
+                    best.v = a; best.u = b;
+                    best.cost = MeshLod_Error(state.quadrics[a], state.Position(b));
+                }
+                if (MeshLod_CanCollapse(state, b, a, &pairs))
+                {
+                    double cost = MeshLod_Error(state.quadrics[b], state.Position(a));
+                    if (best.cost < 0.0 || cost < best.cost)
+                    {
+                        best.v = b; best.u = a;
+                        best.cost = cost;
+                    }
+                }
+                if (best.cost >= 0.0)
+                    collapses.push_back(best);
+            }
+
+        std::sort(collapses.begin(), collapses.end());
+
+        for (size_t v = 0; v < num_vertices; ++v)
+            remap[v] = (uint32_t)v;
+        std::fill(locked.begin(), locked.end(), 0);
+
+        size_t num_collapses = 0;
+        for (size_t i = 0; i < collapses.size() && 3*num_triangles > target_num_indices; ++i)
+        {
+            const MeshLodCollapse& collapse = collapses[i];
+            uint32_t v = collapse.v;
+            uint32_t u = collapse.u;
+
+            if (collapse.cost > error_limit)
+                break;
+
+            if (locked[v] || locked[u])
+                continue;
+
+            if (!MeshLod_CanCollapse(state, v, u, &pairs) || MeshLod_Flips(state, v, u))
+                continue;
+
+            for (size_t p = 0; p < pairs.size(); ++p)
+                remap[pairs[p].first] = pairs[p].second;
+
+            // Os triângulos com "v" e "u" desaparecem; os demais triângulos
+            // de "v" mudam, e suas posições não podem mais ser colapsadas
+            // neste passo.
+            for (uint32_t j = state.offsets[v]; j < state.offsets[v + 1]; ++j)
+            {
+                uint32_t t = state.adjacency[j];
+                bool removed = false;
+                for (size_t k = 0; k < 3; ++k)
+                {
+                    locked[state.Corner(t, k)] = 1;
+                    removed = removed || state.Corner(t, k) == u;
+                }
+                if (removed)
+                    num_triangles -= 1;
+            }
+
+            MeshLod_AddQuadric(&state.quadrics[u], state.quadrics[v]);
+            worst_error = std::max(worst_error, collapse.cost);
+            num_collapses += 1;
+        }
+
+        if (num_collapses == 0)
+            break;
+
+        for (size_t i = 0; i < state.indices.size(); ++i)
+            state.indices[i] = remap[state.indices[i]];
+
+        MeshLod_RemoveDegenerate(&state);
+        MeshLod_BuildTopology(&state, num_vertices);
+    }
+
+    return (float)std::sqrt(worst_error);
+}
@@ -0,0 +1,348 @@
+#include "meshopt.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Simulação de uma cache FIFO de vértices. Em vez de manter a fila,
+// guardamos para cada vértice o "instante" em que ele entrou na cache: o
+// vértice está na cache se entrou há menos de MESHOPT_CACHE_SIZE entradas.
+struct MeshOptCache {
+    std::vector<unsigned> timestamps;
+    unsigned              time;
+
+    explicit MeshOptCache(size_t num_vertices)
+        : timestamps(num_vertices, 0), time(MESHOPT_CACHE_SIZE + 1)
+    {
+    }
+
+    void Reset()
+    {
+        time += MESHOPT_CACHE_SIZE + 1;
+    }
+
+    // Retorna o número de vértices do triângulo que não estavam na cache.
+    unsigned Triangle(const uint32_t* triangle)
+    {
+        unsigned misses = 0;
+        for (size_t k = 0; k < 3; ++k)
+        {
+            uint32_t v = triangle[k];
+            if (time - timestamps[v] > MESHOPT_CACHE_SIZE)
+            {
+                timestamps[v] = time++;
+                misses += 1;
+            }
+        }
+        return misses;
+    }
+};
+
+MeshOptStats MeshOpt_AnalyzeVertexCache(const uint32_t* indices, size_t num_indices, size_t num_vertices)
+{
+    MeshOptStats stats;
+    stats.acmr = 0.0f;
+    stats.atvr = 0.0f;
+
+    if (num_indices == 0 || num_vertices == 0)
+        return stats;
+
+    MeshOptCache cache(num_vertices);
+    size_t misses = 0;
+    for (size_t i = 0; i < num_indices; i += 3)
+        misses += cache.Triangle(indices + i);
+
+    stats.acmr = (float)misses / (float)(num_indices / 3);
+    stats.atvr = (float)misses / (float)num_vertices;
+    return stats;
+}
+
+// Estado do algoritmo Tipsify. Os nomes seguem o pseudocódigo do artigo.
+struct Tipsify {
+    std::vector<uint32_t> adjacency_offsets; // A: triângulos de cada vértice
+    std::vector<uint32_t> adjacency;
+    std::vector<uint32_t> live;              // L: triângulos ainda não emitidos de cada vértice
+    std::vector<unsigned> timestamps;        // C: instante em que o vértice entrou na cache
+    std::vector<uint32_t> dead_end;          // D: pilha de vértices já usados
+    size_t                cursor;            // i: próximo vértice na varredura sequencial
+    unsigned              time;              // s
+
+    // Próximo vértice a partir do qual emitir triângulos quando nenhum
+    // candidato está disponível: o mais recente da pilha que ainda tenha
+    // triângulos, ou o próximo na ordem original. Retorna -1 ao terminar.
+    long SkipDeadEnd()
+    {
+        while (!dead_end.empty())
+        {
+            uint32_t d = dead_end.back();
+            dead_end.pop_back();
+            if (live[d] > 0)
+                return d;
+        }
+
+        while (cursor < live.size())
+        {
+            if (live[cursor] > 0)
+                return (long)cursor++;
+            cursor += 1;
+        }
+
+        return -1;
+    }
+
+    // Entre os vértices dos triângulos recém emitidos, escolhe o que
+    // provavelmente ainda estará na cache depois de emitir todos os seus
+    // triângulos, e que está há mais tempo nela.
+    long NextVertex(const std::vector<uint32_t>& candidates, bool* dead_end_hit)
+    {
+        long best = -1;
+        long best_priority = -1;
+
+        for (size_t c = 0; c < candidates.size(); ++c)
+        {
+            uint32_t v = candidates[c];
+            if (live[v] == 0)
+                continue;
+
+            long priority = 0;
+            long age = (long)(time - timestamps[v]);
+            if (age + 2 * (long)live[v] <= MESHOPT_CACHE_SIZE)
+                priority = age;
+
+            if (priority > best_priority)
+            {
+                best_priority = priority;
+                best = v;
+            }
+        }
+
+        *dead_end_hit = (best == -1);
+        if (best == -1)
+            best = SkipDeadEnd();
+        return best;
+    }
+};
+
+void MeshOpt_OptimizeVertexCache(uint32_t* indices, size_t num_indices, size_t num_vertices, std::vector<size_t>* clusters)
+{
+    size_t num_triangles = num_indices / 3;
+    if (clusters)
+        clusters->clear();
+    if (num_triangles == 0)
+        return;
+
+    Tipsify t;
+
+    // Lista de adjacência vértice -> triângulos
+    t.adjacency_offsets.assign(num_vertices + 1, 0);
+    for (size_t i = 0; i < num_indices; ++i)
+        t.adjacency_offsets[indices[i] + 1] += 1;
+    for (size_t v = 0; v < num_vertices; ++v)
+        t.adjacency_offsets[v + 1] += t.adjacency_offsets[v];
+
+    t.adjacency.resize(num_indices);
+    t.live.assign(num_vertices, 0);
+    for (size_t i = 0; i < num_indices; ++i)
+    {
+        uint32_t v = indices[i];
+        t.adjacency[t.adjacency_offsets[v] + t.live[v]] = (uint32_t)(i / 3);
+        t.live[v] += 1;
+    }
+
+    t.timestamps.assign(num_vertices, 0);
+    t.cursor = 0;
+    t.time = MESHOPT_CACHE_SIZE + 1;
+
+    std::vector<uint32_t> output;
+    output.reserve(num_indices);
+    std::vector<bool> emitted(num_triangles, false);
+    std::vector<uint32_t> candidates;
+
+    if (clusters)
+        clusters->push_back(0);
+
+    long fanning = indices[0];
+    while (fanning >= 0)
+    {
+        candidates.clear();
+
+        // Emite todos os triângulos ainda não emitidos em volta do vértice
+        uint32_t f = (uint32_t)fanning;
+        for (uint32_t a = t.adjacency_offsets[f]; a < t.adjacency_offsets[f + 1]; ++a)
+        {
+            uint32_t triangle = t.adjacency[a];
+            if (emitted[triangle])
+                continue;
+
+            for (size_t k = 0; k < 3; ++k)
+            {
+                uint32_t v = indices[3*triangle + k];
+                output.push_back(v);
+                t.dead_end.push_back(v);
+                candidates.push_back(v);
+                t.live[v] -= 1;
+
+                if (t.time - t.timestamps[v] > MESHOPT_CACHE_SIZE)
+                    t.timestamps[v] = t.time++;
+            }
+            emitted[triangle] = true;
+        }
+
+        bool dead_end_hit;
+        fanning = t.NextVertex(candidates, &dead_end_hit);
+
+        // Ao sair de um beco sem saída a localidade é perdida: começa um
+        // novo grupo de triângulos.
+        if (clusters && dead_end_hit && fanning >= 0 && clusters->back() != output.size() / 3)
+            clusters->push_back(output.size() / 3);
+    }
+
+    memcpy(indices, output.data(), num_indices * sizeof(uint32_t));
+}
+
+// Divide os grupos gerados pelo Tipsify em grupos menores, sempre que o ACMR
+// acumulado dentro do grupo estiver abaixo de "threshold" vezes o ACMR do grupo
+// inteiro. Grupos menores permitem uma ordenação mais fina para o overdraw.
+static void MeshOpt_SoftBoundaries(const uint32_t* indices, size_t num_triangles, size_t num_vertices, const std::vector<size_t>& clusters, float threshold, std::vector<size_t>* result)
+{
+    MeshOptCache cache(num_vertices);
+    result->clear();
+
+    for (size_t c = 0; c < clusters.size(); ++c)
+    {
+        size_t start = clusters[c];
+        size_t end = (c + 1 < clusters.size()) ? clusters[c + 1] : num_triangles;
+
+        cache.Reset();
+        unsigned cluster_misses = 0;
+        for (size_t i = start; i < end; ++i)
+            cluster_misses += cache.Triangle(indices + 3*i);
+
+        float cluster_threshold = threshold * (float)cluster_misses / (float)(end - start);
+
+        result->push_back(start);
+
+        cache.Reset();
+        unsigned running_misses = 0;
+        unsigned running_triangles = 0;
+        for (size_t i = start; i < end; ++i)
+        {
+            running_misses += cache.Triangle(indices + 3*i);
+            running_triangles += 1;
+
+            if ((float)running_misses / (float)running_triangles <= cluster_threshold && i + 1 < end)
+            {
+                result->push_back(i + 1);
+                cache.Reset();
+                running_misses = 0;
+                running_triangles = 0;
+            }
+        }
+    }
+}
+
+void MeshOpt_OptimizeOverdraw(uint32_t* indices, size_t num_indices, const float* positions, size_t position_stride, size_t num_vertices, const std::vector<size_t>& clusters, float threshold)
+{
+    size_t num_triangles = num_indices / 3;
+    if (num_triangles == 0 || clusters.empty())
+        return;
+
+    std::vector<size_t> soft_clusters;
+    MeshOpt_SoftBoundaries(indices, num_triangles, num_vertices, clusters, threshold, &soft_clusters);
+
+    // Centroide da malha
+    double mesh_centroid[3] = { 0.0, 0.0, 0.0 };
+    for (size_t v = 0; v < num_vertices; ++v)
+        for (size_t k = 0; k < 3; ++k)
+            mesh_centroid[k] += positions[v*position_stride + k];
+    for (size_t k = 0; k < 3; ++k)
+        mesh_centroid[k] /= (double)num_vertices;
+
+    // Para cada grupo, calculamos o centroide e a normal média (ponderados
+    // pela área dos triângulos). Grupos cuja normal aponta para fora da malha
+    // tendem a ocultar outros grupos, e devem ser desenhados antes.
+    size_t num_clusters = soft_clusters.size();
+    std::vector<float> sort_keys(num_clusters);
+    for (size_t c = 0; c < num_clusters; ++c)
+    {
+        size_t start = soft_clusters[c];
+        size_t end = (c + 1 < num_clusters) ? soft_clusters[c + 1] : num_triangles;
+
+        double centroid[3] = { 0.0, 0.0, 0.0 };
+        double normal[3] = { 0.0, 0.0, 0.0 };
+        double area_sum = 0.0;
+
+        for (size_t i = start; i < end; ++i)
+        {
+            const float* a = positions + indices[3*i + 0]*position_stride;
+            const float* b = positions + indices[3*i + 1]*position_stride;
+            const float* c2 = positions + indices[3*i + 2]*position_stride;
+
+            double u[3] = { b[0]-a[0], b[1]-a[1], b[2]-a[2] };
+            double w[3] = { c2[0]-a[0], c2[1]-a[1], c2[2]-a[2] };
+            double n[3] = { u[1]*w[2] - u[2]*w[1], u[2]*w[0] - u[0]*w[2], u[0]*w[1] - u[1]*w[0] };
+            double area = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+
+            for (size_t k = 0; k < 3; ++k)
+            {
+                centroid[k] += area * (a[k] + b[k] + c2[k]) / 3.0;
+                normal[k] += n[k];
+            }
+            area_sum += area;
+        }
+
+        double normal_length = std::sqrt(normal[0]*normal[0] + normal[1]*normal[1] + normal[2]*normal[2]);
+        double key = 0.0;
+        if (area_sum > 0.0 && normal_length > 0.0)
+        {
+            for (size_t k = 0; k < 3; ++k)
+                key += (centroid[k] / area_sum - mesh_centroid[k]) * (normal[k] / normal_length);
+        }
+        sort_keys[c] = (float)key;
+    }
+
+    std::vector<size_t> order(num_clusters);
+    for (size_t c = 0; c < num_clusters; ++c)
+        order[c] = c;
+    std::stable_sort(order.begin(), order.end(),
+        [&sort_keys](size_t a, size_t b) { return sort_keys[a] > sort_keys[b]; });
+
+    std::vector<uint32_t> output;
+    output.reserve(num_indices);
+    for (size_t o = 0; o < num_clusters; ++o)
+    {
+        size_t c = order[o];
+        size_t start = soft_clusters[c];
+        size_t end = (c + 1 < num_clusters) ? soft_clusters[c + 1] : num_triangles;
+        output.insert(output.end(), indices + 3*start, indices + 3*end);
+    }
+
+    memcpy(indices, output.data(), num_indices * sizeof(uint32_t));
+}
+
+void MeshOpt_OptimizeVertexFetch(uint32_t* indices, size_t num_indices, size_t num_vertices, std::vector<uint32_t>* remap)
+{
+    const uint32_t unused = 0xFFFFFFFFu;
+    remap->assign(num_vertices, unused);
+
+    uint32_t next = 0;
+    for (size_t i = 0; i < num_indices; ++i)
+    {
+        uint32_t& r = (*remap)[indices[i]];
+        if (r == unused)
+            r = next++;
+        indices[i] = r;
+    }
+
+    // Vértices não referenciados vão para o final
+    for (size_t v = 0; v < num_vertices; ++v)
+        if ((*remap)[v] == unused)
+            (*remap)[v] = next++;
+}
+
+void MeshOpt_Remap(float* data, size_t components, size_t num_vertices, const std::vector<uint32_t>& remap)
+{
+    std::vector<float> copy(data, data + components * num_vertices);
+    for (size_t v = 0; v < num_vertices; ++v)
+        memcpy(data + remap[v]*components, copy.data() + v*components, components * sizeof(float));
+}
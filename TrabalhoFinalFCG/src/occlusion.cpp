@@ -0,0 +1,306 @@
+#include "occlusion.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include <glm/common.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "utils.h"
+
+GLuint CreateGpuProgram(GLuint vertex_shader_id, GLuint fragment_shader_id); // Função definida em main.cpp
+
+// Os vértices do cubo unitário [0,1]^3 são levados para a AABB testada
+// diretamente no vertex shader.
+const GLchar* const occlusionvertexshader_source = ""
+"#version 330\n"
+"layout (location = 0) in vec3 position;\n"
+"uniform mat4 projection_view;\n"
+"uniform vec3 box_min;\n"
+"uniform vec3 box_max;\n"
+"void main()\n"
+"{\n"
+    "gl_Position = projection_view * vec4(mix(box_min, box_max, position), 1.0);\n"
+"}\n"
+"\0";
+
+const GLchar* const occlusionfragmentshader_source = ""
+"#version 330\n"
+"out vec4 color;\n"
+"void main()\n"
+"{\n"
+    "color = vec4(1.0);\n"
+"}\n"
+"\0";
+
+// Margem adicionada às AABBs testadas, para que faces de objetos que
+// coincidem com a sua AABB (paredes, por exemplo) não escondam a própria
+// AABB por imprecisão do Z-buffer.
+#define OCCLUSION_BOX_MARGIN 0.05f
+
+struct OcclusionState {
+    GLuint    query;
+    bool      allocated;
+    bool      pending;       // Consulta enviada e resultado ainda não lido
+    bool      visible;       // Último resultado
+    bool      requested;     // Teste guardado para o próximo Occlusion_Flush()
+    unsigned  update_frame;  // Último quadro em que Occlusion_Update() foi chamada
+    unsigned  next_test_frame;
+    unsigned  visible_tests; // Testes visíveis consecutivos
+    glm::vec3 box_min;
+    glm::vec3 box_max;
+};
+
+static std::vector<OcclusionState> g_OcclusionStates;
+static std::vector<OcclusionId>    g_FreeOcclusionStates;
+static std::vector<OcclusionId>    g_RetiredOcclusionStates; // Destruídos, com consulta ou teste ainda pendente
+static std::vector<OcclusionId>    g_OcclusionRequests;
+static unsigned                    g_OcclusionFrame = 1;
+
+static GLuint g_OcclusionProgram;
+static GLuint g_OcclusionVAO;
+static GLint  g_OcclusionProjectionViewUniform;
+static GLint  g_OcclusionBoxMinUniform;
+static GLint  g_OcclusionBoxMaxUniform;
+
+static GLuint Occlusion_LoadShader(GLenum type, const GLchar* const shader_string)
+{
+    GLuint shader_id = glCreateShader(type);
+    glShaderSource(shader_id, 1, &shader_string, NULL);
+    glCompileShader(shader_id);
+
+    GLint compiled_ok;
+    glGetShaderiv(shader_id, GL_COMPILE_STATUS, &compiled_ok);
+    if ( !compiled_ok )
+    {
+        GLchar log[1024];
+        glGetShaderInfoLog(shader_id, sizeof(log), NULL, log);
+        fprintf(stderr, "ERROR: OpenGL compilation failed.\n== Start of compilation log\n%s== End of compilation log\n", log);
+    }
+
+    return shader_id;
+}
+
+void Occlusion_Init()
+{
+    GLuint vertex_shader_id = Occlusion_LoadShader(GL_VERTEX_SHADER, occlusionvertexshader_source);
+    GLuint fragment_shader_id = Occlusion_LoadShader(GL_FRAGMENT_SHADER, occlusionfragmentshader_source);
+    g_OcclusionProgram = CreateGpuProgram(vertex_shader_id, fragment_shader_id);
+    glCheckError();
+
+    g_OcclusionProjectionViewUniform = glGetUniformLocation(g_OcclusionProgram, "projection_view");
+    g_OcclusionBoxMinUniform         = glGetUniformLocation(g_OcclusionProgram, "box_min");
+    g_OcclusionBoxMaxUniform         = glGetUniformLocation(g_OcclusionProgram, "box_max");
+
+    // Cubo unitário, com as 12 faces triangulares. As faces são desenhadas
+    // sem backface culling, então a orientação não importa.
+    static const GLfloat vertices[] = {
+        0.0f, 0.0f, 0.0f,   1.0f, 0.0f, 0.0f,   0.0f, 1.0f, 0.0f,   1.0f, 1.0f, 0.0f,
+        0.0f, 0.0f, 1.0f,   1.0f, 0.0f, 1.0f,   0.0f, 1.0f, 1.0f,   1.0f, 1.0f, 1.0f,
+    };
+    static const GLubyte indices[] = {
+        0, 1, 2,  2, 1, 3,  // z = 0
+        4, 6, 5,  5, 6, 7,  // z = 1
+        0, 4, 1,  1, 4, 5,  // y = 0
+        2, 3, 6,  6, 3, 7,  // y = 1
+        0, 2, 4,  4, 2, 6,  // x = 0
+        1, 5, 3,  3, 5, 7,  // x = 1
+    };
+
+    GLuint buffers[2];
+    glGenVertexArrays(1, &g_OcclusionVAO);
+    glGenBuffers(2, buffers);
+
+    glBindVertexArray(g_OcclusionVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glCheckError();
+}
+
+OcclusionId Occlusion_Create()
+{
+    OcclusionId id;
+    if ( !g_FreeOcclusionStates.empty() )
+    {
+        id = g_FreeOcclusionStates.back();
+        g_FreeOcclusionStates.pop_back();
+    }
+    else
+    {
+        id = (OcclusionId)g_OcclusionStates.size();
+        g_OcclusionStates.push_back(OcclusionState());
+        glGenQueries(1, &g_OcclusionStates[id].query);
+    }
+
+    // Instâncias novas começam visíveis. O primeiro teste é espalhado entre
+    // os próximos quadros, para que um modelo recém-carregado não gere uma
+    // consulta por instância no mesmo quadro.
+    OcclusionState& state = g_OcclusionStates[id];
+    state.allocated = true;
+    state.pending = false;
+    state.visible = true;
+    state.requested = false;
+    state.update_frame = g_OcclusionFrame;
+    state.next_test_frame = g_OcclusionFrame + (unsigned)id % OCCLUSION_MAX_INTERVAL;
+    state.visible_tests = 0;
+    return id;
+}
+
+void Occlusion_Destroy(OcclusionId id)
+{
+    // O objeto de consulta é mantido para reutilização, mas só volta para
+    // g_FreeOcclusionStates depois que o resultado de uma consulta pendente
+    // está disponível (e é ignorado), e que um teste guardado foi retirado
+    // de g_OcclusionRequests; caso contrário, uma nova instância com o mesmo
+    // identificador poderia ler o resultado da instância destruída.
+    g_OcclusionStates[id].allocated = false;
+    g_RetiredOcclusionStates.push_back(id);
+}
+
+// Devolve para g_FreeOcclusionStates os estados destruídos que não têm mais
+// consultas pendentes. Chamada ao final de Occlusion_Flush(), quando nenhum
+// deles está em g_OcclusionRequests.
+static void Occlusion_RecycleRetired()
+{
+    size_t kept = 0;
+    for (size_t i = 0; i < g_RetiredOcclusionStates.size(); ++i)
+    {
+        OcclusionId id = g_RetiredOcclusionStates[i];
+        OcclusionState& state = g_OcclusionStates[id];
+        if ( state.pending )
+        {
+            GLuint available = 0;
+            glGetQueryObjectuiv(state.query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if ( !available )
+            {
+                g_RetiredOcclusionStates[kept++] = id;
+                continue;
+            }
+            state.pending = false;
+        }
+        g_FreeOcclusionStates.push_back(id);
+    }
+    g_RetiredOcclusionStates.resize(kept);
+}
+
+// Atualiza o estado com o resultado de um teste
+static void Occlusion_SetResult(OcclusionState& state, bool visible)
+{
+    if ( visible )
+    {
+        state.visible_tests = state.visible ? state.visible_tests + 1 : 0;
+        unsigned interval = 1u << std::min(state.visible_tests, 4u);
+        state.next_test_frame = g_OcclusionFrame + std::min(interval, (unsigned)OCCLUSION_MAX_INTERVAL);
+    }
+    else
+    {
+        state.visible_tests = 0;
+        state.next_test_frame = g_OcclusionFrame;
+    }
+    state.visible = visible;
+}
+
+bool Occlusion_Update(OcclusionId id, const glm::vec3& box_min, const glm::vec3& box_max)
+{
+    OcclusionState& state = g_OcclusionStates[id];
+
+    // Uma instância que não foi atualizada no quadro anterior (que estava
+    // fora do frustum, por exemplo) tem um resultado antigo, que não vale
+    // mais; ela volta como visível, e é testada neste quadro.
+    if ( state.update_frame + 1 < g_OcclusionFrame )
+    {
+        state.pending = false;
+        state.visible = true;
+        state.visible_tests = 0;
+        state.next_test_frame = g_OcclusionFrame;
+    }
+    state.update_frame = g_OcclusionFrame;
+
+    if ( state.pending )
+    {
+        GLuint available = 0;
+        glGetQueryObjectuiv(state.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if ( available )
+        {
+            GLuint any_samples_passed = 0;
+            glGetQueryObjectuiv(state.query, GL_QUERY_RESULT, &any_samples_passed);
+            state.pending = false;
+            Occlusion_SetResult(state, any_samples_passed != 0);
+        }
+    }
+
+    if ( !state.pending && !state.requested && g_OcclusionFrame >= state.next_test_frame )
+    {
+        state.requested = true;
+        state.box_min = box_min - glm::vec3(OCCLUSION_BOX_MARGIN);
+        state.box_max = box_max + glm::vec3(OCCLUSION_BOX_MARGIN);
+        g_OcclusionRequests.push_back(id);
+    }
+
+    return state.visible;
+}
+
+size_t Occlusion_Flush(const glm::mat4& projection_view, const glm::vec3& camera_position, float near_distance)
+{
+    size_t num_queries = 0;
+
+    GLint program, vertex_array;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vertex_array);
+    GLboolean cull_face = glIsEnabled(GL_CULL_FACE);
+
+    // As AABBs não alteram o framebuffer, somente contam fragmentos que
+    // passam no teste de profundidade.
+    glUseProgram(g_OcclusionProgram);
+    glBindVertexArray(g_OcclusionVAO);
+    glUniformMatrix4fv(g_OcclusionProjectionViewUniform, 1, GL_FALSE, glm::value_ptr(projection_view));
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+    glDisable(GL_CULL_FACE);
+
+    for (size_t i = 0; i < g_OcclusionRequests.size(); ++i)
+    {
+        OcclusionState& state = g_OcclusionStates[g_OcclusionRequests[i]];
+        state.requested = false;
+        if ( !state.allocated )
+            continue;
+
+        glm::vec3 near_min = state.box_min - glm::vec3(near_distance);
+        glm::vec3 near_max = state.box_max + glm::vec3(near_distance);
+        if ( glm::all(glm::greaterThanEqual(camera_position, near_min)) && glm::all(glm::lessThanEqual(camera_position, near_max)) )
+        {
+            Occlusion_SetResult(state, true);
+            continue;
+        }
+
+        glUniform3fv(g_OcclusionBoxMinUniform, 1, glm::value_ptr(state.box_min));
+        glUniform3fv(g_OcclusionBoxMaxUniform, 1, glm::value_ptr(state.box_max));
+        glBeginQuery(GL_ANY_SAMPLES_PASSED, state.query);
+        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, 0);
+        glEndQuery(GL_ANY_SAMPLES_PASSED);
+        state.pending = true;
+        num_queries += 1;
+    }
+    g_OcclusionRequests.clear();
+    Occlusion_RecycleRetired();
+
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDepthMask(GL_TRUE);
+    if ( cull_face )
+        glEnable(GL_CULL_FACE);
+    glBindVertexArray(vertex_array);
+    glUseProgram(program);
+    glCheckError();
+
+    g_OcclusionFrame += 1;
+    return num_queries;
+}
@@ -0,0 +1,290 @@
+#include "programcache.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include <GLFW/glfw3.h>
+
+#include "cachefile.hpp"
+
+// Constantes do OpenGL 4.1 (GL_ARB_get_program_binary), que não fazem parte
+// do OpenGL 3.3 core
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH           0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS      0x87FE
+
+typedef void (APIENTRYP ProgramCacheGetProgramBinaryProc)(GLuint program, GLsizei buf_size, GLsizei* length, GLenum* binary_format, void* binary);
+typedef void (APIENTRYP ProgramCacheProgramBinaryProc)(GLuint program, GLenum binary_format, const void* binary, GLsizei length);
+typedef void (APIENTRYP ProgramCacheProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+
+static ProgramCacheGetProgramBinaryProc  g_GetProgramBinary;
+static ProgramCacheProgramBinaryProc     g_ProgramBinary;
+static ProgramCacheProgramParameteriProc g_ProgramParameteri;
+
+// Formato do arquivo:
+//
+//   ProgramCacheHeader
+//   ProgramCacheEntry[num_entries]
+//   binários dos programas
+//
+// com cada bloco alinhado a 16 bytes (veja CacheFile_WriteBlock()).
+struct ProgramCacheHeader {
+    char     magic[4];      // "PRGC"
+    uint32_t version;       // PROGRAMCACHE_VERSION
+    uint64_t driver;        // Hash das strings do driver
+    uint64_t num_entries;
+};
+
+struct ProgramCacheEntry {
+    uint64_t key;
+    uint64_t offset;
+    uint64_t size;
+    uint32_t format;
+    float    compile_seconds;
+};
+
+struct ProgramBinary {
+    GLenum               format;
+    std::vector<uint8_t> data;
+    double               compile_seconds;
+};
+
+static bool                               g_Enabled = false;
+static std::string                        g_Filename;
+static uint64_t                           g_Driver = 0;
+static std::map<uint64_t, ProgramBinary>  g_Binaries;
+static bool                               g_Dirty = false;
+static ProgramCacheStats                  g_Stats = { 0, 0, 0, 0.0 };
+
+// Hash FNV-1a de 64 bits, continuando a partir de "h"
+static uint64_t ProgramCache_Hash(uint64_t h, const void* data, size_t size)
+{
+    const unsigned char* bytes = (const unsigned char*) data;
+    for (size_t i = 0; i < size; ++i)
+    {
+        h ^= bytes[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static uint64_t ProgramCache_HashString(uint64_t h, const char* str)
+{
+    // O terminador também entra no hash, separando strings consecutivas
+    return str ? ProgramCache_Hash(h, str, strlen(str) + 1) : ProgramCache_Hash(h, "", 1);
+}
+
+static bool ProgramCache_HasExtension(const char* name)
+{
+    GLint num_extensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+    for (GLint i = 0; i < num_extensions; ++i)
+    {
+        const char* extension = (const char*) glGetStringi(GL_EXTENSIONS, i);
+        if ( extension && strcmp(extension, name) == 0 )
+            return true;
+    }
+    return false;
+}
+
+static void ProgramCache_Read()
+{
+    CacheFile file;
+    if ( !CacheFile_Map(g_Filename, &file) )
+        return;
+
+    const ProgramCacheHeader* header = (const ProgramCacheHeader*) file.data;
+    bool valid = file.size >= sizeof(ProgramCacheHeader)
+              && memcmp(header->magic, "PRGC", 4) == 0
+              && header->version == PROGRAMCACHE_VERSION
+              && header->driver == g_Driver
+              && CacheFile_InBounds(&file, CacheFile_Align(sizeof(ProgramCacheHeader)), header->num_entries, sizeof(ProgramCacheEntry));
+
+    // Um arquivo de outra versão ou de outro driver é ignorado, e
+    // sobrescrito por ProgramCache_Save().
+    if ( valid )
+    {
+        const ProgramCacheEntry* entries = (const ProgramCacheEntry*) ((const char*) file.data + CacheFile_Align(sizeof(ProgramCacheHeader)));
+        for (uint64_t i = 0; i < header->num_entries; ++i)
+        {
+            const ProgramCacheEntry& entry = entries[i];
+            if ( !CacheFile_InBounds(&file, entry.offset, entry.size, 1) )
+                continue;
+
+            ProgramBinary& binary = g_Binaries[entry.key];
+            binary.format = entry.format;
+            binary.compile_seconds = entry.compile_seconds;
+            binary.data.assign((const uint8_t*) file.data + entry.offset, (const uint8_t*) file.data + entry.offset + entry.size);
+        }
+    }
+
+    CacheFile_Unmap(&file);
+}
+
+bool ProgramCache_Init(GLADloadproc load, const char* filename)
+{
+    g_Enabled = false;
+
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if ( major < 4 || (major == 4 && minor < 1) )
+    {
+        if ( !ProgramCache_HasExtension("GL_ARB_get_program_binary") )
+            return false;
+    }
+
+    g_GetProgramBinary  = (ProgramCacheGetProgramBinaryProc)load("glGetProgramBinary");
+    g_ProgramBinary     = (ProgramCacheProgramBinaryProc)load("glProgramBinary");
+    g_ProgramParameteri = (ProgramCacheProgramParameteriProc)load("glProgramParameteri");
+    if ( !g_GetProgramBinary || !g_ProgramBinary || !g_ProgramParameteri )
+        return false;
+
+    GLint num_formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+    if ( num_formats <= 0 )
+        return false;
+
+    g_Driver = 14695981039346656037ULL;
+    g_Driver = ProgramCache_HashString(g_Driver, (const char*) glGetString(GL_VENDOR));
+    g_Driver = ProgramCache_HashString(g_Driver, (const char*) glGetString(GL_RENDERER));
+    g_Driver = ProgramCache_HashString(g_Driver, (const char*) glGetString(GL_VERSION));
+
+    g_Filename = filename;
+    g_Binaries.clear();
+    g_Dirty = false;
+    ProgramCache_Read();
+
+    g_Enabled = true;
+    return true;
+}
+
+void ProgramCache_Save()
+{
+    if ( !g_Enabled || !g_Dirty )
+        return;
+
+    std::string tmp_filename = g_Filename + ".tmp";
+    FILE* f = fopen(tmp_filename.c_str(), "wb");
+    if ( f == NULL )
+        return;
+
+    ProgramCacheHeader header;
+    memcpy(header.magic, "PRGC", 4);
+    header.version     = PROGRAMCACHE_VERSION;
+    header.driver      = g_Driver;
+    header.num_entries = g_Binaries.size();
+
+    // As posições dos binários são calculadas antes de gravar a tabela
+    std::vector<ProgramCacheEntry> entries;
+    size_t offset = CacheFile_Align(sizeof(ProgramCacheHeader)) + g_Binaries.size() * sizeof(ProgramCacheEntry);
+    for (std::map<uint64_t, ProgramBinary>::const_iterator it = g_Binaries.begin(); it != g_Binaries.end(); ++it)
+    {
+        offset = CacheFile_Align(offset);
+
+        ProgramCacheEntry entry;
+        entry.key             = it->first;
+        entry.offset          = offset;
+        entry.size            = it->second.data.size();
+        entry.format          = it->second.format;
+        entry.compile_seconds = (float) it->second.compile_seconds;
+        entries.push_back(entry);
+
+        offset += entry.size;
+    }
+
+    size_t written = 0;
+    bool ok = CacheFile_WriteBlock(f, &header, sizeof(header), &written)
+           && CacheFile_WriteBlock(f, entries.data(), entries.size() * sizeof(ProgramCacheEntry), &written);
+    for (std::map<uint64_t, ProgramBinary>::const_iterator it = g_Binaries.begin(); ok && it != g_Binaries.end(); ++it)
+        ok = CacheFile_WriteBlock(f, it->second.data.data(), it->second.data.size(), &written);
+
+    if ( CacheFile_Commit(f, tmp_filename, g_Filename, ok) )
+        g_Dirty = false;
+}
+
+bool ProgramCache_Enabled()
+{
+    return g_Enabled;
+}
+
+uint64_t ProgramCache_Key(const std::string* sources, size_t count)
+{
+    uint64_t h = g_Driver;
+    for (size_t i = 0; i < count; ++i)
+        h = ProgramCache_HashString(h, sources[i].c_str());
+    return h;
+}
+
+void ProgramCache_PrepareLink(GLuint program_id)
+{
+    if ( g_Enabled )
+        g_ProgramParameteri(program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+GLuint ProgramCache_Load(uint64_t key)
+{
+    if ( !g_Enabled )
+        return 0;
+
+    std::map<uint64_t, ProgramBinary>::iterator it = g_Binaries.find(key);
+    if ( it == g_Binaries.end() )
+    {
+        g_Stats.misses += 1;
+        return 0;
+    }
+
+    double start = glfwGetTime();
+    GLuint program_id = glCreateProgram();
+    g_ProgramBinary(program_id, it->second.format, it->second.data.data(), (GLsizei) it->second.data.size());
+
+    // O driver pode recusar o binário; o programa é então compilado a partir
+    // do código GLSL, e o novo binário substitui este.
+    GLint linked_ok = GL_FALSE;
+    glGetProgramiv(program_id, GL_LINK_STATUS, &linked_ok);
+    if ( linked_ok == GL_FALSE )
+    {
+        glDeleteProgram(program_id);
+        g_Binaries.erase(it);
+        g_Dirty = true;
+        g_Stats.rejected += 1;
+        g_Stats.misses += 1;
+        return 0;
+    }
+
+    g_Stats.hits += 1;
+    g_Stats.seconds_saved += it->second.compile_seconds - (glfwGetTime() - start);
+    return program_id;
+}
+
+void ProgramCache_Store(uint64_t key, GLuint program_id, double compile_seconds)
+{
+    if ( !g_Enabled )
+        return;
+
+    GLint linked_ok = GL_FALSE;
+    glGetProgramiv(program_id, GL_LINK_STATUS, &linked_ok);
+    GLint length = 0;
+    glGetProgramiv(program_id, GL_PROGRAM_BINARY_LENGTH, &length);
+    if ( linked_ok == GL_FALSE || length <= 0 )
+        return;
+
+    ProgramBinary& binary = g_Binaries[key];
+    binary.data.resize((size_t) length);
+    binary.compile_seconds = compile_seconds;
+    g_GetProgramBinary(program_id, length, &length, &binary.format, binary.data.data());
+    if ( length <= 0 )
+    {
+        g_Binaries.erase(key);
+        return;
+    }
+    binary.data.resize((size_t) length);
+    g_Dirty = true;
+}
+
+const ProgramCacheStats& ProgramCache_Stats()
+{
+    return g_Stats;
+}
@@ -0,0 +1,441 @@
+#include "pvs.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include <glm/common.hpp>
+#include <glm/matrix.hpp>
+#include <glm/vec4.hpp>
+
+#include "assetloader.hpp"
+#include "cachefile.hpp"
+
+// Número de pontos amostrados em cada célula (em uma grade de
+// PVS_CELL_SAMPLES x PVS_CELL_SAMPLES, em cada altura dos olhos) e na AABB
+// de cada instância.
+#define PVS_CELL_SAMPLES   4
+#define PVS_TARGET_SAMPLES 32
+
+// Cabeçalho do arquivo, seguido de um PvsEntryRecord por instância e, na
+// próxima posição alinhada a 16 bytes, dos bits de todas as células.
+struct PvsHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t num_entries;
+    int32_t  cells_x;
+    int32_t  cells_z;
+    float    cell_size;
+    float    area_min[3];
+    float    area_max[3];
+    uint32_t words_per_cell;
+    uint64_t offset_bits;
+    uint64_t scene_hash;
+};
+
+struct PvsEntryRecord {
+    char     object[PVS_MAX_NAME];
+    int32_t  position[3];
+    float    box_min[3];
+    float    box_max[3];
+};
+
+static const char PVS_MAGIC[8] = { 'F', 'C', 'G', 'P', 'V', 'S', '\0', '\0' };
+
+// Oclusor com a transformação inversa já calculada, para que os segmentos
+// sejam testados no sistema de coordenadas da caixa.
+struct PvsBakeOccluder {
+    glm::mat4 inverse_model;
+    glm::vec3 box_min;
+    glm::vec3 box_max;
+    glm::vec3 outer_min;
+    glm::vec3 outer_max;
+};
+
+// Pontos amostrados na AABB de uma instância, no sistema de coordenadas de
+// cada oclusor (samples[o*num_samples + s]), e se estão dentro do oclusor.
+struct PvsBakeTarget {
+    size_t                 num_samples;
+    std::vector<glm::vec3> samples;
+    std::vector<bool>      inside;
+};
+
+static bool Pvs_Contains(const glm::vec3& box_min, const glm::vec3& box_max, const glm::vec3& p)
+{
+    return glm::all(glm::greaterThanEqual(p, box_min)) && glm::all(glm::lessThanEqual(p, box_max));
+}
+
+// Testa se o segmento de "a" até "b" cruza a caixa (método "slab").
+static bool Pvs_SegmentHitsBox(const glm::vec3& a, const glm::vec3& b, const glm::vec3& box_min, const glm::vec3& box_max)
+{
+    glm::vec3 d = b - a;
+    float tmin = 0.0f, tmax = 1.0f;
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        if ( std::fabs(d[axis]) < 1e-8f )
+        {
+            if ( a[axis] < box_min[axis] || a[axis] > box_max[axis] )
+                return false;
+            continue;
+        }
+
+        float t0 = (box_min[axis] - a[axis]) / d[axis];
+        float t1 = (box_max[axis] - a[axis]) / d[axis];
+        if ( t0 > t1 )
+            std::swap(t0, t1);
+
+        tmin = std::max(tmin, t0);
+        tmax = std::min(tmax, t1);
+        if ( tmin > tmax )
+            return false;
+    }
+
+    return true;
+}
+
+// Pontos amostrados na AABB de uma instância: os cantos, o centro, os
+// centros das faces, e pontos pseudoaleatórios (sempre os mesmos) no
+// interior.
+static void Pvs_TargetSamples(const PvsEntry& entry, std::vector<glm::vec3>* samples)
+{
+    samples->clear();
+
+    glm::vec3 center = 0.5f * (entry.box_min + entry.box_max);
+    glm::vec3 half   = 0.5f * (entry.box_max - entry.box_min);
+
+    samples->push_back(center);
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        glm::vec3 offset(0.0f);
+        offset[axis] = half[axis];
+        samples->push_back(center - offset);
+        samples->push_back(center + offset);
+    }
+    for (int i = 0; i < 8; ++i)
+        samples->push_back(glm::vec3((i & 1) ? entry.box_max.x : entry.box_min.x,
+                                     (i & 2) ? entry.box_max.y : entry.box_min.y,
+                                     (i & 4) ? entry.box_max.z : entry.box_min.z));
+
+    uint32_t seed = 2166136261u ^ (uint32_t)(entry.position.x * 73856093 ^ entry.position.y * 19349663 ^ entry.position.z * 83492791);
+    while ( samples->size() < PVS_TARGET_SAMPLES )
+    {
+        glm::vec3 u;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            u[axis] = (seed >> 8) * (1.0f / 16777216.0f);
+        }
+        samples->push_back(entry.box_min + u * (entry.box_max - entry.box_min));
+    }
+}
+
+// Calcula o conjunto de uma célula
+static void Pvs_BakeCell(Pvs* pvs, int cell, const std::vector<PvsBakeOccluder>& occluders, const std::vector<PvsBakeTarget>& targets)
+{
+    int cx = cell % pvs->cells_x;
+    int cz = cell / pvs->cells_x;
+
+    glm::vec3 cell_min(pvs->area_min.x + cx * pvs->cell_size, pvs->area_min.y, pvs->area_min.z + cz * pvs->cell_size);
+    glm::vec3 cell_max(cell_min.x + pvs->cell_size, pvs->area_max.y, cell_min.z + pvs->cell_size);
+
+    // Pontos de vista amostrados na célula
+    std::vector<glm::vec3> eyes;
+    int heights = (pvs->area_max.y > pvs->area_min.y) ? 2 : 1;
+    for (int h = 0; h < heights; ++h)
+        for (int i = 0; i < PVS_CELL_SAMPLES; ++i)
+            for (int j = 0; j < PVS_CELL_SAMPLES; ++j)
+                eyes.push_back(glm::vec3(cell_min.x + (i + 0.5f) * pvs->cell_size / PVS_CELL_SAMPLES,
+                                         (h == 0) ? cell_min.y : cell_max.y,
+                                         cell_min.z + (j + 0.5f) * pvs->cell_size / PVS_CELL_SAMPLES));
+
+    // Para cada ponto de vista, os oclusores que o bloqueiam, e o ponto de
+    // vista no sistema de coordenadas de cada um.
+    std::vector< std::vector<size_t> >    eye_occluders(eyes.size());
+    std::vector< std::vector<glm::vec3> > eye_local(eyes.size());
+    for (size_t e = 0; e < eyes.size(); ++e)
+        for (size_t o = 0; o < occluders.size(); ++o)
+        {
+            glm::vec3 local = glm::vec3(occluders[o].inverse_model * glm::vec4(eyes[e], 1.0f));
+            if ( !Pvs_Contains(occluders[o].outer_min, occluders[o].outer_max, local) )
+            {
+                eye_occluders[e].push_back(o);
+                eye_local[e].push_back(local);
+            }
+        }
+
+    uint64_t* bits = &pvs->bits[cell * pvs->words_per_cell];
+
+    // Instâncias próximas da célula são sempre visíveis
+    glm::vec3 near_min = cell_min - glm::vec3(pvs->cell_size);
+    glm::vec3 near_max = cell_max + glm::vec3(pvs->cell_size);
+
+    for (size_t t = 0; t < pvs->entries.size(); ++t)
+    {
+        const PvsEntry& entry = pvs->entries[t];
+        bool visible = glm::all(glm::lessThanEqual(entry.box_min, near_max)) && glm::all(glm::greaterThanEqual(entry.box_max, near_min));
+
+        const PvsBakeTarget& target = targets[t];
+        for (size_t e = 0; e < eyes.size() && !visible; ++e)
+        {
+            for (size_t s = 0; s < target.num_samples && !visible; ++s)
+            {
+                bool blocked = false;
+                for (size_t k = 0; k < eye_occluders[e].size() && !blocked; ++k)
+                {
+                    size_t o = eye_occluders[e][k];
+
+                    // Um ponto dentro do próprio oclusor (a instância do
+                    // prédio, por exemplo) não é bloqueado por ele.
+                    size_t sample = o * target.num_samples + s;
+                    if ( target.inside[sample] )
+                        continue;
+
+                    blocked = Pvs_SegmentHitsBox(eye_local[e][k], target.samples[sample], occluders[o].box_min, occluders[o].box_max);
+                }
+                visible = !blocked;
+            }
+        }
+
+        if ( visible )
+            bits[t / 64] |= (uint64_t)1 << (t % 64);
+    }
+}
+
+// Hash FNV-1a de 64 bits, continuando a partir de "h"
+static uint64_t Pvs_Hash(uint64_t h, const void* data, size_t size)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; ++i)
+    {
+        h ^= bytes[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static glm::ivec3 Pvs_Quantize(const glm::vec3& v)
+{
+    return glm::ivec3(glm::round(v / PVS_POSITION_STEP));
+}
+
+glm::ivec3 Pvs_Key(const glm::mat4& model)
+{
+    return Pvs_Quantize(glm::vec3(model[3]));
+}
+
+uint64_t Pvs_SceneHash(const std::vector<PvsEntry>& entries, const std::vector<PvsOccluder>& occluders)
+{
+    // As caixas são quantizadas como as posições, para que diferenças de
+    // arredondamento não invalidem o arquivo.
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        glm::ivec3 key[3] = { entries[i].position, Pvs_Quantize(entries[i].box_min), Pvs_Quantize(entries[i].box_max) };
+        h = Pvs_Hash(h, entries[i].object.c_str(), entries[i].object.size() + 1);
+        h = Pvs_Hash(h, key, sizeof(key));
+    }
+    for (size_t i = 0; i < occluders.size(); ++i)
+    {
+        glm::ivec3 key[5] = { Pvs_Key(occluders[i].model),
+                              Pvs_Quantize(occluders[i].box_min), Pvs_Quantize(occluders[i].box_max),
+                              Pvs_Quantize(occluders[i].outer_min), Pvs_Quantize(occluders[i].outer_max) };
+        h = Pvs_Hash(h, key, sizeof(key));
+    }
+    return h;
+}
+
+void Pvs_Bake(Pvs* pvs, const glm::vec3& area_min, const glm::vec3& area_max, float cell_size,
+              const std::vector<PvsEntry>& entries, const std::vector<PvsOccluder>& occluders, unsigned num_threads)
+{
+    pvs->area_min  = area_min;
+    pvs->area_max  = area_max;
+    pvs->cell_size = cell_size;
+    pvs->cells_x   = std::max(1, (int)std::ceil((area_max.x - area_min.x) / cell_size));
+    pvs->cells_z   = std::max(1, (int)std::ceil((area_max.z - area_min.z) / cell_size));
+    pvs->entries   = entries;
+    pvs->words_per_cell = (entries.size() + 63) / 64;
+    pvs->bits.assign(pvs->cells_x * pvs->cells_z * pvs->words_per_cell, 0);
+    pvs->scene_hash = Pvs_SceneHash(entries, occluders);
+
+    std::vector<PvsBakeOccluder> bake_occluders(occluders.size());
+    for (size_t i = 0; i < occluders.size(); ++i)
+    {
+        bake_occluders[i].inverse_model = glm::inverse(occluders[i].model);
+        bake_occluders[i].box_min   = occluders[i].box_min;
+        bake_occluders[i].box_max   = occluders[i].box_max;
+        bake_occluders[i].outer_min = occluders[i].outer_min;
+        bake_occluders[i].outer_max = occluders[i].outer_max;
+    }
+
+    std::vector<PvsBakeTarget> targets(entries.size());
+    std::vector<glm::vec3> samples;
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        Pvs_TargetSamples(entries[i], &samples);
+
+        PvsBakeTarget& target = targets[i];
+        target.num_samples = samples.size();
+        for (size_t o = 0; o < bake_occluders.size(); ++o)
+            for (size_t s = 0; s < samples.size(); ++s)
+            {
+                glm::vec3 local = glm::vec3(bake_occluders[o].inverse_model * glm::vec4(samples[s], 1.0f));
+                target.samples.push_back(local);
+                target.inside.push_back(Pvs_Contains(bake_occluders[o].box_min, bake_occluders[o].box_max, local));
+            }
+    }
+
+    // Cada célula é um trabalho para as threads do carregador de recursos;
+    // cada uma escreve somente nos bits da sua célula, e não há "commit".
+    int num_cells = pvs->cells_x * pvs->cells_z;
+
+    AssetLoader_Start(num_threads);
+    for (int cell = 0; cell < num_cells; ++cell)
+        AssetLoader_Submit([pvs, cell, &bake_occluders, &targets]{ Pvs_BakeCell(pvs, cell, bake_occluders, targets); },
+                           []{});
+    AssetLoader_Finish();
+}
+
+int Pvs_Cell(const Pvs* pvs, const glm::vec3& position)
+{
+    // A altura da câmera pode variar um pouco em torno das alturas
+    // amostradas.
+    if ( position.y < pvs->area_min.y - 0.5f || position.y > pvs->area_max.y + 0.5f )
+        return -1;
+
+    int cx = (int)std::floor((position.x - pvs->area_min.x) / pvs->cell_size);
+    int cz = (int)std::floor((position.z - pvs->area_min.z) / pvs->cell_size);
+    if ( cx < 0 || cx >= pvs->cells_x || cz < 0 || cz >= pvs->cells_z )
+        return -1;
+
+    return cx + cz * pvs->cells_x;
+}
+
+int Pvs_FindEntry(const Pvs* pvs, const std::string& object, const glm::ivec3& position)
+{
+    for (size_t i = 0; i < pvs->entries.size(); ++i)
+        if ( pvs->entries[i].position == position && pvs->entries[i].object == object )
+            return (int)i;
+    return -1;
+}
+
+size_t Pvs_CountVisible(const Pvs* pvs, int cell)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < pvs->entries.size(); ++i)
+        count += Pvs_IsVisible(pvs, cell, (int)i) ? 1 : 0;
+    return count;
+}
+
+bool Pvs_Write(const Pvs* pvs, const std::string& filename)
+{
+    PvsHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PVS_MAGIC, sizeof(PVS_MAGIC));
+    header.version        = PVS_VERSION;
+    header.num_entries    = (uint32_t)pvs->entries.size();
+    header.cells_x        = pvs->cells_x;
+    header.cells_z        = pvs->cells_z;
+    header.cell_size      = pvs->cell_size;
+    header.words_per_cell = (uint32_t)pvs->words_per_cell;
+    header.scene_hash     = pvs->scene_hash;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        header.area_min[axis] = pvs->area_min[axis];
+        header.area_max[axis] = pvs->area_max[axis];
+    }
+    header.offset_bits = CacheFile_Align(sizeof(header) + pvs->entries.size() * sizeof(PvsEntryRecord));
+
+    std::string tmp_filename = filename + ".tmp";
+
+    FILE* f = fopen(tmp_filename.c_str(), "wb");
+    if (f == NULL)
+        return false;
+
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+
+    for (size_t i = 0; ok && i < pvs->entries.size(); ++i)
+    {
+        const PvsEntry& entry = pvs->entries[i];
+
+        PvsEntryRecord record;
+        memset(&record, 0, sizeof(record));
+        strncpy(record.object, entry.object.c_str(), PVS_MAX_NAME - 1);
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            record.position[axis] = entry.position[axis];
+            record.box_min[axis] = entry.box_min[axis];
+            record.box_max[axis] = entry.box_max[axis];
+        }
+
+        ok = fwrite(&record, sizeof(record), 1, f) == 1;
+    }
+
+    size_t written = sizeof(header) + pvs->entries.size() * sizeof(PvsEntryRecord);
+    ok = ok && CacheFile_WriteBlock(f, pvs->bits.data(), pvs->bits.size() * sizeof(uint64_t), &written);
+
+    return CacheFile_Commit(f, tmp_filename, filename, ok);
+}
+
+bool Pvs_Read(Pvs* pvs, const std::string& filename)
+{
+    CacheFile file;
+    if (!CacheFile_Map(filename, &file))
+        return false;
+
+    PvsHeader header;
+    if (file.size < sizeof(header))
+    {
+        CacheFile_Unmap(&file);
+        return false;
+    }
+    memcpy(&header, file.data, sizeof(header));
+
+    if (memcmp(header.magic, PVS_MAGIC, sizeof(PVS_MAGIC)) != 0 || header.version != PVS_VERSION)
+    {
+        CacheFile_Unmap(&file);
+        return false;
+    }
+
+    uint64_t num_words = (uint64_t)header.words_per_cell * (uint64_t)std::max(0, header.cells_x) * (uint64_t)std::max(0, header.cells_z);
+    if (header.cells_x <= 0 || header.cells_z <= 0 || !(header.cell_size > 0.0f)
+        || header.words_per_cell != (header.num_entries + 63) / 64
+        || !CacheFile_InBounds(&file, sizeof(header), header.num_entries, sizeof(PvsEntryRecord))
+        || !CacheFile_InBounds(&file, header.offset_bits, num_words, sizeof(uint64_t)))
+    {
+        fprintf(stderr, "WARNING: Arquivo de PVS corrompido: \"%s\".\n", filename.c_str());
+        CacheFile_Unmap(&file);
+        return false;
+    }
+
+    const char* base = (const char*)file.data;
+
+    pvs->cells_x        = header.cells_x;
+    pvs->cells_z        = header.cells_z;
+    pvs->cell_size      = header.cell_size;
+    pvs->words_per_cell = header.words_per_cell;
+    pvs->scene_hash     = header.scene_hash;
+    pvs->area_min       = glm::vec3(header.area_min[0], header.area_min[1], header.area_min[2]);
+    pvs->area_max       = glm::vec3(header.area_max[0], header.area_max[1], header.area_max[2]);
+
+    pvs->entries.resize(header.num_entries);
+    for (uint32_t i = 0; i < header.num_entries; ++i)
+    {
+        PvsEntryRecord record;
+        memcpy(&record, base + sizeof(header) + i*sizeof(record), sizeof(record));
+        record.object[PVS_MAX_NAME - 1] = '\0';
+
+        PvsEntry& entry = pvs->entries[i];
+        entry.object  = record.object;
+        entry.position = glm::ivec3(record.position[0], record.position[1], record.position[2]);
+        entry.box_min = glm::vec3(record.box_min[0], record.box_min[1], record.box_min[2]);
+        entry.box_max = glm::vec3(record.box_max[0], record.box_max[1], record.box_max[2]);
+    }
+
+    pvs->bits.resize((size_t)num_words);
+    memcpy(pvs->bits.data(), base + header.offset_bits, (size_t)num_words * sizeof(uint64_t));
+
+    CacheFile_Unmap(&file);
+    return true;
+}
@@ -0,0 +1,124 @@
+#include "renderqueue.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+// Retorna o número pequeno de "id" em "ids", adicionando-o se necessário.
+static uint64_t RenderQueue_Slot(std::vector<GLuint>* ids, GLuint id)
+{
+    std::vector<GLuint>::iterator it = std::find(ids->begin(), ids->end(), id);
+    if ( it != ids->end() )
+        return (uint64_t)(it - ids->begin());
+
+    ids->push_back(id);
+    return (uint64_t)(ids->size() - 1);
+}
+
+// Bits de um float não negativo, que têm a mesma ordem que os valores
+static uint32_t RenderQueue_DepthBits(float depth)
+{
+    if ( !(depth > 0.0f) )
+        return 0;
+
+    uint32_t bits;
+    std::memcpy(&bits, &depth, sizeof(bits));
+    return bits;
+}
+
+// Número de trocas de estado ao desenhar os pacotes na ordem "order"
+static size_t RenderQueue_CountChanges(const std::vector<RenderPacket>& packets, const uint32_t* order, size_t count)
+{
+    size_t changes = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const RenderPacket& packet = packets[order ? order[i] : i];
+        if ( i == 0 )
+        {
+            changes += 4;
+            continue;
+        }
+
+        const RenderPacket& previous = packets[order ? order[i - 1] : i - 1];
+        changes += (packet.pass != previous.pass);
+        changes += (packet.program != previous.program);
+        changes += (packet.material != previous.material);
+        changes += (packet.vertex_array != previous.vertex_array);
+    }
+    return changes;
+}
+
+void RenderQueue_Init(RenderQueue* queue, bool sort)
+{
+    queue->sort = sort;
+    RenderQueue_Clear(queue);
+}
+
+void RenderQueue_Clear(RenderQueue* queue)
+{
+    queue->packets.clear();
+    queue->order.clear();
+    queue->programs.clear();
+    queue->vertex_arrays.clear();
+    queue->stats.packets = 0;
+    queue->stats.changes_submitted = 0;
+    queue->stats.changes_sorted = 0;
+}
+
+void RenderQueue_Submit(RenderQueue* queue, const RenderPacket& packet, float depth)
+{
+    uint64_t program      = RenderQueue_Slot(&queue->programs, packet.program) & 0xFF;
+    uint64_t vertex_array = RenderQueue_Slot(&queue->vertex_arrays, packet.vertex_array) & 0xFF;
+    uint64_t material     = (uint64_t)packet.material & 0xFFF;
+
+    queue->packets.push_back(packet);
+    queue->packets.back().key = ((uint64_t)packet.pass << 60) | (program << 52) | (material << 40)
+                              | (vertex_array << 32) | RenderQueue_DepthBits(depth);
+}
+
+// Ordem pela chave e, com chaves iguais, pela ordem de envio
+struct RenderQueueCompare {
+    const std::vector<RenderPacket>* packets;
+    bool operator()(uint32_t a, uint32_t b) const
+    {
+        uint64_t key_a = (*packets)[a].key;
+        uint64_t key_b = (*packets)[b].key;
+        return key_a < key_b || (key_a == key_b && a < b);
+    }
+};
+
+// Ordem somente pelo passo, e então pela ordem de envio
+struct RenderQueueComparePass {
+    const std::vector<RenderPacket>* packets;
+    bool operator()(uint32_t a, uint32_t b) const
+    {
+        RenderPass pass_a = (*packets)[a].pass;
+        RenderPass pass_b = (*packets)[b].pass;
+        return pass_a < pass_b || (pass_a == pass_b && a < b);
+    }
+};
+
+void RenderQueue_Sort(RenderQueue* queue)
+{
+    size_t count = queue->packets.size();
+
+    queue->order.resize(count);
+    for (size_t i = 0; i < count; ++i)
+        queue->order[i] = (uint32_t)i;
+
+    // Os passos são sempre desenhados na ordem; sem a ordenação completa,
+    // somente eles são considerados.
+    if ( queue->sort )
+    {
+        RenderQueueCompare compare = { &queue->packets };
+        std::sort(queue->order.begin(), queue->order.end(), compare);
+    }
+    else
+    {
+        RenderQueueComparePass compare = { &queue->packets };
+        std::sort(queue->order.begin(), queue->order.end(), compare);
+    }
+
+    queue->stats.packets           = count;
+    queue->stats.changes_submitted = RenderQueue_CountChanges(queue->packets, NULL, count);
+    queue->stats.changes_sorted    = RenderQueue_CountChanges(queue->packets, queue->order.data(), count);
+}
@@ -0,0 +1,93 @@
+#include "residency.hpp"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+struct Asset {
+    std::string           name;
+    AssetType             type;
+    int                   refcount;
+    bool                  resident;
+    size_t                cpu_bytes;
+    size_t                gpu_bytes;
+    std::function<void()> evict;
+};
+
+static std::vector<Asset> g_Assets;
+
+AssetId Residency_Asset(const char* name, AssetType type)
+{
+    for (size_t i = 0; i < g_Assets.size(); ++i)
+        if (g_Assets[i].type == type && g_Assets[i].name == name)
+            return (AssetId)i;
+
+    Asset asset;
+    asset.name      = name;
+    asset.type      = type;
+    asset.refcount  = 0;
+    asset.resident  = false;
+    asset.cpu_bytes = 0;
+    asset.gpu_bytes = 0;
+    g_Assets.push_back(asset);
+    return (AssetId)(g_Assets.size() - 1);
+}
+
+void Residency_AddRef(AssetId asset)
+{
+    g_Assets[asset].refcount += 1;
+}
+
+void Residency_Release(AssetId asset)
+{
+    Asset& a = g_Assets[asset];
+    if (a.refcount == 0)
+        return;
+
+    a.refcount -= 1;
+    if (a.refcount > 0 || !a.resident)
+        return;
+
+    printf("Removendo \"%s\" da memória (sem referências).\n", a.name.c_str());
+    if (a.evict)
+        a.evict();
+
+    a.resident  = false;
+    a.cpu_bytes = 0;
+    a.gpu_bytes = 0;
+    a.evict     = nullptr;
+}
+
+int Residency_RefCount(AssetId asset)
+{
+    return g_Assets[asset].refcount;
+}
+
+void Residency_SetResident(AssetId asset, size_t cpu_bytes, size_t gpu_bytes, std::function<void()> evict)
+{
+    Asset& a = g_Assets[asset];
+    a.resident  = true;
+    a.cpu_bytes = cpu_bytes;
+    a.gpu_bytes = gpu_bytes;
+    a.evict     = evict;
+}
+
+void Residency_PrintReport()
+{
+    size_t total_cpu = 0;
+    size_t total_gpu = 0;
+
+    printf("Recursos (referências, KiB na CPU, KiB na GPU):\n");
+    for (size_t i = 0; i < g_Assets.size(); ++i)
+    {
+        const Asset& a = g_Assets[i];
+        if (a.resident)
+            printf("  %-50s %3d %8.1f %8.1f\n", a.name.c_str(), a.refcount, a.cpu_bytes / 1024.0, a.gpu_bytes / 1024.0);
+        else
+            printf("  %-50s %3d   (não residente)\n", a.name.c_str(), a.refcount);
+
+        total_cpu += a.cpu_bytes;
+        total_gpu += a.gpu_bytes;
+    }
+    printf("  %-50s     %8.1f %8.1f\n", "Total", total_cpu / 1024.0, total_gpu / 1024.0);
+}
@@ -0,0 +1,428 @@
+#include "scenebvh.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include <glm/common.hpp>
+
+static bool SceneBvh_IsLeaf(const SceneBvhNode& node)
+{
+    return node.child1 < 0;
+}
+
+// Metade da área de superfície de uma AABB, usada pela heurística SAH
+static float SceneBvh_Area(const glm::vec3& box_min, const glm::vec3& box_max)
+{
+    glm::vec3 d = box_max - box_min;
+    return d.x*d.y + d.y*d.z + d.z*d.x;
+}
+
+static float SceneBvh_UnionArea(const SceneBvhNode& a, const glm::vec3& box_min, const glm::vec3& box_max)
+{
+    return SceneBvh_Area(glm::min(a.box_min, box_min), glm::max(a.box_max, box_max));
+}
+
+static bool SceneBvh_Overlaps(const SceneBvhNode& node, const glm::vec3& box_min, const glm::vec3& box_max)
+{
+    return node.box_min.x <= box_max.x && node.box_max.x >= box_min.x
+        && node.box_min.y <= box_max.y && node.box_max.y >= box_min.y
+        && node.box_min.z <= box_max.z && node.box_max.z >= box_min.z;
+}
+
+static int32_t SceneBvh_AllocateNode(SceneBvh* bvh)
+{
+    int32_t index;
+    if (!bvh->free_nodes.empty())
+    {
+        index = bvh->free_nodes.back();
+        bvh->free_nodes.pop_back();
+    }
+    else
+    {
+        index = (int32_t)bvh->nodes.size();
+        bvh->nodes.push_back(SceneBvhNode());
+    }
+
+    SceneBvhNode& node = bvh->nodes[index];
+    node.parent = -1;
+    node.child1 = -1;
+    node.child2 = -1;
+    node.height = 0;
+    node.user_data = 0;
+    return index;
+}
+
+static void SceneBvh_FreeNode(SceneBvh* bvh, int32_t index)
+{
+    bvh->nodes[index].height = -1;
+    bvh->free_nodes.push_back(index);
+}
+
+// Recalcula a AABB e a altura de um nó interno a partir dos seus filhos
+static void SceneBvh_Refit(SceneBvh* bvh, int32_t index)
+{
+    SceneBvhNode& node = bvh->nodes[index];
+    const SceneBvhNode& child1 = bvh->nodes[node.child1];
+    const SceneBvhNode& child2 = bvh->nodes[node.child2];
+    node.box_min = glm::min(child1.box_min, child2.box_min);
+    node.box_max = glm::max(child1.box_max, child2.box_max);
+    node.height  = 1 + std::max(child1.height, child2.height);
+}
+
+static void SceneBvh_ReplaceChild(SceneBvh* bvh, int32_t parent, int32_t old_child, int32_t new_child)
+{
+    if (parent < 0)
+    {
+        bvh->root = new_child;
+        return;
+    }
+
+    if (bvh->nodes[parent].child1 == old_child)
+        bvh->nodes[parent].child1 = new_child;
+    else
+        bvh->nodes[parent].child2 = new_child;
+}
+
+// Se as alturas dos filhos do nó "a" diferem em mais de um, "sobe" o filho
+// mais alto, trazendo para o lugar de "a" o seu neto mais alto. Retorna o nó
+// que ocupa agora a posição de "a".
+static int32_t SceneBvh_Balance(SceneBvh* bvh, int32_t a)
+{
+    SceneBvhNode& A = bvh->nodes[a];
+    if (SceneBvh_IsLeaf(A) || A.height < 2)
+        return a;
+
+    int32_t b = A.child1;
+    int32_t c = A.child2;
+    int32_t balance = bvh->nodes[c].height - bvh->nodes[b].height;
+
+    if (balance > -2 && balance < 2)
+        return a;
+
+    // "up" é o filho mais alto, e "other" o seu irmão
+    bool c_up = balance > 0;
+    int32_t up    = c_up ? c : b;
+    int32_t other = c_up ? b : c;
+    SceneBvhNode& Up = bvh->nodes[up];
+
+    int32_t f = Up.child1;
+    int32_t g = Up.child2;
+
+    Up.child1 = a;
+    Up.parent = A.parent;
+    A.parent  = up;
+    SceneBvh_ReplaceChild(bvh, Up.parent, a, up);
+
+    // O neto mais alto fica em "up"; o outro substitui "up" em "a"
+    int32_t keep = (bvh->nodes[f].height > bvh->nodes[g].height) ? f : g;
+    int32_t move = (keep == f) ? g : f;
+
+    Up.child2 = keep;
+    if (c_up)
+        A.child2 = move;
+    else
+        A.child1 = move;
+    bvh->nodes[move].parent = a;
+
+    assert(A.child1 == other || A.child2 == other);
+    (void)other;
+
+    SceneBvh_Refit(bvh, a);
+    SceneBvh_Refit(bvh, up);
+    return up;
+}
+
+// Refaz as AABBs e rebalanceia os nós a partir de "index" até a raiz
+static void SceneBvh_FixUpwards(SceneBvh* bvh, int32_t index)
+{
+    while (index >= 0)
+    {
+        index = SceneBvh_Balance(bvh, index);
+        SceneBvh_Refit(bvh, index);
+        index = bvh->nodes[index].parent;
+    }
+}
+
+static void SceneBvh_InsertLeaf(SceneBvh* bvh, int32_t leaf)
+{
+    if (bvh->root < 0)
+    {
+        bvh->root = leaf;
+        bvh->nodes[leaf].parent = -1;
+        return;
+    }
+
+    glm::vec3 box_min = bvh->nodes[leaf].box_min;
+    glm::vec3 box_max = bvh->nodes[leaf].box_max;
+
+    // Descemos pela árvore escolhendo, em cada nó, entre criar ali o novo
+    // par (custo "cost") ou descer para um dos filhos, de acordo com o
+    // aumento da área de superfície de cada opção.
+    int32_t index = bvh->root;
+    while (!SceneBvh_IsLeaf(bvh->nodes[index]))
+    {
+        const SceneBvhNode& node = bvh->nodes[index];
+
+        float area = SceneBvh_Area(node.box_min, node.box_max);
+        float combined_area = SceneBvh_UnionArea(node, box_min, box_max);
+
+        float cost = 2.0f * combined_area;
+        float inheritance_cost = 2.0f * (combined_area - area);
+
+        float child_cost[2];
+        int32_t children[2] = { node.child1, node.child2 };
+        for (int i = 0; i < 2; ++i)
+        {
+            const SceneBvhNode& child = bvh->nodes[children[i]];
+            float union_area = SceneBvh_UnionArea(child, box_min, box_max);
+            child_cost[i] = inheritance_cost + (SceneBvh_IsLeaf(child) ? union_area : union_area - SceneBvh_Area(child.box_min, child.box_max));
+        }
+
+        if (cost < child_cost[0] && cost < child_cost[1])
+            break;
+
+        index = (child_cost[0] < child_cost[1]) ? children[0] : children[1];
+    }
+
+    // Criamos um novo nó interno no lugar de "sibling", com filhos
+    // "sibling" e "leaf".
+    int32_t sibling = index;
+    int32_t old_parent = bvh->nodes[sibling].parent;
+    int32_t new_parent = SceneBvh_AllocateNode(bvh);
+
+    SceneBvhNode& parent = bvh->nodes[new_parent];
+    parent.parent = old_parent;
+    parent.child1 = sibling;
+    parent.child2 = leaf;
+    SceneBvh_ReplaceChild(bvh, old_parent, sibling, new_parent);
+    bvh->nodes[sibling].parent = new_parent;
+    bvh->nodes[leaf].parent = new_parent;
+
+    SceneBvh_FixUpwards(bvh, new_parent);
+}
+
+static void SceneBvh_RemoveLeaf(SceneBvh* bvh, int32_t leaf)
+{
+    if (leaf == bvh->root)
+    {
+        bvh->root = -1;
+        return;
+    }
+
+    int32_t parent = bvh->nodes[leaf].parent;
+    int32_t grandparent = bvh->nodes[parent].parent;
+    int32_t sibling = (bvh->nodes[parent].child1 == leaf) ? bvh->nodes[parent].child2 : bvh->nodes[parent].child1;
+
+    // O irmão de "leaf" substitui o pai dos dois
+    SceneBvh_ReplaceChild(bvh, grandparent, parent, sibling);
+    bvh->nodes[sibling].parent = grandparent;
+    SceneBvh_FreeNode(bvh, parent);
+
+    SceneBvh_FixUpwards(bvh, grandparent);
+}
+
+void SceneBvh_Init(SceneBvh* bvh, float margin)
+{
+    bvh->nodes.clear();
+    bvh->free_nodes.clear();
+    bvh->root = -1;
+    bvh->num_proxies = 0;
+    bvh->margin = margin;
+}
+
+SceneBvhProxy SceneBvh_Insert(SceneBvh* bvh, const glm::vec3& box_min, const glm::vec3& box_max, uint32_t user_data)
+{
+    int32_t leaf = SceneBvh_AllocateNode(bvh);
+
+    SceneBvhNode& node = bvh->nodes[leaf];
+    node.box_min = box_min - glm::vec3(bvh->margin);
+    node.box_max = box_max + glm::vec3(bvh->margin);
+    node.user_data = user_data;
+
+    SceneBvh_InsertLeaf(bvh, leaf);
+    bvh->num_proxies += 1;
+    return leaf;
+}
+
+void SceneBvh_Remove(SceneBvh* bvh, SceneBvhProxy proxy)
+{
+    SceneBvh_RemoveLeaf(bvh, proxy);
+    SceneBvh_FreeNode(bvh, proxy);
+    bvh->num_proxies -= 1;
+}
+
+bool SceneBvh_Move(SceneBvh* bvh, SceneBvhProxy proxy, const glm::vec3& box_min, const glm::vec3& box_max)
+{
+    SceneBvhNode& node = bvh->nodes[proxy];
+    if (glm::all(glm::lessThanEqual(node.box_min, box_min)) && glm::all(glm::greaterThanEqual(node.box_max, box_max)))
+        return false;
+
+    SceneBvh_RemoveLeaf(bvh, proxy);
+
+    SceneBvhNode& moved = bvh->nodes[proxy];
+    moved.box_min = box_min - glm::vec3(bvh->margin);
+    moved.box_max = box_max + glm::vec3(bvh->margin);
+
+    SceneBvh_InsertLeaf(bvh, proxy);
+    return true;
+}
+
+uint32_t SceneBvh_UserData(const SceneBvh* bvh, SceneBvhProxy proxy)
+{
+    return bvh->nodes[proxy].user_data;
+}
+
+int SceneBvh_Height(const SceneBvh* bvh)
+{
+    return (bvh->root < 0) ? 0 : bvh->nodes[bvh->root].height;
+}
+
+// Adiciona a "results" todas as folhas abaixo do nó "index"
+static void SceneBvh_CollectLeaves(const SceneBvh* bvh, int32_t index, std::vector<int32_t>* stack, std::vector<uint32_t>* results)
+{
+    size_t base = stack->size();
+    stack->push_back(index);
+    while (stack->size() > base)
+    {
+        const SceneBvhNode& node = bvh->nodes[stack->back()];
+        stack->pop_back();
+
+        if (SceneBvh_IsLeaf(node))
+        {
+            results->push_back(node.user_data);
+        }
+        else
+        {
+            stack->push_back(node.child1);
+            stack->push_back(node.child2);
+        }
+    }
+}
+
+void SceneBvh_QueryFrustum(const SceneBvh* bvh, const Frustum& frustum, std::vector<uint32_t>* results)
+{
+    if (bvh->root < 0)
+        return;
+
+    std::vector<int32_t> stack;
+    stack.reserve(64);
+    stack.push_back(bvh->root);
+
+    while (!stack.empty())
+    {
+        int32_t index = stack.back();
+        stack.pop_back();
+
+        const SceneBvhNode& node = bvh->nodes[index];
+        int classification = Frustum_ClassifyBox(frustum, node.box_min, node.box_max);
+        if (classification == FRUSTUM_OUTSIDE)
+            continue;
+
+        // Nós completamente dentro do frustum não precisam de mais testes
+        if (classification == FRUSTUM_INSIDE || SceneBvh_IsLeaf(node))
+        {
+            SceneBvh_CollectLeaves(bvh, index, &stack, results);
+            continue;
+        }
+
+        stack.push_back(node.child1);
+        stack.push_back(node.child2);
+    }
+}
+
+void SceneBvh_QueryBox(const SceneBvh* bvh, const glm::vec3& box_min, const glm::vec3& box_max, std::vector<uint32_t>* results)
+{
+    if (bvh->root < 0)
+        return;
+
+    std::vector<int32_t> stack;
+    stack.reserve(64);
+    stack.push_back(bvh->root);
+
+    while (!stack.empty())
+    {
+        const SceneBvhNode& node = bvh->nodes[stack.back()];
+        stack.pop_back();
+
+        if (!SceneBvh_Overlaps(node, box_min, box_max))
+            continue;
+
+        if (SceneBvh_IsLeaf(node))
+        {
+            results->push_back(node.user_data);
+        }
+        else
+        {
+            stack.push_back(node.child1);
+            stack.push_back(node.child2);
+        }
+    }
+}
+
+// Interseção raio-AABB pelo método das "slabs". Retorna a distância de
+// entrada na caixa (zero se a origem está dentro dela), ou um valor
+// negativo se o raio não atinge a caixa antes de "max_distance".
+static float SceneBvh_RayBox(const glm::vec3& origin, const glm::vec3& inverse_direction, float max_distance, const SceneBvhNode& node)
+{
+    float tmin = 0.0f;
+    float tmax = max_distance;
+
+    for (int i = 0; i < 3; ++i)
+    {
+        float t1 = (node.box_min[i] - origin[i]) * inverse_direction[i];
+        float t2 = (node.box_max[i] - origin[i]) * inverse_direction[i];
+
+        // Raio paralelo ao eixo, com a origem sobre um dos planos da caixa
+        if (std::isnan(t1) || std::isnan(t2))
+            continue;
+
+        tmin = std::max(tmin, std::min(t1, t2));
+        tmax = std::min(tmax, std::max(t1, t2));
+    }
+
+    return (tmin <= tmax) ? tmin : -1.0f;
+}
+
+void SceneBvh_QueryRay(const SceneBvh* bvh, const glm::vec3& origin, const glm::vec3& direction, float max_distance, std::vector<SceneBvhHit>* hits)
+{
+    if (bvh->root < 0)
+        return;
+
+    // Componentes nulas da direção resultam em infinitos, tratados
+    // corretamente por SceneBvh_RayBox().
+    glm::vec3 inverse_direction = 1.0f / direction;
+
+    size_t first = hits->size();
+
+    std::vector<int32_t> stack;
+    stack.reserve(64);
+    stack.push_back(bvh->root);
+
+    while (!stack.empty())
+    {
+        const SceneBvhNode& node = bvh->nodes[stack.back()];
+        stack.pop_back();
+
+        float distance = SceneBvh_RayBox(origin, inverse_direction, max_distance, node);
+        if (distance < 0.0f)
+            continue;
+
+        if (SceneBvh_IsLeaf(node))
+        {
+            SceneBvhHit hit;
+            hit.user_data = node.user_data;
+            hit.distance = distance;
+            hits->push_back(hit);
+        }
+        else
+        {
+            stack.push_back(node.child1);
+            stack.push_back(node.child2);
+        }
+    }
+
+    std::sort(hits->begin() + first, hits->end(), [](const SceneBvhHit& a, const SceneBvhHit& b) {
+        return a.distance < b.distance;
+    });
+}
@@ -13,68 +13,89 @@ in vec4 position_model;
 // Coordenadas de textura obtidas do arquivo OBJ (se existirem!)
 in vec2 texcoords;
 
-// Matrizes computadas no código C++ e enviadas para a GPU
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-
-// Identificador que define qual objeto está sendo desenhado no momento
-#define SPHERE 0
-#define BUNNY  1
-#define PLANE  2
-#define MAINBUILD 3
-#define BAGUETE 4
-#define BUTTER 6
-#define CHEESE 7
-#define LUA 8
-
-#define PLANE_ASPHALT 10
-#define PLANE_GRASS 11
-#define SMALLHOUSE 12
-#define GASSTATION 13
-#define MYHOUSE 14
-
-#define LONGHOUSE 16
-#define WOODHOUSE 17
-#define LASTHOUSE 18
-#define POLE 19
-#define CALCADA 20
-#define LILHOUSE 21
-#define MAQUINA 22
-#define SKY 23
-
-uniform int object_id;
-
-// Parâmetros da axis-aligned bounding box (AABB) do modelo
-uniform vec4 bbox_min;
-uniform vec4 bbox_max;
-
-// Variáveis para acesso das imagens de textura
-uniform sampler2D TextureImage0;
-uniform sampler2D TextureImage1;
-uniform sampler2D TextureImage2;
-uniform sampler2D TextureImage3;
-uniform sampler2D TextureImage4;
-uniform sampler2D TextureImage5;
-uniform sampler2D TextureImage6;
-uniform sampler2D TextureImage7;
-uniform sampler2D TextureImage8;
-uniform sampler2D TextureImage9;
-uniform sampler2D TextureImage10;
-uniform sampler2D TextureImage11;
-uniform sampler2D TextureImage12;
-uniform sampler2D TextureImage13;
-uniform sampler2D TextureImage14;
-uniform sampler2D TextureImage15;
-uniform sampler2D TextureImage16;
-uniform sampler2D TextureImage17;
-uniform sampler2D TextureImage18;
-uniform sampler2D TextureImage19;
-uniform sampler2D TextureImage20;
-
-// cor branca para objetos destacados
-uniform vec4 color_override;  // Cor para sobrescrever a cor padrão
-uniform bool use_color_override; // Flag para indicar se devemos usar a cor de sobreposição
+// Dados do quadro, computados no código C++ e enviados para a GPU uma vez
+// por quadro. Veja FrameUniforms em "main.cpp".
+layout (std140) uniform FrameUniforms {
+    mat4 view;
+    mat4 projection;
+    vec4 camera_position; // Posição da câmera, em coordenadas globais
+    vec4 light_direction; // Sentido da fonte de luz, em coordenadas globais
+    vec4 frame_time;      // (segundos desde o início do programa, 0, 0, 0)
+};
+
+// Mapeamentos de coordenadas de textura e modelos de iluminação. Veja
+// ShaderUvMode e ShaderLighting em "shaderpermutation.hpp".
+#define UV_NONE      0
+#define UV_TEXCOORDS 1
+#define UV_SPHERE    2
+#define UV_BBOX      3
+#define UV_SKY       4
+
+#define LIGHTING_LAMBERT 0
+#define LIGHTING_FLAT    1
+
+#ifdef GPU_DRIVEN
+// Dados da instância estática, vindos de "shader_vertex.glsl"
+flat in int   instance_object_id;
+flat in vec4  instance_bbox_min;
+flat in vec4  instance_bbox_max;
+flat in ivec4 instance_texture_kd0;
+flat in ivec4 instance_texture_kd1;
+
+#define object_id   instance_object_id
+#define bbox_min    instance_bbox_min
+#define bbox_max    instance_bbox_max
+#define texture_kd0 instance_texture_kd0
+#define texture_kd1 instance_texture_kd1
+
+// Instâncias estáticas nunca são destacadas
+#define use_color_override false
+#define color_override     vec4(0.0)
+#else
+// Dados do desenho (veja "shader_vertex.glsl"): matrizes, parâmetros da
+// axis-aligned bounding box (AABB) do modelo, material e cor de destaque.
+layout (std140) uniform DrawUniforms {
+    mat4  model;
+    mat4  normal_matrix;
+    vec4  bbox_min;
+    vec4  bbox_max;
+    ivec4 material;       // (object_id, quantized_vertices, use_color_override, instanced)
+    ivec4 texture_kd0;
+    ivec4 texture_kd1;
+    vec4  color_override; // Cor para sobrescrever a cor padrão
+};
+
+#define object_id          material.x
+#define use_color_override (material.z != 0)
+#endif
+
+// Escolhas do material. Na variante MATERIAL_PERMUTATION (veja
+// "shaderpermutation.hpp") elas são constantes definidas na compilação, e os
+// testes abaixo são resolvidos pelo compilador; nas demais, vêm dos dados do
+// desenho.
+#ifdef MATERIAL_PERMUTATION
+#define uv_mode        UV_MODE
+#define kd0_array      TEXTURE_KD0_ARRAY
+#define kd1_array      TEXTURE_KD1_ARRAY
+#define lighting_model LIGHTING_MODEL
+#else
+#define uv_mode        texture_kd0.w
+#define kd0_array      texture_kd0.x
+#define kd1_array      texture_kd1.x
+#define lighting_model (use_color_override ? LIGHTING_FLAT : LIGHTING_LAMBERT)
+#endif
+
+// Variáveis para acesso das imagens de textura. As texturas são agrupadas em
+// arrays (veja "texturearray.hpp"), e cada textura é identificada pelo par
+// (índice do array, camada dentro do array).
+uniform sampler2DArray TextureArrays[12];
+
+// Texturas do objeto atual (texture_kd0 e texture_kd1, veja
+// MakeDrawUniforms() em "main.cpp"). A segunda textura é usada somente por
+// objetos com duas texturas, como a Terra (dia e noite); os demais têm
+// texture_kd1.x == -1. A terceira componente é o menor nível de mipmap já
+// enviado para a GPU (veja TextureArray_Stream()), e a quarta componente de
+// texture_kd0 é o mapeamento das coordenadas de textura (UV_*).
 
 // O valor de saída ("out") de um Fragment Shader é a cor final do fragmento.
 out vec4 color;
@@ -83,12 +104,48 @@ out vec4 color;
 #define M_PI   3.14159265358979323846
 #define M_PI_2 1.57079632679489661923
 
+// Amostra a camada "t.y" do array "s", sem usar os níveis de mipmap menores
+// que "t.z", que ainda não foram enviados para a GPU. Calculamos o nível de
+// mipmap da mesma forma que texture(), a partir das derivadas "ddx" e "ddy"
+// das coordenadas de textura, e o limitamos antes de chamar textureLod().
+vec3 SampleLayer(sampler2DArray s, ivec3 t, vec2 uv, vec2 ddx, vec2 ddy)
+{
+    vec2 size = vec2(textureSize(s, 0).xy);
+    vec2 dx = ddx * size;
+    vec2 dy = ddy * size;
+    float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy)));
+    return textureLod(s, vec3(uv, float(t.y)), max(lod, float(t.z))).rgb;
+}
+
+// Amostra a textura "t", do array "array", nas coordenadas "uv". No GLSL
+// 3.30 os elementos de um vetor de samplers só podem ser acessados com
+// índices constantes, portanto escolhemos o array com uma sequência de testes
+// (que tem sempre o mesmo resultado para todos os fragmentos de um mesmo
+// desenho, e que o compilador resolve se "array" é constante). As derivadas
+// são calculadas antes dos testes, fora de qualquer desvio.
+vec3 SampleTexture(int array, ivec3 t, vec2 uv)
+{
+    vec2 ddx = dFdx(uv);
+    vec2 ddy = dFdy(uv);
+    if ( array == 0 ) return SampleLayer(TextureArrays[0], t, uv, ddx, ddy);
+    if ( array == 1 ) return SampleLayer(TextureArrays[1], t, uv, ddx, ddy);
+    if ( array == 2 ) return SampleLayer(TextureArrays[2], t, uv, ddx, ddy);
+    if ( array == 3 ) return SampleLayer(TextureArrays[3], t, uv, ddx, ddy);
+    if ( array == 4 ) return SampleLayer(TextureArrays[4], t, uv, ddx, ddy);
+    if ( array == 5 ) return SampleLayer(TextureArrays[5], t, uv, ddx, ddy);
+    if ( array == 6 ) return SampleLayer(TextureArrays[6], t, uv, ddx, ddy);
+    if ( array == 7 ) return SampleLayer(TextureArrays[7], t, uv, ddx, ddy);
+    if ( array == 8 ) return SampleLayer(TextureArrays[8], t, uv, ddx, ddy);
+    if ( array == 9 ) return SampleLayer(TextureArrays[9], t, uv, ddx, ddy);
+    if ( array == 10 ) return SampleLayer(TextureArrays[10], t, uv, ddx, ddy);
+    if ( array == 11 ) return SampleLayer(TextureArrays[11], t, uv, ddx, ddy);
+    return vec3(0.0, 0.0, 0.0);
+}
+
 void main()
 {
-    // Obtemos a posição da câmera utilizando a inversa da matriz que define o
-    // sistema de coordenadas da câmera.
-    vec4 origin = vec4(0.0, 0.0, 0.0, 1.0);
-    vec4 camera_position = inverse(view) * origin;
+    // A posição da câmera (a inversa da matriz "view" aplicada à origem) é
+    // computada na CPU, em FrameUniforms.
 
     // O fragmento atual é coberto por um ponto que percente à superfície de um
     // dos objetos virtuais da cena. Este ponto, p, possui uma posição no
@@ -102,7 +159,7 @@ void main()
     vec4 n = normalize(normal);
 
     // Vetor que define o sentido da fonte de luz em relação ao ponto atual.
-    vec4 l = normalize(vec4(1.0,1.0,0.0,0.0));
+    vec4 l = light_direction;
 
     // Vetor que define o sentido da câmera em relação ao ponto atual.
     vec4 v = normalize(camera_position - p);
@@ -111,7 +168,9 @@ void main()
     float U = 0.0;
     float V = 0.0;
 
-    if ( object_id == SPHERE || object_id == LUA ) // a lua também é uma esfera
+    // O mapeamento das coordenadas de textura depende do objeto (veja
+    // InitObjectMaterials() em "main.cpp").
+    if ( uv_mode == UV_SPHERE ) // a Terra e a lua
     {
         vec4 bbox_center = (bbox_min + bbox_max) / 2.0;
 
@@ -131,7 +190,7 @@ void main()
         U = (theta + M_PI) / (2.0 * M_PI);
         V = (phi + M_PI_2) / M_PI;
     }
-    else if ( object_id == BUNNY )
+    else if ( uv_mode == UV_BBOX ) // o coelho
     {
         float minx = bbox_min.x;
         float maxx = bbox_max.x;
@@ -139,92 +198,16 @@ void main()
         float miny = bbox_min.y;
         float maxy = bbox_max.y;
 
-        float minz = bbox_min.z;
-        float maxz = bbox_max.z;
-
         U = (position_model.x - minx) / (maxx - minx);
         V = (position_model.y - miny) / (maxy - miny);
     }
-    else if ( object_id == PLANE || object_id == PLANE_ASPHALT || object_id == PLANE_GRASS)
-    {
-        U = texcoords.x;
-        V = texcoords.y;
-    }
-    else if ( object_id == BAGUETE )
-    {
-        U = texcoords.x;
-        V = texcoords.y;
-    }
-    else if ( object_id == POLE )
-    {
-        U = texcoords.x;
-        V = texcoords.y;
-    }
-       else if ( object_id == CALCADA )
-    {
-        U = texcoords.x;
-        V = texcoords.y;
-    }
-    else if ( object_id == SMALLHOUSE )
-    {
-        U = texcoords.x;
-        V = texcoords.y;
-    }
-    else if ( object_id == GASSTATION )
-    {
-        U = texcoords.x;
-        V = texcoords.y;
-    }
-    else if ( object_id == MYHOUSE )
-    {
-        U = texcoords.x;
-        V = texcoords.y;
-    }
-
-    else if ( object_id == LONGHOUSE )
-    {
-        U = texcoords.x;
-        V = texcoords.y;
-    }
-    else if ( object_id == WOODHOUSE )
-    {
-        U = texcoords.x;
-        V = texcoords.y;
-    }
-    else if ( object_id == LASTHOUSE )
-    {
-        U = texcoords.x;
-        V = texcoords.y;
-    }
-    else if ( object_id == LILHOUSE )
-    {
-        U = texcoords.x;
-        V = texcoords.y;
-    }
-    else if ( object_id == MAQUINA )
+    else if ( uv_mode == UV_TEXCOORDS )
     {
         U = texcoords.x;
         V = texcoords.y;
     }
-    else if ( object_id == CHEESE )
+    else if ( uv_mode == UV_SKY )
     {
-        U = texcoords.x;
-        V = texcoords.y;
-    }
-    else if ( object_id == BUTTER )
-    {
-        U = texcoords.x;
-        V = texcoords.y;
-    }
-    else if ( object_id == MAINBUILD )
-    {
-        U = texcoords.x;
-        V = texcoords.y;
-    }
-    else if (object_id == SKY)
-    {
-        vec4 bbox_center = (bbox_min + bbox_max) / 2.0;
-
         float theta = atan(position_model.x, position_model.z);
         float phi = asin(position_model.y);
 
@@ -239,92 +222,20 @@ void main()
     // Calculamos cores diferentes dependendo do objeto
     vec3 Kd_final;
 
-    if ( object_id == BAGUETE )
-    {
-        // Baguete usa apenas TextureImage2
-        Kd_final = texture(TextureImage2, vec2(U,V)).rgb;
-    }
-        else if ( object_id == PLANE || object_id == PLANE_ASPHALT )
-    {
-        Kd_final = texture(TextureImage3, vec2(U,V)).rgb;
-    }
-    else if ( object_id == POLE )
-    {
-        Kd_final = texture(TextureImage4, vec2(U,V)).rgb;
-    }
-    else if ( object_id == LUA )
-    {
-        Kd_final = texture(TextureImage5, vec2(U,V)).rgb;
-    }
-        else if ( object_id == CALCADA )
-    {
-        Kd_final = texture(TextureImage6, vec2(U,V)).rgb;
-    }
-    else if ( object_id == SMALLHOUSE )
-    {
-        Kd_final = texture(TextureImage7, vec2(U,V)).rgb;
-    }
-        else if ( object_id == PLANE_GRASS )
+    if ( kd1_array >= 0 )
     {
-        Kd_final = texture(TextureImage8, vec2(U,V)).rgb;
-    }
-    else if ( object_id ==  GASSTATION )
-    {
-        Kd_final = texture(TextureImage9, vec2(U,V)).rgb;
-    }
-    else if ( object_id ==  MYHOUSE )
-    {
-        Kd_final = texture(TextureImage10, vec2(U,V)).rgb;
-    }
-    else if ( object_id ==  LONGHOUSE )
-    {
-        Kd_final = texture(TextureImage11, vec2(U,V)).rgb;
-    }
-    else if ( object_id ==  WOODHOUSE )
-    {
-        Kd_final = texture(TextureImage12, vec2(U,V)).rgb;
-    }
-    else if ( object_id ==  LASTHOUSE )
-    {
-        Kd_final = texture(TextureImage13, vec2(U,V)).rgb;
-    }
-    else if ( object_id ==  LILHOUSE )
-    {
-        Kd_final = texture(TextureImage14, vec2(U,V)).rgb;
-    }
-    else if ( object_id ==  MAQUINA )
-    {
-        Kd_final = texture(TextureImage15, vec2(U,V)).rgb;
-    }
-    else if ( object_id ==  SKY )
-    {
-        Kd_final = texture(TextureImage16, vec2(U,V)).rgb;
-    }
-    else if ( object_id ==  BUNNY )
-    {
-        Kd_final = texture(TextureImage17, vec2(U,V)).rgb;
-    }
-    else if ( object_id ==  CHEESE )
-    {
-        Kd_final = texture(TextureImage17, vec2(U,V)).rgb;
-    }
-    else if ( object_id ==  BUTTER )
-    {
-        Kd_final = texture(TextureImage18, vec2(U,V)).rgb;
-    }
-    else if ( object_id ==  MAINBUILD )
-    {
-        Kd_final = texture(TextureImage20, vec2(U,V)).rgb;
+        // Objetos com duas texturas (a Terra) interpolam entre a textura
+        // noturna e a diurna de acordo com a iluminação
+        vec3 Kd0 = SampleTexture(kd0_array, texture_kd0.xyz, vec2(U,V));
+        vec3 Kd1 = SampleTexture(kd1_array, texture_kd1.xyz, vec2(U,V));
+        Kd_final = mix(Kd1, Kd0, lambert);
     }
     else
     {
-        // Outros objetos usam TextureImage0 e TextureImage1 com interpolação
-        vec3 Kd0 = texture(TextureImage0, vec2(U,V)).rgb;
-        vec3 Kd1 = texture(TextureImage1, vec2(U,V)).rgb;
-        Kd_final = mix(Kd1, Kd0, lambert);
+        Kd_final = SampleTexture(kd0_array, texture_kd0.xyz, vec2(U,V));
     }
 
-    if (use_color_override)
+    if ( lighting_model == LIGHTING_FLAT )
     {
         color = color_override;
     }
@@ -6,10 +6,86 @@ layout (location = 0) in vec4 model_coefficients;
 layout (location = 1) in vec4 normal_coefficients;
 layout (location = 2) in vec2 texture_coefficients;
 
-// Matrizes computadas no código C++ e enviadas para a GPU
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// Dados do quadro, computados no código C++ e enviados para a GPU uma vez
+// por quadro. Veja FrameUniforms em "main.cpp".
+layout (std140) uniform FrameUniforms {
+    mat4 view;
+    mat4 projection;
+    vec4 camera_position; // Posição da câmera, em coordenadas globais
+    vec4 light_direction; // Sentido da fonte de luz, em coordenadas globais
+    vec4 frame_time;      // (segundos desde o início do programa, 0, 0, 0)
+};
+
+#ifdef GPU_DRIVEN
+// Variante dos shaders para as instâncias estáticas desenhadas por
+// glMultiDrawElementsIndirect() (veja "gpudriven.hpp"): os dados do objeto
+// vêm do SSBO de instâncias, na posição dada pelo atributo por instância
+// "instance_slot", em vez de uniforms. Os dados usados pelo fragment shader
+// são repassados a ele sem interpolação.
+struct StaticInstance {
+    mat4  model;
+    mat4  normal_matrix;
+    vec4  bbox_min;
+    vec4  bbox_max;
+    vec4  world_min;
+    vec4  world_max;
+    ivec4 material;    // (object_id, quantized_vertices, 0, 0)
+    ivec4 texture_kd0;
+    ivec4 texture_kd1;
+};
+layout (std430, binding = 0) readonly buffer StaticInstances { StaticInstance instances[]; };
+layout (location = 3) in uint instance_slot;
+
+#define model              instances[instance_slot].model
+#define normal_matrix      instances[instance_slot].normal_matrix
+#define quantized_vertices (instances[instance_slot].material.y != 0)
+#define bbox_min           instances[instance_slot].bbox_min
+#define bbox_max           instances[instance_slot].bbox_max
+
+flat out int   instance_object_id;
+flat out vec4  instance_bbox_min;
+flat out vec4  instance_bbox_max;
+flat out ivec4 instance_texture_kd0;
+flat out ivec4 instance_texture_kd1;
+#else
+// Dados do desenho, em um trecho do buffer de uniforms ligado pelo código
+// C++ antes de cada desenho. Veja DrawUniforms em "main.cpp". A matriz
+// "normal_matrix" é a inversa da transposta de "model", computada na CPU.
+layout (std140) uniform DrawUniforms {
+    mat4  model;
+    mat4  normal_matrix;
+    vec4  bbox_min;
+    vec4  bbox_max;
+    ivec4 material;       // (object_id, quantized_vertices, use_color_override, instanced)
+    ivec4 texture_kd0;
+    ivec4 texture_kd1;
+    vec4  color_override;
+};
+
+// Se verdadeiro, os atributos acima estão no formato compacto definido em
+// "vertexformat.hpp": a posição (xyz) está normalizada para [0,1] dentro da
+// bounding box do objeto, e a normal (xy) está em coordenadas octaédricas.
+#define quantized_vertices (material.y != 0)
+
+// Desenho instanciado (veja EndInstancedDraws() em "main.cpp"): se
+// verdadeiro, as matrizes de cada instância vêm dos atributos por instância
+// abaixo, e não do bloco acima.
+#define instanced (material.w != 0)
+layout (location = 4) in mat4 instance_model;
+layout (location = 8) in mat4 instance_normal_matrix;
+#endif
+
+// Decodifica uma normal em coordenadas octaédricas. Veja "vertexformat.cpp".
+vec4 DecodeOctahedral(vec2 e)
+{
+    vec3 n = vec3(e.x, e.y, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+    {
+        vec2 s = vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+        n.xy = (1.0 - abs(e.yx)) * s;
+    }
+    return vec4(normalize(n), 0.0);
+}
 
 // Atributos de vértice que serão gerados como saída ("out") pelo Vertex Shader.
 // ** Estes serão interpolados pelo rasterizador! ** gerando, assim, valores
@@ -22,6 +98,22 @@ out vec2 texcoords;
 
 void main()
 {
+#ifdef GPU_DRIVEN
+    mat4 object_model = model;
+    mat4 object_normal_matrix = normal_matrix;
+#else
+    mat4 object_model = instanced ? instance_model : model;
+    mat4 object_normal_matrix = instanced ? instance_normal_matrix : normal_matrix;
+#endif
+
+    vec4 model_position = model_coefficients;
+    vec4 model_normal = normal_coefficients;
+    if (quantized_vertices)
+    {
+        model_position = vec4(mix(bbox_min.xyz, bbox_max.xyz, model_coefficients.xyz), 1.0);
+        model_normal = DecodeOctahedral(normal_coefficients.xy);
+    }
+
     // A variável gl_Position define a posição final de cada vértice
     // OBRIGATORIAMENTE em "normalized device coordinates" (NDC), onde cada
     // coeficiente estará entre -1 e 1 após divisão por w.
@@ -34,7 +126,7 @@ void main()
     // deste Vertex Shader, a placa de vídeo (GPU) fará a divisão por W. Veja
     // slides 41-67 e 69-86 do documento Aula_09_Projecoes.pdf.
 
-    gl_Position = projection * view * model * model_coefficients;
+    gl_Position = projection * view * object_model * model_position;
 
     // Como as variáveis acima  (tipo vec4) são vetores com 4 coeficientes,
     // também é possível acessar e modificar cada coeficiente de maneira
@@ -51,17 +143,26 @@ void main()
     // rasterizador para gerar atributos únicos para cada fragmento gerado.
 
     // Posição do vértice atual no sistema de coordenadas global (World).
-    position_world = model * model_coefficients;
+    position_world = object_model * model_position;
 
     // Posição do vértice atual no sistema de coordenadas local do modelo.
-    position_model = model_coefficients;
+    position_model = model_position;
 
     // Normal do vértice atual no sistema de coordenadas global (World).
     // Veja slides 123-151 do documento Aula_07_Transformacoes_Geometricas_3D.pdf.
-    normal = inverse(transpose(model)) * normal_coefficients;
+    // A matriz inverse(transpose(object_model)) é computada na CPU.
+    normal = object_normal_matrix * model_normal;
     normal.w = 0.0;
 
     // Coordenadas de textura obtidas do arquivo OBJ (se existirem!)
     texcoords = texture_coefficients;
+
+#ifdef GPU_DRIVEN
+    instance_object_id   = instances[instance_slot].material.x;
+    instance_bbox_min    = bbox_min;
+    instance_bbox_max    = bbox_max;
+    instance_texture_kd0 = instances[instance_slot].texture_kd0;
+    instance_texture_kd1 = instances[instance_slot].texture_kd1;
+#endif
 }
 
@@ -0,0 +1,87 @@
+#include "shaderpermutation.hpp"
+
+#include <cstdio>
+
+// Permutação equivalente com os campos que não afetam o shader zerados
+static ShaderPermutation ShaderPermutation_Normalize(const ShaderPermutation& permutation)
+{
+    ShaderPermutation normalized = permutation;
+    if ( normalized.lighting == SHADER_LIGHTING_FLAT )
+    {
+        normalized.uv_mode   = SHADER_UV_NONE;
+        normalized.kd0_array = -1;
+        normalized.kd1_array = -1;
+    }
+    if ( normalized.kd0_array < 0 )
+        normalized.kd0_array = -1;
+    if ( normalized.kd1_array < 0 )
+        normalized.kd1_array = -1;
+    return normalized;
+}
+
+uint32_t ShaderPermutation_Key(const ShaderPermutation& permutation)
+{
+    ShaderPermutation normalized = ShaderPermutation_Normalize(permutation);
+
+    // bits 0-7: uv_mode, 8-15: kd0_array+1, 16-23: kd1_array+1, 24-31: lighting
+    return ((uint32_t)normalized.uv_mode & 0xFF)
+         | (((uint32_t)(normalized.kd0_array + 1) & 0xFF) << 8)
+         | (((uint32_t)(normalized.kd1_array + 1) & 0xFF) << 16)
+         | (((uint32_t)normalized.lighting & 0xFF) << 24);
+}
+
+ShaderPermutation ShaderPermutation_FromKey(uint32_t key)
+{
+    ShaderPermutation permutation;
+    permutation.uv_mode   = (ShaderUvMode)(key & 0xFF);
+    permutation.kd0_array = (int)((key >> 8) & 0xFF) - 1;
+    permutation.kd1_array = (int)((key >> 16) & 0xFF) - 1;
+    permutation.lighting  = (ShaderLighting)((key >> 24) & 0xFF);
+    return permutation;
+}
+
+std::string ShaderPermutation_Header(const ShaderPermutation& permutation, const char* version)
+{
+    ShaderPermutation normalized = ShaderPermutation_Normalize(permutation);
+
+    char defines[256];
+    snprintf(defines, sizeof(defines),
+             "#define MATERIAL_PERMUTATION\n"
+             "#define UV_MODE %d\n"
+             "#define TEXTURE_KD0_ARRAY %d\n"
+             "#define TEXTURE_KD1_ARRAY %d\n"
+             "#define LIGHTING_MODEL %d\n",
+             (int)normalized.uv_mode, normalized.kd0_array, normalized.kd1_array, (int)normalized.lighting);
+
+    // A diretiva "#line" mantém os números das linhas dos erros de
+    // compilação iguais aos do arquivo.
+    return std::string(version) + "\n" + defines + "#line 1\n";
+}
+
+GLuint ShaderPermutation_Find(const ShaderPermutationCache* cache, const ShaderPermutation& permutation)
+{
+    std::map<uint32_t, GLuint>::const_iterator it = cache->programs.find(ShaderPermutation_Key(permutation));
+    return (it != cache->programs.end()) ? it->second : 0;
+}
+
+void ShaderPermutation_Insert(ShaderPermutationCache* cache, const ShaderPermutation& permutation, GLuint program, double seconds)
+{
+    cache->programs[ShaderPermutation_Key(permutation)] = program;
+    cache->compiled        += 1;
+    cache->compile_seconds += seconds;
+}
+
+void ShaderPermutation_Replace(ShaderPermutationCache* cache, uint32_t key, GLuint program)
+{
+    GLuint& current = cache->programs[key];
+    if ( current != 0 )
+        glDeleteProgram(current);
+    current = program;
+}
+
+void ShaderPermutation_Clear(ShaderPermutationCache* cache)
+{
+    for (std::map<uint32_t, GLuint>::const_iterator it = cache->programs.begin(); it != cache->programs.end(); ++it)
+        glDeleteProgram(it->second);
+    cache->programs.clear();
+}
@@ -0,0 +1,228 @@
+#include "shaderreload.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+#include <sys/stat.h>
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+#include <GLFW/glfw3.h>
+
+#include "programcache.hpp"
+
+// Constantes de GL_KHR_parallel_shader_compile, iguais às de
+// GL_ARB_parallel_shader_compile
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR           0x91B1
+
+typedef void (APIENTRYP ShaderReloadMaxShaderCompilerThreadsProc)(GLuint count);
+
+static bool g_ParallelCompile = false;
+
+// Intervalo entre as comparações das datas de modificação, em segundos,
+// quando não há inotify
+static const double SHADERWATCHER_POLL_INTERVAL = 0.5;
+
+static bool ShaderReload_HasExtension(const char* name)
+{
+    GLint num_extensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+    for (GLint i = 0; i < num_extensions; ++i)
+    {
+        const char* extension = (const char*) glGetStringi(GL_EXTENSIONS, i);
+        if ( extension && strcmp(extension, name) == 0 )
+            return true;
+    }
+    return false;
+}
+
+bool ShaderReload_Init(GLADloadproc load)
+{
+    ShaderReloadMaxShaderCompilerThreadsProc max_threads = NULL;
+    if ( ShaderReload_HasExtension("GL_KHR_parallel_shader_compile") )
+        max_threads = (ShaderReloadMaxShaderCompilerThreadsProc)load("glMaxShaderCompilerThreadsKHR");
+    else if ( ShaderReload_HasExtension("GL_ARB_parallel_shader_compile") )
+        max_threads = (ShaderReloadMaxShaderCompilerThreadsProc)load("glMaxShaderCompilerThreadsARB");
+
+    // 0xFFFFFFFF deixa o driver escolher o número de threads
+    g_ParallelCompile = (max_threads != NULL);
+    if ( g_ParallelCompile )
+        max_threads(0xFFFFFFFF);
+    return g_ParallelCompile;
+}
+
+bool ShaderReload_ParallelCompile()
+{
+    return g_ParallelCompile;
+}
+
+static long long ShaderWatcher_ModificationTime(const std::string& path)
+{
+    struct stat info;
+    if ( stat(path.c_str(), &info) != 0 )
+        return 0;
+    return (long long) info.st_mtime;
+}
+
+void ShaderWatcher_Init(ShaderWatcher* watcher, const char* directory, const char* const* filenames, size_t count)
+{
+    watcher->directory = directory;
+    watcher->filenames.assign(filenames, filenames + count);
+    watcher->fd = -1;
+    watcher->next_check = 0.0;
+
+#if defined(__linux__)
+    // O diretório é observado, e não os arquivos, pois muitos editores gravam
+    // um arquivo novo e o renomeiam sobre o anterior.
+    watcher->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if ( watcher->fd >= 0 && inotify_add_watch(watcher->fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO) < 0 )
+    {
+        close(watcher->fd);
+        watcher->fd = -1;
+    }
+#endif
+
+    watcher->mtimes.clear();
+    for (size_t i = 0; i < count; ++i)
+        watcher->mtimes.push_back(ShaderWatcher_ModificationTime(watcher->directory + "/" + filenames[i]));
+}
+
+bool ShaderWatcher_Poll(ShaderWatcher* watcher)
+{
+    bool changed = false;
+
+#if defined(__linux__)
+    if ( watcher->fd >= 0 )
+    {
+        // Lemos todos os eventos disponíveis, pois uma gravação pode gerar
+        // vários deles
+        alignas(struct inotify_event) char buffer[4096];
+        ssize_t length;
+        while ( (length = read(watcher->fd, buffer, sizeof(buffer))) > 0 )
+        {
+            for (ssize_t i = 0; i < length; )
+            {
+                const struct inotify_event* event = (const struct inotify_event*) (buffer + i);
+                for (size_t j = 0; event->len > 0 && j < watcher->filenames.size(); ++j)
+                    if ( watcher->filenames[j] == event->name )
+                        changed = true;
+                i += sizeof(struct inotify_event) + event->len;
+            }
+        }
+        return changed;
+    }
+#endif
+
+    double now = glfwGetTime();
+    if ( now < watcher->next_check )
+        return false;
+    watcher->next_check = now + SHADERWATCHER_POLL_INTERVAL;
+
+    for (size_t i = 0; i < watcher->filenames.size(); ++i)
+    {
+        long long mtime = ShaderWatcher_ModificationTime(watcher->directory + "/" + watcher->filenames[i]);
+        if ( mtime != watcher->mtimes[i] )
+        {
+            watcher->mtimes[i] = mtime;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+void ShaderWatcher_Destroy(ShaderWatcher* watcher)
+{
+#if defined(__linux__)
+    if ( watcher->fd >= 0 )
+        close(watcher->fd);
+#endif
+    watcher->fd = -1;
+}
+
+void ShaderReload_Begin(PendingProgram* pending, const std::string& vertex_source, const char* vertex_filename,
+                        const std::string& fragment_source, const char* fragment_filename)
+{
+    pending->vertex_filename   = vertex_filename;
+    pending->fragment_filename = fragment_filename;
+    pending->start             = glfwGetTime();
+
+    const GLchar* strings[2]  = { vertex_source.c_str(), fragment_source.c_str() };
+    const GLint   lengths[2]  = { (GLint) vertex_source.size(), (GLint) fragment_source.size() };
+
+    pending->vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(pending->vertex_shader, 1, &strings[0], &lengths[0]);
+    glCompileShader(pending->vertex_shader);
+
+    pending->fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(pending->fragment_shader, 1, &strings[1], &lengths[1]);
+    glCompileShader(pending->fragment_shader);
+
+    // A linkagem é pedida logo em seguida, sem consultar o resultado da
+    // compilação; um erro de compilação aparece como erro de linkagem.
+    pending->program = glCreateProgram();
+    glAttachShader(pending->program, pending->vertex_shader);
+    glAttachShader(pending->program, pending->fragment_shader);
+    ProgramCache_PrepareLink(pending->program);
+    glLinkProgram(pending->program);
+}
+
+static void ShaderReload_PrintShaderLog(GLuint shader_id, const std::string& filename)
+{
+    GLint compiled_ok = GL_FALSE;
+    glGetShaderiv(shader_id, GL_COMPILE_STATUS, &compiled_ok);
+    GLint log_length = 0;
+    glGetShaderiv(shader_id, GL_INFO_LOG_LENGTH, &log_length);
+    if ( log_length <= 1 )
+        return;
+
+    std::vector<GLchar> log(log_length);
+    glGetShaderInfoLog(shader_id, log_length, &log_length, log.data());
+    fprintf(stderr, "%s: OpenGL compilation of \"%s\"%s\n== Start of compilation log\n%s== End of compilation log\n",
+            compiled_ok ? "WARNING" : "ERROR", filename.c_str(), compiled_ok ? "." : " failed.", log.data());
+}
+
+PendingProgramStatus ShaderReload_Poll(const PendingProgram* pending)
+{
+    if ( g_ParallelCompile )
+    {
+        GLint completed = GL_FALSE;
+        glGetProgramiv(pending->program, GL_COMPLETION_STATUS_KHR, &completed);
+        if ( completed == GL_FALSE )
+            return PENDING_PROGRAM_COMPILING;
+    }
+
+    GLint linked_ok = GL_FALSE;
+    glGetProgramiv(pending->program, GL_LINK_STATUS, &linked_ok);
+    if ( linked_ok != GL_FALSE )
+        return PENDING_PROGRAM_READY;
+
+    ShaderReload_PrintShaderLog(pending->vertex_shader, pending->vertex_filename);
+    ShaderReload_PrintShaderLog(pending->fragment_shader, pending->fragment_filename);
+
+    GLint log_length = 0;
+    glGetProgramiv(pending->program, GL_INFO_LOG_LENGTH, &log_length);
+    if ( log_length > 1 )
+    {
+        std::vector<GLchar> log(log_length);
+        glGetProgramInfoLog(pending->program, log_length, &log_length, log.data());
+        fprintf(stderr, "ERROR: OpenGL linking of program failed.\n== Start of link log\n%s\n== End of link log\n", log.data());
+    }
+    return PENDING_PROGRAM_FAILED;
+}
+
+void ShaderReload_Finish(PendingProgram* pending, bool keep_program)
+{
+    glDeleteShader(pending->vertex_shader);
+    glDeleteShader(pending->fragment_shader);
+    pending->vertex_shader = pending->fragment_shader = 0;
+
+    if ( !keep_program )
+    {
+        glDeleteProgram(pending->program);
+        pending->program = 0;
+    }
+}
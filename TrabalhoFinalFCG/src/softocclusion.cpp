@@ -0,0 +1,246 @@
+#include "softocclusion.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <glm/vec4.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SOFTOCCLUSION_SSE2
+#endif
+
+// Profundidade (z em coordenadas normalizadas, levado para [0,1]) do oclusor
+// mais próximo em cada pixel, com a linha 0 na parte de baixo da tela.
+alignas(16) static float g_SoftDepth[SOFTOCCLUSION_WIDTH * SOFTOCCLUSION_HEIGHT];
+
+static glm::mat4 g_SoftProjectionView;
+
+// Um vértice em coordenadas de tela (em pixels do Z-buffer), ou marcado
+// como atrás do near plane.
+struct SoftVertex {
+    float x, y, z;
+    bool  clipped;
+};
+
+static SoftVertex SoftOcclusion_Project(const glm::mat4& transform, const glm::vec3& p)
+{
+    glm::vec4 clip = transform * glm::vec4(p, 1.0f);
+
+    SoftVertex v;
+    v.clipped = clip.w <= 1e-6f || clip.z < -clip.w;
+    if ( v.clipped )
+    {
+        v.x = v.y = v.z = 0.0f;
+        return v;
+    }
+
+    float inv_w = 1.0f / clip.w;
+    v.x = (clip.x * inv_w * 0.5f + 0.5f) * SOFTOCCLUSION_WIDTH;
+    v.y = (clip.y * inv_w * 0.5f + 0.5f) * SOFTOCCLUSION_HEIGHT;
+    v.z =  clip.z * inv_w * 0.5f + 0.5f;
+    return v;
+}
+
+void SoftOcclusion_Begin(const glm::mat4& projection_view)
+{
+    g_SoftProjectionView = projection_view;
+    std::fill(g_SoftDepth, g_SoftDepth + SOFTOCCLUSION_WIDTH * SOFTOCCLUSION_HEIGHT, 1.0f);
+}
+
+// Função de aresta E(x,y) = a*x + b*y + c, positiva à esquerda da aresta
+// orientada de "p" para "q".
+struct SoftEdge {
+    float a, b, c;
+};
+
+static SoftEdge SoftOcclusion_Edge(const SoftVertex& p, const SoftVertex& q)
+{
+    SoftEdge e;
+    e.a = p.y - q.y;
+    e.b = q.x - p.x;
+    e.c = -(e.a * p.x + e.b * p.y);
+    return e;
+}
+
+static void SoftOcclusion_RasterizeTriangle(const SoftVertex& v0, SoftVertex v1, SoftVertex v2)
+{
+    // Os oclusores são sólidos, então desenhamos as faces nas duas
+    // orientações, trocando dois vértices quando necessário.
+    float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+    if ( area < 0.0f )
+    {
+        std::swap(v1, v2);
+        area = -area;
+    }
+    if ( area < 1e-6f )
+        return;
+
+    int xmin = std::max(0, (int)std::floor(std::min(v0.x, std::min(v1.x, v2.x))));
+    int xmax = std::min(SOFTOCCLUSION_WIDTH - 1, (int)std::floor(std::max(v0.x, std::max(v1.x, v2.x))));
+    int ymin = std::max(0, (int)std::floor(std::min(v0.y, std::min(v1.y, v2.y))));
+    int ymax = std::min(SOFTOCCLUSION_HEIGHT - 1, (int)std::floor(std::max(v0.y, std::max(v1.y, v2.y))));
+    if ( xmin > xmax || ymin > ymax )
+        return;
+
+    // Cada função de aresta, dividida pela área, é a coordenada baricêntrica
+    // do vértice oposto; com elas, z também é uma função linear de (x,y).
+    SoftEdge e0 = SoftOcclusion_Edge(v1, v2);
+    SoftEdge e1 = SoftOcclusion_Edge(v2, v0);
+    SoftEdge e2 = SoftOcclusion_Edge(v0, v1);
+
+    float inv_area = 1.0f / area;
+    SoftEdge z;
+    z.a = (e0.a * v0.z + e1.a * v1.z + e2.a * v2.z) * inv_area;
+    z.b = (e0.b * v0.z + e1.b * v1.z + e2.b * v2.z) * inv_area;
+    z.c = (e0.c * v0.z + e1.c * v1.z + e2.c * v2.z) * inv_area;
+
+    // Os pixels são processados em grupos de 4 alinhados na linha; os pixels
+    // do grupo fora do triângulo são descartados pelas funções de aresta.
+    int xstart = xmin & ~3;
+
+    for (int y = ymin; y <= ymax; ++y)
+    {
+        float  py  = y + 0.5f;
+        float* row = g_SoftDepth + y * SOFTOCCLUSION_WIDTH;
+
+#ifdef SOFTOCCLUSION_SSE2
+        __m128 offsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+        __m128 px      = _mm_add_ps(_mm_set1_ps((float)xstart), offsets);
+        __m128 w0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(e0.a), px), _mm_set1_ps(e0.b * py + e0.c));
+        __m128 w1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(e1.a), px), _mm_set1_ps(e1.b * py + e1.c));
+        __m128 w2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(e2.a), px), _mm_set1_ps(e2.b * py + e2.c));
+        __m128 zv = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(z.a),  px), _mm_set1_ps(z.b  * py + z.c));
+        __m128 dw0 = _mm_set1_ps(4.0f * e0.a);
+        __m128 dw1 = _mm_set1_ps(4.0f * e1.a);
+        __m128 dw2 = _mm_set1_ps(4.0f * e2.a);
+        __m128 dz  = _mm_set1_ps(4.0f * z.a);
+        __m128 zero = _mm_setzero_ps();
+
+        for (int x = xstart; x <= xmax; x += 4)
+        {
+            __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(w0, zero), _mm_cmpge_ps(w1, zero)), _mm_cmpge_ps(w2, zero));
+            if ( _mm_movemask_ps(inside) != 0 )
+            {
+                __m128 depth   = _mm_load_ps(row + x);
+                __m128 nearest = _mm_min_ps(depth, zv);
+                _mm_store_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, depth)));
+            }
+
+            w0 = _mm_add_ps(w0, dw0);
+            w1 = _mm_add_ps(w1, dw1);
+            w2 = _mm_add_ps(w2, dw2);
+            zv = _mm_add_ps(zv, dz);
+        }
+#else
+        for (int x = xstart; x <= xmax; ++x)
+        {
+            float px = x + 0.5f;
+            if ( e0.a * px + e0.b * py + e0.c >= 0.0f && e1.a * px + e1.b * py + e1.c >= 0.0f && e2.a * px + e2.b * py + e2.c >= 0.0f )
+                row[x] = std::min(row[x], z.a * px + z.b * py + z.c);
+        }
+#endif
+    }
+}
+
+void SoftOcclusion_RasterizeTriangles(const glm::mat4& model, const float* positions, size_t num_vertices, const uint32_t* indices, size_t num_indices)
+{
+    static std::vector<SoftVertex> vertices;
+    vertices.resize(num_vertices);
+
+    glm::mat4 transform = g_SoftProjectionView * model;
+    for (size_t i = 0; i < num_vertices; ++i)
+        vertices[i] = SoftOcclusion_Project(transform, glm::vec3(positions[3*i + 0], positions[3*i + 1], positions[3*i + 2]));
+
+    for (size_t i = 0; i + 2 < num_indices; i += 3)
+    {
+        const SoftVertex& v0 = vertices[indices[i + 0]];
+        const SoftVertex& v1 = vertices[indices[i + 1]];
+        const SoftVertex& v2 = vertices[indices[i + 2]];
+
+        // Em vez de recortar os triângulos que cruzam o near plane, somente
+        // os ignoramos: o oclusor fica menor, e o descarte continua correto.
+        if ( v0.clipped || v1.clipped || v2.clipped )
+            continue;
+
+        SoftOcclusion_RasterizeTriangle(v0, v1, v2);
+    }
+}
+
+void SoftOcclusion_RasterizeBox(const glm::mat4& model, const glm::vec3& box_min, const glm::vec3& box_max)
+{
+    const float positions[] = {
+        box_min.x, box_min.y, box_min.z,   box_max.x, box_min.y, box_min.z,
+        box_min.x, box_max.y, box_min.z,   box_max.x, box_max.y, box_min.z,
+        box_min.x, box_min.y, box_max.z,   box_max.x, box_min.y, box_max.z,
+        box_min.x, box_max.y, box_max.z,   box_max.x, box_max.y, box_max.z,
+    };
+    static const uint32_t indices[] = {
+        0, 1, 2,  2, 1, 3,
+        4, 6, 5,  5, 6, 7,
+        0, 4, 1,  1, 4, 5,
+        2, 3, 6,  6, 3, 7,
+        0, 2, 4,  4, 2, 6,
+        1, 5, 3,  3, 5, 7,
+    };
+
+    SoftOcclusion_RasterizeTriangles(model, positions, 8, indices, 36);
+}
+
+bool SoftOcclusion_TestBox(const glm::vec3& box_min, const glm::vec3& box_max)
+{
+    // Retângulo na tela e profundidade mais próxima da AABB
+    float xmin = SOFTOCCLUSION_WIDTH, xmax = 0.0f;
+    float ymin = SOFTOCCLUSION_HEIGHT, ymax = 0.0f;
+    float zmin = 1.0f;
+
+    for (int i = 0; i < 8; ++i)
+    {
+        glm::vec3 corner((i & 1) ? box_max.x : box_min.x,
+                         (i & 2) ? box_max.y : box_min.y,
+                         (i & 4) ? box_max.z : box_min.z);
+
+        SoftVertex v = SoftOcclusion_Project(g_SoftProjectionView, corner);
+
+        // AABBs que cruzam o near plane estão na frente de tudo
+        if ( v.clipped )
+            return true;
+
+        xmin = std::min(xmin, v.x);
+        xmax = std::max(xmax, v.x);
+        ymin = std::min(ymin, v.y);
+        ymax = std::max(ymax, v.y);
+        zmin = std::min(zmin, v.z);
+    }
+
+    int x0 = std::max(0, (int)std::floor(xmin));
+    int x1 = std::min(SOFTOCCLUSION_WIDTH - 1, (int)std::floor(xmax));
+    int y0 = std::max(0, (int)std::floor(ymin));
+    int y1 = std::min(SOFTOCCLUSION_HEIGHT - 1, (int)std::floor(ymax));
+    if ( x0 > x1 || y0 > y1 )
+        return true;
+
+    // A AABB está escondida se, em todos os pixels do retângulo, algum
+    // oclusor está mais próximo que ela. Como na rasterização, processamos
+    // grupos de 4 pixels alinhados; os pixels vizinhos incluídos somente
+    // tornam o teste mais conservador.
+    int xstart = x0 & ~3;
+    for (int y = y0; y <= y1; ++y)
+    {
+        const float* row = g_SoftDepth + y * SOFTOCCLUSION_WIDTH;
+
+#ifdef SOFTOCCLUSION_SSE2
+        __m128 z = _mm_set1_ps(zmin);
+        for (int x = xstart; x <= x1; x += 4)
+            if ( _mm_movemask_ps(_mm_cmpge_ps(_mm_load_ps(row + x), z)) != 0 )
+                return true;
+#else
+        for (int x = xstart; x <= x1; ++x)
+            if ( row[x] >= zmin )
+                return true;
+#endif
+    }
+
+    return false;
+}
@@ -0,0 +1,237 @@
+#include "staticbatch.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <map>
+#include <tuple>
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/mat3x3.hpp>
+#include <glm/matrix.hpp>
+#include <glm/vec4.hpp>
+
+#include "frustum.hpp"
+
+// Transforma os vértices das instâncias de um grupo para coordenadas
+// globais, acrescentando-os a "vertices" e "indices".
+static void StaticBatch_BuildChunk(StaticBatchChunk* chunk, const std::vector<StaticBatchSource>& sources,
+                                   std::vector<FloatVertex>* vertices, std::vector<uint32_t>* indices)
+{
+    size_t chunk_first_vertex = vertices->size();
+
+    for (size_t s = 0; s < chunk->sources.size(); ++s)
+    {
+        const StaticBatchSource& source = sources[chunk->sources[s]];
+
+        // As normais são transformadas pela inversa da transposta da
+        // matriz "model", como em "shader_vertex.glsl".
+        glm::mat3 normal_matrix = glm::transpose(glm::inverse(glm::mat3(source.model)));
+
+        uint32_t first_vertex = (uint32_t)(vertices->size() - chunk_first_vertex);
+        for (size_t v = 0; v < source.num_vertices; ++v)
+        {
+            const FloatVertex& in = source.vertices[v];
+            glm::vec4 position = source.model * glm::vec4(in.position[0], in.position[1], in.position[2], 1.0f);
+            glm::vec3 normal   = normal_matrix * glm::vec3(in.normal[0], in.normal[1], in.normal[2]);
+            if ( glm::dot(normal, normal) > 0.0f )
+                normal = glm::normalize(normal);
+
+            FloatVertex out;
+            out.position[0] = position.x;
+            out.position[1] = position.y;
+            out.position[2] = position.z;
+            out.position[3] = 1.0f;
+            out.normal[0]   = normal.x;
+            out.normal[1]   = normal.y;
+            out.normal[2]   = normal.z;
+            out.normal[3]   = 0.0f;
+            out.texcoord[0] = in.texcoord[0];
+            out.texcoord[1] = in.texcoord[1];
+            vertices->push_back(out);
+
+            chunk->world_min = glm::min(chunk->world_min, glm::vec3(position));
+            chunk->world_max = glm::max(chunk->world_max, glm::vec3(position));
+        }
+
+        // Uma matriz que espelha o modelo inverte a orientação dos
+        // triângulos; trocamos dois vértices de cada um para que o
+        // back-face culling continue correto.
+        bool mirrored = glm::determinant(glm::mat3(source.model)) < 0.0f;
+        for (size_t t = 0; t + 2 < source.num_indices; t += 3)
+        {
+            indices->push_back(first_vertex + source.indices[t + 0]);
+            indices->push_back(first_vertex + source.indices[t + (mirrored ? 2 : 1)]);
+            indices->push_back(first_vertex + source.indices[t + (mirrored ? 1 : 2)]);
+        }
+    }
+}
+
+void StaticBatch_Build(StaticBatch* batch, const std::vector<StaticBatchSource>& sources, float chunk_size)
+{
+    // Os buffers antigos são mantidos até que os grupos reaproveitados
+    // sejam copiados.
+    StaticBatch previous = *batch;
+    batch->vertex_array  = 0;
+    batch->vertex_buffer = 0;
+    batch->index_buffer  = 0;
+    batch->vertex_bytes  = 0;
+    batch->chunks.clear();
+
+    std::map<std::vector<size_t>, size_t> previous_chunks;
+    for (size_t c = 0; c < previous.chunks.size(); ++c)
+        previous_chunks[previous.chunks[c].ids] = c;
+
+    // Agrupamos as instâncias pela chave (material, célula x, célula z). O
+    // mapa mantém os grupos em ordem de material, de forma que grupos
+    // desenhados em sequência tendem a usar as mesmas texturas.
+    typedef std::tuple<int, int, int> ChunkKey;
+    std::map<ChunkKey, std::vector<size_t> > groups;
+
+    for (size_t i = 0; i < sources.size(); ++i)
+    {
+        const StaticBatchSource& source = sources[i];
+        if ( source.num_indices == 0 )
+            continue;
+
+        glm::vec3 world_min, world_max;
+        Frustum_TransformBox(source.model, source.bbox_min, source.bbox_max, &world_min, &world_max);
+        glm::vec3 center = 0.5f * (world_min + world_max);
+
+        ChunkKey key(source.material, (int)std::floor(center.x / chunk_size), (int)std::floor(center.z / chunk_size));
+        groups[key].push_back(i);
+    }
+
+    // Grupos novos são montados em "vertices" e "indices"; "copied" guarda,
+    // para cada grupo, o grupo anterior de onde ele é copiado, ou -1.
+    std::vector<FloatVertex> vertices;
+    std::vector<uint32_t>    indices;
+    std::vector<int>         copied;
+    std::vector<size_t>      staged_vertex, staged_index;
+    size_t total_vertices = 0, total_indices = 0;
+
+    for (std::map<ChunkKey, std::vector<size_t> >::const_iterator it = groups.begin(); it != groups.end(); ++it)
+    {
+        StaticBatchChunk chunk;
+        chunk.material     = std::get<0>(it->first);
+        chunk.world_min    = glm::vec3(INFINITY);
+        chunk.world_max    = glm::vec3(-INFINITY);
+        chunk.first_index  = total_indices;
+        chunk.first_vertex = total_vertices;
+        chunk.sources      = it->second;
+        for (size_t s = 0; s < chunk.sources.size(); ++s)
+            chunk.ids.push_back(sources[chunk.sources[s]].id);
+
+        std::map<std::vector<size_t>, size_t>::const_iterator old = previous_chunks.find(chunk.ids);
+        if ( old != previous_chunks.end() )
+        {
+            const StaticBatchChunk& previous_chunk = previous.chunks[old->second];
+            chunk.world_min    = previous_chunk.world_min;
+            chunk.world_max    = previous_chunk.world_max;
+            chunk.num_indices  = previous_chunk.num_indices;
+            chunk.num_vertices = previous_chunk.num_vertices;
+            copied.push_back((int)old->second);
+        }
+        else
+        {
+            staged_vertex.push_back(vertices.size());
+            staged_index.push_back(indices.size());
+            StaticBatch_BuildChunk(&chunk, sources, &vertices, &indices);
+            chunk.num_vertices = vertices.size() - staged_vertex.back();
+            chunk.num_indices  = indices.size() - staged_index.back();
+            copied.push_back(-1);
+        }
+
+        total_vertices += chunk.num_vertices;
+        total_indices  += chunk.num_indices;
+        batch->chunks.push_back(chunk);
+    }
+
+    if ( batch->chunks.empty() )
+    {
+        StaticBatch_Destroy(&previous);
+        return;
+    }
+
+    glGenVertexArrays(1, &batch->vertex_array);
+    glBindVertexArray(batch->vertex_array);
+
+    glGenBuffers(1, &batch->vertex_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, batch->vertex_buffer);
+    glBufferData(GL_ARRAY_BUFFER, total_vertices * sizeof(FloatVertex), NULL, GL_STATIC_DRAW);
+
+    GLsizei stride = sizeof(FloatVertex);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(FloatVertex, position));
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(FloatVertex, normal));
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(FloatVertex, texcoord));
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+
+    glGenBuffers(1, &batch->index_buffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch->index_buffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, total_indices * sizeof(uint32_t), NULL, GL_STATIC_DRAW);
+
+    glBindVertexArray(0);
+
+    // Os índices de cada grupo são relativos ao seu primeiro vértice (veja
+    // StaticBatch_Draw()), então um grupo pode ser copiado para qualquer
+    // posição dos buffers novos.
+    size_t staged = 0;
+    for (size_t c = 0; c < batch->chunks.size(); ++c)
+    {
+        const StaticBatchChunk& chunk = batch->chunks[c];
+        if ( copied[c] >= 0 )
+        {
+            const StaticBatchChunk& previous_chunk = previous.chunks[copied[c]];
+            glBindBuffer(GL_COPY_READ_BUFFER, previous.vertex_buffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, batch->vertex_buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, previous_chunk.first_vertex * sizeof(FloatVertex),
+                                chunk.first_vertex * sizeof(FloatVertex), chunk.num_vertices * sizeof(FloatVertex));
+            glBindBuffer(GL_COPY_READ_BUFFER, previous.index_buffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, batch->index_buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, previous_chunk.first_index * sizeof(uint32_t),
+                                chunk.first_index * sizeof(uint32_t), chunk.num_indices * sizeof(uint32_t));
+        }
+        else
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, batch->vertex_buffer);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, chunk.first_vertex * sizeof(FloatVertex),
+                            chunk.num_vertices * sizeof(FloatVertex), &vertices[staged_vertex[staged]]);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, batch->index_buffer);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, chunk.first_index * sizeof(uint32_t),
+                            chunk.num_indices * sizeof(uint32_t), &indices[staged_index[staged]]);
+            staged += 1;
+        }
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    StaticBatch_Destroy(&previous);
+
+    batch->vertex_bytes = total_vertices * sizeof(FloatVertex);
+}
+
+void StaticBatch_Destroy(StaticBatch* batch)
+{
+    if ( batch->vertex_array != 0 )
+    {
+        glDeleteVertexArrays(1, &batch->vertex_array);
+        glDeleteBuffers(1, &batch->vertex_buffer);
+        glDeleteBuffers(1, &batch->index_buffer);
+    }
+
+    batch->vertex_array  = 0;
+    batch->vertex_buffer = 0;
+    batch->index_buffer  = 0;
+    batch->vertex_bytes  = 0;
+    batch->chunks.clear();
+}
+
+void StaticBatch_Draw(const StaticBatch* batch, size_t chunk)
+{
+    glBindVertexArray(batch->vertex_array);
+    glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)batch->chunks[chunk].num_indices, GL_UNSIGNED_INT,
+                             (void*)(batch->chunks[chunk].first_index * sizeof(uint32_t)), (GLint)batch->chunks[chunk].first_vertex);
+}
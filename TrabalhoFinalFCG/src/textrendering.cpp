@@ -1,6 +1,7 @@
 // Based on http://hamelot.io/visualization/opengl-text-without-any-external-libraries/
 //   and on https://github.com/rougier/freetype-gl
 #include <string>
+#include <vector>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -10,6 +11,7 @@
 
 #include "utils.h"
 #include "dejavufont.h"
+#include "programcache.hpp"
 
 GLuint CreateGpuProgram(GLuint vertex_shader_id, GLuint fragment_shader_id); // Função definida em main.cpp
 
@@ -87,6 +89,21 @@ GLuint textVBO;
 GLuint textprogram_id;
 GLuint texttexture_id;
 
+// Os textos não são desenhados por TextRendering_PrintString(): os vértices
+// de todos os caracteres do quadro são acumulados em "textvertices", e
+// desenhados com uma única chamada por TextRendering_Flush().
+struct TextVertex { float x, y, s, t; };
+std::vector<TextVertex> textvertices;
+size_t textbuffer_size = 0; // Tamanho atual de textVBO, em bytes
+
+// Posição de cada caractere em dejavufont.glyphs, ou -1 se a fonte não o tem
+#define TEXTRENDERING_MAX_CODEPOINT 256
+int textglyph_index[TEXTRENDERING_MAX_CODEPOINT];
+
+// Tamanho da janela, atualizado por TextRendering_SetWindowSize()
+int textwindow_width  = 800;
+int textwindow_height = 600;
+
 void TextRendering_Init()
 {
     GLuint sampler;
@@ -101,17 +118,28 @@ void TextRendering_Init()
     glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glCheckError();
 
-    GLuint textvertexshader_id = glCreateShader(GL_VERTEX_SHADER);
-    TextRendering_LoadShader(textvertexshader_source, textvertexshader_id);
-    glCheckError();
+    // O programa é lido do cache de programas, se possível (veja
+    // "programcache.hpp")
+    std::string sources[2] = { textvertexshader_source, textfragmentshader_source };
+    uint64_t key = ProgramCache_Key(sources, 2);
+    textprogram_id = ProgramCache_Load(key);
+    if ( textprogram_id == 0 )
+    {
+        double start = glfwGetTime();
 
-    GLuint textfragmentshader_id = glCreateShader(GL_FRAGMENT_SHADER);
-    TextRendering_LoadShader(textfragmentshader_source, textfragmentshader_id);
-    glCheckError();
+        GLuint textvertexshader_id = glCreateShader(GL_VERTEX_SHADER);
+        TextRendering_LoadShader(textvertexshader_source, textvertexshader_id);
+        glCheckError();
 
-    textprogram_id = CreateGpuProgram(textvertexshader_id, textfragmentshader_id);
-    glLinkProgram(textprogram_id);
-    glCheckError();
+        GLuint textfragmentshader_id = glCreateShader(GL_FRAGMENT_SHADER);
+        TextRendering_LoadShader(textfragmentshader_source, textfragmentshader_id);
+        glCheckError();
+
+        textprogram_id = CreateGpuProgram(textvertexshader_id, textfragmentshader_id);
+        glCheckError();
+
+        ProgramCache_Store(key, textprogram_id, glfwGetTime() - start);
+    }
 
     GLuint texttex_uniform;
     texttex_uniform = glGetUniformLocation(textprogram_id, "tex");
@@ -127,7 +155,6 @@ void TextRendering_Init()
     glBindVertexArray(textVAO);
 
     glBindBuffer(GL_ARRAY_BUFFER, textVBO);
-    glBufferData(GL_ARRAY_BUFFER, 24 * sizeof(float), NULL, GL_DYNAMIC_DRAW);
     glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
     glEnableVertexAttribArray(0);
     glCheckError();
@@ -140,6 +167,59 @@ void TextRendering_Init()
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
     glCheckError();
+
+    for (size_t i = 0; i < TEXTRENDERING_MAX_CODEPOINT; ++i)
+        textglyph_index[i] = -1;
+    for (size_t j = 0; j < dejavufont.glyphs_count; ++j)
+        if (dejavufont.glyphs[j].codepoint < TEXTRENDERING_MAX_CODEPOINT && textglyph_index[dejavufont.glyphs[j].codepoint] < 0)
+            textglyph_index[dejavufont.glyphs[j].codepoint] = (int)j;
+}
+
+// Deve ser chamada sempre que a janela é redimensionada (veja
+// FramebufferSizeCallback() em main.cpp), com o tamanho da janela dado por
+// glfwGetWindowSize().
+void TextRendering_SetWindowSize(int width, int height)
+{
+    textwindow_width  = width;
+    textwindow_height = height;
+}
+
+// Desenha todos os textos impressos desde a chamada anterior, sobre a imagem
+// atual. Deve ser chamada uma vez por quadro, antes de glfwSwapBuffers().
+void TextRendering_Flush()
+{
+    if (textvertices.empty())
+        return;
+
+    // O buffer é realocado a cada quadro ("orphaning"), de forma que o driver
+    // não precisa esperar o fim do desenho do quadro anterior.
+    size_t size = textvertices.size() * sizeof(TextVertex);
+    if (size > textbuffer_size)
+        textbuffer_size = 2 * size;
+
+    glBindBuffer(GL_ARRAY_BUFFER, textVBO);
+    glBufferData(GL_ARRAY_BUFFER, textbuffer_size, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, textvertices.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    glDepthFunc(GL_ALWAYS);
+
+    glUseProgram(textprogram_id);
+    glBindVertexArray(textVAO);
+
+    glDrawArrays(GL_TRIANGLES, 0, (GLsizei) textvertices.size());
+
+    glBindVertexArray(0);
+    glUseProgram(0);
+    glDepthFunc(GL_LESS);
+
+    glDisable(GL_BLEND);
+
+    textvertices.clear();
 }
 
 float textscale = 1.5f;
@@ -147,26 +227,17 @@ float textscale = 1.5f;
 void TextRendering_PrintString(GLFWwindow* window, const std::string &str, float x, float y, float scale = 1.0f)
 {
     scale *= textscale;
-    int width, height;
-    glfwGetWindowSize(window, &width, &height);
-    float sx = scale / width;
-    float sy = scale / height;
+    float sx = scale / textwindow_width;
+    float sy = scale / textwindow_height;
 
     for (size_t i = 0; i < str.size(); i++)
     {
         // Find the glyph for the character we are looking for
-        texture_glyph_t *glyph = 0;
-        for (size_t j = 0; j < dejavufont.glyphs_count; ++j)
-        {
-            if (dejavufont.glyphs[j].codepoint == (uint32_t)str[i])
-            {
-                glyph = &dejavufont.glyphs[j];
-                break;
-            }
-        }
-        if (!glyph) {
+        uint32_t codepoint = (uint32_t)str[i];
+        if (codepoint >= TEXTRENDERING_MAX_CODEPOINT || textglyph_index[codepoint] < 0) {
             continue;
         }
+        texture_glyph_t *glyph = &dejavufont.glyphs[textglyph_index[codepoint]];
         x += glyph->kerning[0].kerning;
         float x0 = (float) (x + glyph->offset_x * sx);
         float y0 = (float) (y + glyph->offset_y * sy);
@@ -178,7 +249,7 @@ void TextRendering_PrintString(GLFWwindow* window, const std::string &str, float
         float s1 = glyph->s1 - 0.5f/dejavufont.tex_width;
         float t1 = glyph->t1 - 0.5f/dejavufont.tex_height;
 
-        struct {float x, y, s, t;} data[6] = {
+        TextVertex data[6] = {
             { x0, y0, s0, t0 },
             { x0, y1, s0, t1 },
             { x1, y1, s1, t1 },
@@ -186,26 +257,7 @@ void TextRendering_PrintString(GLFWwindow* window, const std::string &str, float
             { x1, y1, s1, t1 },
             { x1, y0, s1, t0 }
         };
-
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-        glDepthFunc(GL_ALWAYS);
-        glBindBuffer(GL_ARRAY_BUFFER, textVBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, 24 * sizeof(float), data);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-        glUseProgram(textprogram_id);
-        glBindVertexArray(textVAO);
-
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-
-        glBindVertexArray(0);
-        glUseProgram(0);
-        glDepthFunc(GL_LESS);
-
-        glDisable(GL_BLEND);
+        textvertices.insert(textvertices.end(), data, data + 6);
 
         x += (glyph->advance_x * sx);
     }
@@ -213,16 +265,12 @@ void TextRendering_PrintString(GLFWwindow* window, const std::string &str, float
 
 float TextRendering_LineHeight(GLFWwindow* window)
 {
-    int width, height;
-    glfwGetWindowSize(window, &width, &height);
-    return dejavufont.height / height * textscale;
+    return dejavufont.height / textwindow_height * textscale;
 }
 
 float TextRendering_CharWidth(GLFWwindow* window)
 {
-    int width, height;
-    glfwGetWindowSize(window, &width, &height);
-    return dejavufont.glyphs[32].advance_x / width * textscale;
+    return dejavufont.glyphs[32].advance_x / textwindow_width * textscale;
 }
 
 void TextRendering_PrintMatrix(GLFWwindow* window, glm::mat4 M, float x, float y, float scale = 1.0f)
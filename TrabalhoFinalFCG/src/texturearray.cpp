@@ -0,0 +1,401 @@
+#include "texturearray.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "texturecompress.hpp"
+
+// Formatos da extensão GL_EXT_texture_compression_s3tc em sRGB (definidos
+// pela GL_EXT_texture_sRGB), que não fazem parte do OpenGL 3.3 core.
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT       0x8C4C
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+
+// Uma textura registrada. "data" guarda a cópia dos níveis somente até o
+// envio do nível 0 para a GPU.
+struct TextureEntry {
+    std::string               name;
+    TextureFormat             format;
+    int                       width;
+    int                       height;
+    std::vector<TextureLevel> levels;
+    std::vector<uint8_t>      data;
+    int                       array; // -1 enquanto não enviada (ou após ser liberada)
+    int                       layer;
+    int                       resident_level; // Menor nível já enviado para a GPU
+    float                     requested_pixels; // Maior tamanho na tela desde o último TextureArray_Stream()
+    bool                      live;
+};
+
+struct TextureArrayObject {
+    GLuint texture;
+    GLuint sampler;
+    GLuint unit;
+    int    live_layers;
+};
+
+static std::vector<TextureEntry>             g_Textures;        // Indexado por TextureHandle
+static std::vector<TextureArrayObject>       g_Arrays;
+static std::map<std::string, TextureHandle>  g_TexturesByName;
+static bool                                  g_Compressed = true;
+static GLuint                                g_StreamBuffer = 0; // Pixel buffer object usado por TextureArray_Stream()
+
+bool TextureArray_CompressionSupported()
+{
+    bool supported = false;
+
+    GLint num_extensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+    for (GLint i = 0; i < num_extensions; ++i)
+    {
+        const char* extension = (const char*) glGetStringi(GL_EXTENSIONS, i);
+        if (strcmp(extension, "GL_EXT_texture_compression_s3tc") == 0)
+            supported = true;
+    }
+
+    if (!supported)
+        return false;
+
+    while (glGetError() != GL_NO_ERROR)
+        ;
+
+    // Um bloco BC1 de 4x4 texels, em um array de uma camada
+    static const uint8_t block[8] = { 0 };
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_COMPRESSED_SRGB_S3TC_DXT1_EXT, 4, 4, 1, 0, sizeof(block), block);
+    supported = glGetError() == GL_NO_ERROR;
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    glDeleteTextures(1, &texture);
+
+    return supported;
+}
+
+TextureHandle TextureArray_Add(const char* name, const TextureView& texture)
+{
+    TextureEntry entry;
+    entry.name   = name;
+    entry.format = texture.format;
+    entry.width  = texture.width;
+    entry.height = texture.height;
+    entry.levels = texture.levels;
+    entry.data.assign(texture.data, texture.data + texture.data_size);
+    entry.array  = -1;
+    entry.layer  = 0;
+    entry.resident_level   = (int)texture.levels.size();
+    entry.requested_pixels = 0.0f;
+    entry.live   = true;
+
+    TextureHandle handle = (TextureHandle)g_Textures.size();
+    g_Textures.push_back(entry);
+    g_TexturesByName[entry.name] = handle;
+    return handle;
+}
+
+TextureHandle TextureArray_Find(const char* name)
+{
+    std::map<std::string, TextureHandle>::const_iterator it = g_TexturesByName.find(name);
+    if (it == g_TexturesByName.end())
+        return TEXTUREARRAY_INVALID_HANDLE;
+    return it->second;
+}
+
+TextureBinding TextureArray_Binding(TextureHandle texture)
+{
+    TextureBinding binding = { -1, 0, 0 };
+    if (texture < 0 || (size_t)texture >= g_Textures.size() || !g_Textures[texture].live)
+        return binding;
+
+    binding.array     = g_Textures[texture].array;
+    binding.layer     = g_Textures[texture].layer;
+    binding.min_level = g_Textures[texture].resident_level;
+    return binding;
+}
+
+size_t TextureArray_Bytes(TextureHandle texture, bool compressed)
+{
+    const TextureEntry& entry = g_Textures[texture];
+
+    size_t bytes = 0;
+    for (size_t i = 0; i < entry.levels.size(); ++i)
+        bytes += compressed ? entry.levels[i].size : (size_t)entry.levels[i].width * entry.levels[i].height * 4;
+    return bytes;
+}
+
+static GLenum TextureArray_GLFormat(TextureFormat format)
+{
+    return (format == TEXTURE_FORMAT_BC3) ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+}
+
+// Envia um nível de uma textura para a sua camada no array, que deve estar
+// ligado a GL_TEXTURE_2D_ARRAY. Se um pixel buffer object estiver ligado a
+// GL_PIXEL_UNPACK_BUFFER, "pixels" é a posição dos dados dentro do mesmo.
+static void TextureArray_SubImage(const TextureEntry& entry, size_t level, const void* pixels, size_t size)
+{
+    GLsizei w = entry.levels[level].width;
+    GLsizei h = entry.levels[level].height;
+
+    if (g_Compressed)
+        glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, (GLint)level, 0, 0, entry.layer, w, h, 1, TextureArray_GLFormat(entry.format), (GLsizei)size, pixels);
+    else
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, (GLint)level, 0, 0, entry.layer, w, h, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+}
+
+// Dados de um nível, no formato enviado para a GPU: os blocos comprimidos, ou
+// os texels descomprimidos em "rgba".
+static const void* TextureArray_LevelData(const TextureEntry& entry, size_t level, std::vector<uint8_t>* rgba, size_t* size)
+{
+    if (g_Compressed)
+    {
+        *size = entry.levels[level].size;
+        return &entry.data[entry.levels[level].offset];
+    }
+
+    TextureView view;
+    view.format    = entry.format;
+    view.width     = entry.width;
+    view.height    = entry.height;
+    view.data      = entry.data.data();
+    view.data_size = entry.data.size();
+    view.levels    = entry.levels;
+    TextureCompress_Decompress(view, level, rgba);
+    *size = rgba->size();
+    return rgba->data();
+}
+
+// Cria um array ligado a "unit" com camadas para as texturas "members", todas
+// com mesmas dimensões, formato e número de níveis. Todos os níveis são
+// alocados, mas somente os da cauda (veja TEXTUREARRAY_TAIL_SIZE) são
+// enviados; os demais são enviados aos poucos por TextureArray_Stream().
+static TextureArrayObject TextureArray_Create(const std::vector<TextureHandle>& members, GLuint unit)
+{
+    const TextureEntry& first = g_Textures[members[0]];
+    GLsizei layers = (GLsizei)members.size();
+
+    TextureArrayObject array;
+    array.unit = unit;
+    array.live_layers = (int)members.size();
+
+    glGenTextures(1, &array.texture);
+    glGenSamplers(1, &array.sampler);
+
+    // Veja slides 95-96 do documento Aula_20_Mapeamento_de_Texturas.pdf
+    glSamplerParameteri(array.sampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glSamplerParameteri(array.sampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glSamplerParameteri(array.sampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glSamplerParameteri(array.sampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, array.texture);
+
+    // Todos os níveis de mipmap já foram gerados (veja TextureCompress_Cook()),
+    // portanto não chamamos glGenerateMipmap().
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, (GLint)first.levels.size() - 1);
+
+    for (size_t level = 0; level < first.levels.size(); ++level)
+    {
+        GLsizei w = first.levels[level].width;
+        GLsizei h = first.levels[level].height;
+        GLsizei size = (GLsizei)first.levels[level].size;
+
+        if (g_Compressed)
+            glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, (GLint)level, TextureArray_GLFormat(first.format), w, h, layers, 0, size * layers, NULL);
+        else
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, (GLint)level, GL_SRGB8_ALPHA8, w, h, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    }
+
+    std::vector<uint8_t> rgba;
+    for (size_t i = 0; i < members.size(); ++i)
+    {
+        TextureEntry& entry = g_Textures[members[i]];
+        entry.layer = (int)i;
+
+        int level = (int)entry.levels.size() - 1;
+        while (level > 0 && std::max(entry.levels[level - 1].width, entry.levels[level - 1].height) <= TEXTUREARRAY_TAIL_SIZE)
+            level -= 1;
+
+        for (entry.resident_level = (int)entry.levels.size(); entry.resident_level > level; )
+        {
+            entry.resident_level -= 1;
+            size_t size;
+            const void* pixels = TextureArray_LevelData(entry, entry.resident_level, &rgba, &size);
+            TextureArray_SubImage(entry, entry.resident_level, pixels, size);
+        }
+    }
+
+    glBindSampler(unit, array.sampler);
+
+    return array;
+}
+
+void TextureArray_Build(GLuint first_unit, bool compressed)
+{
+    g_Compressed = compressed;
+
+    // Agrupamos as texturas ainda não enviadas por dimensões, formato e
+    // número de níveis.
+    typedef std::pair< std::pair<int, int>, std::pair<int, size_t> > ArrayKey;
+    std::map< ArrayKey, std::vector<TextureHandle> > groups;
+    for (size_t i = 0; i < g_Textures.size(); ++i)
+    {
+        const TextureEntry& entry = g_Textures[i];
+        if (!entry.live || entry.array >= 0)
+            continue;
+
+        ArrayKey key(std::make_pair(entry.width, entry.height), std::make_pair((int)entry.format, entry.levels.size()));
+        groups[key].push_back((TextureHandle)i);
+    }
+
+    for (std::map< ArrayKey, std::vector<TextureHandle> >::const_iterator it = groups.begin(); it != groups.end(); ++it)
+    {
+        if (g_Arrays.size() >= TEXTUREARRAY_MAX_ARRAYS)
+        {
+            fprintf(stderr, "ERROR: Número máximo de arrays de texturas (%d) excedido.\n", TEXTUREARRAY_MAX_ARRAYS);
+            std::exit(EXIT_FAILURE);
+        }
+
+        const std::vector<TextureHandle>& members = it->second;
+        int index = (int)g_Arrays.size();
+        g_Arrays.push_back(TextureArray_Create(members, first_unit + index));
+
+        for (size_t i = 0; i < members.size(); ++i)
+        {
+            TextureEntry& entry = g_Textures[members[i]];
+            entry.array = index;
+            if (entry.resident_level == 0)
+                std::vector<uint8_t>().swap(entry.data);
+        }
+
+        const TextureEntry& first = g_Textures[members[0]];
+        printf("Array de texturas %d: %dx%d, %s, %d camadas.\n", index, first.width, first.height,
+               compressed ? (first.format == TEXTURE_FORMAT_BC3 ? "BC3" : "BC1") : "RGBA8", (int)members.size());
+    }
+}
+
+void TextureArray_Request(TextureHandle texture, float pixels)
+{
+    if (texture < 0 || (size_t)texture >= g_Textures.size())
+        return;
+
+    TextureEntry& entry = g_Textures[texture];
+    entry.requested_pixels = std::max(entry.requested_pixels, pixels);
+}
+
+// Prioridade de envio do próximo nível de uma textura: quanto maior a textura
+// aparece na tela em relação à resolução do nível já enviado, maior a
+// prioridade. Texturas que não apareceram na tela têm prioridade zero, mas
+// continuam sendo enviadas quando sobra espaço no orçamento.
+static float TextureArray_Priority(const TextureEntry& entry)
+{
+    const TextureLevel& level = entry.levels[entry.resident_level];
+    return entry.requested_pixels / std::max(level.width, level.height);
+}
+
+size_t TextureArray_Stream(size_t byte_budget)
+{
+    std::vector<TextureHandle> pending;
+    for (size_t i = 0; i < g_Textures.size(); ++i)
+    {
+        const TextureEntry& entry = g_Textures[i];
+        if (entry.live && entry.array >= 0 && entry.resident_level > 0)
+            pending.push_back((TextureHandle)i);
+    }
+
+    std::stable_sort(pending.begin(), pending.end(), [](TextureHandle a, TextureHandle b) {
+        return TextureArray_Priority(g_Textures[a]) > TextureArray_Priority(g_Textures[b]);
+    });
+
+    if (!pending.empty() && g_StreamBuffer == 0)
+        glGenBuffers(1, &g_StreamBuffer);
+
+    // Enviamos no máximo um nível por textura por quadro. O orçamento pode
+    // ser ultrapassado somente pelo primeiro nível enviado no quadro, para que
+    // níveis maiores que o orçamento também sejam enviados.
+    size_t uploaded = 0;
+    std::vector<uint8_t> rgba;
+    for (size_t i = 0; i < pending.size(); ++i)
+    {
+        TextureEntry& entry = g_Textures[pending[i]];
+        int level = entry.resident_level - 1;
+
+        size_t size = g_Compressed ? entry.levels[level].size : (size_t)entry.levels[level].width * entry.levels[level].height * 4;
+        if (uploaded > 0 && uploaded + size > byte_budget)
+            continue;
+
+        size_t data_size;
+        const void* data = TextureArray_LevelData(entry, level, &rgba, &data_size);
+
+        // Copiamos o nível para um pixel buffer object e enviamos a partir
+        // dele: a cópia para a textura é feita pela GPU, sem bloquear esta
+        // thread. Realocar o buffer a cada envio ("orphaning") evita esperar
+        // que a GPU termine de ler o conteúdo anterior.
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, g_StreamBuffer);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, data_size, NULL, GL_STREAM_DRAW);
+        void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, data_size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (mapped == NULL)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            break;
+        }
+        memcpy(mapped, data, data_size);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+        const TextureArrayObject& array = g_Arrays[entry.array];
+        glActiveTexture(GL_TEXTURE0 + array.unit);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array.texture);
+        TextureArray_SubImage(entry, level, (const void*)0, data_size);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        entry.resident_level = level;
+        if (level == 0)
+            std::vector<uint8_t>().swap(entry.data);
+
+        uploaded += size;
+        if (uploaded >= byte_budget)
+            break;
+    }
+
+    for (size_t i = 0; i < g_Textures.size(); ++i)
+        g_Textures[i].requested_pixels = 0.0f;
+
+    return uploaded;
+}
+
+void TextureArray_Release(TextureHandle texture)
+{
+    TextureEntry& entry = g_Textures[texture];
+    if (!entry.live)
+        return;
+
+    entry.live = false;
+    std::vector<uint8_t>().swap(entry.data);
+
+    if (entry.array < 0)
+        return;
+
+    TextureArrayObject& array = g_Arrays[entry.array];
+    entry.array = -1;
+
+    // A memória de uma camada não pode ser devolvida individualmente; o
+    // array inteiro é removido quando a sua última camada é liberada.
+    array.live_layers -= 1;
+    if (array.live_layers == 0)
+    {
+        glBindSampler(array.unit, 0);
+        glDeleteTextures(1, &array.texture);
+        glDeleteSamplers(1, &array.sampler);
+        array.texture = 0;
+        array.sampler = 0;
+    }
+}
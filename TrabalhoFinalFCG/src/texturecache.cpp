@@ -0,0 +1,198 @@
+#include "texturecache.hpp"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "texturecompress.hpp"
+
+// Cabeçalho do arquivo de cache, seguido de um TextureCacheLevel por nível de
+// mipmap e, na próxima posição alinhada a 16 bytes, dos dados de todos os
+// níveis.
+struct TextureCacheHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t num_levels;
+    uint32_t reserved;
+    uint64_t source_size;
+    int64_t  source_mtime;
+    uint64_t source_hash;
+    uint64_t data_size;
+    uint64_t offset_data;
+};
+
+struct TextureCacheLevel {
+    uint32_t width;
+    uint32_t height;
+    uint64_t offset; // Relativo ao início dos dados
+    uint64_t size;
+};
+
+static const char TEXTURECACHE_MAGIC[8] = { 'F', 'C', 'G', 'T', 'E', 'X', '\0', '\0' };
+
+static std::string TextureCache_Filename(const char* image_filename)
+{
+    return std::string(image_filename) + ".texcache";
+}
+
+TextureView TextureData_View(const TextureData& texture)
+{
+    TextureView view;
+    view.format    = texture.format;
+    view.width     = texture.width;
+    view.height    = texture.height;
+    view.data      = texture.data.data();
+    view.data_size = texture.data.size();
+    view.levels    = texture.levels;
+    return view;
+}
+
+void TextureCache_Close(TextureCacheFile* file)
+{
+    CacheFile_Unmap(&file->file);
+    file->view = TextureView();
+}
+
+bool TextureCache_Open(const char* image_filename, TextureCacheFile* file)
+{
+    file->view = TextureView();
+
+    uint64_t source_size;
+    int64_t  source_mtime;
+    if (!CacheFile_StatSource(image_filename, &source_size, &source_mtime))
+        return false;
+
+    if (!CacheFile_Map(TextureCache_Filename(image_filename), &file->file))
+        return false;
+
+    TextureCacheHeader header;
+    if (file->file.size < sizeof(header))
+    {
+        TextureCache_Close(file);
+        return false;
+    }
+    memcpy(&header, file->file.data, sizeof(header));
+
+    if (memcmp(header.magic, TEXTURECACHE_MAGIC, sizeof(TEXTURECACHE_MAGIC)) != 0
+        || header.version != TEXTURECACHE_VERSION
+        || header.source_size != source_size)
+    {
+        TextureCache_Close(file);
+        return false;
+    }
+
+    // Se a data de modificação mudou, só aceitamos o cache caso o conteúdo
+    // do arquivo fonte continue idêntico.
+    if (header.source_mtime != source_mtime)
+    {
+        uint64_t source_hash;
+        if (!CacheFile_HashSource(image_filename, &source_hash) || source_hash != header.source_hash)
+        {
+            TextureCache_Close(file);
+            return false;
+        }
+
+        // O conteúdo é o mesmo: guardamos a nova data no cache, evitando
+        // calcular o hash do arquivo fonte nas próximas execuções.
+        CacheFile_UpdateSourceMtime(TextureCache_Filename(image_filename), offsetof(TextureCacheHeader, source_mtime), source_mtime);
+    }
+
+    if ((header.format != TEXTURE_FORMAT_BC1 && header.format != TEXTURE_FORMAT_BC3)
+        || header.num_levels == 0 || header.num_levels > 32
+        || !CacheFile_InBounds(&file->file, sizeof(header), header.num_levels, sizeof(TextureCacheLevel))
+        || !CacheFile_InBounds(&file->file, header.offset_data, header.data_size, 1))
+    {
+        fprintf(stderr, "WARNING: Cache de textura corrompido para \"%s\".\n", image_filename);
+        TextureCache_Close(file);
+        return false;
+    }
+
+    const char* base = (const char*)file->file.data;
+
+    TextureView& view = file->view;
+    view.format    = (TextureFormat)header.format;
+    view.width     = (int)header.width;
+    view.height    = (int)header.height;
+    view.data      = (const uint8_t*)(base + header.offset_data);
+    view.data_size = (size_t)header.data_size;
+
+    for (uint32_t i = 0; i < header.num_levels; ++i)
+    {
+        TextureCacheLevel record;
+        memcpy(&record, base + sizeof(header) + i*sizeof(record), sizeof(record));
+
+        // Os dados de cada nível devem estar dentro do vetor de dados, e ter
+        // o tamanho esperado para as suas dimensões.
+        if (record.width == 0 || record.height == 0
+            || record.offset > view.data_size
+            || record.size > view.data_size - record.offset
+            || record.size != TextureCompress_LevelSize(view.format, (int)record.width, (int)record.height))
+            break;
+
+        TextureLevel level;
+        level.width  = (int)record.width;
+        level.height = (int)record.height;
+        level.offset = (size_t)record.offset;
+        level.size   = (size_t)record.size;
+        view.levels.push_back(level);
+    }
+
+    if (view.levels.size() != header.num_levels)
+    {
+        fprintf(stderr, "WARNING: Cache de textura corrompido para \"%s\".\n", image_filename);
+        TextureCache_Close(file);
+        return false;
+    }
+
+    return true;
+}
+
+bool TextureCache_Write(const char* image_filename, const TextureView& texture)
+{
+    TextureCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TEXTURECACHE_MAGIC, sizeof(TEXTURECACHE_MAGIC));
+    header.version    = TEXTURECACHE_VERSION;
+    header.format     = (uint32_t)texture.format;
+    header.width      = (uint32_t)texture.width;
+    header.height     = (uint32_t)texture.height;
+    header.num_levels = (uint32_t)texture.levels.size();
+    header.data_size  = texture.data_size;
+    header.offset_data = CacheFile_Align(sizeof(header) + texture.levels.size() * sizeof(TextureCacheLevel));
+
+    if (!CacheFile_StatSource(image_filename, &header.source_size, &header.source_mtime)
+        || !CacheFile_HashSource(image_filename, &header.source_hash))
+        return false;
+
+    std::string filename = TextureCache_Filename(image_filename);
+    std::string tmp_filename = filename + ".tmp";
+
+    FILE* f = fopen(tmp_filename.c_str(), "wb");
+    if (f == NULL)
+        return false;
+
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+
+    for (size_t i = 0; ok && i < texture.levels.size(); ++i)
+    {
+        const TextureLevel& level = texture.levels[i];
+
+        TextureCacheLevel record;
+        memset(&record, 0, sizeof(record));
+        record.width  = (uint32_t)level.width;
+        record.height = (uint32_t)level.height;
+        record.offset = level.offset;
+        record.size   = level.size;
+
+        ok = fwrite(&record, sizeof(record), 1, f) == 1;
+    }
+
+    size_t written = sizeof(header) + texture.levels.size() * sizeof(TextureCacheLevel);
+    ok = ok && CacheFile_WriteBlock(f, texture.data, texture.data_size, &written);
+
+    return CacheFile_Commit(f, tmp_filename, filename, ok);
+}
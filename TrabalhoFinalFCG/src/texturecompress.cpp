@@ -0,0 +1,548 @@
+#include "texturecompress.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Tabela de conversão sRGB -> linear, indexada pelo valor de 8 bits.
+struct SrgbTable {
+    float to_linear[256];
+
+    SrgbTable()
+    {
+        for (int i = 0; i < 256; ++i)
+        {
+            float c = i / 255.0f;
+            to_linear[i] = (c <= 0.04045f) ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+        }
+    }
+};
+
+static const SrgbTable& TextureCompress_SrgbTable()
+{
+    static const SrgbTable table;
+    return table;
+}
+
+static uint8_t TextureCompress_LinearToSrgb(float c)
+{
+    c = std::min(std::max(c, 0.0f), 1.0f);
+    float s = (c <= 0.0031308f) ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+    return (uint8_t)(s * 255.0f + 0.5f);
+}
+
+// Filtro de uma dimensão. Na redução, é um filtro caixa: cada texel de
+// destino cobre o intervalo [i*src/dst, (i+1)*src/dst) da origem, e cada texel
+// de origem contribui proporcionalmente à parte coberta (quando src = 2*dst
+// isto é a média usual de dois texels; quando src é ímpar, cada destino cobre
+// até três texels). Na ampliação, é a interpolação linear entre os dois
+// texels de origem mais próximos.
+struct FilterTap {
+    int   source;
+    float weight;
+};
+
+static void TextureCompress_FilterTaps(int src, int dst, std::vector< std::vector<FilterTap> >* taps)
+{
+    taps->assign(dst, std::vector<FilterTap>());
+    float scale = (float)src / dst;
+    for (int i = 0; i < dst; ++i)
+    {
+        if (dst > src)
+        {
+            float center = std::min(std::max((i + 0.5f) * scale - 0.5f, 0.0f), (float)(src - 1));
+            int   s0 = (int)center;
+            int   s1 = std::min(s0 + 1, src - 1);
+            float t  = center - s0;
+            (*taps)[i].push_back(FilterTap{ s0, 1.0f - t });
+            (*taps)[i].push_back(FilterTap{ s1, t });
+            continue;
+        }
+
+        float start = i * scale;
+        float end   = (i + 1) * scale;
+        for (int s = (int)start; s < src && s < end; ++s)
+        {
+            float weight = std::min(end, (float)(s + 1)) - std::max(start, (float)s);
+            if (weight > 1e-6f)
+                (*taps)[i].push_back(FilterTap{ s, weight / scale });
+        }
+    }
+}
+
+// Redimensiona a imagem "src" (RGBA sRGB) para "w" x "h" texels.
+static void TextureCompress_Resize(const uint8_t* src, int width, int height, std::vector<uint8_t>* dst, int w, int h)
+{
+    std::vector< std::vector<FilterTap> > taps_x, taps_y;
+    TextureCompress_FilterTaps(width, w, &taps_x);
+    TextureCompress_FilterTaps(height, h, &taps_y);
+
+    const float* to_linear = TextureCompress_SrgbTable().to_linear;
+
+    dst->resize((size_t)w * h * 4);
+    for (int y = 0; y < h; ++y)
+    {
+        for (int x = 0; x < w; ++x)
+        {
+            float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            for (size_t ty = 0; ty < taps_y[y].size(); ++ty)
+            {
+                for (size_t tx = 0; tx < taps_x[x].size(); ++tx)
+                {
+                    const FilterTap& fy = taps_y[y][ty];
+                    const FilterTap& fx = taps_x[x][tx];
+                    const uint8_t* texel = src + ((size_t)fy.source * width + fx.source) * 4;
+                    float weight = fx.weight * fy.weight;
+                    sum[0] += weight * to_linear[texel[0]];
+                    sum[1] += weight * to_linear[texel[1]];
+                    sum[2] += weight * to_linear[texel[2]];
+                    sum[3] += weight * texel[3]; // O canal alfa já é linear
+                }
+            }
+
+            uint8_t* out = &(*dst)[((size_t)y * w + x) * 4];
+            out[0] = TextureCompress_LinearToSrgb(sum[0]);
+            out[1] = TextureCompress_LinearToSrgb(sum[1]);
+            out[2] = TextureCompress_LinearToSrgb(sum[2]);
+            out[3] = (uint8_t)std::min(sum[3] + 0.5f, 255.0f);
+        }
+    }
+}
+
+// Dimensão em que a imagem é armazenada: a potência de dois mais próxima (em
+// escala logarítmica) de "size". Largura e altura são arredondadas
+// separadamente, mantendo aproximadamente a proporção da imagem.
+static int TextureCompress_PowerOfTwo(int size)
+{
+    int power = 1;
+    while (power * 2 <= size)
+        power *= 2;
+    if (size * 2 >= power * 3)
+        power *= 2;
+    return power;
+}
+
+static uint16_t TextureCompress_Pack565(const float color[3])
+{
+    int r = (int)(std::min(std::max(color[0], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+    int g = (int)(std::min(std::max(color[1], 0.0f), 255.0f) * 63.0f / 255.0f + 0.5f);
+    int b = (int)(std::min(std::max(color[2], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static void TextureCompress_Unpack565(uint16_t c, int color[3])
+{
+    int r = (c >> 11) & 31;
+    int g = (c >> 5) & 63;
+    int b = c & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+// As quatro cores de um bloco com color0 > color1. Os decodificadores usam
+// exatamente estas cores (a menos de arredondamento) nos formatos BC1 e BC3.
+static void TextureCompress_Palette(uint16_t c0, uint16_t c1, int palette[4][3])
+{
+    TextureCompress_Unpack565(c0, palette[0]);
+    TextureCompress_Unpack565(c1, palette[1]);
+    for (int k = 0; k < 3; ++k)
+    {
+        palette[2][k] = (2*palette[0][k] + palette[1][k]) / 3;
+        palette[3][k] = (palette[0][k] + 2*palette[1][k]) / 3;
+    }
+}
+
+// Escolhe, para cada texel, a cor mais próxima da paleta definida por c0 e c1.
+// Retorna o erro quadrático total.
+static int TextureCompress_ColorIndices(const uint8_t block[16][4], uint16_t c0, uint16_t c1, uint8_t indices[16])
+{
+    int palette[4][3];
+    TextureCompress_Palette(c0, c1, palette);
+
+    int total = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        int best = 0;
+        int best_error = 1 << 30;
+        for (int p = 0; p < 4; ++p)
+        {
+            int dr = block[i][0] - palette[p][0];
+            int dg = block[i][1] - palette[p][1];
+            int db = block[i][2] - palette[p][2];
+            int error = dr*dr + dg*dg + db*db;
+            if (error < best_error)
+            {
+                best = p;
+                best_error = error;
+            }
+        }
+        indices[i] = (uint8_t)best;
+        total += best_error;
+    }
+    return total;
+}
+
+// Ajusta as cores de referência por mínimos quadrados, mantendo fixos os
+// índices: cada texel é aproximado por (1-t)*a + t*b, com t em
+// {0, 1, 1/3, 2/3} conforme o seu índice.
+static bool TextureCompress_FitEndpoints(const uint8_t block[16][4], const uint8_t indices[16], float a[3], float b[3])
+{
+    static const float weights[4] = { 0.0f, 1.0f, 1.0f/3.0f, 2.0f/3.0f };
+
+    float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+    float ax[3] = { 0.0f, 0.0f, 0.0f };
+    float bx[3] = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; ++i)
+    {
+        float t = weights[indices[i]];
+        float s = 1.0f - t;
+        aa += s*s;
+        bb += t*t;
+        ab += s*t;
+        for (int k = 0; k < 3; ++k)
+        {
+            ax[k] += s * block[i][k];
+            bx[k] += t * block[i][k];
+        }
+    }
+
+    float det = aa*bb - ab*ab;
+    if (fabsf(det) < 1e-6f)
+        return false;
+
+    for (int k = 0; k < 3; ++k)
+    {
+        a[k] = (ax[k]*bb - bx[k]*ab) / det;
+        b[k] = (bx[k]*aa - ax[k]*ab) / det;
+    }
+    return true;
+}
+
+// Ordena as cores de referência de forma que color0 > color1 (modo de quatro
+// cores), trocando os índices correspondentes.
+static void TextureCompress_OrderEndpoints(uint16_t* c0, uint16_t* c1, uint8_t indices[16])
+{
+    static const uint8_t swapped[4] = { 1, 0, 3, 2 };
+    if (*c0 < *c1)
+    {
+        std::swap(*c0, *c1);
+        for (int i = 0; i < 16; ++i)
+            indices[i] = swapped[indices[i]];
+    }
+}
+
+// Comprime as cores de um bloco de 4x4 texels em 8 bytes. As cores de
+// referência iniciais são os extremos dos texels projetados sobre o eixo
+// principal (de maior variância) das cores do bloco, e são então refinadas
+// por TextureCompress_FitEndpoints().
+static void TextureCompress_EncodeColorBlock(const uint8_t block[16][4], uint8_t out[8])
+{
+    float mean[3] = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; ++i)
+        for (int k = 0; k < 3; ++k)
+            mean[k] += block[i][k] / 16.0f;
+
+    float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; ++i)
+    {
+        float r = block[i][0] - mean[0];
+        float g = block[i][1] - mean[1];
+        float b = block[i][2] - mean[2];
+        cov[0] += r*r; cov[1] += r*g; cov[2] += r*b;
+        cov[3] += g*g; cov[4] += g*b; cov[5] += b*b;
+    }
+
+    // Eixo principal por iteração de potência
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < 8; ++iteration)
+    {
+        float x = cov[0]*axis[0] + cov[1]*axis[1] + cov[2]*axis[2];
+        float y = cov[1]*axis[0] + cov[3]*axis[1] + cov[4]*axis[2];
+        float z = cov[2]*axis[0] + cov[4]*axis[1] + cov[5]*axis[2];
+        float length = std::max(std::max(fabsf(x), fabsf(y)), fabsf(z));
+        if (length < 1e-6f)
+            break;
+        axis[0] = x / length;
+        axis[1] = y / length;
+        axis[2] = z / length;
+    }
+
+    int min_i = 0, max_i = 0;
+    float min_d = 1e30f, max_d = -1e30f;
+    for (int i = 0; i < 16; ++i)
+    {
+        float d = block[i][0]*axis[0] + block[i][1]*axis[1] + block[i][2]*axis[2];
+        if (d < min_d) { min_d = d; min_i = i; }
+        if (d > max_d) { max_d = d; max_i = i; }
+    }
+
+    float a[3] = { (float)block[max_i][0], (float)block[max_i][1], (float)block[max_i][2] };
+    float b[3] = { (float)block[min_i][0], (float)block[min_i][1], (float)block[min_i][2] };
+
+    uint16_t c0 = TextureCompress_Pack565(a);
+    uint16_t c1 = TextureCompress_Pack565(b);
+    uint8_t indices[16];
+    int error = TextureCompress_ColorIndices(block, c0, c1, indices);
+
+    for (int iteration = 0; iteration < 2 && error > 0; ++iteration)
+    {
+        if (!TextureCompress_FitEndpoints(block, indices, a, b))
+            break;
+
+        uint16_t f0 = TextureCompress_Pack565(a);
+        uint16_t f1 = TextureCompress_Pack565(b);
+        uint8_t fit_indices[16];
+        int fit_error = TextureCompress_ColorIndices(block, f0, f1, fit_indices);
+        if (fit_error >= error)
+            break;
+
+        c0 = f0;
+        c1 = f1;
+        error = fit_error;
+        memcpy(indices, fit_indices, sizeof(indices));
+    }
+
+    TextureCompress_OrderEndpoints(&c0, &c1, indices);
+
+    // Se as duas cores forem iguais, o bloco estaria no modo de três cores
+    // (color0 <= color1), no qual o índice 3 é preto; usamos somente o índice 0.
+    uint32_t bits = 0;
+    if (c0 != c1)
+        for (int i = 0; i < 16; ++i)
+            bits |= (uint32_t)indices[i] << (2*i);
+
+    out[0] = (uint8_t)(c0 & 0xFF);
+    out[1] = (uint8_t)(c0 >> 8);
+    out[2] = (uint8_t)(c1 & 0xFF);
+    out[3] = (uint8_t)(c1 >> 8);
+    out[4] = (uint8_t)(bits & 0xFF);
+    out[5] = (uint8_t)((bits >> 8) & 0xFF);
+    out[6] = (uint8_t)((bits >> 16) & 0xFF);
+    out[7] = (uint8_t)(bits >> 24);
+}
+
+// Os oito valores de alfa de um bloco BC3 com alpha0 > alpha1, ou os seis
+// valores mais 0 e 255 com alpha0 <= alpha1.
+static void TextureCompress_AlphaPalette(int a0, int a1, int palette[8])
+{
+    palette[0] = a0;
+    palette[1] = a1;
+    if (a0 > a1)
+    {
+        for (int k = 1; k <= 6; ++k)
+            palette[k + 1] = ((7 - k)*a0 + k*a1) / 7;
+    }
+    else
+    {
+        for (int k = 1; k <= 4; ++k)
+            palette[k + 1] = ((5 - k)*a0 + k*a1) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+// Comprime o canal alfa de um bloco de 4x4 texels em 8 bytes.
+static void TextureCompress_EncodeAlphaBlock(const uint8_t block[16][4], uint8_t out[8])
+{
+    int a0 = 0, a1 = 255;
+    for (int i = 0; i < 16; ++i)
+    {
+        a0 = std::max(a0, (int)block[i][3]);
+        a1 = std::min(a1, (int)block[i][3]);
+    }
+
+    int palette[8];
+    TextureCompress_AlphaPalette(a0, a1, palette);
+
+    uint64_t bits = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        int best = 0;
+        int best_error = 1 << 30;
+        for (int p = 0; p < 8; ++p)
+        {
+            int error = abs(block[i][3] - palette[p]);
+            if (error < best_error)
+            {
+                best = p;
+                best_error = error;
+            }
+        }
+        bits |= (uint64_t)best << (3*i);
+    }
+
+    out[0] = (uint8_t)a0;
+    out[1] = (uint8_t)a1;
+    for (int k = 0; k < 6; ++k)
+        out[2 + k] = (uint8_t)((bits >> (8*k)) & 0xFF);
+}
+
+// Copia o bloco de 4x4 texels da posição (bx,by), repetindo os texels da
+// borda quando o bloco ultrapassa a imagem.
+static void TextureCompress_FetchBlock(const uint8_t* rgba, int width, int height, int bx, int by, uint8_t block[16][4])
+{
+    for (int y = 0; y < 4; ++y)
+    {
+        int sy = std::min(by*4 + y, height - 1);
+        for (int x = 0; x < 4; ++x)
+        {
+            int sx = std::min(bx*4 + x, width - 1);
+            memcpy(block[y*4 + x], rgba + ((size_t)sy * width + sx) * 4, 4);
+        }
+    }
+}
+
+static void TextureCompress_EncodeLevel(TextureFormat format, const uint8_t* rgba, int width, int height, uint8_t* out)
+{
+    int blocks_x = (width + 3) / 4;
+    int blocks_y = (height + 3) / 4;
+    for (int by = 0; by < blocks_y; ++by)
+    {
+        for (int bx = 0; bx < blocks_x; ++bx)
+        {
+            uint8_t block[16][4];
+            TextureCompress_FetchBlock(rgba, width, height, bx, by, block);
+
+            if (format == TEXTURE_FORMAT_BC3)
+            {
+                TextureCompress_EncodeAlphaBlock(block, out);
+                out += 8;
+            }
+            TextureCompress_EncodeColorBlock(block, out);
+            out += 8;
+        }
+    }
+}
+
+size_t TextureCompress_LevelSize(TextureFormat format, int width, int height)
+{
+    size_t block_size = (format == TEXTURE_FORMAT_BC3) ? 16 : 8;
+    return (size_t)((width + 3) / 4) * (size_t)((height + 3) / 4) * block_size;
+}
+
+void TextureCompress_Cook(const uint8_t* rgba, int width, int height, TextureData* texture)
+{
+    bool opaque = true;
+    for (size_t i = 0; opaque && i < (size_t)width * height; ++i)
+        opaque = rgba[i*4 + 3] == 255;
+
+    // As coordenadas de textura estão sempre em [0,1], portanto redimensionar
+    // a imagem não altera a sua aparência, somente a sua resolução.
+    std::vector<uint8_t> current, next;
+    int stored_width  = TextureCompress_PowerOfTwo(width);
+    int stored_height = TextureCompress_PowerOfTwo(height);
+    if (width != stored_width || height != stored_height)
+    {
+        TextureCompress_Resize(rgba, width, height, &current, stored_width, stored_height);
+        rgba   = current.data();
+        width  = stored_width;
+        height = stored_height;
+    }
+
+    texture->format = opaque ? TEXTURE_FORMAT_BC1 : TEXTURE_FORMAT_BC3;
+    texture->width  = width;
+    texture->height = height;
+    texture->levels.clear();
+
+    // Posição de cada nível no vetor de dados
+    size_t total = 0;
+    for (int w = width, h = height; ; w = std::max(w/2, 1), h = std::max(h/2, 1))
+    {
+        TextureLevel level;
+        level.width  = w;
+        level.height = h;
+        level.offset = total;
+        level.size   = TextureCompress_LevelSize(texture->format, w, h);
+        texture->levels.push_back(level);
+        total += level.size;
+        if (w == 1 && h == 1)
+            break;
+    }
+    texture->data.resize(total);
+
+    // Cada nível é obtido do anterior, já reduzido
+    const uint8_t* source = rgba;
+    for (size_t i = 0; i < texture->levels.size(); ++i)
+    {
+        const TextureLevel& level = texture->levels[i];
+        TextureCompress_EncodeLevel(texture->format, source, level.width, level.height, &texture->data[level.offset]);
+
+        if (i + 1 < texture->levels.size())
+        {
+            const TextureLevel& smaller = texture->levels[i + 1];
+            TextureCompress_Resize(source, level.width, level.height, &next, smaller.width, smaller.height);
+            current.swap(next);
+            source = current.data();
+        }
+    }
+}
+
+void TextureCompress_Decompress(const TextureView& texture, size_t level_index, std::vector<uint8_t>* rgba)
+{
+    const TextureLevel& level = texture.levels[level_index];
+    const uint8_t* in = texture.data + level.offset;
+
+    rgba->resize((size_t)level.width * level.height * 4);
+
+    int blocks_x = (level.width + 3) / 4;
+    int blocks_y = (level.height + 3) / 4;
+    for (int by = 0; by < blocks_y; ++by)
+    {
+        for (int bx = 0; bx < blocks_x; ++bx)
+        {
+            int alpha[16];
+            for (int i = 0; i < 16; ++i)
+                alpha[i] = 255;
+
+            if (texture.format == TEXTURE_FORMAT_BC3)
+            {
+                int palette[8];
+                TextureCompress_AlphaPalette(in[0], in[1], palette);
+                uint64_t bits = 0;
+                for (int k = 0; k < 6; ++k)
+                    bits |= (uint64_t)in[2 + k] << (8*k);
+                for (int i = 0; i < 16; ++i)
+                    alpha[i] = palette[(bits >> (3*i)) & 7];
+                in += 8;
+            }
+
+            uint16_t c0 = (uint16_t)(in[0] | (in[1] << 8));
+            uint16_t c1 = (uint16_t)(in[2] | (in[3] << 8));
+            uint32_t bits = (uint32_t)in[4] | ((uint32_t)in[5] << 8) | ((uint32_t)in[6] << 16) | ((uint32_t)in[7] << 24);
+            in += 8;
+
+            int palette[4][3];
+            TextureCompress_Palette(c0, c1, palette);
+            if (c0 <= c1 && texture.format == TEXTURE_FORMAT_BC1)
+            {
+                // Modo de três cores: índice 2 é a média, índice 3 é preto
+                for (int k = 0; k < 3; ++k)
+                {
+                    palette[2][k] = (palette[0][k] + palette[1][k]) / 2;
+                    palette[3][k] = 0;
+                }
+            }
+
+            for (int y = 0; y < 4; ++y)
+            {
+                int ty = by*4 + y;
+                if (ty >= level.height)
+                    break;
+                for (int x = 0; x < 4; ++x)
+                {
+                    int tx = bx*4 + x;
+                    if (tx >= level.width)
+                        break;
+                    int i = y*4 + x;
+                    const int* color = palette[(bits >> (2*i)) & 3];
+                    uint8_t* out = &(*rgba)[((size_t)ty * level.width + tx) * 4];
+                    out[0] = (uint8_t)color[0];
+                    out[1] = (uint8_t)color[1];
+                    out[2] = (uint8_t)color[2];
+                    out[3] = (uint8_t)alpha[i];
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#include "uniformbuffer.hpp"
+
+void UniformRing_Init(UniformRing* ring, size_t size)
+{
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+
+    ring->size       = size;
+    ring->head       = 0;
+    ring->alignment  = (alignment > 0) ? (size_t)alignment : 256;
+    ring->generation = 0;
+
+    glGenBuffers(1, &ring->buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, ring->buffer);
+    glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformRing_BeginFrame(UniformRing* ring)
+{
+    glBindBuffer(GL_UNIFORM_BUFFER, ring->buffer);
+    glBufferData(GL_UNIFORM_BUFFER, ring->size, NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    ring->head = 0;
+}
+
+size_t UniformRing_Stride(const UniformRing* ring, size_t size)
+{
+    return (size + ring->alignment - 1) / ring->alignment * ring->alignment;
+}
+
+size_t UniformRing_Upload(UniformRing* ring, const void* data, size_t size)
+{
+    if ( ring->head + size > ring->size )
+    {
+        UniformRing_BeginFrame(ring);
+        ring->generation += 1;
+    }
+
+    size_t offset = ring->head;
+    glBindBuffer(GL_UNIFORM_BUFFER, ring->buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    ring->head = offset + UniformRing_Stride(ring, size);
+    return offset;
+}
+
+void UniformRing_Bind(const UniformRing* ring, GLuint binding, size_t offset, size_t size)
+{
+    glBindBufferRange(GL_UNIFORM_BUFFER, binding, ring->buffer, offset, size);
+}
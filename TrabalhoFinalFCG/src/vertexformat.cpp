@@ -0,0 +1,128 @@
+#include "vertexformat.hpp"
+
+#include <cmath>
+#include <cstring>
+
+#include <glm/gtc/packing.hpp>
+
+// Codifica uma normal (unitária) em coordenadas octaédricas: a normal é
+// projetada no octaedro |x|+|y|+|z| = 1, e o hemisfério z < 0 é "dobrado"
+// sobre o quadrado [-1,1]^2. Veja Cigolle et al., "A Survey of Efficient
+// Representations for Independent Unit Vectors", JCGT 2014.
+static void VertexFormat_EncodeOctahedral(float x, float y, float z, int16_t* out)
+{
+    float l1 = std::fabs(x) + std::fabs(y) + std::fabs(z);
+    float u = 0.0f;
+    float v = 0.0f;
+
+    if (l1 > 0.0f && std::isfinite(l1))
+    {
+        u = x / l1;
+        v = y / l1;
+        if (z < 0.0f)
+        {
+            float fu = (1.0f - std::fabs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+            float fv = (1.0f - std::fabs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+            u = fu;
+            v = fv;
+        }
+    }
+
+    out[0] = (int16_t)glm::packSnorm1x16(u);
+    out[1] = (int16_t)glm::packSnorm1x16(v);
+}
+
+// Inversa de VertexFormat_EncodeOctahedral()
+static void VertexFormat_DecodeOctahedral(const int16_t* in, float* out)
+{
+    float u = glm::unpackSnorm1x16((uint16_t)in[0]);
+    float v = glm::unpackSnorm1x16((uint16_t)in[1]);
+    float z = 1.0f - std::fabs(u) - std::fabs(v);
+    if (z < 0.0f)
+    {
+        float fu = (1.0f - std::fabs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+        float fv = (1.0f - std::fabs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+        u = fu;
+        v = fv;
+    }
+
+    float length = std::sqrt(u*u + v*v + z*z);
+    out[0] = length > 0.0f ? u / length : 0.0f;
+    out[1] = length > 0.0f ? v / length : 0.0f;
+    out[2] = length > 0.0f ? z / length : 0.0f;
+    out[3] = 0.0f;
+}
+
+void VertexFormat_Pack(const MeshView& mesh, std::vector<PackedVertex>* vertices)
+{
+    size_t num_vertices = mesh.num_model_coefficients / 4;
+    bool has_normals = mesh.num_normal_coefficients == 4 * num_vertices;
+    bool has_texcoords = mesh.num_texture_coefficients == 2 * num_vertices;
+
+    vertices->assign(num_vertices, PackedVertex());
+
+    for (size_t shape = 0; shape < mesh.shapes.size(); ++shape)
+    {
+        const MeshShape& s = mesh.shapes[shape];
+        float bbox_min[3] = { s.bbox_min.x, s.bbox_min.y, s.bbox_min.z };
+        float bbox_max[3] = { s.bbox_max.x, s.bbox_max.y, s.bbox_max.z };
+
+        for (size_t i = s.base_vertex; i < s.base_vertex + s.num_vertices; ++i)
+        {
+            PackedVertex& out = (*vertices)[i];
+
+            for (size_t k = 0; k < 3; ++k)
+            {
+                float extent = bbox_max[k] - bbox_min[k];
+                float t = extent > 0.0f ? (mesh.model_coefficients[4*i + k] - bbox_min[k]) / extent : 0.0f;
+                out.position[k] = glm::packUnorm1x16(t);
+            }
+            out.position[3] = 0;
+
+            if (has_normals)
+            {
+                const float* n = mesh.normal_coefficients + 4*i;
+                VertexFormat_EncodeOctahedral(n[0], n[1], n[2], out.normal);
+            }
+
+            if (has_texcoords)
+            {
+                out.texcoord[0] = glm::packHalf1x16(mesh.texture_coefficients[2*i + 0]);
+                out.texcoord[1] = glm::packHalf1x16(mesh.texture_coefficients[2*i + 1]);
+            }
+        }
+    }
+}
+
+void VertexFormat_Unpack(const PackedVertex* vertices, size_t count, const glm::vec3& bbox_min, const glm::vec3& bbox_max, FloatVertex* out)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        const PackedVertex& in = vertices[i];
+        for (int k = 0; k < 3; ++k)
+            out[i].position[k] = bbox_min[k] + glm::unpackUnorm1x16(in.position[k]) * (bbox_max[k] - bbox_min[k]);
+        out[i].position[3] = 1.0f;
+        VertexFormat_DecodeOctahedral(in.normal, out[i].normal);
+        out[i].texcoord[0] = glm::unpackHalf1x16(in.texcoord[0]);
+        out[i].texcoord[1] = glm::unpackHalf1x16(in.texcoord[1]);
+    }
+}
+
+void VertexFormat_Interleave(const MeshView& mesh, std::vector<FloatVertex>* vertices)
+{
+    size_t num_vertices = mesh.num_model_coefficients / 4;
+    bool has_normals = mesh.num_normal_coefficients == 4 * num_vertices;
+    bool has_texcoords = mesh.num_texture_coefficients == 2 * num_vertices;
+
+    vertices->assign(num_vertices, FloatVertex());
+
+    for (size_t i = 0; i < num_vertices; ++i)
+    {
+        FloatVertex& out = (*vertices)[i];
+        memcpy(out.position, mesh.model_coefficients + 4*i, sizeof(out.position));
+        if (has_normals)
+            memcpy(out.normal, mesh.normal_coefficients + 4*i, sizeof(out.normal));
+        if (has_texcoords)
+            memcpy(out.texcoord, mesh.texture_coefficients + 2*i, sizeof(out.texcoord));
+    }
+}